@@ -29,12 +29,20 @@ void set_control_parameter(const char* parameter_name, const char* val, ControlI
     else if (strcmp("bootstrapping_full_output_flag", parameter_name) == 0) sscanf(val, "%d", &control_input->bootstrapping_full_output_flag);
     else if (strcmp("bootstrapping_num_estimates", parameter_name) == 0) sscanf(val, "%d", &control_input->bootstrapping_num_estimates);
     else if (strcmp("bootstrapping_num_subsamples", parameter_name) == 0) sscanf(val, "%d", &control_input->bootstrapping_num_subsamples);
+    else if (strcmp("bootstrapping_pcg_iterations", parameter_name) == 0) sscanf(val, "%d", &control_input->bootstrapping_pcg_iterations);
+    else if (strcmp("bootstrapping_pcg_tolerance", parameter_name) == 0) sscanf(val, "%lf", &control_input->bootstrapping_pcg_tolerance);
+    else if (strcmp("bootstrapping_frame_group_size", parameter_name) == 0) sscanf(val, "%d", &control_input->bootstrapping_frame_group_size);
+    else if (strcmp("accumulation_tsqr_group_size", parameter_name) == 0) sscanf(val, "%d", &control_input->accumulation_tsqr_group_size);
     else if (strcmp("random_num_seed", parameter_name) == 0) sscanf(val, "%lu", &control_input->random_num_seed);
     else if (strcmp("constrain_pressure_flag", parameter_name) == 0) sscanf(val, "%d", &control_input->pressure_constraint_flag);
     else if (strcmp("volume_weighting_flag", parameter_name) == 0) sscanf(val, "%d", &control_input->volume_weighting_flag);
     else if (strcmp("position_dimension", parameter_name) == 0) sscanf(val, "%d", &control_input->position_dimension);
     else if (strcmp("start_frame", parameter_name) == 0) sscanf(val, "%d", &control_input->starting_frame);
     else if (strcmp("n_frames", parameter_name) == 0) sscanf(val, "%d", &control_input->n_frames);
+    else if (strcmp("frame_stride", parameter_name) == 0) sscanf(val, "%d", &control_input->frame_stride);
+    else if (strcmp("lammps_mmap_flag", parameter_name) == 0) sscanf(val, "%d", &control_input->lammps_mmap_flag);
+    else if (strcmp("frame_prefetch_depth", parameter_name) == 0) sscanf(val, "%d", &control_input->frame_prefetch_depth);
+    else if (strcmp("trajectory_shard_count", parameter_name) == 0) sscanf(val, "%d", &control_input->trajectory_shard_count);
     else if (strcmp("nonbonded_cutoff", parameter_name) == 0) sscanf(val, "%lf", &control_input->pair_nonbonded_cutoff);
     else if (strcmp("pair_nonbonded_basis_set_resolution", parameter_name) == 0) sscanf(val, "%lf", &control_input->pair_nonbonded_fm_binwidth);
     else if (strcmp("pair_bond_basis_set_resolution", parameter_name) == 0) sscanf(val, "%lf", &control_input->pair_bond_fm_binwidth);
@@ -55,6 +63,9 @@ void set_control_parameter(const char* parameter_name, const char* val, ControlI
     else if (strcmp("rcond", parameter_name) == 0) sscanf(val, "%lf", &control_input->rcond);
 	else if (strcmp("sparse_safety_factor", parameter_name) == 0) sscanf(val, "%lf", &control_input->sparse_safety_factor);
 	else if (strcmp("num_sparse_threads", parameter_name) == 0) sscanf(val, "%d", &control_input->num_sparse_threads);
+	else if (strcmp("block_decoupling_flag", parameter_name) == 0) sscanf(val, "%d", &control_input->block_decoupling_flag);
+	else if (strcmp("mixed_precision_flag", parameter_name) == 0) sscanf(val, "%d", &control_input->mixed_precision_flag);
+	else if (strcmp("num_threads", parameter_name) == 0) sscanf(val, "%d", &control_input->num_threads);
     else if (strcmp("max_pair_bonds_per_site", parameter_name) == 0) sscanf(val, "%d", &control_input->max_pair_bonds_per_site);
     else if (strcmp("max_angles_per_site", parameter_name) == 0) sscanf(val, "%d", &control_input->max_angles_per_site);
     else if (strcmp("max_dihedrals_per_site", parameter_name) == 0) sscanf(val, "%d", &control_input->max_dihedrals_per_site);
@@ -83,11 +94,14 @@ void set_control_parameter(const char* parameter_name, const char* val, ControlI
 	else if (strcmp("density_excluded_style", parameter_name) == 0) sscanf(val, "%d", &control_input->density_excluded_style);
     else if (strcmp("output_spline_coeffs_flag", parameter_name) == 0) sscanf(val, "%d", &control_input->output_spline_coeffs_flag);
     else if (strcmp("output_normal_equations_rhs_flag", parameter_name) == 0) sscanf(val, "%d", &control_input->output_normal_equations_rhs_flag);
+    else if (strcmp("output_table_style", parameter_name) == 0) sscanf(val, "%d", &control_input->output_table_style);
     else if (strcmp("output_pair_nonbonded_parameter_distribution", parameter_name) == 0) sscanf(val, "%d", &control_input->output_pair_nonbonded_parameter_distribution);
     else if (strcmp("output_pair_bond_parameter_distribution", parameter_name) == 0) sscanf(val, "%d", &control_input->output_pair_bond_parameter_distribution);
     else if (strcmp("output_angle_parameter_distribution", parameter_name) == 0) sscanf(val, "%d", &control_input->output_angle_parameter_distribution);
     else if (strcmp("output_dihedral_parameter_distribution", parameter_name) == 0) sscanf(val, "%d", &control_input->output_dihedral_parameter_distribution);
 	else if (strcmp("output_density_parameter_distribution", parameter_name) == 0) sscanf(val, "%d", &control_input->output_density_parameter_distribution);
+	else if (strcmp("range_trim_style", parameter_name) == 0) sscanf(val, "%d", &control_input->range_trim_style);
+	else if (strcmp("range_trim_threshold", parameter_name) == 0) sscanf(val, "%lf", &control_input->range_trim_threshold);
     else if ((strcmp("temperature", parameter_name) == 0) || (strcmp("Temperature", parameter_name) == 0)) sscanf(val, "%lf", &control_input->temperature);
     else if (strcmp("boltzmann", parameter_name) == 0) sscanf(val, "%lf", &control_input->boltzmann);
     else if (strcmp("iteration_step_size", parameter_name) == 0) sscanf(val, "%lf", &control_input->iteration_step_size);
@@ -127,9 +141,17 @@ ControlInputs::ControlInputs(void)
     bootstrapping_full_output_flag = 0;
 	bootstrapping_num_estimates = 1;
 	bootstrapping_num_subsamples = 1;
+	bootstrapping_pcg_iterations = 0;
+	bootstrapping_pcg_tolerance = 1.0e-10;
+	bootstrapping_frame_group_size = 16;
+	accumulation_tsqr_group_size = 1;
     random_num_seed = 1;
     starting_frame = 1;
     n_frames = 10;
+    frame_stride = 1;
+    lammps_mmap_flag = 1;
+    frame_prefetch_depth = 0;
+    trajectory_shard_count = 1;
     pair_nonbonded_cutoff = 1.0;
     pair_nonbonded_fm_binwidth = 0.05;
     pair_bond_fm_binwidth = 0.05;
@@ -150,6 +172,9 @@ ControlInputs::ControlInputs(void)
     rcond = -1.0;
 	sparse_safety_factor = 0.20;
     num_sparse_threads = 1;
+    block_decoupling_flag = 1;
+    mixed_precision_flag = 0;
+    num_threads = 0;
     max_pair_bonds_per_site = 4;
     max_angles_per_site = 12;
     max_dihedrals_per_site = 36;
@@ -178,11 +203,14 @@ ControlInputs::ControlInputs(void)
 	density_excluded_style = 0;
     output_spline_coeffs_flag = 0;
     output_normal_equations_rhs_flag = 0;
+    output_table_style = 0;
     output_pair_nonbonded_parameter_distribution = 0;
     output_pair_bond_parameter_distribution = 0;
     output_angle_parameter_distribution = 0;
     output_dihedral_parameter_distribution = 0;
 	output_density_parameter_distribution = 0;
+	range_trim_style = 0;
+	range_trim_threshold = 0.0;
     iteration_step_size = 1.0;
     temperature = 300;
     boltzmann = 0.0019872041;
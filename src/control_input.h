@@ -16,8 +16,12 @@ typedef struct ControlInputs {
 	// Data settings
     int starting_frame;
     int n_frames;
+    int frame_stride;
     int frames_per_traj_block;
     int volume_weighting_flag;
+    int lammps_mmap_flag;
+    int frame_prefetch_depth;
+    int trajectory_shard_count;
     
     // Input specifications
     int use_statistical_reweighting;
@@ -33,6 +37,10 @@ typedef struct ControlInputs {
     int bootstrapping_full_output_flag;
 	int bootstrapping_num_estimates;
 	int bootstrapping_num_subsamples;
+	int bootstrapping_pcg_iterations;
+	double bootstrapping_pcg_tolerance;
+	int bootstrapping_frame_group_size;
+	int accumulation_tsqr_group_size;
     uint_fast32_t random_num_seed;					// Only used when dynamic_state_sampling or bootstrapping_flag is 1
 
     // Interaction style specifications.
@@ -72,6 +80,7 @@ typedef struct ControlInputs {
     int output_residual;
     int output_spline_coeffs_flag;
     int output_normal_equations_rhs_flag;
+    int output_table_style;
     double pair_nonbonded_output_binwidth;
     double pair_bond_output_binwidth;
     double angle_output_binwidth;
@@ -87,6 +96,8 @@ typedef struct ControlInputs {
     int output_angle_parameter_distribution;
     int output_dihedral_parameter_distribution;
 	int output_density_parameter_distribution;
+	int range_trim_style;
+	double range_trim_threshold;
         
     // Iteration and BI specification
     double iteration_step_size;
@@ -102,6 +113,9 @@ typedef struct ControlInputs {
     double rcond;
 	double sparse_safety_factor; 
 	int num_sparse_threads;
+	int block_decoupling_flag;
+	int mixed_precision_flag;
+	int num_threads;
 	
 	ControlInputs(void);
 	~ControlInputs(void);
@@ -0,0 +1,94 @@
+//
+//  convert_trajectory.cpp
+//
+//  This driver converts a CG trajectory into the binary CG trajectory format
+//  (.mscgtrj), which the other drivers read with the -b flag without parsing.
+//  It converts the frames selected by start_frame, n_frames and frame_stride
+//  in control.in, so iterative workflows pay the parsing cost only once.
+//
+//  Copyright (c) 2016 The Voth Group at The University of Chicago. All rights reserved.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include "control_input.h"
+#include "interaction_model.h"
+#include "misc.h"
+#include "topology.h"
+#include "trajectory_input.h"
+
+void report_converter_usage_error(const char* exe_name);
+
+int main(int argc, char* argv[])
+{
+    double start_cputime = clock();
+    FrameSource fs;
+
+    // Split the output options from the trajectory options, which are
+    // parsed exactly as for the other drivers.
+    printf("Parsing command line arguments.\n");
+    char* output_filename = NULL;
+    int double_precision = 1;
+    int no_forces = 0;
+    int n_trajectory_args = 1;
+    char** trajectory_args = new char*[argc];
+    trajectory_args[0] = argv[0];
+    for (int i = 1; i < argc; i++) {
+    	if (strcmp(argv[i], "-o") == 0) {
+    		if (i + 1 >= argc) report_converter_usage_error(argv[0]);
+    		output_filename = argv[++i];
+    	} else if (strcmp(argv[i], "-single") == 0) {
+    		double_precision = 0;
+    	} else if (strcmp(argv[i], "-noforces") == 0) {
+    		no_forces = 1;
+    	} else {
+    		trajectory_args[n_trajectory_args++] = argv[i];
+    	}
+    }
+    if (output_filename == NULL) report_converter_usage_error(argv[0]);
+    parse_command_line_arguments(n_trajectory_args, trajectory_args, &fs);
+    delete [] trajectory_args;
+
+    printf("Reading high level control parameters.\n");
+    ControlInputs control_input;
+    CG_MODEL_DATA cg(&control_input);   // CG model parameters and data; put here to initialize without default constructor
+    copy_control_inputs_to_frd(&control_input, &fs);
+    fs.no_forces = no_forces;
+    // Every selected frame is converted; frame weights and virial constraint
+    // values are applied when the binary trajectory is read.
+    fs.use_statistical_reweighting = 0;
+    fs.pressure_constraint_flag = 0;
+
+    printf("Reading topology file.\n");
+    read_topology_file(&cg.topo_data, &cg);
+
+    printf("Reading first frame.\n");
+    fs.get_first_frame(&fs, cg.n_cg_sites, cg.topo_data.cg_site_types);
+    fs.move_to_start_frame(&fs);
+
+    BinaryTrajectoryWriter* writer = open_binary_trajectory_writer(output_filename, &fs, double_precision);
+    for (int i = 0; i < fs.n_frames; i++) {
+    	if ( (i > 0) && ((*fs.get_next_frame)(&fs) == 0) ) {
+    		printf("Failure reading frame %d (%d). Check trajectory for errors.\n", fs.current_frame_n, i);
+    		exit(EXIT_FAILURE);
+    	}
+    	write_binary_trajectory_frame(writer, &fs);
+    }
+    close_binary_trajectory_writer(writer);
+    fs.cleanup(&fs);
+
+    //print cpu time used
+    double end_cputime = clock();
+    double elapsed_cputime = ((double)(end_cputime - start_cputime)) / CLOCKS_PER_SEC;
+    printf("%f seconds used.\n", elapsed_cputime); fflush(stdout);
+
+    return 0;
+}
+
+void report_converter_usage_error(const char* exe_name)
+{
+    printf("Usage: %s <trajectory options as for newfm.x> -o file.mscgtrj [-single] [-noforces]\n", exe_name);
+    exit(EXIT_FAILURE);
+}
@@ -43,6 +43,16 @@ extern void dgelss_(int* m, int* n, int* nrhs, double* a, int* lda, double* b, i
 
 extern void dgetri_(const int* n, double* a, const int* lda, int* ipiv, double* work, const int* lwork, int *info);
 
+extern void dpotrf_(char* uplo, int* n, double* a, int* lda, int* info);
+
+extern void dpotrs_(char* uplo, int* n, int* nrhs, double* a, int* lda, double* b, int* ldb, int* info);
+
+extern void spotrf_(char* uplo, int* n, float* a, int* lda, int* info);
+
+extern void spotrs_(char* uplo, int* n, int* nrhs, float* a, int* lda, float* b, int* ldb, int* info);
+
+extern void spocon_(char* uplo, int* n, float* a, int* lda, float* anorm, float* rcond, float* work, int* iwork, int* info);
+
 # endif
 					
 #ifdef __cplusplus
@@ -18,6 +18,15 @@
 
 #include "fm_output.h"
 
+// Grid of values for the tables of a single interaction. The grids of a
+// whole class are evaluated before any of its tables are written.
+
+struct TableGrid {
+	int index_among_defined;
+	std::vector<double> axis_vals, force_vals, potential_vals;
+	std::vector<double> tab_axis_vals, tab_force_vals;	// Tabulated forces to add to the force-matched ones, if any
+};
+
 //----------------------------------------------------------------------------
 // Prototypes for private implementation routines.
 //----------------------------------------------------------------------------
@@ -25,20 +34,24 @@
 void write_interaction_data_to_file(CG_MODEL_DATA* const cg, MATRIX_DATA* const mat);
 void write_three_body_interaction_data(ThreeBodyNonbondedClassComputer* const icomp, MATRIX_DATA* const mat, char ** const name);
 
-void pad_and_print_table_files(const char char_id, const std::string& basename, std::vector<double>& axis_vals, std::vector<double>& force_vals, std::vector<double>& potential_vals, const double cutoff);
-void pad_and_print_single_table(const char char_id, const std::string& basename, std::vector<double>& axis_vals, std::vector<double>& force_vals, const double cutoff);
-void print_table_files(const char char_id, std::string& basename, std::vector<double>& axis_vals, std::vector<double>& force_vals, std::vector<double>& potential_vals);
+void pad_and_print_table_files(const char char_id, const std::string& basename, std::vector<double>& axis_vals, std::vector<double>& force_vals, std::vector<double>& potential_vals, const double cutoff, FILE* const table_stream);
+void pad_and_print_single_table(const char char_id, const std::string& basename, std::vector<double>& axis_vals, std::vector<double>& force_vals, const double cutoff, FILE* const table_stream);
+void print_table_files(const char char_id, std::string& basename, std::vector<double>& axis_vals, std::vector<double>& force_vals, std::vector<double>& potential_vals, FILE* const table_stream);
 
-void write_one_param_table_files(InteractionClassComputer* const icomp, char ** const name, const std::vector<double> &spline_coeffs, const int index_among_defined_intrxns, const double cutoff);
-void write_one_param_table_files_energy(InteractionClassComputer* const icomp, char ** const name, const std::vector<double> &spline_coeffs, const int index_among_defined_intrxns, const double cutoff);
+void write_class_table_files(InteractionClassComputer* const icomp, char ** const name, MATRIX_DATA* const mat, const double cutoff);
+void calc_one_param_table_grid(InteractionClassComputer* const icomp, const std::vector<double> &spline_coeffs, const bool energy_splines, TableGrid &grid);
+void write_one_param_table_files(InteractionClassComputer* const icomp, char ** const name, TableGrid &grid, const double cutoff, FILE* const table_stream);
+void write_one_param_table_files_energy(InteractionClassComputer* const icomp, char ** const name, TableGrid &grid, const double cutoff, FILE* const table_stream);
 void write_two_param_bspline_table_file(InteractionClassComputer* const icomp, char ** const name, MATRIX_DATA* const mat, const int index_among_defined);
 
 void write_one_param_linear_spline_file(InteractionClassComputer* const icomp, char ** const name, MATRIX_DATA* const mat, const int index_among_defined_intrxns);
 void write_one_param_bspline_file(InteractionClassComputer* const icomp, char ** const name, MATRIX_DATA* const mat, const int index_among_defined);
 void write_output_solution(MATRIX_DATA* const mat);
+void write_solution_bundle(CG_MODEL_DATA* const cg, MATRIX_DATA* const mat, const char* filename);
+void add_solution_bundle_layout(InteractionClassComputer* const icomp, const size_t n_solution_columns, const int record_types, std::vector<SolutionBundleInteraction> &interactions);
 
 void write_MSCGFM_table_output_file(const std::string& filename_base, const std::vector<double>& axis, const std::vector<double>& force);
-void write_LAMMPS_table_output_file(const char i_type, const std::string& interaction_name, std::vector<double>& axis_vals, std::vector<double>& potential_vals, std::vector<double>& force_vals);
+void write_LAMMPS_table_output_file(const char i_type, const std::string& interaction_name, std::vector<double>& axis_vals, std::vector<double>& potential_vals, std::vector<double>& force_vals, FILE* const table_stream);
 void write_full_bootstrapping_MSCGFM_table_output_file(const std::string& filename_base, const std::vector<double>& axis, std::vector<double> const master_force, std::vector<double>* const force, int const bootstrapping_num_estimates);
 void write_bootstrapping_MSCGFM_table_output_file(const std::string& filename_base, const std::vector<double>& axis, std::vector<double> const master_force, std::vector<double>* const force, int const bootstrapping_num_estimates);
 
@@ -59,9 +72,11 @@ void write_fm_interaction_output_files(CG_MODEL_DATA* const cg, MATRIX_DATA* con
 {
 	reinsert_periodic_solution_coefficients(cg, mat);
 
-    // Write a binary copy of the solution vector if desired.
+    // Write a binary copy of the solution vector or a results bundle if desired.
     if (mat->output_solution_flag == 1) {
     	write_output_solution(mat);
+    } else if (mat->output_solution_flag == 2) {
+    	write_solution_bundle(cg, mat, "solution.mscgsol");
     }
 
     // Write all interaction-by-interaction output files.
@@ -80,78 +95,42 @@ void write_interaction_data_to_file(CG_MODEL_DATA* const cg, MATRIX_DATA* const
     // interactions in that class. For one-parameter interactions right now.
 	std::list<InteractionClassComputer*>::iterator icomp_iterator;
 	for(icomp_iterator = cg->icomp_list.begin(); icomp_iterator != cg->icomp_list.end(); icomp_iterator++) {
-        // For every defined interaction,
+		// Boltzmann inversion only gives output for the interactions with parameter distributions.
+		if (mat->matrix_type == kDummy && (*icomp_iterator)->ispec->output_parameter_distribution == 0) continue;
+		
+		// Select the correct type name array for the interactions.
+		char** name = select_name((*icomp_iterator)->ispec, cg->name);
+
+		// Write tabular output, regardless of spline type.
+		// Output for Boltzmann inversion is based on energy splines, that for force matching on force splines.
+		if (mat->bootstrapping_flag == 1) {
+			for (unsigned i = 0; i < (*icomp_iterator)->ispec->defined_to_matched_intrxn_index_map.size(); i++) {
+				if ((*icomp_iterator)->ispec->defined_to_matched_intrxn_index_map[i] == 0) continue;
+				if (mat->matrix_type == kDummy) {
+					write_bootstrapping_one_param_table_files_energy(*icomp_iterator, name, mat->fm_solution, mat->bootstrap_solutions, i, mat->bootstrapping_num_estimates, mat->bootstrapping_full_output_flag, cg->pair_nonbonded_cutoff);
+				} else {
+					write_bootstrapping_one_param_table_files(*icomp_iterator, name, mat->fm_solution, mat->bootstrap_solutions, i, mat->bootstrapping_num_estimates, mat->bootstrapping_full_output_flag);
+				}
+			}
+		} else {
+			write_class_table_files(*icomp_iterator, name, mat, cg->pair_nonbonded_cutoff);
+		}
+
+        // Write special output files for the specific spline types.
         for (unsigned i = 0; i < (*icomp_iterator)->ispec->defined_to_matched_intrxn_index_map.size(); i++) {
             // If that interaction is being matched
-            if ((*icomp_iterator)->ispec->defined_to_matched_intrxn_index_map[i] != 0) {
-            	    
-            	// Select the correct type name array for the interaction.
-				char** name = select_name((*icomp_iterator)->ispec, cg->name);
-
-				// Write output based on energy splines
-	        	if(mat->matrix_type == kDummy){
-	      	 		if(mat->matrix_type == kDummy && (*icomp_iterator)->ispec->output_parameter_distribution == 0) continue;
-		         	
-		         	if (mat->bootstrapping_flag == 1) {
-	                	// Write tabular output, regardless of spline type.
- 	   	            	write_bootstrapping_one_param_table_files_energy(*icomp_iterator, name, mat->fm_solution, mat->bootstrap_solutions, i, mat->bootstrapping_num_estimates, mat->bootstrapping_full_output_flag, cg->pair_nonbonded_cutoff);
-        	        	// Write special output files for the specific spline types.
-            	    	if ((*icomp_iterator)->ispec->get_basis_type() == kBSpline ||
-            	    	    (*icomp_iterator)->ispec->get_basis_type() == kBSplineAndDeriv ) {
-                		    write_bootstrapping_one_param_bspline_file(*icomp_iterator, name, mat, i);
-	                	} else if ((*icomp_iterator)->ispec->get_basis_type() == kLinearSpline) {
-    	            	    write_bootstrapping_one_param_linear_spline_file(*icomp_iterator, name, mat, i);
-        	        	} else {
-            	    	    printf("Unrecognized basis type.\n");
-                		    exit(EXIT_FAILURE);
-                		}
-   					} else {
-						// Write tabular output, regardless of spline type.
-						write_one_param_table_files_energy(*icomp_iterator, name, mat->fm_solution, i, cg->pair_nonbonded_cutoff);
-					
-						// Write special output files for the specific spline types.	      
-						if ((*icomp_iterator)->ispec->get_basis_type() == kBSpline ||
-							(*icomp_iterator)->ispec->get_basis_type() == kBSplineAndDeriv ) {
-							write_one_param_bspline_file(*icomp_iterator, name, mat, i);
-						} else if ((*icomp_iterator)->ispec->get_basis_type() == kLinearSpline) {
-							write_one_param_linear_spline_file(*icomp_iterator, name, mat, i);
-						} else {
-							printf("Unrecognized basis type.\n");
-							exit(EXIT_FAILURE);
-						}
-					}
-	      		} else {	
-	      			// This is for force matching
-	      			// Write output based on force splines		
-   					if (mat->bootstrapping_flag == 1) {
-	                	// Write tabular output, regardless of spline type.
- 	   	            	write_bootstrapping_one_param_table_files(*icomp_iterator, name, mat->fm_solution, mat->bootstrap_solutions, i, mat->bootstrapping_num_estimates, mat->bootstrapping_full_output_flag);
-        	        	// Write special output files for the specific spline types.
-            	    	if ((*icomp_iterator)->ispec->get_basis_type() == kBSpline ||
-            	    	    (*icomp_iterator)->ispec->get_basis_type() == kBSplineAndDeriv ) {
-                		    write_bootstrapping_one_param_bspline_file(*icomp_iterator, name, mat, i);
-	                	} else if ((*icomp_iterator)->ispec->get_basis_type() == kLinearSpline) {
-    	            	    write_bootstrapping_one_param_linear_spline_file(*icomp_iterator, name, mat, i);
-        	        	} else {
-            	    	    printf("Unrecognized basis type.\n");
-                		    exit(EXIT_FAILURE);
-                		}
-   					} else {
-	                	// Write tabular output, regardless of spline type.
-				  		write_one_param_table_files(*icomp_iterator, name, mat->fm_solution, i, cg->pair_nonbonded_cutoff);
-        	        	// Write special output files for the specific spline types.
-            	    	if ((*icomp_iterator)->ispec->get_basis_type() == kBSpline ||
-            	    	    (*icomp_iterator)->ispec->get_basis_type() == kBSplineAndDeriv ) {
-                		    write_one_param_bspline_file(*icomp_iterator, name, mat, i);
-		    			} else if ((*icomp_iterator)->ispec->get_basis_type() == kLinearSpline) {
-    	                	write_one_param_linear_spline_file(*icomp_iterator, name, mat, i);
-    	            	} else {
-            	        	printf("Unrecognized basis type.\n");
-                	    	exit(EXIT_FAILURE);
-                		}
-					}
-	      		}
-	    	}
+            if ((*icomp_iterator)->ispec->defined_to_matched_intrxn_index_map[i] == 0) continue;
+            if ((*icomp_iterator)->ispec->get_basis_type() == kBSpline ||
+                (*icomp_iterator)->ispec->get_basis_type() == kBSplineAndDeriv ) {
+                if (mat->bootstrapping_flag == 1) write_bootstrapping_one_param_bspline_file(*icomp_iterator, name, mat, i);
+                else write_one_param_bspline_file(*icomp_iterator, name, mat, i);
+            } else if ((*icomp_iterator)->ispec->get_basis_type() == kLinearSpline) {
+                if (mat->bootstrapping_flag == 1) write_bootstrapping_one_param_linear_spline_file(*icomp_iterator, name, mat, i);
+                else write_one_param_linear_spline_file(*icomp_iterator, name, mat, i);
+            } else {
+                printf("Unrecognized basis type.\n");
+                exit(EXIT_FAILURE);
+            }
         }
 	}
       
@@ -205,14 +184,20 @@ void write_MSCGFM_table_output_file(const std::string& filename_base, const std:
     fclose(curr_table_output_file);
 }
 
-void write_LAMMPS_table_output_file(const char i_type, const std::string& interaction_name, std::vector<double>& axis_vals, std::vector<double>& potential_vals, std::vector<double>& force_vals) 
-{
-	// Set-up LAMMPS table file
-	std::string filename = interaction_name + ".table";
-	FILE* curr_table_output_file = open_file(filename.c_str(), "w");
+// Write the LAMMPS table for an interaction to its own file or, if a
+// table_stream is given, as one section of a table file for its class.
 
-	// Write header
-	fprintf(curr_table_output_file, "# Header information on force file\n");
+void write_LAMMPS_table_output_file(const char i_type, const std::string& interaction_name, std::vector<double>& axis_vals, std::vector<double>& potential_vals, std::vector<double>& force_vals, FILE* const table_stream) 
+{
+	FILE* curr_table_output_file = table_stream;
+	if (table_stream == NULL) {
+		// Set-up LAMMPS table file
+		std::string filename = interaction_name + ".table";
+		curr_table_output_file = open_file(filename.c_str(), "w");
+
+		// Write header
+		fprintf(curr_table_output_file, "# Header information on force file\n");
+	}
 	fprintf(curr_table_output_file, "\n");
 	fprintf(curr_table_output_file, "%s\n", interaction_name.c_str());
 	
@@ -239,66 +224,125 @@ void write_LAMMPS_table_output_file(const char i_type, const std::string& intera
 	{
 		fprintf(curr_table_output_file, "%d %lf %lf %lf\n", (k+1), axis_vals[k], potential_vals[k], force_vals[k]);
 	}
-	fclose(curr_table_output_file);
+	if (table_stream == NULL) fclose(curr_table_output_file);
+}
+
+// Write the tables of all matched interactions in a class. The splines are
+// evaluated one interaction after another, since the spline computer of a
+// class keeps shared scratch space. The tables are then padded, integrated
+// and written in parallel. For a single table file per class, every
+// interaction's LAMMPS sections are collected in memory and put together in
+// order afterwards.
+
+void write_class_table_files(InteractionClassComputer* const icomp, char ** const name, MATRIX_DATA* const mat, const double cutoff)
+{
+	const bool energy_splines = (mat->matrix_type == kDummy);
+	std::vector<TableGrid> grids;
+	for (unsigned i = 0; i < icomp->ispec->defined_to_matched_intrxn_index_map.size(); i++) {
+		if (icomp->ispec->defined_to_matched_intrxn_index_map[i] == 0) continue;
+		grids.push_back(TableGrid());
+		grids.back().index_among_defined = i;
+		calc_one_param_table_grid(icomp, mat->fm_solution, energy_splines, grids.back());
+	}
+	if (grids.empty()) return;
+	
+	std::vector<char*> sections(grids.size(), NULL);
+	std::vector<size_t> section_sizes(grids.size(), 0);
+	#pragma omp parallel for schedule(dynamic)
+	for (int j = 0; j < (int)grids.size(); j++) {
+		FILE* table_stream = NULL;
+		if (mat->output_table_style == 1) {
+			table_stream = open_memstream(&sections[j], &section_sizes[j]);
+			if (table_stream == NULL) {
+				printf("Could not collect the LAMMPS table of a %s interaction.\n", icomp->ispec->get_full_name().c_str());
+				exit(EXIT_FAILURE);
+			}
+		}
+		if (energy_splines) {
+			write_one_param_table_files_energy(icomp, name, grids[j], cutoff, table_stream);
+		} else {
+			write_one_param_table_files(icomp, name, grids[j], cutoff, table_stream);
+		}
+		if (table_stream != NULL) fclose(table_stream);
+	}
+	
+	if (mat->output_table_style == 1) {
+		std::string filename = icomp->ispec->get_table_name() + ".table";
+		FILE* class_table_file = open_file(filename.c_str(), "w");
+		fprintf(class_table_file, "# Header information on force file\n");
+		for (unsigned j = 0; j < grids.size(); j++) {
+			fwrite(sections[j], sizeof(char), section_sizes[j], class_table_file);
+			free(sections[j]);
+		}
+		fclose(class_table_file);
+	}
+}
+
+// Compute forces and potentials (energy splines) or forces (force splines)
+// over a grid of parameter values for a single interaction.
+
+void calc_one_param_table_grid(InteractionClassComputer* const icomp, const std::vector<double> &spline_coeffs, const bool energy_splines, TableGrid &grid)
+{
+	if (energy_splines) {
+		icomp->calc_grid_of_force_and_deriv_vals(spline_coeffs, grid.index_among_defined, icomp->ispec->output_binwidth, grid.axis_vals, grid.potential_vals, grid.force_vals);
+		make_negative(grid.force_vals);
+	} else {
+		icomp->calc_grid_of_force_vals(spline_coeffs, grid.index_among_defined, icomp->ispec->output_binwidth, grid.axis_vals, grid.force_vals);
+		if (icomp->ispec->defined_to_tabulated_intrxn_index_map[grid.index_among_defined] != 0) {
+			icomp->calc_grid_of_table_force_vals(grid.index_among_defined, icomp->ispec->output_binwidth, grid.tab_axis_vals, grid.tab_force_vals);
+		}
+	}
 }
 
 // Write the tabular output for a single interaction.
-void write_one_param_table_files_energy(InteractionClassComputer* const icomp, char ** const name, const std::vector<double> &spline_coeffs, const int index_among_defined_intrxns, const double cutoff) 
+void write_one_param_table_files_energy(InteractionClassComputer* const icomp, char ** const name, TableGrid &grid, const double cutoff, FILE* const table_stream) 
 {
-  // Compute forces and potentials over a grid of parameter values.
   // Correct name is selected in calling function write_interaction_data_to_file
-  std::vector<double> axis_vals, force_vals, potential_vals;
-  icomp->calc_grid_of_force_and_deriv_vals(spline_coeffs, index_among_defined_intrxns, icomp->ispec->output_binwidth, axis_vals, potential_vals, force_vals);
-  make_negative(force_vals);
-  
   // Determine base for output filenames.
-  std::string basename = icomp->ispec->get_basename(name, index_among_defined_intrxns, "_");
+  std::string basename = icomp->ispec->get_basename(name, grid.index_among_defined, "_");
 
   // Print out tabulated output files in MSCGFM style and LAMMPS style.
-  write_MSCGFM_table_output_file(basename, axis_vals, potential_vals);
-  pad_and_print_table_files(icomp->ispec->get_char_id(), basename, axis_vals, force_vals, potential_vals, cutoff);
+  write_MSCGFM_table_output_file(basename, grid.axis_vals, grid.potential_vals);
+  pad_and_print_table_files(icomp->ispec->get_char_id(), basename, grid.axis_vals, grid.force_vals, grid.potential_vals, cutoff, table_stream);
 }
 				 
-void write_one_param_table_files(InteractionClassComputer* const icomp, char ** const name, const std::vector<double> &spline_coeffs, const int index_among_defined_intrxns, const double cutoff) 
+void write_one_param_table_files(InteractionClassComputer* const icomp, char ** const name, TableGrid &grid, const double cutoff, FILE* const table_stream) 
 {	
-    // Compute forces over a grid of parameter values.
 	// Correct name is selected in calling function write_interaction_data_to_file
-    std::vector<double> axis_vals, force_vals, potential_vals;
-    int index_among_tabulated = icomp->ispec->defined_to_tabulated_intrxn_index_map[index_among_defined_intrxns];
-	icomp->calc_grid_of_force_vals(spline_coeffs, index_among_defined_intrxns, icomp->ispec->output_binwidth, axis_vals, force_vals);
+	std::vector<double> &axis_vals = grid.axis_vals;
+	std::vector<double> &force_vals = grid.force_vals;
+	std::vector<double> &potential_vals = grid.potential_vals;
 	// Integrate force starting from cutoff = 0.0 potential.
 	integrate_force(axis_vals, force_vals, potential_vals);
     
     // Determine base for output filenames.
-    std::string basename = icomp->ispec->get_basename(name, index_among_defined_intrxns, "_");
+    std::string basename = icomp->ispec->get_basename(name, grid.index_among_defined, "_");
 	
 	// Print out tabulated output files in MSCGFM style and LAMMPS style.
     write_MSCGFM_table_output_file(basename, axis_vals, force_vals);
-    if( index_among_tabulated == 0) {
-    	pad_and_print_table_files(icomp->ispec->get_char_id(), basename, axis_vals, force_vals, potential_vals, cutoff);
+    if (icomp->ispec->defined_to_tabulated_intrxn_index_map[grid.index_among_defined] == 0) {
+    	pad_and_print_table_files(icomp->ispec->get_char_id(), basename, axis_vals, force_vals, potential_vals, cutoff, table_stream);
     } else {
-    	print_table_files(icomp->ispec->get_char_id(), basename, axis_vals, force_vals, potential_vals);
+    	print_table_files(icomp->ispec->get_char_id(), basename, axis_vals, force_vals, potential_vals, table_stream);
 	
-		std::vector<double> tab_axis_vals, tab_force_vals;
-		icomp->calc_grid_of_table_force_vals(index_among_defined_intrxns, icomp->ispec->output_binwidth, tab_axis_vals, tab_force_vals);
 		// sum the forces between the fm and tab.
-		add_force_vals(axis_vals, force_vals, tab_axis_vals, tab_force_vals);
+		add_force_vals(axis_vals, force_vals, grid.tab_axis_vals, grid.tab_force_vals);
 		// Integrate force starting from cutoff
 		integrate_force(axis_vals, force_vals, potential_vals);
 		
 		write_MSCGFM_table_output_file(basename + "_sum", axis_vals, force_vals);
-		pad_and_print_table_files(icomp->ispec->get_char_id(), basename + "_sum", axis_vals, force_vals, potential_vals, cutoff);
+		pad_and_print_table_files(icomp->ispec->get_char_id(), basename + "_sum", axis_vals, force_vals, potential_vals, cutoff, table_stream);
     }
 }
 
-void pad_and_print_table_files(const char char_id, const std::string& basename, std::vector<double>& axis_vals, std::vector<double>& force_vals, std::vector<double>& potential_vals, const double cutoff)
+void pad_and_print_table_files(const char char_id, const std::string& basename, std::vector<double>& axis_vals, std::vector<double>& force_vals, std::vector<double>& potential_vals, const double cutoff, FILE* const table_stream)
 {	
 	if (char_id == 'n') {
-    	pad_and_print_single_table(char_id, basename, axis_vals, force_vals, 0.0);
+    	pad_and_print_single_table(char_id, basename, axis_vals, force_vals, 0.0, table_stream);
 	} else if (char_id == 'b') {
-		pad_and_print_single_table(char_id, basename, axis_vals, force_vals, cutoff);
+		pad_and_print_single_table(char_id, basename, axis_vals, force_vals, cutoff, table_stream);
 	} else if (char_id == 'a') {
-    	pad_and_print_single_table(char_id, basename, axis_vals, force_vals, 180.0);
+    	pad_and_print_single_table(char_id, basename, axis_vals, force_vals, 180.0, table_stream);
 	} else if (char_id == 'd') {
    	 	double first_axis_wrapped = wrap_periodic_axis(-180.0, 180.0, axis_vals, force_vals);
    	 	trim_excess_axis(-180.0, 180.0, axis_vals, force_vals);
@@ -312,18 +356,18 @@ void pad_and_print_table_files(const char char_id, const std::string& basename,
    	 	// rewrite force file with wrapped forces
    	 	write_MSCGFM_table_output_file(basename, axis_vals, force_vals);
 		// wire LAMMPS table with force and potential
-   	 	write_LAMMPS_table_output_file(char_id, basename, axis_vals, corrected_potential_vals, force_vals); 
+   	 	write_LAMMPS_table_output_file(char_id, basename, axis_vals, corrected_potential_vals, force_vals, table_stream); 
     } else {		
-    	write_LAMMPS_table_output_file(char_id, basename, axis_vals, potential_vals, force_vals);   
+    	write_LAMMPS_table_output_file(char_id, basename, axis_vals, potential_vals, force_vals, table_stream);   
     }
 }
 
-void print_table_files(const char char_id, std::string& basename, std::vector<double>& axis_vals, std::vector<double>& force_vals, std::vector<double>& potential_vals)
+void print_table_files(const char char_id, std::string& basename, std::vector<double>& axis_vals, std::vector<double>& force_vals, std::vector<double>& potential_vals, FILE* const table_stream)
 {		
-	write_LAMMPS_table_output_file(char_id, basename, axis_vals, potential_vals, force_vals);
+	write_LAMMPS_table_output_file(char_id, basename, axis_vals, potential_vals, force_vals, table_stream);
 }
 
-void pad_and_print_single_table(const char char_id, const std::string& basename, std::vector<double>& axis_vals, std::vector<double>& force_vals, const double cutoff)
+void pad_and_print_single_table(const char char_id, const std::string& basename, std::vector<double>& axis_vals, std::vector<double>& force_vals, const double cutoff, FILE* const table_stream)
 {
    std::vector<double> padded_potential_vals;
    
@@ -350,7 +394,7 @@ void pad_and_print_single_table(const char char_id, const std::string& basename,
    integrate_force(axis_vals, force_vals, padded_potential_vals);
    
    // write LAMMPS table using padded forces and potentials
-   write_LAMMPS_table_output_file(char_id, basename, axis_vals, padded_potential_vals, force_vals);
+   write_LAMMPS_table_output_file(char_id, basename, axis_vals, padded_potential_vals, force_vals, table_stream);
 }
 
 void write_two_param_bspline_table_file(InteractionClassComputer* const icomp, char ** const name, MATRIX_DATA* const mat, const int index_among_defined)
@@ -451,6 +495,162 @@ void write_output_solution(MATRIX_DATA* const mat)
 	fclose(xout);
 }
 
+// Write the solution, its column layout, and its solver statistics as a
+// results bundle.
+
+void write_solution_bundle(CG_MODEL_DATA* const cg, MATRIX_DATA* const mat, const char* filename)
+{
+	std::vector<SolutionBundleInteraction> interactions;
+	std::list<InteractionClassComputer*>::iterator icomp_iterator;
+	for(icomp_iterator = cg->icomp_list.begin(); icomp_iterator != cg->icomp_list.end(); icomp_iterator++) {
+		add_solution_bundle_layout(*icomp_iterator, mat->fm_solution.size(), 1, interactions);
+	}
+	if (cg->three_body_nonbonded_computer.ispec->class_subtype > 0) add_solution_bundle_layout(&cg->three_body_nonbonded_computer, mat->fm_solution.size(), 0, interactions);
+	
+	SolutionBundleHeader header;
+	memset(&header, 0, sizeof(SolutionBundleHeader));
+	memcpy(header.tag, "MSCGSOLN", 8);
+	header.version = 1;
+	header.n_columns = mat->fm_solution.size();
+	header.n_interactions = interactions.size();
+	header.n_singular_values = mat->fm_singular_values.size();
+	if (header.n_singular_values > 0) header.contents += kBundleSingularValues;
+	if (mat->fm_residual >= 0.0) {
+		header.contents += kBundleResidual;
+		header.residual = mat->fm_residual;
+	}
+	if (mat->bootstrapping_flag == 1) {
+		header.contents += kBundleBootstrapSolutions;
+		header.n_bootstrap_estimates = mat->bootstrapping_num_estimates;
+		header.n_bootstrap_columns = mat->bootstrap_solutions[0].size();
+	}
+	header.byte_order_mark = 0x0102030405060708ULL;
+	
+	// Checksum the sections in the order they are written.
+	uint64_t checksum = kChecksumSeed;
+	checksum = update_checksum(mat->fm_solution.data(), header.n_columns * sizeof(double), checksum);
+	checksum = update_checksum(interactions.data(), header.n_interactions * sizeof(SolutionBundleInteraction), checksum);
+	checksum = update_checksum(mat->fm_singular_values.data(), header.n_singular_values * sizeof(double), checksum);
+	for (unsigned k = 0; k < header.n_bootstrap_estimates; k++) {
+		checksum = update_checksum(mat->bootstrap_solutions[k].data(), header.n_bootstrap_columns * sizeof(double), checksum);
+	}
+	header.checksum = checksum;
+	
+	FILE* bundle_file = open_file(filename, "wb");
+	fwrite(&header, sizeof(SolutionBundleHeader), 1, bundle_file);
+	fwrite(mat->fm_solution.data(), sizeof(double), header.n_columns, bundle_file);
+	fwrite(interactions.data(), sizeof(SolutionBundleInteraction), header.n_interactions, bundle_file);
+	fwrite(mat->fm_singular_values.data(), sizeof(double), header.n_singular_values, bundle_file);
+	for (unsigned k = 0; k < header.n_bootstrap_estimates; k++) {
+		fwrite(mat->bootstrap_solutions[k].data(), sizeof(double), header.n_bootstrap_columns, bundle_file);
+	}
+	if (ferror(bundle_file) != 0) {
+		printf("Problem writing results bundle %s\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	fclose(bundle_file);
+}
+
+// Record the solution columns of each force-matched interaction of a class.
+
+void add_solution_bundle_layout(InteractionClassComputer* const icomp, const size_t n_solution_columns, const int record_types, std::vector<SolutionBundleInteraction> &interactions)
+{
+	InteractionClassSpec* ispec = icomp->ispec;
+	for (unsigned i = 0; i < ispec->defined_to_matched_intrxn_index_map.size(); i++) {
+		unsigned index_among_matched = ispec->defined_to_matched_intrxn_index_map[i];
+		if (index_among_matched == 0) continue;
+		
+		SolutionBundleInteraction interaction;
+		memset(&interaction, 0, sizeof(SolutionBundleInteraction));
+		interaction.class_type = ispec->class_type;
+		interaction.index_among_defined = i;
+		if (record_types == 1) {
+			std::vector<int> types = ispec->get_interaction_types(i);
+			for (unsigned j = 0; (j < types.size()) && (j < 4); j++) interaction.types[j] = types[j];
+		}
+		
+		// The three-body column indices stop at the start of the last interaction,
+		// which then runs to the end of the solution.
+		interaction.first_column = icomp->interaction_class_column_index + ispec->interaction_column_indices[index_among_matched - 1];
+		size_t end_column = n_solution_columns;
+		if (index_among_matched < ispec->interaction_column_indices.size()) end_column = icomp->interaction_class_column_index + ispec->interaction_column_indices[index_among_matched];
+		interaction.n_columns = end_column - interaction.first_column;
+		interactions.push_back(interaction);
+	}
+}
+
+// Check whether a file starts like a results bundle.
+
+int is_solution_bundle(const char* filename)
+{
+	char tag[8];
+	FILE* bundle_file = open_file(filename, "rb");
+	size_t n_read = fread(tag, 1, 8, bundle_file);
+	fclose(bundle_file);
+	if ( (n_read == 8) && (memcmp(tag, "MSCGSOLN", 8) == 0) ) return 1;
+	return 0;
+}
+
+// Read a results bundle, checking its header, size, and checksum.
+
+void read_solution_bundle(const char* filename, SolutionBundle* const bundle)
+{
+	FILE* bundle_file = open_file(filename, "rb");
+	SolutionBundleHeader header;
+	if (fread(&header, sizeof(SolutionBundleHeader), 1, bundle_file) != 1) {
+		printf("Results bundle %s is too short to hold a header.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	if ( (memcmp(header.tag, "MSCGSOLN", 8) != 0) || (header.version != 1) ) {
+		printf("File %s is not a results bundle of a supported version.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	if (header.byte_order_mark != 0x0102030405060708ULL) {
+		printf("Results bundle %s was written with a different byte order.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	
+	// Read all sections at once and check them before unpacking.
+	size_t n_doubles = header.n_columns + header.n_singular_values + header.n_bootstrap_estimates * header.n_bootstrap_columns;
+	size_t data_size = n_doubles * sizeof(double) + header.n_interactions * sizeof(SolutionBundleInteraction);
+	fseek(bundle_file, 0, SEEK_END);
+	long file_size = ftell(bundle_file);
+	fseek(bundle_file, sizeof(SolutionBundleHeader), SEEK_SET);
+	if (file_size != (long)(sizeof(SolutionBundleHeader) + data_size)) {
+		printf("Results bundle %s is truncated or does not match its header.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	std::vector<char> data(data_size);
+	if (fread(data.data(), 1, data_size, bundle_file) != data_size) {
+		printf("Problem reading results bundle %s\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	fclose(bundle_file);
+	if (update_checksum(data.data(), data_size, kChecksumSeed) != header.checksum) {
+		printf("Results bundle %s is corrupt; its checksum does not match.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	
+	const char* position = data.data();
+	bundle->solution.resize(header.n_columns);
+	memcpy(bundle->solution.data(), position, header.n_columns * sizeof(double));
+	position += header.n_columns * sizeof(double);
+	bundle->interactions.resize(header.n_interactions);
+	memcpy(bundle->interactions.data(), position, header.n_interactions * sizeof(SolutionBundleInteraction));
+	position += header.n_interactions * sizeof(SolutionBundleInteraction);
+	bundle->singular_values.resize(header.n_singular_values);
+	memcpy(bundle->singular_values.data(), position, header.n_singular_values * sizeof(double));
+	position += header.n_singular_values * sizeof(double);
+	bundle->has_residual = ((header.contents & kBundleResidual) != 0);
+	bundle->residual = header.residual;
+	bundle->bootstrap_solutions.resize(header.n_bootstrap_estimates);
+	for (unsigned k = 0; k < header.n_bootstrap_estimates; k++) {
+		bundle->bootstrap_solutions[k].resize(header.n_bootstrap_columns);
+		memcpy(bundle->bootstrap_solutions[k].data(), position, header.n_bootstrap_columns * sizeof(double));
+		position += header.n_bootstrap_columns * sizeof(double);
+	}
+}
+
 void write_full_bootstrapping_MSCGFM_table_output_file(const std::string& filename_base, const std::vector<double>& axis, std::vector<double> const master_force, std::vector<double>* const force, int const bootstrapping_num_estimates) 
 {
 	std::string filename_tmp = filename_base + ".dat";
@@ -530,7 +730,7 @@ void write_bootstrapping_one_param_table_files(InteractionClassComputer* const i
     	write_bootstrapping_MSCGFM_table_output_file(basename, axis_vals, master_force_vals, force_vals, bootstrapping_num_estimates);
     }
     // Only write master copy for LAMMPS output.
-    write_LAMMPS_table_output_file(icomp->ispec->get_char_id(), basename, axis_vals, potential_vals[0], force_vals[0]); 
+    write_LAMMPS_table_output_file(icomp->ispec->get_char_id(), basename, axis_vals, potential_vals[0], force_vals[0], NULL); 
     delete [] force_vals;
     delete [] potential_vals;  
 }
@@ -575,7 +775,7 @@ void write_bootstrapping_one_param_table_files_energy(InteractionClassComputer*
     	write_bootstrapping_MSCGFM_table_output_file(basename, axis_vals, master_force_vals, force_vals, bootstrapping_num_estimates);
     }
     // Only write master copy for LAMMPS output. 
-	pad_and_print_table_files(icomp->ispec->get_char_id(), basename, axis_vals, master_force_vals, master_potential_vals, cutoff);
+	pad_and_print_table_files(icomp->ispec->get_char_id(), basename, axis_vals, master_force_vals, master_potential_vals, cutoff, NULL);
     delete [] force_vals;
     delete [] potential_vals;  
 }
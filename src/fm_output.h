@@ -8,9 +8,55 @@
 #ifndef _fm_output_h
 #define _fm_output_h
 
+#include <cstdint>
+#include <vector>
+
 struct CG_MODEL_DATA;
 struct MATRIX_DATA;
 
+// A results bundle (.mscgsol) holds a fixed header followed by the solution,
+// the column layout of each force-matched interaction, the singular values of
+// the solve, and the bootstrap solutions, in that order. Everything is in
+// native byte order, which byte_order_mark checks, and the checksum covers
+// all of the data after the header.
+
+enum SolutionBundleContents {kBundleSingularValues = 1, kBundleResidual = 2, kBundleBootstrapSolutions = 4};
+
+struct SolutionBundleHeader {
+	char tag[8];							// "MSCGSOLN"
+	uint32_t version;						// Format version, currently 1
+	uint32_t contents;						// Sum of the SolutionBundleContents flags of the data stored
+	uint64_t n_columns;						// Length of the solution
+	uint64_t n_interactions;
+	uint64_t n_singular_values;
+	uint64_t n_bootstrap_estimates;
+	uint64_t n_bootstrap_columns;			// Length of each bootstrap solution
+	double residual;						// MS-CG residual if kBundleResidual is set
+	uint64_t byte_order_mark;				// 0x0102030405060708 as written
+	uint64_t checksum;						// update_checksum of the data following the header
+};
+
+struct SolutionBundleInteraction {
+	int32_t class_type;						// InteractionClassType of the interaction
+	uint32_t index_among_defined;
+	int32_t types[4];						// Types of the interacting sites (from 1); 0 past the last site and for three-body interactions
+	uint64_t first_column;					// Index of the interaction's first coefficient in the solution
+	uint64_t n_columns;
+};
+
+struct SolutionBundle {
+	std::vector<double> solution;
+	std::vector<SolutionBundleInteraction> interactions;
+	std::vector<double> singular_values;	// Empty unless the solution was found by singular value decomposition
+	int has_residual;
+	double residual;
+	std::vector< std::vector<double> > bootstrap_solutions;
+};
+
 void write_fm_interaction_output_files(CG_MODEL_DATA* const cg, MATRIX_DATA* const mat);
 
+// Read a results bundle written with output_solution_flag 2.
+int is_solution_bundle(const char* filename);
+void read_solution_bundle(const char* filename, SolutionBundle* const bundle);
+
 #endif
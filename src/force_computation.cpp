@@ -30,31 +30,31 @@ bool check_density_excluded_list(const TopologyData* const topo_data, const int
 // differing by the way that potentially interacting particles are found in 
 // each frame and possibly found not to interact after.
 
-void order_pair_nonbonded_fm_matrix_element_calculation(InteractionClassComputer* const info, calc_pair_matrix_elements calc_matrix_elements, int* const cg_site_types, const int n_cg_types, MATRIX_DATA* const mat, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths);
-void order_bonded_fm_matrix_element_calculation(InteractionClassComputer* const info, int* const cg_site_types, const int n_cg_types, MATRIX_DATA* const mat, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths);
-void order_three_body_nonbonded_fm_matrix_element_calculation(InteractionClassComputer* const info, int* const cg_site_types, const int n_cg_types, MATRIX_DATA* const mat, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths);
-void density_fm_matrix_element_calculation(InteractionClassComputer* const iclass, calc_pair_matrix_elements calc_matrix_elements, int* const cg_site_types, const int n_cg_types, MATRIX_DATA* const mat, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths);
+void order_pair_nonbonded_fm_matrix_element_calculation(InteractionClassComputer* const info, calc_pair_matrix_elements calc_matrix_elements, int* const cg_site_types, const int n_cg_types, MATRIX_DATA* const mat, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths);
+void order_bonded_fm_matrix_element_calculation(InteractionClassComputer* const info, int* const cg_site_types, const int n_cg_types, MATRIX_DATA* const mat, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths);
+void order_three_body_nonbonded_fm_matrix_element_calculation(InteractionClassComputer* const info, int* const cg_site_types, const int n_cg_types, MATRIX_DATA* const mat, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths);
+void density_fm_matrix_element_calculation(InteractionClassComputer* const iclass, calc_pair_matrix_elements calc_matrix_elements, int* const cg_site_types, const int n_cg_types, MATRIX_DATA* const mat, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths);
 
 // Helper functions for the above
 
-void process_completed_density(DensityClassComputer* const info, calc_pair_matrix_elements process_density, const int n_cg_types, int* const cg_site_types, MATRIX_DATA* const mat, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths);
-inline void decode_density_interaction_and_calculate(DensityClassComputer* info, unsigned long interaction_flags, calc_pair_matrix_elements calc_matrix_elements, int* const cg_site_types, MATRIX_DATA* const mat, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths);
+void process_completed_density(DensityClassComputer* const info, calc_pair_matrix_elements process_density, const int n_cg_types, int* const cg_site_types, MATRIX_DATA* const mat, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths);
+inline void decode_density_interaction_and_calculate(DensityClassComputer* info, unsigned long interaction_flags, calc_pair_matrix_elements calc_matrix_elements, int* const cg_site_types, MATRIX_DATA* const mat, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths);
 void process_normal_interaction_matrix_elements(InteractionClassComputer* const info, MATRIX_DATA* const mat, const int n_body, int* particle_ids, std::array<double, DIMENSION>* derivatives, const double param_value, const int virial_flag, const double param_deriv, const double distance);
 void process_density_matrix_elements(InteractionClassComputer* const info, MATRIX_DATA* const mat, const int n_body, int* particle_ids, std::array<double, DIMENSION>* derivatives, const double density_value, const int virial_flag, const double density_derivative, const double distance);
 
 // Functions for calculating individual 3-component matrix elements.
 
-void calc_isotropic_two_body_fm_matrix_elements(InteractionClassComputer* const info, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
-void calc_angular_three_body_fm_matrix_elements(InteractionClassComputer* const info, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
-void calc_dihedral_four_body_fm_matrix_elements(InteractionClassComputer* const info, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
-void calc_density_fm_matrix_elements(InteractionClassComputer* const info, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
-void calc_nonbonded_1_three_body_fm_matrix_elements(InteractionClassComputer* const info, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
-void calc_nonbonded_2_three_body_fm_matrix_elements(InteractionClassComputer* const info, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
+void calc_isotropic_two_body_fm_matrix_elements(InteractionClassComputer* const info, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
+void calc_angular_three_body_fm_matrix_elements(InteractionClassComputer* const info, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
+void calc_dihedral_four_body_fm_matrix_elements(InteractionClassComputer* const info, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
+void calc_density_fm_matrix_elements(InteractionClassComputer* const info, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
+void calc_nonbonded_1_three_body_fm_matrix_elements(InteractionClassComputer* const info, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
+void calc_nonbonded_2_three_body_fm_matrix_elements(InteractionClassComputer* const info, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
 double calc_gaussian_density_derivative(DensityClassComputer* const icomp, DensityClassSpec* const ispec, const double distance);
 double calc_switching_density_derivative(DensityClassComputer* const icomp, DensityClassSpec* const ispec, const double distance);
 double calc_lucy_density_derivative(DensityClassComputer* const icomp, DensityClassSpec* const ispec, const double distance);
 double calc_re_density_derivative(DensityClassComputer* const icomp, DensityClassSpec* const ispec, const double distance);
-void do_nothing(InteractionClassComputer* const info, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
+void do_nothing(InteractionClassComputer* const info, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
 void accumulate_matching_order_parameter_forces(InteractionClassComputer* const info, const int first_nonzero_basis_index, double extra_derivative_value, std::vector<double> &basis_fn_vals, const int n_body, const int* particle_ids, std::array<double, DIMENSION>* const &derivatives, MATRIX_DATA * const mat);
 
 //--------------------------------------------------------------------
@@ -293,7 +293,7 @@ void calculate_frame_fm_matrix(CG_MODEL_DATA* const cg, MATRIX_DATA* const mat,
 
 // Find all neighbors of all particles and call nonbonded matrix element computations for any pairs that interact. 
 
-void PairNonbondedClassComputer::calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<double, DIMENSION>* const &x, const real* simulation_box_half_lengths) 
+void PairNonbondedClassComputer::calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<frame_real, DIMENSION>* const &x, const real* simulation_box_half_lengths) 
 {
     if (ispec->n_defined == 0) return;
     trajectory_block_frame_index = traj_block_frame_index;
@@ -301,7 +301,7 @@ void PairNonbondedClassComputer::calculate_interactions(MATRIX_DATA* const mat,
     walk_neighbor_list(mat, calculate_fm_matrix_elements, n_cg_types, topo_data, pair_cell_list, x, simulation_box_half_lengths);
 }
 
-inline void InteractionClassComputer::walk_neighbor_list(MATRIX_DATA* const mat, calc_pair_matrix_elements calc_matrix_elements, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<double, DIMENSION>* const &x, const real* simulation_box_half_lengths) 
+inline void InteractionClassComputer::walk_neighbor_list(MATRIX_DATA* const mat, calc_pair_matrix_elements calc_matrix_elements, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<frame_real, DIMENSION>* const &x, const real* simulation_box_half_lengths) 
 {
     if (ispec->n_defined == 0) return;
     int stencil_size = pair_cell_list.get_stencil_size();
@@ -331,7 +331,7 @@ inline void InteractionClassComputer::walk_neighbor_list(MATRIX_DATA* const mat,
     }
 }
 
-inline void DensityClassComputer::walk_density_neighbor_list(MATRIX_DATA* const mat, calc_pair_matrix_elements calc_matrix_elements, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<double, DIMENSION>* const &x, const real* simulation_box_half_lengths) 
+inline void DensityClassComputer::walk_density_neighbor_list(MATRIX_DATA* const mat, calc_pair_matrix_elements calc_matrix_elements, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<frame_real, DIMENSION>* const &x, const real* simulation_box_half_lengths) 
 {
     if (ispec->n_defined == 0) return;
     int stencil_size = pair_cell_list.get_stencil_size();
@@ -363,7 +363,7 @@ inline void DensityClassComputer::walk_density_neighbor_list(MATRIX_DATA* const
 
 // Calculate matrix elements for all bonded interactions by looping over the approriate topology lists. 
 
-void PairBondedClassComputer::calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<double, DIMENSION>* const &x, const real* simulation_box_half_lengths) 
+void PairBondedClassComputer::calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<frame_real, DIMENSION>* const &x, const real* simulation_box_half_lengths) 
 {
     if (ispec->n_defined == 0) return;
     trajectory_block_frame_index = traj_block_frame_index;
@@ -376,7 +376,7 @@ void PairBondedClassComputer::calculate_interactions(MATRIX_DATA* const mat, int
     }
 }
 
-void AngularClassComputer::calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<double, DIMENSION>* const &x, const real* simulation_box_half_lengths) 
+void AngularClassComputer::calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<frame_real, DIMENSION>* const &x, const real* simulation_box_half_lengths) 
 {
     if (ispec->n_defined == 0) return;
     trajectory_block_frame_index = traj_block_frame_index;
@@ -394,7 +394,7 @@ void AngularClassComputer::calculate_interactions(MATRIX_DATA* const mat, int tr
     }
 }
 
-void DihedralClassComputer::calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<double, DIMENSION>* const &x, const real* simulation_box_half_lengths) 
+void DihedralClassComputer::calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<frame_real, DIMENSION>* const &x, const real* simulation_box_half_lengths) 
 {
     if (ispec->n_defined == 0) return;
     
@@ -424,7 +424,7 @@ void DihedralClassComputer::calculate_interactions(MATRIX_DATA* const mat, int t
 // for each pair of density groups that interact. Exclusion lists are handled in the called subroutines.
 // Then, calculate the matrix elements by looking through the neighbor list (for all pairs of neighbors for all particles) to calculate matrix elements.
 
-void DensityClassComputer::calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<double, DIMENSION>* const &x, const real* simulation_box_half_lengths) 
+void DensityClassComputer::calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<frame_real, DIMENSION>* const &x, const real* simulation_box_half_lengths) 
 {
 	if (ispec->get_n_defined() == 0) return;
 	
@@ -449,7 +449,7 @@ void DensityClassComputer::calculate_interactions(MATRIX_DATA* const mat, int tr
 // Find all pairs of neighbors of all particles and call nonbonded matrix element computations
 // for any triples that interact. Exclusion lists are handled in the called subroutines.
 
-void ThreeBodyNonbondedClassComputer::calculate_3B_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const ThreeBCellList& three_body_cell_list, std::array<double, DIMENSION>* const &x, const real* simulation_box_half_lengths) 
+void ThreeBodyNonbondedClassComputer::calculate_3B_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const ThreeBCellList& three_body_cell_list, std::array<frame_real, DIMENSION>* const &x, const real* simulation_box_half_lengths) 
 {
     if (ispec->n_defined == 0) return;
     if (ispec->class_subtype > 0) {                    
@@ -459,7 +459,7 @@ void ThreeBodyNonbondedClassComputer::calculate_3B_interactions(MATRIX_DATA* con
 	}
 }
 
-inline void InteractionClassComputer::walk_3B_neighbor_list(MATRIX_DATA* const mat, const int n_cg_types, const TopologyData& topo_data, const ThreeBCellList& three_body_cell_list, std::array<double, DIMENSION>* const &x, const real* simulation_box_half_lengths) 
+inline void InteractionClassComputer::walk_3B_neighbor_list(MATRIX_DATA* const mat, const int n_cg_types, const TopologyData& topo_data, const ThreeBCellList& three_body_cell_list, std::array<frame_real, DIMENSION>* const &x, const real* simulation_box_half_lengths) 
 {
 	int stencil_size = three_body_cell_list.get_stencil_size();
     for (int kk = 0; kk < three_body_cell_list.size; kk++) {
@@ -553,7 +553,7 @@ inline bool check_density_excluded_list(const TopologyData* const topo_data, con
 // each frame and possibly found not to interact after.
 //--------------------------------------------------------------------
 
-void order_pair_nonbonded_fm_matrix_element_calculation(InteractionClassComputer* const info, calc_pair_matrix_elements calc_matrix_elements, int* const cg_site_types, const int n_cg_types, MATRIX_DATA* const mat, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths)
+void order_pair_nonbonded_fm_matrix_element_calculation(InteractionClassComputer* const info, calc_pair_matrix_elements calc_matrix_elements, int* const cg_site_types, const int n_cg_types, MATRIX_DATA* const mat, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths)
 {
     // Calculate the appropriate matrix elements.
     info->index_among_defined_intrxns = info->ispec->get_index_from_hash(calc_two_body_interaction_hash(cg_site_types[info->k], cg_site_types[info->l], n_cg_types));
@@ -562,7 +562,7 @@ void order_pair_nonbonded_fm_matrix_element_calculation(InteractionClassComputer
     calc_matrix_elements(info, x, simulation_box_half_lengths, mat);
 }
 
-void order_bonded_fm_matrix_element_calculation(InteractionClassComputer* const info, int* const cg_site_types, const int n_cg_types, MATRIX_DATA* const mat, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths)
+void order_bonded_fm_matrix_element_calculation(InteractionClassComputer* const info, int* const cg_site_types, const int n_cg_types, MATRIX_DATA* const mat, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths)
 {
      // Calculate the appropriate matrix elements.    
     info->index_among_defined_intrxns = info->ispec->get_index_from_hash(info->calculate_hash_number(cg_site_types, n_cg_types));
@@ -571,7 +571,7 @@ void order_bonded_fm_matrix_element_calculation(InteractionClassComputer* const
     (*info->calculate_fm_matrix_elements)(info, x, simulation_box_half_lengths, mat);
 }
 
-void order_three_body_nonbonded_fm_matrix_element_calculation(InteractionClassComputer* const info, int* const cg_site_types, const int n_cg_types, MATRIX_DATA* const mat, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths)
+void order_three_body_nonbonded_fm_matrix_element_calculation(InteractionClassComputer* const info, int* const cg_site_types, const int n_cg_types, MATRIX_DATA* const mat, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths)
 {
     ThreeBodyNonbondedClassComputer* icomp = static_cast<ThreeBodyNonbondedClassComputer*>(info);
     ThreeBodyNonbondedClassSpec* ispec = static_cast<ThreeBodyNonbondedClassSpec*>(icomp->ispec);
@@ -589,7 +589,7 @@ void order_three_body_nonbonded_fm_matrix_element_calculation(InteractionClassCo
     (*icomp->calculate_fm_matrix_elements)(icomp, x, simulation_box_half_lengths, mat); 
 }
 
-void density_fm_matrix_element_calculation(InteractionClassComputer* const info, calc_pair_matrix_elements calc_matrix_elements, int* const cg_site_types, const int n_cg_types, MATRIX_DATA* const mat, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths)
+void density_fm_matrix_element_calculation(InteractionClassComputer* const info, calc_pair_matrix_elements calc_matrix_elements, int* const cg_site_types, const int n_cg_types, MATRIX_DATA* const mat, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths)
 {
 	DensityClassComputer* icomp = static_cast<DensityClassComputer*>(info);
 	DensityClassSpec* ispec = static_cast<DensityClassSpec*>(icomp->ispec);
@@ -611,7 +611,7 @@ void density_fm_matrix_element_calculation(InteractionClassComputer* const info,
 // Helper functions of functions in the above section.
 //---------------------------------------------------------------------
 
-void process_completed_density(DensityClassComputer* const info, calc_pair_matrix_elements process_density, const int n_cg_types, int *const cg_site_types, MATRIX_DATA* const mat, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths) 
+void process_completed_density(DensityClassComputer* const info, calc_pair_matrix_elements process_density, const int n_cg_types, int *const cg_site_types, MATRIX_DATA* const mat, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths) 
 {	
 	DensityClassSpec* ispec = static_cast<DensityClassSpec*>(info->ispec);
 	
@@ -635,7 +635,7 @@ void process_completed_density(DensityClassComputer* const info, calc_pair_matri
 	}
 }
 
-inline void decode_density_interaction_and_calculate(DensityClassComputer* info, unsigned long interaction_flags, calc_pair_matrix_elements calc_matrix_elements, int *const cg_site_types, MATRIX_DATA* const mat, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths)
+inline void decode_density_interaction_and_calculate(DensityClassComputer* info, unsigned long interaction_flags, calc_pair_matrix_elements calc_matrix_elements, int *const cg_site_types, MATRIX_DATA* const mat, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths)
 {
 	DensityClassSpec* ispec = static_cast<DensityClassSpec*>(info->ispec);
 	// Loop through to determine which bits are non-zero.
@@ -768,7 +768,7 @@ inline void process_density_matrix_elements(InteractionClassComputer* const info
 
 // Each of these functions follows the idiom of calc_isotropic_two_body_fm_matrix_elements.
 
-void calc_isotropic_two_body_fm_matrix_elements(InteractionClassComputer* const info, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
+void calc_isotropic_two_body_fm_matrix_elements(InteractionClassComputer* const info, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
 {
     int particle_ids[2] = {info->k, info->l};
     std::array<double, DIMENSION>* derivatives = new std::array<double, DIMENSION>[1];
@@ -785,7 +785,7 @@ void calc_isotropic_two_body_fm_matrix_elements(InteractionClassComputer* const
     delete [] derivatives;
 }
 
-void calc_angular_three_body_fm_matrix_elements(InteractionClassComputer* const info, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
+void calc_angular_three_body_fm_matrix_elements(InteractionClassComputer* const info, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
 {
     int particle_ids[3] = {info->k, info->l, info->j}; // end indices (k, l), followed by center index (j)
     std::array<double, DIMENSION>* derivatives = new std::array<double, DIMENSION>[2];
@@ -803,7 +803,7 @@ void calc_angular_three_body_fm_matrix_elements(InteractionClassComputer* const
     delete [] derivatives;
 }
 
-void calc_dihedral_four_body_fm_matrix_elements(InteractionClassComputer* const info, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
+void calc_dihedral_four_body_fm_matrix_elements(InteractionClassComputer* const info, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
 {
     int particle_ids[4] = {info->k, info->l, info->i, info->j}; // end indices (k, l) followed by central bond indices (i, j)
     std::array<double, DIMENSION>* derivatives = new std::array<double, DIMENSION>[3];
@@ -826,7 +826,7 @@ void calc_dihedral_four_body_fm_matrix_elements(InteractionClassComputer* const
 	delete [] derivatives;
 }
 
-void calc_nonbonded_1_three_body_fm_matrix_elements(InteractionClassComputer* const info, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
+void calc_nonbonded_1_three_body_fm_matrix_elements(InteractionClassComputer* const info, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
 {
     int particle_ids[3] = {info->k, info->l, info->j}; // end indices (k, l) followed by center index (j).    
     ThreeBodyNonbondedClassComputer* icomp = static_cast<ThreeBodyNonbondedClassComputer*>(info);
@@ -879,7 +879,7 @@ void calc_nonbonded_1_three_body_fm_matrix_elements(InteractionClassComputer* co
     delete [] derivatives;
 }
 
-void calc_nonbonded_2_three_body_fm_matrix_elements(InteractionClassComputer* const info, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
+void calc_nonbonded_2_three_body_fm_matrix_elements(InteractionClassComputer* const info, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
 {
     int particle_ids[3] = {info->k, info->l, info->j}; // end indices (k, l) followed by center index (j).    
     ThreeBodyNonbondedClassComputer* icomp = static_cast<ThreeBodyNonbondedClassComputer*>(info);
@@ -929,7 +929,7 @@ void calc_nonbonded_2_three_body_fm_matrix_elements(InteractionClassComputer* co
 	delete [] derivatives;
 }
 
-void calc_gaussian_density_values(InteractionClassComputer* const info, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
+void calc_gaussian_density_values(InteractionClassComputer* const info, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
 {
 	DensityClassComputer* icomp = static_cast<DensityClassComputer*>(info);
 	DensityClassSpec* ispec = static_cast<DensityClassSpec*>(icomp->ispec);
@@ -948,7 +948,7 @@ void calc_gaussian_density_values(InteractionClassComputer* const info, std::arr
 	}
 }
 
-void calc_switching_density_values(InteractionClassComputer* const info, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
+void calc_switching_density_values(InteractionClassComputer* const info, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
 {
 	DensityClassComputer* icomp = static_cast<DensityClassComputer*>(info);
 	DensityClassSpec* ispec = static_cast<DensityClassSpec*>(icomp->ispec);
@@ -969,7 +969,7 @@ void calc_switching_density_values(InteractionClassComputer* const info, std::ar
 	}
 }
 
-void calc_lucy_density_values(InteractionClassComputer* const info, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
+void calc_lucy_density_values(InteractionClassComputer* const info, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
 {
 	DensityClassComputer* icomp = static_cast<DensityClassComputer*>(info);
 	DensityClassSpec* ispec = static_cast<DensityClassSpec*>(icomp->ispec);
@@ -991,7 +991,7 @@ void calc_lucy_density_values(InteractionClassComputer* const info, std::array<d
 	}
 }
 
-void calc_re_density_values(InteractionClassComputer* const info, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
+void calc_re_density_values(InteractionClassComputer* const info, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
 {
 	DensityClassComputer* icomp = static_cast<DensityClassComputer*>(info);
 	DensityClassSpec* ispec = static_cast<DensityClassSpec*>(icomp->ispec);
@@ -1017,7 +1017,7 @@ void calc_re_density_values(InteractionClassComputer* const info, std::array<dou
 	}
 }
 
-void calc_density_fm_matrix_elements(InteractionClassComputer* const info, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
+void calc_density_fm_matrix_elements(InteractionClassComputer* const info, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
 {
 	info->index_among_matched_interactions = info->ispec->defined_to_matched_intrxn_index_map[info->index_among_defined_intrxns];
 	info->index_among_tabulated_interactions = info->ispec->defined_to_tabulated_intrxn_index_map[info->index_among_defined_intrxns];
@@ -1077,6 +1077,180 @@ double calc_re_density_derivative(DensityClassComputer* const icomp, DensityClas
 	return density_derivative;
 }
 
-void do_nothing(InteractionClassComputer* const info, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat) 
+void do_nothing(InteractionClassComputer* const info, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat) 
 {
 }
+
+// Build the FM equations from every frame sample of a frame source, one
+// block of frame samples at a time. This is the frame loop of newfm.x.
+
+void construct_full_fm_matrix(CG_MODEL_DATA* const cg, MATRIX_DATA* const mat, FrameSource* const frame_source)
+{
+    int n_blocks;
+    int read_stat = 1;
+    int total_frame_samples = frame_source->n_frames;
+	int traj_frame_num = 0;
+	int times_sampled = 1;
+	double* ref_box_half_lengths = new double[frame_source->position_dimension];
+    
+    // Skip the desired number of frames before starting the matrix building loops.
+    frame_source->move_to_start_frame(frame_source);
+    
+    // Perform initial generation of cell lists user for generating neighbor lists.
+    // This list will only be rebuilt if the box dimensions change.
+    
+    // Initialize the cell linked lists for finding neighbors in the provided frames;
+    PairCellList pair_cell_list = PairCellList();
+    ThreeBCellList three_body_cell_list = ThreeBCellList();
+    
+    // Populate the cell linked lists.
+    pair_cell_list.init(cg->pair_nonbonded_interactions.cutoff, frame_source);
+    if (cg->three_body_nonbonded_interactions.class_subtype > 0) {
+    	double max_cutoff = 0.0;
+        for (int i = 0; i < cg->three_body_nonbonded_interactions.get_n_defined(); i++) {
+        	max_cutoff = fmax(max_cutoff, cg->three_body_nonbonded_interactions.three_body_nonbonded_cutoffs[i]);
+        }
+    three_body_cell_list.init(max_cutoff, frame_source);
+    }
+    
+	// Record this box's dimensions.
+	for (int i = 0; i < frame_source->position_dimension; i++) {
+		ref_box_half_lengths[i] = frame_source->frame_config->simulation_box_half_lengths[i];
+	}
+	
+	// Begin the main building loops. This routine operates as a for loop
+    // over frame blocks wrapped around a loop over frames within each block.
+    // In the inner loop, frames are read every iteration and new matrix elements are computed.
+    // In the outer loop, the blockwise matrix is incorporated into the total equations, 
+    // then wiped for the process to start again with the next iteration.
+
+    // Set up the loop index limits for the inner and outer loops.
+    if (frame_source->dynamic_state_sampling == 1) {
+		total_frame_samples = frame_source->n_frames * frame_source->dynamic_state_samples_per_frame;
+	}	
+    if (mat->matrix_type == kDense) {
+        n_blocks = total_frame_samples;
+	    mat->frames_per_traj_block = 1;
+    } else {
+		// Check if number of frames is divisible by frames per trajectory block.
+		if (total_frame_samples % mat->frames_per_traj_block != 0) {
+			printf("Total number of frame samples %d is not divisible by block size %d.\n", total_frame_samples, mat->frames_per_traj_block);
+			exit(EXIT_FAILURE);
+		}
+		n_blocks = total_frame_samples / mat->frames_per_traj_block;
+	}
+
+    mat->accumulation_row_shift = 0;
+
+    // For each block of frame samples.
+    printf("Entering primary matrix-building loop.\n"); fflush(stdout);
+    for (mat->trajectory_block_index = 0; mat->trajectory_block_index < n_blocks; mat->trajectory_block_index++) {
+        
+        // Wipe the matrix, then calculate the target virial for all frames in this block.
+        (*mat->set_fm_matrix_to_zero)(mat);
+        add_target_virials_from_trajectory(mat, frame_source->pressure_constraint_rhs_vector);
+
+        // For each frame sample in this block
+        for (int trajectory_block_frame_index = 0; trajectory_block_frame_index < mat->frames_per_traj_block; trajectory_block_frame_index++) {
+	
+		    // Check that the last frame was read successfully (read at end of each iteration)
+    		if (read_stat == 0) {
+        		printf("Failure reading frame %d (%d). Check trajectory for errors.\n", frame_source->current_frame_n, mat->trajectory_block_index * mat->frames_per_traj_block + trajectory_block_frame_index);
+        		exit(EXIT_FAILURE);
+    		}
+
+            // If reweighting is being used, scale the block of the FM matrix for this frame
+            // by the appropriate weighting factor. Weights are per trajectory frame,
+            // so every state sample of a frame takes that frame's weight.
+            if (frame_source->use_statistical_reweighting) {
+                printf("Reweighting entries for trajectory frame %d. ", traj_frame_num);
+                mat->current_frame_weight = frame_source->frame_weights[traj_frame_num];
+            }
+            
+            //Skip processing frame if frame weight is 0.
+            if (frame_source->use_statistical_reweighting && mat->current_frame_weight == 0.0) {
+            } else {
+            
+            	// Check if the simulation box has changed.
+            	int box_change = 0;
+            	for (int i = 0; i < frame_source->position_dimension; i++) {
+					if ( fabs(ref_box_half_lengths[i] - frame_source->frame_config->simulation_box_half_lengths[i]) > VERYSMALL_F ) {
+						box_change = 1;
+						break;
+					}
+				}
+				
+				// Redo cell list set-up and update reference box size if box has changed.
+				if (box_change == 1) {
+	            	// Re-initialize the cell linked lists for finding neighbors in the provided frames;
+  					pair_cell_list = PairCellList();
+    				three_body_cell_list = ThreeBCellList();
+    				pair_cell_list.init(cg->pair_nonbonded_interactions.cutoff, frame_source);
+    				if (cg->three_body_nonbonded_interactions.class_subtype > 0) {
+        				double max_cutoff = 0.0;
+        				for (int i = 0; i < cg->three_body_nonbonded_interactions.get_n_defined(); i++) {
+            				max_cutoff = fmax(max_cutoff, cg->three_body_nonbonded_interactions.three_body_nonbonded_cutoffs[i]);
+        				}
+        				three_body_cell_list.init(max_cutoff, frame_source);
+    				}
+    			
+    				// Update the reference_box_half_lengths for this new box size.
+    				for (int i = 0; i < frame_source->position_dimension; i++) {
+    					ref_box_half_lengths[i] = frame_source->frame_config->simulation_box_half_lengths[i];
+    				}
+    			}
+    			
+    			// Modify frame weight if using volume weighting.
+    			if (mat->volume_weighting_flag == 1) {
+    				real* half_lengths = frame_source->frame_config->simulation_box_half_lengths;
+    				double volume = 1.0;
+    				for (int i = 0; i < mat->position_dimension; i++) volume *= 2.0 * half_lengths[i];
+    				mat->current_frame_weight *= volume * volume;
+    			}
+				
+				// Process frame information.
+                FrameConfig* frame_config = frame_source->getFrameConfig();
+    			calculate_frame_fm_matrix(cg, mat, frame_config, pair_cell_list, three_body_cell_list, trajectory_block_frame_index);
+            }
+			
+            // Read the next frame; the success of this read will be
+            // checked at the start of the next iteration of the loop.
+            if (frame_source->dynamic_state_sampling == 0) {
+				// Read next frame.
+				// Only do this if we are not currently process the last frame.
+				if ( ((trajectory_block_frame_index + 1) < mat->frames_per_traj_block) ||
+			         ((mat->trajectory_block_index + 1) < n_blocks) ) {
+					read_stat = (*frame_source->get_next_frame)(frame_source);  
+				}
+				traj_frame_num++;
+				
+			} else if (times_sampled < frame_source->dynamic_state_samples_per_frame) {
+				// Resample this frame.
+				frame_source->sampleTypesFromProbs();
+				times_sampled++;
+				
+			} else {
+				// Read next frame, sample frame, and reset sampling counter.
+				// Only do this if we are not currently process the last frame.
+				if ( ((trajectory_block_frame_index + 1) < mat->frames_per_traj_block) ||
+			         ((mat->trajectory_block_index + 1) < n_blocks) ) {
+					read_stat = (*frame_source->get_next_frame)(frame_source);  
+				}
+				frame_source->sampleTypesFromProbs();
+				times_sampled = 1;
+				traj_frame_num++;
+			}
+		}
+		
+        // Print status and do end-of-block computations before wiping the blockwise matrix and beginning anew
+        printf("\r%d (%d) frames have been sampled. ", frame_source->current_frame_n, (mat->trajectory_block_index + 1) * mat->frames_per_traj_block);
+        fflush(stdout);
+        (*mat->do_end_of_frameblock_matrix_manipulations)(mat);
+	}
+
+    printf("\nFinishing frame parsing.\n");
+    
+    // Close the trajectory and free the relevant temp variables.
+    frame_source->cleanup(frame_source);
+    delete [] ref_box_half_lengths;
+}
@@ -13,7 +13,7 @@
 #endif
 
 // Function prototypes for internal functions.
-void subtract_min_image_vectors(const int* particle_ids, const std::array<double, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, std::array<double, DIMENSION> &displacement);
+void subtract_min_image_vectors(const int* particle_ids, const std::array<frame_real, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, std::array<double, DIMENSION> &displacement);
 void subtract_min_image_particles(const std::array<double, DIMENSION> &particle_position1, const std::array<double, DIMENSION> &particle_position2, const real *simulation_box_half_lengths, std::array<double, DIMENSION> &displacement);
 void cross_product(const std::array<double, DIMENSION> &a, const std::array<double, DIMENSION> &b, std::array<double, DIMENSION> &c);
 double dot_product(const std::array<double, DIMENSION> &a, const std::array<double, DIMENSION> &b);
@@ -25,10 +25,10 @@ inline void check_cos(double &cos_theta);
 // Small helper functions used internally.
 //------------------------------------------------------------
 
-void subtract_min_image_vectors(const int* particle_ids, const std::array<double, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, std::array<double, DIMENSION> &displacement)
+void subtract_min_image_vectors(const int* particle_ids, const std::array<frame_real, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, std::array<double, DIMENSION> &displacement)
 {
     for (int i = 0; i < DIMENSION; i++) {
-        displacement[i] = particle_positions[particle_ids[1]][i] - particle_positions[particle_ids[0]][i];
+        displacement[i] = (double)particle_positions[particle_ids[1]][i] - particle_positions[particle_ids[0]][i];
         if (displacement[i] > simulation_box_half_lengths[i]) displacement[i] -= 2.0 * simulation_box_half_lengths[i];
         else if (displacement[i] < -simulation_box_half_lengths[i]) displacement[i] += 2.0 * simulation_box_half_lengths[i];
     }
@@ -43,7 +43,7 @@ void subtract_min_image_particles(const std::array<double, DIMENSION> &particle_
     }
 }
 
-void get_minimum_image(const int l, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths)
+void get_minimum_image(const int l, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths)
 {
     for (int i = 0; i < DIMENSION; i++) {
         if (x[l][i] < 0) x[l][i] += 2.0 * simulation_box_half_lengths[i];
@@ -80,7 +80,7 @@ double dot_product(const double* a, const double* b)
 
 // Calculate a squared distance and one derivative.
 
-bool conditionally_calc_squared_distance_and_derivatives(const int* particle_ids, const std::array<double, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, const double cutoff2, double &param_val, std::array<double, DIMENSION>* &derivatives)
+bool conditionally_calc_squared_distance_and_derivatives(const int* particle_ids, const std::array<frame_real, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, const double cutoff2, double &param_val, std::array<double, DIMENSION>* &derivatives)
 {
     double rr2 = 0.0;
     std::array<double, DIMENSION> displacement;
@@ -101,7 +101,7 @@ bool conditionally_calc_squared_distance_and_derivatives(const int* particle_ids
 
 // Calculate a distance and one derivative.
 
-bool conditionally_calc_distance_and_derivatives(const int* particle_ids, const std::array<double, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, const double cutoff2, double &param_val, std::array<double, DIMENSION>* &derivatives)
+bool conditionally_calc_distance_and_derivatives(const int* particle_ids, const std::array<frame_real, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, const double cutoff2, double &param_val, std::array<double, DIMENSION>* &derivatives)
 {
     bool within_cutoff = conditionally_calc_squared_distance_and_derivatives(particle_ids, particle_positions, simulation_box_half_lengths, cutoff2, param_val, derivatives);
 
@@ -118,7 +118,7 @@ bool conditionally_calc_distance_and_derivatives(const int* particle_ids, const
 
 // Calculate the angle between three particles and its derivatives.
 
-bool conditionally_calc_angle_and_derivatives(const int* particle_ids, const std::array<double, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, const double cutoff2, double &param_val, std::array<double, DIMENSION>* &derivatives)
+bool conditionally_calc_angle_and_derivatives(const int* particle_ids, const std::array<frame_real, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, const double cutoff2, double &param_val, std::array<double, DIMENSION>* &derivatives)
 {   
     std::array<double, DIMENSION>* dist_derivs_20 = new std::array<double, DIMENSION>[1];
     std::array<double, DIMENSION>* dist_derivs_21 = new std::array<double, DIMENSION>[1];
@@ -162,7 +162,7 @@ bool conditionally_calc_angle_and_derivatives(const int* particle_ids, const std
 
 // Calculate a the cosine of an angle along with its derivatives.
 
-bool conditionally_calc_angle_and_intermediates(const int* particle_ids, std::array<double, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, const double cutoff2, std::array<double, DIMENSION>* &dist_derivs_20, std::array<double, DIMENSION>* &dist_derivs_21, std::array<double, DIMENSION>* &derivatives, double &param_val, double &rr_20, double &rr_21)
+bool conditionally_calc_angle_and_intermediates(const int* particle_ids, std::array<frame_real, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, const double cutoff2, std::array<double, DIMENSION>* &dist_derivs_20, std::array<double, DIMENSION>* &dist_derivs_21, std::array<double, DIMENSION>* &derivatives, double &param_val, double &rr_20, double &rr_21)
 {
     int particle_ids_20[2] = {particle_ids[2], particle_ids[0]};
     int particle_ids_21[2] = {particle_ids[2], particle_ids[1]};
@@ -199,7 +199,7 @@ bool conditionally_calc_angle_and_intermediates(const int* particle_ids, std::ar
 
 // Calculate a terms for Stillinger-Weber interactions.
 
-bool conditionally_calc_sw_angle_and_intermediates(const int* particle_ids, std::array<double, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, const double cutoff, const double gamma, std::array<double, DIMENSION>* &dist_derivs_01, std::array<double, DIMENSION>* &dist_derivs_02, std::array<double, DIMENSION>* &derivatives, double &param_val, double &rr1, double &rr2, double &angle_prefactor, double &dr1_prefactor, double &dr2_prefactor)
+bool conditionally_calc_sw_angle_and_intermediates(const int* particle_ids, std::array<frame_real, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, const double cutoff, const double gamma, std::array<double, DIMENSION>* &dist_derivs_01, std::array<double, DIMENSION>* &dist_derivs_02, std::array<double, DIMENSION>* &derivatives, double &param_val, double &rr1, double &rr2, double &angle_prefactor, double &dr1_prefactor, double &dr2_prefactor)
 {	
 	bool within_cutoff = conditionally_calc_angle_and_intermediates(particle_ids, particle_positions, simulation_box_half_lengths, cutoff*cutoff, dist_derivs_01, dist_derivs_02, derivatives, param_val, rr1, rr2);
 	if(within_cutoff == false) {
@@ -224,7 +224,7 @@ bool conditionally_calc_sw_angle_and_intermediates(const int* particle_ids, std:
 // Calculate a dihedral angle and its derivatives.
 // Thanks to Andrew Jewett (jewett.aij  g m ail) for inspiration from LAMMPS dihedral_table.cpp
 
-bool conditionally_calc_dihedral_and_derivatives(const int* particle_ids, const std::array<double, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, const double cutoff2, double &param_val, std::array<double, DIMENSION>* &derivatives)
+bool conditionally_calc_dihedral_and_derivatives(const int* particle_ids, const std::array<frame_real, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, const double cutoff2, double &param_val, std::array<double, DIMENSION>* &derivatives)
 {
     // Find the relevant displacements for defining the angle.
     std::array<double, DIMENSION> disp03, disp23, disp12;
@@ -286,7 +286,7 @@ bool conditionally_calc_dihedral_and_derivatives(const int* particle_ids, const
 
 // Calculate a squared distance.
 
-void calc_squared_distance(const int* particle_ids, const std::array<double, DIMENSION>*const &particle_positions, const real *simulation_box_half_lengths, double &param_val)
+void calc_squared_distance(const int* particle_ids, const std::array<frame_real, DIMENSION>*const &particle_positions, const real *simulation_box_half_lengths, double &param_val)
 {
 	std::array<double, DIMENSION> displacement;
 	double rr2 = 0.0;
@@ -299,7 +299,7 @@ void calc_squared_distance(const int* particle_ids, const std::array<double, DIM
 
 // Calculate a distance.
 
-void calc_distance(const int* particle_ids, std::array<double, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, double &param_val)
+void calc_distance(const int* particle_ids, std::array<frame_real, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, double &param_val)
 {
     calc_squared_distance(particle_ids, particle_positions, simulation_box_half_lengths, param_val);
     param_val = sqrt(param_val);
@@ -307,7 +307,7 @@ void calc_distance(const int* particle_ids, std::array<double, DIMENSION>* const
 
 // Calculate the angle between three particles.
 
-void calc_angle(const int* particle_ids, const std::array<double, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, double &param_val)
+void calc_angle(const int* particle_ids, const std::array<frame_real, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, double &param_val)
 {   
     std::array<double, DIMENSION>* dist_derivs_20 = new std::array<double, DIMENSION>[1];
     std::array<double, DIMENSION>* dist_derivs_21 = new std::array<double, DIMENSION>[1];
@@ -334,7 +334,7 @@ void calc_angle(const int* particle_ids, const std::array<double, DIMENSION>* co
 // Calculate a dihedral angle.
 // Thanks to Andrew Jewett (jewett.aij  g m ail) for inspiration from LAMMPS dihedral_table.cpp
 
-void calc_dihedral(const int* particle_ids, const std::array<double, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, double &param_val)
+void calc_dihedral(const int* particle_ids, const std::array<frame_real, DIMENSION>* const &particle_positions, const real *simulation_box_half_lengths, double &param_val)
 {
     // Find the relevant displacements for defining the angle.
     std::array<double, DIMENSION> disp03, disp23, disp12;
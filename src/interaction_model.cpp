@@ -161,6 +161,15 @@ void check_input_values(CG_MODEL_DATA* cg)
 		printf("Invalid bspline_k (%d) for %s!\n (Must be at least 3)\n", cg->three_body_nonbonded_interactions.get_bspline_k(), cg->three_body_nonbonded_interactions.get_full_name().c_str());
 		exit(EXIT_FAILURE);
 	}
+	
+	if ( cg->range_trim_style < 0 || cg->range_trim_style > 2 ) {
+		printf("Invalid range_trim_style (%d)!\n", cg->range_trim_style);
+		exit(EXIT_FAILURE);
+	}
+	if ( cg->range_trim_threshold < 0.0 || (cg->range_trim_style == 2 && cg->range_trim_threshold >= 0.5) ) {
+		printf("Invalid range_trim_threshold (%lf)!\n", cg->range_trim_threshold);
+		exit(EXIT_FAILURE);
+	}
 }
 
 // Check that specified nonbonded interactions do not extend past the nonbonded cutoff
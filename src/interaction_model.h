@@ -30,6 +30,7 @@ class ThreeBCellList;
 struct InteractionClassComputer;
 struct ThreeBodyNonbondedClassComputer;
 struct DensityClassSpec;
+struct ParameterHistogram;
 
 // Function called externally
 void free_interaction_data(CG_MODEL_DATA* cg);
@@ -42,7 +43,7 @@ void check_input_values(CG_MODEL_DATA* cg);
 
 enum InteractionClassType {kPairNonbonded = 2, kPairBonded = -2, kAngularBonded = -3, kDihedralBonded = -4, kThreeBodyNonbonded = 3, kDensity = 4};
 // function pointer "type" used for polymorphism of matrix element calculation (for pair nonbonded types)
-typedef void (*calc_pair_matrix_elements)(InteractionClassComputer* const, std::array<double, DIMENSION>* const &, const real*, MATRIX_DATA* const);
+typedef void (*calc_pair_matrix_elements)(InteractionClassComputer* const, std::array<frame_real, DIMENSION>* const &, const real*, MATRIX_DATA* const);
 typedef void (*calc_interaction_matrix_elements)(InteractionClassComputer* const info, MATRIX_DATA* const mat, const int n_body, int* particle_ids, std::array<double, DIMENSION>* derivatives, const double param_value, const int virial_flag, const double param_deriv, const double distance);
 
 //-------------------------------------------------------------
@@ -67,6 +68,8 @@ struct InteractionClassSpec {
     double output_binwidth;
 	int output_parameter_distribution;
 	FILE** output_range_file_handles;
+	ParameterHistogram* parameter_histograms;	// Sampled parameter counts for each defined interaction (rangefinder only)
+	double* sampled_pair_densities;				// Number of pairs per unit volume summed over the sampled frames for each defined interaction (rangefinder only)
 
 	// n_defined is the number of unique type combinations for n_cg_sites and the interaction type.
 	// defined_to_possible is used for bonded-type interactions and converts the type combination hash
@@ -163,11 +166,14 @@ struct InteractionClassSpec {
 		n_tabulated = n_to_force_match = n_from_table = 0;
 		n_defined = 0;
 		class_subtype = 0;
+		parameter_histograms = NULL;
+		sampled_pair_densities = NULL;
 	};
 	
 	~InteractionClassSpec() {
 		delete [] lower_cutoffs;
 		delete [] upper_cutoffs;
+		delete [] sampled_pair_densities;
 		
 	    if (n_tabulated > 0) {
     	    for (int i = 0; i < n_tabulated; i++) {
@@ -213,7 +219,7 @@ struct InteractionClassComputer {
     double stillinger_weber_angle_parameter;   // Current interaction's SW angle param (three-body interactions only).
     
     // Function called to calculate matrix elements corresponding to an interaction in the current class of interactions.
-    void (*calculate_fm_matrix_elements)(InteractionClassComputer* const self, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
+    void (*calculate_fm_matrix_elements)(InteractionClassComputer* const self, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
     // Function called to evaluate the values of functions in an interaction's basis set
     void (*set_up_fm_bases)(void);
 	// Function called to accumulate the interactions into the matrix for the interaction.
@@ -224,7 +230,7 @@ struct InteractionClassComputer {
     // Function to calculate index of an actual interaction among all possible interactions for the current class
 	virtual int calculate_hash_number(int* const cg_site_types, const int n_cg_types) = 0;
 	
-	virtual void calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<double, DIMENSION>* const &x, const real* simulation_box_half_lengths) = 0;
+	virtual void calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<frame_real, DIMENSION>* const &x, const real* simulation_box_half_lengths) = 0;
 	
 	void set_up_computer(InteractionClassSpec* const ispec_pt, int *curr_iclass_col_index);	
 
@@ -233,8 +239,8 @@ struct InteractionClassComputer {
 	void calc_grid_of_force_vals(const std::vector<double> &spline_coeffs, const int index_among_defined_intrxns, const double binwidth, std::vector<double> &axis_vals, std::vector<double> &force_vals);
 	void calc_grid_of_force_and_deriv_vals(const std::vector<double> &spline_coeffs, const int index_among_defined_intrxns, const double binwidth, std::vector<double> &axis_vals, std::vector<double> &force_vals, std::vector<double> &deriv_vals);
 	
-	void walk_neighbor_list(MATRIX_DATA* const mat, calc_pair_matrix_elements calc_matrix_elements, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<double, DIMENSION>* const &x, const real* simulation_box_half_lengths);
-	void walk_3B_neighbor_list(MATRIX_DATA* const mat, const int n_cg_types, const TopologyData& topo_data, const ThreeBCellList& three_body_cell_list, std::array<double, DIMENSION>* const &x, const real* simulation_box_half_lengths);
+	void walk_neighbor_list(MATRIX_DATA* const mat, calc_pair_matrix_elements calc_matrix_elements, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<frame_real, DIMENSION>* const &x, const real* simulation_box_half_lengths);
+	void walk_3B_neighbor_list(MATRIX_DATA* const mat, const int n_cg_types, const TopologyData& topo_data, const ThreeBCellList& three_body_cell_list, std::array<frame_real, DIMENSION>* const &x, const real* simulation_box_half_lengths);
 
 	void set_indices(void) {
 		index_among_matched_interactions   = ispec->defined_to_matched_intrxn_index_map[index_among_defined_intrxns];
@@ -251,6 +257,7 @@ struct InteractionClassComputer {
     std::vector<double> table_basis_fn_vals;
 
 	InteractionClassComputer() {
+		ispec = NULL;
 		fm_s_comp = NULL;
 		table_s_comp = NULL;
 	}
@@ -538,7 +545,7 @@ struct DensityClassSpec: InteractionClassSpec {
 struct PairNonbondedClassComputer : InteractionClassComputer {
 	void class_set_up_computer(void);
 	//void class_set_up_range(void);
-	void calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<double, DIMENSION>* const &x, const real* simulation_box_half_lengths);
+	void calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<frame_real, DIMENSION>* const &x, const real* simulation_box_half_lengths);
 
     int calculate_hash_number(int* const cg_site_types, const int n_cg_types) {
 	    return calc_two_body_interaction_hash(cg_site_types[k], cg_site_types[l], n_cg_types);
@@ -548,7 +555,7 @@ struct PairNonbondedClassComputer : InteractionClassComputer {
 struct PairBondedClassComputer : InteractionClassComputer {
 	void class_set_up_computer(void);
 	//void class_set_up_range(void);
-	void calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<double, DIMENSION>* const &x, const real* simulation_box_half_lengths); 
+	void calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<frame_real, DIMENSION>* const &x, const real* simulation_box_half_lengths); 
 
     int calculate_hash_number(int* const cg_site_types, const int n_cg_types) {
 	    return calc_two_body_interaction_hash(cg_site_types[k], cg_site_types[l], n_cg_types);
@@ -558,7 +565,7 @@ struct PairBondedClassComputer : InteractionClassComputer {
 struct AngularClassComputer : InteractionClassComputer {
 	void class_set_up_computer(void);
 	//void class_set_up_range(void);
-	void calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<double, DIMENSION>* const &x, const real* simulation_box_half_lengths);
+	void calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<frame_real, DIMENSION>* const &x, const real* simulation_box_half_lengths);
 
     int calculate_hash_number(int* const cg_site_types, const int n_cg_types) {
 	    return calc_three_body_interaction_hash(cg_site_types[j], cg_site_types[k], cg_site_types[l], n_cg_types);
@@ -568,7 +575,7 @@ struct AngularClassComputer : InteractionClassComputer {
 struct DihedralClassComputer : InteractionClassComputer {
 	void class_set_up_computer(void);
 	//void class_set_up_range(void);
-	void calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<double, DIMENSION>* const &x, const real* simulation_box_half_lengths);
+	void calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<frame_real, DIMENSION>* const &x, const real* simulation_box_half_lengths);
 
     int calculate_hash_number(int* const cg_site_types, const int n_cg_types) {
 		return calc_four_body_interaction_hash(cg_site_types[i], cg_site_types[j], cg_site_types[k], cg_site_types[l], n_cg_types);
@@ -581,8 +588,8 @@ struct ThreeBodyNonbondedClassComputer : InteractionClassComputer {
 	void special_set_up_computer(InteractionClassSpec* const ispec_pt, int *curr_iclass_col_index);
 	void class_set_up_computer(void) {} ;
 	//void class_set_up_range(void);
-	void calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<double, DIMENSION>* const &x, const real* simulation_box_half_lengths) {};
-	void calculate_3B_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const ThreeBCellList& three_body_cell_list, std::array<double, DIMENSION>* const &x, const real* simulation_box_half_lengths);
+	void calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<frame_real, DIMENSION>* const &x, const real* simulation_box_half_lengths) {};
+	void calculate_3B_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const ThreeBCellList& three_body_cell_list, std::array<frame_real, DIMENSION>* const &x, const real* simulation_box_half_lengths);
 	
     void calculate_bspline_elements_and_deriv_elements(double* coef1);
 	void calculate_bspline_deriv_elements(double* coef1);
@@ -615,22 +622,22 @@ struct DensityClassComputer : InteractionClassComputer {
 	// Specific Implementaitons of InteractionClassComputer functions
 	void class_set_up_computer(void);
 	//void class_set_up_range(void);
-	void calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<double, DIMENSION>* const &x, const real* simulation_box_half_lengths);
-	void walk_density_neighbor_list(MATRIX_DATA* const mat, calc_pair_matrix_elements calc_matrix_elements, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<double, DIMENSION>* const &x, const real* simulation_box_half_lengths);
+	void calculate_interactions(MATRIX_DATA* const mat, int traj_block_frame_index, int curr_frame_starting_row, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<frame_real, DIMENSION>* const &x, const real* simulation_box_half_lengths);
+	void walk_density_neighbor_list(MATRIX_DATA* const mat, calc_pair_matrix_elements calc_matrix_elements, const int n_cg_types, const TopologyData& topo_data, const PairCellList& pair_cell_list, std::array<frame_real, DIMENSION>* const &x, const real* simulation_box_half_lengths);
 	
 	// Additional Computer functions specific to Density.
 	void reset_density_array(void);
 	
 	// Additional function pointer to calculate the density_values array before computing the interaction
-	void (*calculate_density_values)(InteractionClassComputer* const self, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
-   	void (*process_density)(InteractionClassComputer* const self, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
+	void (*calculate_density_values)(InteractionClassComputer* const self, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
+   	void (*process_density)(InteractionClassComputer* const self, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
 	double (*calculate_density_derivative)(DensityClassComputer* const icomp, DensityClassSpec* const ispec, const double distance);
 	
 	// Need to implement these functions
 	int calculate_hash_number(int* const cg_site_types, const int n_cg_types) {return -1;}
 		
 	inline ~DensityClassComputer() {
-		if(ispec->get_n_defined() > 0) {
+		if( (ispec != NULL) && (ispec->get_n_defined() > 0) ) {
 			delete [] denomenator;
 			delete [] u_cutoff;
 			delete [] f_cutoff;
@@ -686,6 +693,8 @@ struct CG_MODEL_DATA {
 	
     // Non-matrix-associated output flags.
     int output_spline_coeffs_flag;          // 1 to output spline coefficients as well as force tables; 0 otherwise
+    int range_trim_style;                   // 0 to write the sampled extremes as ranges; 1 or 2 to trim a number or fraction of samples from the ends (rangefinder only)
+    double range_trim_threshold;            // Number or fraction of samples that may lie beyond each trimmed end
 
 	inline CG_MODEL_DATA(ControlInputs* control_input) :
 		pair_nonbonded_cutoff(control_input->pair_nonbonded_cutoff),
@@ -694,7 +703,9 @@ struct CG_MODEL_DATA {
 		angular_interactions(control_input), dihedral_interactions(control_input),
 		three_body_nonbonded_interactions(control_input),
 		density_interactions(control_input),
-		output_spline_coeffs_flag(control_input->output_spline_coeffs_flag)
+		output_spline_coeffs_flag(control_input->output_spline_coeffs_flag),
+		range_trim_style(control_input->range_trim_style),
+		range_trim_threshold(control_input->range_trim_threshold)
 {
     	topo_data.excluded_style = control_input->excluded_style;
 		topo_data.density_excluded_style = control_input->density_excluded_style;
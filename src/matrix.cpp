@@ -6,19 +6,84 @@
 //
 
 #include <cassert>
+#include <cfloat>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 
+#include <algorithm>
 #include <array>
+#include <functional>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "control_input.h"
 #include "interaction_model.h"
 #include "external_matrix_routines.h"
+#include "fm_output.h"
 #include "misc.h"
 #include "matrix.h"
 
+//-------------------------------------------------------------
+// structs for normal-equation files
+//-------------------------------------------------------------
+
+// A normal-equation file (result.out, or final_equations.out for the
+// accumulation matrix type) holds a fixed header and then the stored systems,
+// whose layout depends on the matrix type:
+// - dense and sparse normal (0, 3): the upper triangle of the normal matrix
+//   packed column by column (element (k, j) with k <= j at j * (j + 1) / 2 + k)
+//   followed by the normal target vector;
+// - accumulation (2): the triangular factor of the matrix with the target
+//   vector appended as a last column, packed the same way;
+// - sparse (1): the weighted sum of the block solutions followed by the
+//   normalization factors of each unknown;
+// - sparse-sparse (4): the number of stored entries of the normal matrix as a
+//   uint64_t, the normal target vector, the entry values, their one-based int32_t
+//   column indices, and the one-based int32_t row starts, padded to 8 bytes.
+// Everything is in native byte order, which byte_order_mark checks, and the
+// checksum covers all of the data after the header. The files are mapped into
+// memory to be read.
+
+struct NormalEquationFileHeader {
+	char tag[8];							// "MSCGNEQS"
+	uint32_t version;						// Format version, currently 1
+	int32_t matrix_type;					// MatrixType of the calculation that wrote the file
+	uint64_t n_columns;
+	uint64_t n_systems;						// Number of bootstrapping estimates stored, or 1
+	uint64_t n_frames;						// Number of trajectory frames in the calculation
+	double frame_weight_total;				// Inverse of the normalization of the stored equations
+	double force_sq_total;
+	uint64_t interaction_layout_hash;		// interaction_layout_hash of the model that wrote the file
+	uint64_t byte_order_mark;				// 0x0102030405060708 as written
+	uint64_t checksum;						// update_checksum of the data following the header
+};
+
+struct NormalEquationFile {
+	size_t map_size;
+	const char* map_begin;
+	NormalEquationFileHeader header;
+	const double* systems;					// Packed systems following the header in the map
+};
+
+// The arrays of a stored sparse-sparse system within a mapped file.
+
+struct SparseNormalSystem {
+	uint64_t n_entries;
+	const double* rhs;
+	const double* values;
+	const int32_t* column_indices;
+	const int32_t* row_sizes;
+};
+
 // Matrix implementation-specific routines that are properly
 // abstracted into the matrix data struct.
 
@@ -77,14 +142,18 @@ void accumulate_constraint_into_accumulation_target_vector(MATRIX_DATA *mat, int
 void calculate_target_virial_in_dense_vector(MATRIX_DATA* const mat, double *pressure_constraint_rhs_vector);
 void calculate_target_virial_in_accumulation_vector(MATRIX_DATA* const mat, double *pressure_constraint_rhs_vector);
 
-void calculate_target_force_dense_vector(int shift_i, int site_i, MATRIX_DATA* const mat, std::array<double, DIMENSION>* const &f);
-void calculate_target_force_accumulation_vector(int shift_i, int site_i, MATRIX_DATA* const mat, std::array<double, DIMENSION>* const &f);
+void calculate_target_force_dense_vector(int shift_i, int site_i, MATRIX_DATA* const mat, std::array<frame_real, DIMENSION>* const &f);
+void calculate_target_force_accumulation_vector(int shift_i, int site_i, MATRIX_DATA* const mat, std::array<frame_real, DIMENSION>* const &f);
 
 // Post-frame-block routines
 
 void convert_dense_fm_equation_to_normal_form_and_accumulate(MATRIX_DATA* const mat);
 void convert_dense_target_force_vector_to_normal_form_and_accumulate(MATRIX_DATA* const mat);
 void accumulate_accumulation_matrices(MATRIX_DATA* const mat);
+void factor_accumulation_block(const int rows, const int columns, double* const values, const int lda, double* const r_factor);
+void merge_accumulation_r_factors(const int columns, double* const r_factor, const double* const other_r_factor);
+void flush_accumulation_block_buffers(MATRIX_DATA* const mat);
+void finalize_grouped_accumulation(MATRIX_DATA* const mat);
 void solve_sparse_matrix(MATRIX_DATA* const mat);
 void convert_sparse_fm_equation_to_sparse_normal_form_and_accumulate(MATRIX_DATA* const mat);
 void convert_sparse_fm_equation_to_dense_normal_form_and_accumulate(MATRIX_DATA* const mat);
@@ -101,6 +170,7 @@ void regularize_vector_sparse_matrix(MATRIX_DATA* const mat, double* regularizat
 void regularize_sparse_matrix(MATRIX_DATA* const mat, csr_matrix* csr_matrix);
 void regularize_vector_sparse_matrix(MATRIX_DATA* const mat, csr_matrix* csr_normal_matrix, double* regularization_vector);
 void pardiso_solve(MATRIX_DATA* const mat, csr_matrix* const sparse_matrix, double* const dense_fm_normal_rhs_vector);
+void pardiso_solve(MATRIX_DATA* const mat, csr_matrix* const sparse_matrix, double* const dense_fm_normal_rhs_vector, double* const solution, const int n_threads);
 void solve_this_sparse_matrix(MATRIX_DATA* const mat);
 inline void create_sparse_normal_form_matrix(MATRIX_DATA* const mat, const int nnzmax, csr_matrix& csr_fm_matrix, csr_matrix& csr_normal_matrix, double* const dense_fm_rhs_vector, double* const dense_rhs_normal_vector);
 inline void create_dense_normal_form(MATRIX_DATA* const mat, const double frame_weight, dense_matrix* const dense_fm_matrix, dense_matrix* normal_matrix, double* const dense_fm_rhs_vector, double* dense_fm_normal_rhs_vector);
@@ -109,6 +179,9 @@ inline double calculate_sparse_residual(MATRIX_DATA* const mat, csr_matrix* spar
 inline void calculate_and_apply_dense_preconditioning(MATRIX_DATA* mat, dense_matrix* dense_fm_normal_matrix, double* h);
 inline void calculate_dense_svd(MATRIX_DATA* mat, int fm_matrix_columns, dense_matrix* dense_fm_normal_matrix, double* dense_fm_normal_rhs_vector, double* singular_values);
 inline void calculate_dense_svd(MATRIX_DATA* mat, int fm_matrix_columns, int fm_matrix_rows, dense_matrix* dense_fm_normal_matrix, double* dense_fm_normal_rhs_vector, double* singular_values);
+int find_independent_column_blocks(MATRIX_DATA* const mat, dense_matrix* const dense_fm_normal_matrix, std::vector<int> &block_columns, std::vector<int> &block_starts);
+void calculate_block_decoupled_dense_svd(MATRIX_DATA* mat, dense_matrix* dense_fm_normal_matrix, double* dense_fm_normal_rhs_vector, double* singular_values);
+int solve_dense_normal_equations_in_mixed_precision(MATRIX_DATA* const mat, dense_matrix* const dense_fm_normal_matrix, double* const dense_fm_normal_rhs_vector, const double* const h, double &condition_estimate, int &refinement_steps, double &relative_residual);
 
 // After-full-trajectory routines
 
@@ -116,10 +189,12 @@ void average_sparse_block_fm_solutions(MATRIX_DATA* const mat);
 void solve_sparse_fm_normal_equations(MATRIX_DATA* const mat);
 void solve_dense_fm_normal_equations(MATRIX_DATA* const mat);
 void solve_accumulation_form_fm_equations(MATRIX_DATA* const mat);
+void read_previous_iteration_solution(MATRIX_DATA* const mat, double* const x0);
 
 // Bootstrapping routines
 
 void convert_dense_fm_equation_to_normal_form_and_bootstrap(MATRIX_DATA* const mat);
+void flush_dense_bootstrapping_frame_buffer(MATRIX_DATA* const mat);
 void solve_sparse_matrix_for_bootstrap(MATRIX_DATA* const mat);
 void convert_sparse_fm_equation_to_sparse_normal_form_and_bootstrap(MATRIX_DATA* const mat);
 void accumulate_accumulation_matrices_for_bootstrap(MATRIX_DATA* const mat);
@@ -127,15 +202,36 @@ void convert_sparse_fm_equation_to_dense_normal_form_and_bootstrap(MATRIX_DATA*
 void average_sparse_bootstrapping_solutions(MATRIX_DATA* const mat);
 void solve_sparse_fm_bootstrapping_equations(MATRIX_DATA* const mat);
 void solve_dense_fm_normal_bootstrapping_equations(MATRIX_DATA* const mat);
+void add_effective_dense_regularization(MATRIX_DATA* const mat, dense_matrix* const normal_matrix);
+double* factor_master_dense_normal_matrix(MATRIX_DATA* const mat);
+int solve_dense_bootstrap_estimate_by_pcg(MATRIX_DATA* const mat, const double* master_factor, dense_matrix* const normal_matrix, double* const normal_rhs_vector, std::vector<double> &solution, double &relative_residual);
+void solve_dense_bootstrap_estimate_by_svd(MATRIX_DATA* const mat, const int k, double* const singular_values);
 void solve_accumulation_form_bootstrapping_equations(MATRIX_DATA* const mat);
 
 // Matrix-implementation-dependent functions for reading 
 // batches of FM matrices.
 
 int read_res_av_file(std::string* &filenames);
+FILE* begin_normal_equation_file(MATRIX_DATA* const mat, const char* filename, const int n_systems, NormalEquationFileHeader* const header);
+void write_normal_equation_data(FILE* const mat_out, const void* const data, const size_t size, NormalEquationFileHeader* const header);
+void finish_normal_equation_file(FILE* const mat_out, const char* filename, const NormalEquationFileHeader* const header);
+void write_normal_equation_file(MATRIX_DATA* const mat, const char* filename, const int n_systems, dense_matrix* const* const normal_matrices, double* const* const normal_rhs_vectors);
+void write_accumulation_equation_file(MATRIX_DATA* const mat, const char* filename, const int n_systems, dense_matrix* const* const accumulation_matrices);
+void write_block_average_file(MATRIX_DATA* const mat, const char* filename, const int n_systems, const double* const* const block_solution_sums, const double* const normalization_factors);
+void write_sparse_normal_equation_file(MATRIX_DATA* const mat, const char* filename, const csr_matrix* const normal_matrix, const double* const normal_rhs_vector);
+size_t get_fixed_system_values(const int matrix_type, const size_t n_columns);
+size_t get_sparse_normal_system(const char* const system_begin, const char* const data_end, const size_t n_columns, SparseNormalSystem* const system);
+void open_normal_equation_file(MATRIX_DATA* const mat, const char* filename, NormalEquationFile* const equation_file);
+void open_legacy_normal_equation_file(MATRIX_DATA* const mat, const char* filename, NormalEquationFile* const equation_file);
+void close_normal_equation_file(NormalEquationFile* const equation_file);
+void check_single_system(const char* filename, const NormalEquationFile* const equation_file);
+void total_batch_normalizations(MATRIX_DATA* const mat, const std::vector<NormalEquationFileHeader> &batch_headers);
+void read_iterative_reference_equations(MATRIX_DATA* const mat, double* const reference_rhs);
 void read_binary_dense_fm_matrix(MATRIX_DATA* const mat);
 void read_binary_accumulation_fm_matrix(MATRIX_DATA* const mat);
 void read_binary_sparse_fm_matrix(MATRIX_DATA* const mat);
+void check_sparse_normal_system(const char* filename, const SparseNormalSystem &system, const int n_columns);
+void read_binary_sparse_normal_fm_matrix(MATRIX_DATA* const mat);
 void read_regularization_vector(MATRIX_DATA* const mat);
 
 // Output functions.
@@ -157,7 +253,10 @@ MATRIX_DATA::MATRIX_DATA(ControlInputs* const control_input, CG_MODEL_DATA *cons
     output_style 					= control_input->output_style;
     output_normal_equations_rhs_flag= control_input->output_normal_equations_rhs_flag;
     output_solution_flag 			= control_input->output_solution_flag;
+    output_table_style				= control_input->output_table_style;
     rcond							= control_input->rcond;
+    block_decoupling_flag			= control_input->block_decoupling_flag;
+    mixed_precision_flag			= control_input->mixed_precision_flag;
     itnlim 							= control_input->itnlim;
 	num_sparse_threads 				= control_input->num_sparse_threads;
 	position_dimension 				= control_input->position_dimension;
@@ -171,6 +270,19 @@ MATRIX_DATA::MATRIX_DATA(ControlInputs* const control_input, CG_MODEL_DATA *cons
 	bootstrapping_flag 				= control_input->bootstrapping_flag;
 	bootstrapping_full_output_flag 	= control_input->bootstrapping_full_output_flag;
 	bootstrapping_num_estimates 	= control_input->bootstrapping_num_estimates;
+	bootstrapping_pcg_iterations	= control_input->bootstrapping_pcg_iterations;
+	bootstrapping_pcg_tolerance		= control_input->bootstrapping_pcg_tolerance;
+	bootstrapping_frame_group_size	= std::min(control_input->bootstrapping_frame_group_size, control_input->bootstrapping_num_estimates);
+	bootstrapping_buffered_frames	= 0;
+	bootstrapping_frame_normal_matrices = NULL;
+	bootstrapping_frame_normal_rhs_vectors = NULL;
+	bootstrapping_frame_weights = NULL;
+	
+	// Copy the accumulation reduction-tree grouping.
+	accumulation_tsqr_group_size	= control_input->accumulation_tsqr_group_size;
+	accumulation_buffered_blocks	= 0;
+	accumulation_block_buffers		= NULL;
+	accumulation_r_factor			= NULL;
 	
 	// Copy residual, regularization, and bayesian options.
 	regularization_style 			= control_input->regularization_style;
@@ -178,6 +290,7 @@ MATRIX_DATA::MATRIX_DATA(ControlInputs* const control_input, CG_MODEL_DATA *cons
 	bayesian_flag					= control_input->bayesian_flag;
 	bayesian_max_iter				= control_input->bayesian_max_iter;
     output_residual                 = control_input->output_residual;
+    fm_residual						= -1.0;
     force_sq_total					= 0.0;
  
     // Set blockwise composition weighting factors
@@ -190,6 +303,7 @@ MATRIX_DATA::MATRIX_DATA(ControlInputs* const control_input, CG_MODEL_DATA *cons
     // Set normalization based on the default frame weight of 1.0 now, but overwrite later if needed.
     // Will be changed in newfm.cpp if there is another value from read_frame_weights
     normalization = 1.0 /  (double) control_input->n_frames;
+    n_frames = control_input->n_frames;
     
     // Set accumulate_*_forces function pointers
     accumulate_matching_forces 				= accumulate_vector_matching_forces;
@@ -240,6 +354,10 @@ MATRIX_DATA::MATRIX_DATA(ControlInputs* const control_input, CG_MODEL_DATA *cons
 // Perform sanity checks on the new parameters 
 void matrix_sanity_checks(ControlInputs* const control_input) {
 
+    #ifdef _OPENMP
+    if (control_input->num_threads > 0) omp_set_num_threads(control_input->num_threads);
+    #endif
+
     #if _mkl_flag == 1
 	mkl_set_num_threads(control_input->num_sparse_threads);
 	#else 
@@ -260,6 +378,16 @@ void matrix_sanity_checks(ControlInputs* const control_input) {
         exit(EXIT_FAILURE);
     }
     
+    if ( (control_input->output_solution_flag < 0) || (control_input->output_solution_flag > 2) ) {
+        printf("Invalid output_solution_flag (%d)! Please use 0, 1, or 2.\n", control_input->output_solution_flag);
+        exit(EXIT_FAILURE);
+    }
+    
+    if ( (control_input->output_table_style < 0) || (control_input->output_table_style > 1) ) {
+        printf("Invalid output_table_style (%d)! Please use 0 or 1.\n", control_input->output_table_style);
+        exit(EXIT_FAILURE);
+    }
+    
     // Override a user's choice of block_size if it conflicts with use_statistical_reweighting flag
     if ( (control_input->use_statistical_reweighting == 1) && (control_input->frames_per_traj_block != 1) ) {
     	printf("Cannot use statistical reweighting with %d frames per trajectory block.\n", control_input->frames_per_traj_block);
@@ -273,6 +401,16 @@ void matrix_sanity_checks(ControlInputs* const control_input) {
 		exit(EXIT_FAILURE);
 	}
 	
+	if ( (control_input->bootstrapping_flag == 1) && (control_input->bootstrapping_frame_group_size < 1) ) {
+		printf("Please change the bootstrapping frame group size to a positive number and recheck your inputs before rerunning.\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	if ( ((MatrixType)(control_input->matrix_type) == kAccumulation) && (control_input->accumulation_tsqr_group_size < 1) ) {
+		printf("Please change the accumulation TSQR group size to a positive number and recheck your inputs before rerunning.\n");
+		exit(EXIT_FAILURE);
+	}
+	
 	if ( (control_input->volume_weighting_flag == 1) && (control_input->frames_per_traj_block != 1) ) {
 		printf("Cannot use volume weighting with %d frames per trajectory block.\n", control_input->bootstrapping_flag);
 		printf("Please change the block size to 1 and recheck your inputs before rerunning.\n");
@@ -362,6 +500,13 @@ void initialize_dense_matrix(MATRIX_DATA* const mat, ControlInputs* const contro
     
     if (control_input->bootstrapping_flag == 1) {
 		allocate_bootstrapping(mat, control_input, mat->fm_matrix_columns, mat->fm_matrix_columns);
+		
+		// Buffers for the normal equations of a group of frames and their weights in each estimate.
+		// The per-frame normal matrices only ever receive their upper triangles, so the lower triangles stay zero.
+		mat->bootstrapping_frame_normal_matrices = new double[(size_t)mat->bootstrapping_frame_group_size * mat->fm_matrix_columns * mat->fm_matrix_columns]();
+		mat->bootstrapping_frame_normal_rhs_vectors = new double[mat->bootstrapping_frame_group_size * mat->fm_matrix_columns]();
+		mat->bootstrapping_frame_weights = new double[mat->bootstrapping_frame_group_size * (mat->bootstrapping_num_estimates + 1)]();
+		printf("Size of bootstrapping frame buffer: %lu bytes \n", (size_t)mat->bootstrapping_frame_group_size * mat->fm_matrix_columns * mat->fm_matrix_columns * sizeof(double));
     }
 	mat->dense_fm_normal_matrix = new dense_matrix(mat->fm_matrix_columns , mat->fm_matrix_columns);
     mat->dense_fm_normal_rhs_vector = new double[mat->fm_matrix_columns]();
@@ -416,6 +561,16 @@ void initialize_accumulation_matrix(MATRIX_DATA* const mat, ControlInputs* const
 	mat->dense_fm_normal_rhs_vector = new double[mat->accumulation_matrix_columns]();
 
     mat->lapack_tau = new double[mat->accumulation_matrix_columns]();
+    mat->lapack_temp_workspace = NULL;
+    
+    // Grouped blocks are swapped in and out of the FM matrix, so each buffer has the same shape.
+    if (mat->accumulation_tsqr_group_size > 1) {
+    	mat->accumulation_block_buffers = new double*[mat->accumulation_tsqr_group_size];
+    	for (int i = 0; i < mat->accumulation_tsqr_group_size; i++) {
+    		mat->accumulation_block_buffers[i] = new double[(size_t)mat->accumulation_matrix_rows * mat->accumulation_matrix_columns]();
+    	}
+    	printf("Size of accumulation block buffers: %lu bytes \n", (size_t)mat->accumulation_tsqr_group_size * mat->accumulation_matrix_columns * mat->accumulation_matrix_rows * sizeof(double));
+    }
 
     // Initialized the matrix to zero.
     printf("Size of per-frame matrix: %lu bytes \n", mat->accumulation_matrix_columns * mat->accumulation_matrix_rows * sizeof(double));
@@ -779,19 +934,41 @@ void log_n_basis_functions(InteractionClassSpec &ispec) {
 void determine_matrix_columns_and_rows( MATRIX_DATA* const mat, CG_MODEL_DATA* const cg, int const frames_per_traj_block, int const pressure_constraint_flag) 
 {
 	// Determine total number of columns by adding up all the columns for all classes of interaction.
+	// Also record the first column of each force-matched interaction.
 	mat->fm_matrix_columns = 0;
 	mat->virial_constraint_rows = 0;
+	mat->interaction_column_starts.clear();
 	printf("Number of basis functions by interaction class:\n");
 	std::list<InteractionClassSpec*>::iterator iclass_iterator;
 	for(iclass_iterator=cg->iclass_list.begin(); iclass_iterator != cg->iclass_list.end(); iclass_iterator++) {
+		for (int i = 0; i < (*iclass_iterator)->n_to_force_match; i++) {
+			mat->interaction_column_starts.push_back(mat->fm_matrix_columns + (*iclass_iterator)->interaction_column_indices[i]);
+		}
 		mat->fm_matrix_columns += (*iclass_iterator)->get_num_basis_func();
 		log_n_basis_functions(**(iclass_iterator));
 	}    
 	
 	if (cg->three_body_nonbonded_interactions.class_subtype > 0) {
+		mat->interaction_column_starts.push_back(mat->fm_matrix_columns);
 		mat->fm_matrix_columns += cg->three_body_nonbonded_interactions.get_num_basis_func();
 		log_n_basis_functions(cg->three_body_nonbonded_interactions);
 	}
+	
+	// Checksum the force-matched interactions of each class and their columns so that
+	// stored normal equations can be checked against the model that reads them.
+	uint64_t layout_hash = kChecksumSeed;
+	for(iclass_iterator=cg->iclass_list.begin(); iclass_iterator != cg->iclass_list.end(); iclass_iterator++) {
+		int32_t class_description[2] = {(*iclass_iterator)->class_type, (*iclass_iterator)->n_to_force_match};
+		layout_hash = update_checksum(class_description, sizeof(class_description), layout_hash);
+		for (unsigned i = 0; i < (*iclass_iterator)->defined_to_matched_intrxn_index_map.size(); i++) {
+			if ((*iclass_iterator)->defined_to_matched_intrxn_index_map[i] == 0) continue;
+			int32_t interaction_hash = (*iclass_iterator)->get_hash_from_index(i);
+			layout_hash = update_checksum(&interaction_hash, sizeof(int32_t), layout_hash);
+		}
+		layout_hash = update_checksum((*iclass_iterator)->interaction_column_indices.data(), (*iclass_iterator)->interaction_column_indices.size() * sizeof(unsigned), layout_hash);
+	}
+	int32_t column_description[2] = {cg->three_body_nonbonded_interactions.class_subtype, mat->fm_matrix_columns};
+	mat->interaction_layout_hash = update_checksum(column_description, sizeof(column_description), layout_hash);
 
     // Determine the number of rows by seeing the number of particles and the number of auxiliary scalar restraints,
 	// then multiplying by the block size.
@@ -1167,7 +1344,7 @@ void calculate_target_virial_in_accumulation_vector(MATRIX_DATA* const mat, doub
     }
 }
 
-void add_target_force_from_trajectory(int shift_i, int site_i, MATRIX_DATA* const mat, std::array<double, DIMENSION>* const &f) 
+void add_target_force_from_trajectory(int shift_i, int site_i, MATRIX_DATA* const mat, std::array<frame_real, DIMENSION>* const &f) 
 {
     if (mat->matrix_type == kDense || mat->matrix_type == kSparse || mat->matrix_type == kSparseNormal || mat->matrix_type == kSparseSparse) {
         calculate_target_force_dense_vector(shift_i, site_i, mat, f);
@@ -1178,7 +1355,7 @@ void add_target_force_from_trajectory(int shift_i, int site_i, MATRIX_DATA* cons
 
 // Calculate the RHS vector for dense or sparse matrix calculations
 
-void calculate_target_force_dense_vector(int shift_i, int site_i, MATRIX_DATA* const mat, std::array<double, DIMENSION>* const &f)
+void calculate_target_force_dense_vector(int shift_i, int site_i, MATRIX_DATA* const mat, std::array<frame_real, DIMENSION>* const &f)
 {
     int tn = DIMENSION * (site_i + shift_i);
     double force_sq = 0.0;
@@ -1193,7 +1370,7 @@ void calculate_target_force_dense_vector(int shift_i, int site_i, MATRIX_DATA* c
 
 // Calculate the RHS vector for accumulation matrix calculations
 
-inline void calculate_target_force_accumulation_vector(int shift_i, int site_i, MATRIX_DATA* const mat, std::array<double, DIMENSION>* const &f)
+inline void calculate_target_force_accumulation_vector(int shift_i, int site_i, MATRIX_DATA* const mat, std::array<frame_real, DIMENSION>* const &f)
 {
 	mat->dense_fm_matrix->assign_vector(DIMENSION * (site_i + shift_i) + mat->accumulation_row_shift, mat->fm_matrix_columns, f[site_i]);
 }
@@ -1246,36 +1423,82 @@ void convert_dense_fm_equation_to_normal_form_and_accumulate(MATRIX_DATA* const
 
 void convert_dense_fm_equation_to_normal_form_and_bootstrap(MATRIX_DATA* const mat)
 {
-	int onei = 1.0;
-	int matrix_size = mat->fm_matrix_columns * mat->fm_matrix_columns;
-
-	// Create temp normal matrix and rhs vector.
-	dense_matrix* temp_normal_matrix = new dense_matrix(mat->fm_matrix_columns, mat->fm_matrix_columns);
-	double* temp_normal_rhs_vector = new double[mat->fm_matrix_columns]();
-
-	create_dense_normal_form(mat, 1.0, mat->dense_fm_matrix, temp_normal_matrix, mat->dense_fm_rhs_vector, temp_normal_rhs_vector);
+	int slot = mat->bootstrapping_buffered_frames;
+	int group_size = mat->bootstrapping_frame_group_size;
+	double oned = 1.0;
+	double zerod = 0.0;
 	
-	// Add the matrix to the master 
-	double frame_weight = mat->get_frame_weight() * mat->normalization;
-	cblas_daxpy( matrix_size, frame_weight, temp_normal_matrix->values, onei, mat->dense_fm_normal_matrix->values, onei);	    
-	cblas_daxpy( mat->fm_matrix_columns, frame_weight, temp_normal_rhs_vector, onei, mat->dense_fm_normal_rhs_vector, onei);
+	// Take the unweighted normal form of this frame's equations into the next free slot of the frame buffer.
+	// Only the upper triangle is written, as in create_dense_normal_form.
+	double* frame_normal_matrix = mat->bootstrapping_frame_normal_matrices + (size_t)slot * mat->fm_matrix_columns * mat->fm_matrix_columns;
+	double* frame_normal_rhs_vector = mat->bootstrapping_frame_normal_rhs_vectors + slot * mat->fm_matrix_columns;
+    #if _mkl_flag == 1
+	char upper = 'u';
+	char trans = 't';
+	dsyrk(&upper, &trans, &mat->fm_matrix_columns, &mat->fm_matrix_rows, &oned, mat->dense_fm_matrix->values, &mat->fm_matrix_rows, &zerod, frame_normal_matrix, &mat->fm_matrix_columns);
+	#else
+	cblas_dsyrk(CblasColMajor, CblasUpper, CblasTrans, mat->fm_matrix_columns, mat->fm_matrix_rows, oned, mat->dense_fm_matrix->values, mat->fm_matrix_rows, zerod, frame_normal_matrix, mat->fm_matrix_columns);
+	#endif
+	cblas_dgemv(CblasColMajor, CblasTrans, mat->fm_matrix_rows, mat->fm_matrix_columns, oned, mat->dense_fm_matrix->values, mat->fm_matrix_rows, mat->dense_fm_rhs_vector, 1, zerod, frame_normal_rhs_vector, 1);
 	
-	// Add the matrix and vector to each of the bootstrap samples based on the weight for that frame for each bootstrap estimate.
+	// Record the weight of this frame in the master and in each bootstrap estimate.
+	// traj_block_frame_index is the frame number processed since bootstrapping only allows a block size of 1.
+	mat->bootstrapping_frame_weights[slot] = mat->get_frame_weight() * mat->normalization;
 	for (int i = 0; i < mat->bootstrapping_num_estimates; i++) {
-		
-		// traj_block_frame_index is the frame number processed since bootstrapping only allows a block size of 1.
-		// Skip processing frame for this estimate if weight is 0.0.
-		frame_weight = mat->bootstrapping_weights[i][mat->trajectory_block_index];
-		if(frame_weight == 0.0) continue;
-		frame_weight *= mat->bootstrapping_normalization[i];
+		mat->bootstrapping_frame_weights[(i + 1) * group_size + slot] = mat->bootstrapping_weights[i][mat->trajectory_block_index] * mat->bootstrapping_normalization[i];
+	}
+	mat->bootstrapping_buffered_frames++;
+	
+	if (mat->bootstrapping_buffered_frames == group_size) flush_dense_bootstrapping_frame_buffer(mat);
+}
 
-	   cblas_daxpy( matrix_size, frame_weight, temp_normal_matrix->values, onei, mat->bootstrapping_dense_fm_normal_matrices[i]->values, onei);
+// Add the buffered frames' normal equations to the master and to every bootstrap estimate.
+// Each target receives the weighted sum of the whole group in one pass. The matrices are 
+// processed in chunks small enough that the group's slice of the buffer stays in cache 
+// while it is applied to all of the targets, so the buffer is only read from memory once
+// and each target is touched once per group instead of once per frame.
 
-	   cblas_daxpy( mat->fm_matrix_columns, frame_weight, temp_normal_rhs_vector, onei, mat->bootstrapping_dense_fm_normal_rhs_vectors[i], onei);
+void flush_dense_bootstrapping_frame_buffer(MATRIX_DATA* const mat)
+{
+	int n_frames = mat->bootstrapping_buffered_frames;
+	if (n_frames == 0) return;
+	int group_size = mat->bootstrapping_frame_group_size;
+	int n_targets = mat->bootstrapping_num_estimates + 1;
+	long matrix_size = (long)mat->fm_matrix_columns * mat->fm_matrix_columns;
+	const long chunk_size = 2048;
+	long n_chunks = (matrix_size + chunk_size - 1) / chunk_size;
+	
+	// Skip the estimates that do not sample any frame in this group.
+	std::vector<int> active_targets;
+	for (int k = 0; k < n_targets; k++) {
+		for (int g = 0; g < n_frames; g++) {
+			if (mat->bootstrapping_frame_weights[k * group_size + g] != 0.0) {
+				active_targets.push_back(k);
+				break;
+			}
+		}
+	}
+	
+	#pragma omp parallel for schedule(static)
+	for (long chunk = 0; chunk < n_chunks; chunk++) {
+		long offset = chunk * chunk_size;
+		int length = (int)std::min(chunk_size, matrix_size - offset);
+		for (unsigned a = 0; a < active_targets.size(); a++) {
+			int k = active_targets[a];
+			double* target = (k == 0) ? mat->dense_fm_normal_matrix->values : mat->bootstrapping_dense_fm_normal_matrices[k - 1]->values;
+			cblas_dgemv(CblasColMajor, CblasNoTrans, length, n_frames, 1.0, mat->bootstrapping_frame_normal_matrices + offset, (int)matrix_size, 
+						mat->bootstrapping_frame_weights + k * group_size, 1, 1.0, target + offset, 1);
+		}
+	}
+	
+	for (unsigned a = 0; a < active_targets.size(); a++) {
+		int k = active_targets[a];
+		double* target = (k == 0) ? mat->dense_fm_normal_rhs_vector : mat->bootstrapping_dense_fm_normal_rhs_vectors[k - 1];
+		cblas_dgemv(CblasColMajor, CblasNoTrans, mat->fm_matrix_columns, n_frames, 1.0, mat->bootstrapping_frame_normal_rhs_vectors, mat->fm_matrix_columns, 
+					mat->bootstrapping_frame_weights + k * group_size, 1, 1.0, target, 1);
 	}
 	
-	delete temp_normal_matrix;
-	delete [] temp_normal_rhs_vector;
+	mat->bootstrapping_buffered_frames = 0;
 }
 
 // As above, but ignoring the FM matrix.
@@ -1297,6 +1520,15 @@ void convert_dense_target_force_vector_to_normal_form_and_accumulate(MATRIX_DATA
 void accumulate_accumulation_matrices(MATRIX_DATA* const mat)
 {
     int info_in;
+    
+    // Set the block aside to be factored with the rest of its group.
+    // The FM matrix takes over an empty buffer for the next block.
+    if (mat->accumulation_tsqr_group_size > 1) {
+    	std::swap(mat->dense_fm_matrix->values, mat->accumulation_block_buffers[mat->accumulation_buffered_blocks]);
+    	mat->accumulation_buffered_blocks++;
+    	if (mat->accumulation_buffered_blocks == mat->accumulation_tsqr_group_size) flush_accumulation_block_buffers(mat);
+    	return;
+    }
 
     // Initialize the operation if this is the first block.
     if (mat->trajectory_block_index == 0) {
@@ -1313,6 +1545,200 @@ void accumulate_accumulation_matrices(MATRIX_DATA* const mat)
     }
 }
 
+// QR-factor a block of rows and copy its triangular factor into a packed columns x columns matrix.
+// A block with fewer rows than columns gives a trapezoidal factor, which is padded with zero rows.
+
+void factor_accumulation_block(const int rows, const int columns, double* const values, const int lda, double* const r_factor)
+{
+    int info_in;
+    int m = rows;
+    int n = columns;
+    int ld = lda;
+    int lwork = -1;
+    double work_size;
+    double* tau = new double[n]();
+    dgeqrf_(&m, &n, values, &ld, tau, &work_size, &lwork, &info_in);
+    lwork = (int)work_size;
+    double* work = new double[lwork];
+    dgeqrf_(&m, &n, values, &ld, tau, work, &lwork, &info_in);
+    delete [] work;
+    delete [] tau;
+    
+    for (int j = 0; j < columns; j++) {
+        for (int i = 0; i < columns; i++) {
+            r_factor[(size_t)j * columns + i] = ( (i <= j) && (i < rows) ) ? values[(size_t)j * lda + i] : 0.0;
+        }
+    }
+}
+
+// Replace r_factor with the triangular factor of r_factor stacked on other_r_factor.
+
+void merge_accumulation_r_factors(const int columns, double* const r_factor, const double* const other_r_factor)
+{
+    int stacked_rows = 2 * columns;
+    double* stacked = new double[(size_t)stacked_rows * columns]();
+    for (int j = 0; j < columns; j++) {
+        for (int i = 0; i <= j; i++) {
+            stacked[(size_t)j * stacked_rows + i] = r_factor[(size_t)j * columns + i];
+            stacked[(size_t)j * stacked_rows + columns + i] = other_r_factor[(size_t)j * columns + i];
+        }
+    }
+    factor_accumulation_block(stacked_rows, columns, stacked, stacked_rows, r_factor);
+    delete [] stacked;
+}
+
+// Combine a group of buffered frame blocks with the running triangular factor by tall-skinny QR:
+// every block is factored independently, then the factors (with the running factor first) are
+// merged pairwise up a binary reduction tree. The factorizations on each level are independent,
+// so they are done in parallel.
+
+void flush_accumulation_block_buffers(MATRIX_DATA* const mat)
+{
+    int n_blocks = mat->accumulation_buffered_blocks;
+    if (n_blocks == 0) return;
+    int columns = mat->accumulation_matrix_columns;
+    size_t r_size = (size_t)columns * columns;
+    int first_block = (mat->accumulation_r_factor != NULL) ? 1 : 0;
+    int n_factors = n_blocks + first_block;
+    double* r_factors = new double[n_factors * r_size];
+    if (first_block == 1) std::copy(mat->accumulation_r_factor, mat->accumulation_r_factor + r_size, r_factors);
+    
+    // Factor each block and clear its buffer for reuse.
+    #pragma omp parallel for schedule(dynamic)
+    for (int b = 0; b < n_blocks; b++) {
+        factor_accumulation_block(mat->fm_matrix_rows, columns, mat->accumulation_block_buffers[b], mat->accumulation_matrix_rows, r_factors + (b + first_block) * r_size);
+        std::fill(mat->accumulation_block_buffers[b], mat->accumulation_block_buffers[b] + (size_t)mat->accumulation_matrix_rows * columns, 0.0);
+    }
+    
+    // Merge the factors pairwise.
+    for (int stride = 1; stride < n_factors; stride *= 2) {
+        #pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < n_factors - stride; i += 2 * stride) {
+            merge_accumulation_r_factors(columns, r_factors + i * r_size, r_factors + (i + stride) * r_size);
+        }
+    }
+    
+    if (mat->accumulation_r_factor == NULL) mat->accumulation_r_factor = new double[r_size];
+    std::copy(r_factors, r_factors + r_size, mat->accumulation_r_factor);
+    delete [] r_factors;
+    mat->accumulation_buffered_blocks = 0;
+}
+
+// Factor any remaining blocks and place the final triangular factor in the FM matrix
+// in the same layout the ungrouped accumulation leaves it.
+
+void finalize_grouped_accumulation(MATRIX_DATA* const mat)
+{
+    flush_accumulation_block_buffers(mat);
+    int columns = mat->accumulation_matrix_columns;
+    std::fill(mat->dense_fm_matrix->values, mat->dense_fm_matrix->values + (size_t)mat->accumulation_matrix_rows * columns, 0.0);
+    for (int j = 0; (j < columns) && (mat->accumulation_r_factor != NULL); j++) {
+        for (int i = 0; i <= j; i++) {
+            mat->dense_fm_matrix->values[(size_t)j * mat->accumulation_matrix_rows + i] = mat->accumulation_r_factor[(size_t)j * columns + i];
+        }
+    }
+    
+    for (int i = 0; i < mat->accumulation_tsqr_group_size; i++) delete [] mat->accumulation_block_buffers[i];
+    delete [] mat->accumulation_block_buffers;
+    delete [] mat->accumulation_r_factor;
+    mat->accumulation_block_buffers = NULL;
+    mat->accumulation_r_factor = NULL;
+}
+
+//--------------------------------------------------------------------
+// Routines for combining the partial FM equations of trajectory parts
+//--------------------------------------------------------------------
+
+// Dense normal equations are passed in full and summed. Accumulation
+// matrices are passed as their triangular factor, and the factors of
+// all parts are merged as in the grouped accumulation.
+
+void write_partial_fm_equations(MATRIX_DATA* const mat, FILE* const partial_file)
+{
+    size_t n_written = 0;
+    size_t n_expected = 0;
+    if ( (mat->matrix_type == kDense) || (mat->matrix_type == kSparseNormal) ) {
+        size_t n_normal_elements = (size_t)mat->fm_matrix_columns * mat->fm_matrix_columns;
+        n_written += fwrite(mat->dense_fm_normal_matrix->values, sizeof(double), n_normal_elements, partial_file);
+        n_written += fwrite(mat->dense_fm_normal_rhs_vector, sizeof(double), mat->fm_matrix_columns, partial_file);
+        n_expected = n_normal_elements + mat->fm_matrix_columns;
+    } else if (mat->matrix_type == kAccumulation) {
+        if (mat->accumulation_tsqr_group_size > 1) finalize_grouped_accumulation(mat);
+        for (int j = 0; j < mat->accumulation_matrix_columns; j++) {
+            n_written += fwrite(&mat->dense_fm_matrix->values[(size_t)j * mat->accumulation_matrix_rows], sizeof(double), j + 1, partial_file);
+            n_expected += j + 1;
+        }
+    } else {
+        printf("Partial FM equations can only be combined for matrix_type 0, 2 and 3.\n");
+        exit(EXIT_FAILURE);
+    }
+    n_written += fwrite(&mat->force_sq_total, sizeof(double), 1, partial_file);
+    if ( (n_written != n_expected + 1) || (fflush(partial_file) != 0) ) {
+        printf("Could not pass on partial FM equations.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void add_partial_fm_equations(MATRIX_DATA* const mat, FILE* const partial_file, const int first_part)
+{
+    double force_sq_part;
+    if ( (mat->matrix_type == kDense) || (mat->matrix_type == kSparseNormal) ) {
+        size_t n_normal_elements = (size_t)mat->fm_matrix_columns * mat->fm_matrix_columns;
+        double* normal_part = new double[n_normal_elements];
+        double* rhs_part = new double[mat->fm_matrix_columns];
+        if ( (fread(normal_part, sizeof(double), n_normal_elements, partial_file) != n_normal_elements) ||
+             (fread(rhs_part, sizeof(double), mat->fm_matrix_columns, partial_file) != (size_t)mat->fm_matrix_columns) ) {
+            printf("Could not read partial FM equations.\n");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t k = 0; k < n_normal_elements; k++) mat->dense_fm_normal_matrix->values[k] += normal_part[k];
+        for (int k = 0; k < mat->fm_matrix_columns; k++) mat->dense_fm_normal_rhs_vector[k] += rhs_part[k];
+        delete [] normal_part;
+        delete [] rhs_part;
+    } else if (mat->matrix_type == kAccumulation) {
+        int columns = mat->accumulation_matrix_columns;
+        double* r_part = new double[(size_t)columns * columns]();
+        for (int j = 0; j < columns; j++) {
+            if (fread(&r_part[(size_t)j * columns], sizeof(double), j + 1, partial_file) != (size_t)(j + 1)) {
+                printf("Could not read partial FM equations.\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        
+        // Merge with the running factor, which is kept in the FM matrix and,
+        // for grouped accumulation, also where the solver expects it.
+        if (first_part == 0) {
+            double* r_factor = new double[(size_t)columns * columns]();
+            for (int j = 0; j < columns; j++) {
+                for (int i = 0; i <= j; i++) r_factor[(size_t)j * columns + i] = mat->dense_fm_matrix->values[(size_t)j * mat->accumulation_matrix_rows + i];
+            }
+            merge_accumulation_r_factors(columns, r_factor, r_part);
+            std::swap(r_factor, r_part);
+            delete [] r_factor;
+        }
+        std::fill(mat->dense_fm_matrix->values, mat->dense_fm_matrix->values + (size_t)mat->accumulation_matrix_rows * columns, 0.0);
+        for (int j = 0; j < columns; j++) {
+            for (int i = 0; i <= j; i++) {
+                mat->dense_fm_matrix->values[(size_t)j * mat->accumulation_matrix_rows + i] = r_part[(size_t)j * columns + i];
+            }
+        }
+        if (mat->accumulation_tsqr_group_size > 1) {
+            if (mat->accumulation_r_factor == NULL) mat->accumulation_r_factor = new double[(size_t)columns * columns];
+            std::copy(r_part, r_part + (size_t)columns * columns, mat->accumulation_r_factor);
+        }
+        delete [] r_part;
+    } else {
+        printf("Partial FM equations can only be combined for matrix_type 0, 2 and 3.\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    if (fread(&force_sq_part, sizeof(double), 1, partial_file) != 1) {
+        printf("Could not read partial FM equations.\n");
+        exit(EXIT_FAILURE);
+    }
+    mat->force_sq_total += force_sq_part;
+}
+
 void accumulate_accumulation_matrices_for_bootstrap(MATRIX_DATA* const mat)
 {
 	printf("Bootstrapping is not implemented for accumulation matrices.\n");
@@ -1965,6 +2391,14 @@ void regularize_vector_sparse_matrix(MATRIX_DATA* const mat, csr_matrix* csr_nor
 // Wrapper function for PARDISO sparse matrix solver
 
 void pardiso_solve(MATRIX_DATA* const mat, csr_matrix* const sparse_matrix, double* const dense_fm_normal_rhs_vector)
+{
+	pardiso_solve(mat, sparse_matrix, dense_fm_normal_rhs_vector, mat->block_fm_solution, mat->num_sparse_threads);
+}
+
+// The solution is written to the given vector so that independent systems can be solved concurrently,
+// each with its share of the sparse solver threads.
+
+void pardiso_solve(MATRIX_DATA* const mat, csr_matrix* const sparse_matrix, double* const dense_fm_normal_rhs_vector, double* const solution, const int n_threads)
 {
 	printf("Solving sparse normal matrix using PARDISO.\n");
 	fflush(stdout);
@@ -2002,7 +2436,7 @@ void pardiso_solve(MATRIX_DATA* const mat, csr_matrix* const sparse_matrix, doub
 	iparm[26] = 1;							// 1 is matrix-checker for debugging, 0 is off
 	iparm[27] = 0;							// Use double precision
 	iparm[30] = 0;							// Disable partial solve feature.
-	iparm[33] = mat->num_sparse_threads;	// set 34th entry equal to number of processors
+	iparm[33] = n_threads;					// set 34th entry equal to number of processors
 	iparm[34] = 0;							// Use 1-based indexing
 	iparm[35] = 0;							// Do not use Schur complement method.
 	iparm[36] = 0;							// CSR-format input
@@ -2015,7 +2449,7 @@ void pardiso_solve(MATRIX_DATA* const mat, csr_matrix* const sparse_matrix, doub
 	int phase = 13;
 	PARDISO(pt, &maxfct, &mnum, &mtype, &phase, &(mat->fm_matrix_columns), sparse_matrix->values,
 			sparse_matrix->row_sizes, sparse_matrix->column_indices,
-			perm, &nrhs, iparm, &msglvl, dense_fm_normal_rhs_vector, mat->block_fm_solution, &error);
+			perm, &nrhs, iparm, &msglvl, dense_fm_normal_rhs_vector, solution, &error);
     if(error != 0) {
     	printf ("\nError %d during PARDISO sparse matrix solving!\n", error);
     	exit(EXIT_FAILURE);
@@ -2024,7 +2458,7 @@ void pardiso_solve(MATRIX_DATA* const mat, csr_matrix* const sparse_matrix, doub
     phase = -1;
 	PARDISO(pt, &maxfct, &mnum, &mtype, &phase, &(mat->fm_matrix_columns), sparse_matrix->values,
 			sparse_matrix->row_sizes, sparse_matrix->column_indices,
-			perm, &nrhs, iparm, &msglvl, dense_fm_normal_rhs_vector, mat->block_fm_solution, &error);
+			perm, &nrhs, iparm, &msglvl, dense_fm_normal_rhs_vector, solution, &error);
     if(error != 0) {
     	printf ("\nError %d during PARDISO clean-up!\n", error);
     	exit(EXIT_FAILURE);
@@ -2400,6 +2834,286 @@ inline void calculate_dense_svd(MATRIX_DATA* mat, int fm_matrix_columns, int fm_
 	delete [] iwork;
 }  
 
+// Find the sets of columns of the normal matrix that are coupled to each other,
+// either through a nonzero off-diagonal element or by belonging to the same
+// interaction. Columns are returned grouped by block in block_columns, with
+// block k occupying block_columns[block_starts[k]] to block_columns[block_starts[k + 1] - 1].
+
+int find_independent_column_blocks(MATRIX_DATA* const mat, dense_matrix* const dense_fm_normal_matrix, std::vector<int> &block_columns, std::vector<int> &block_starts)
+{
+	int i, j, root_i, root_j;
+	int n_cols = mat->fm_matrix_columns;
+	std::vector<int> parent(n_cols);
+	for (i = 0; i < n_cols; i++) parent[i] = i;
+
+	// Each set of columns is labeled by its lowest column index.
+	auto find_root = [&parent](int k) {
+		while (parent[k] != k) {
+			parent[k] = parent[parent[k]];
+			k = parent[k];
+		}
+		return k;
+	};
+	auto join = [&parent, &find_root](const int k, const int l) {
+		int root_k = find_root(k);
+		int root_l = find_root(l);
+		if (root_k < root_l) parent[root_l] = root_k;
+		else if (root_l < root_k) parent[root_k] = root_l;
+	};
+
+	// Basis functions of a single interaction always stay together.
+	for (unsigned k = 0; k < mat->interaction_column_starts.size(); k++) {
+		int end = n_cols;
+		if (k + 1 < mat->interaction_column_starts.size()) end = mat->interaction_column_starts[k + 1];
+		for (i = mat->interaction_column_starts[k] + 1; i < end; i++) join(mat->interaction_column_starts[k], i);
+	}
+
+	// Any nonzero coupling between two columns places them in the same block.
+	for (j = 0; j < n_cols; j++) {
+		root_j = find_root(j);
+		for (i = 0; i < j; i++) {
+			if (dense_fm_normal_matrix->values[j * n_cols + i] != 0.0) {
+				root_i = find_root(i);
+				if (root_i != root_j) {
+					join(root_i, root_j);
+					root_j = find_root(j);
+				}
+			}
+		}
+	}
+
+	// Number the blocks in order of their first column and group the columns by block.
+	std::vector<int> block_index(n_cols, -1);
+	std::vector<int> block_sizes;
+	for (i = 0; i < n_cols; i++) {
+		root_i = find_root(i);
+		if (block_index[root_i] < 0) {
+			block_index[root_i] = block_sizes.size();
+			block_sizes.push_back(0);
+		}
+		block_sizes[block_index[root_i]]++;
+	}
+	
+	int n_blocks = block_sizes.size();
+	block_starts = std::vector<int>(n_blocks + 1, 0);
+	for (i = 0; i < n_blocks; i++) block_starts[i + 1] = block_starts[i] + block_sizes[i];
+	
+	block_columns = std::vector<int>(n_cols);
+	std::vector<int> block_fill(block_starts.begin(), block_starts.end() - 1);
+	for (i = 0; i < n_cols; i++) {
+		block_columns[block_fill[block_index[find_root(i)]]++] = i;
+	}
+	return n_blocks;
+}
+
+// Solve the preconditioned normal equations by singular value decomposition, 
+// treating each independent block of the matrix as a separate problem when
+// the matrix decomposes. The blocks are solved in parallel, but singular values
+// are still truncated relative to the largest singular value of the whole matrix
+// so that the result matches the single SVD of calculate_dense_svd.
+
+void calculate_block_decoupled_dense_svd(MATRIX_DATA* mat, dense_matrix* dense_fm_normal_matrix, double* dense_fm_normal_rhs_vector, double* singular_values)
+{
+	std::vector<int> block_columns;
+	std::vector<int> block_starts;
+	int n_blocks = 1;
+	if (mat->block_decoupling_flag == 1) {
+		n_blocks = find_independent_column_blocks(mat, dense_fm_normal_matrix, block_columns, block_starts);
+	}
+	if (n_blocks <= 1) {
+		calculate_dense_svd(mat, mat->fm_matrix_columns, dense_fm_normal_matrix, dense_fm_normal_rhs_vector, singular_values);
+		return;
+	}
+	printf("Normal equations decompose into %d independent blocks.\n", n_blocks); fflush(stdout);
+	
+	// Solve the largest blocks first for better load balance.
+	std::vector<int> block_order(n_blocks);
+	for (int b = 0; b < n_blocks; b++) block_order[b] = b;
+	std::stable_sort(block_order.begin(), block_order.end(), [&block_starts](const int a, const int b) {
+		return (block_starts[a + 1] - block_starts[a]) > (block_starts[b + 1] - block_starts[b]);
+	});
+	
+	// For each block, store V^T and U^T * rhs from its SVD; the singular values
+	// are stored in the section of singular_values belonging to that block.
+	std::vector<double*> block_vt(n_blocks);
+	std::vector<double*> block_utb(n_blocks);
+	int n_cols = mat->fm_matrix_columns;
+	
+	#pragma omp parallel for schedule(dynamic)
+	for (int ib = 0; ib < n_blocks; ib++) {
+		int b = block_order[ib];
+		int n_block = block_starts[b + 1] - block_starts[b];
+		const int* columns = &block_columns[block_starts[b]];
+		double* s = singular_values + block_starts[b];
+		
+		// Gather the block and its target vector.
+		double* a = new double[n_block * n_block];
+		double* rhs = new double[n_block];
+		for (int j = 0; j < n_block; j++) {
+			for (int i = 0; i < n_block; i++) {
+				a[j * n_block + i] = dense_fm_normal_matrix->values[columns[j] * n_cols + columns[i]];
+			}
+			rhs[j] = dense_fm_normal_rhs_vector[columns[j]];
+		}
+		
+		double* u = new double[n_block * n_block];
+		block_vt[b] = new double[n_block * n_block];
+		block_utb[b] = new double[n_block];
+		
+		// As for dgelsd, query for the workspace size first.
+		char jobu = 'S';
+		char jobvt = 'S';
+		int lapack_setup_flag = -1;
+		int info_in;
+		double workspace_query;
+		dgesvd_(&jobu, &jobvt, &n_block, &n_block, a, &n_block, s, u, &n_block, block_vt[b], &n_block, &workspace_query, &lapack_setup_flag, &info_in);
+		lapack_setup_flag = (int)(workspace_query);
+		double* lapack_temp_workspace = new double[lapack_setup_flag];
+		dgesvd_(&jobu, &jobvt, &n_block, &n_block, a, &n_block, s, u, &n_block, block_vt[b], &n_block, lapack_temp_workspace, &lapack_setup_flag, &info_in);
+		if (info_in != 0) {
+			printf("SVD of independent block %d failed to converge (info = %d).\n", b, info_in);
+			exit(EXIT_FAILURE);
+		}
+		
+		cblas_dgemv(CblasColMajor, CblasTrans, n_block, n_block, 1.0, u, n_block, rhs, 1, 0.0, block_utb[b], 1);
+		
+		delete [] lapack_temp_workspace;
+		delete [] u;
+		delete [] rhs;
+		delete [] a;
+	}
+	
+	// Singular values at or below rcond times the largest singular value are treated as zero;
+	// a nonpositive rcond means machine precision, as in dgelsd.
+	double max_singular_value = 0.0;
+	for (int i = 0; i < n_cols; i++) {
+		if (singular_values[i] > max_singular_value) max_singular_value = singular_values[i];
+	}
+	double relative_threshold = mat->rcond;
+	if (relative_threshold <= 0.0 || relative_threshold >= 1.0) relative_threshold = 0.5 * DBL_EPSILON;
+	double threshold = relative_threshold * max_singular_value;
+	
+	// Form each block's solution V * S^+ * U^T * rhs and scatter it into the target vector.
+	#pragma omp parallel for schedule(dynamic)
+	for (int ib = 0; ib < n_blocks; ib++) {
+		int b = block_order[ib];
+		int n_block = block_starts[b + 1] - block_starts[b];
+		const int* columns = &block_columns[block_starts[b]];
+		double* s = singular_values + block_starts[b];
+		double* x = new double[n_block];
+		
+		for (int i = 0; i < n_block; i++) {
+			if (s[i] > threshold) block_utb[b][i] /= s[i];
+			else block_utb[b][i] = 0.0;
+		}
+		cblas_dgemv(CblasColMajor, CblasTrans, n_block, n_block, 1.0, block_vt[b], n_block, block_utb[b], 1, 0.0, x, 1);
+		for (int i = 0; i < n_block; i++) dense_fm_normal_rhs_vector[columns[i]] = x[i];
+		
+		delete [] x;
+		delete [] block_vt[b];
+		delete [] block_utb[b];
+	}
+	
+	// Report the singular values in decreasing order, as for a single SVD.
+	std::sort(singular_values, singular_values + n_cols, std::greater<double>());
+}
+
+// Solve the preconditioned, regularized dense normal equations by a single-precision
+// Cholesky factorization refined in double precision, as in LAPACK's dsposv.
+// Preconditioning scales only the columns of the normal matrix, so the rows are
+// scaled by the same factors h to recover a symmetric system; its solution is the
+// same. The normal matrix is not modified. The solution replaces the target vector
+// only if the factorization exists, the estimated condition number is small enough
+// for refinement to converge (and for no singular value to fall below rcond), and
+// the refinement actually converges. Returns 1 on success and 0 if the caller should
+// fall back to SVD.
+
+int solve_dense_normal_equations_in_mixed_precision(MATRIX_DATA* const mat, dense_matrix* const dense_fm_normal_matrix, double* const dense_fm_normal_rhs_vector, const double* const h, double &condition_estimate, int &refinement_steps, double &relative_residual)
+{
+	const int max_refinement_steps = 30;
+	int n_cols = mat->fm_matrix_columns;
+	int onei = 1;
+	int info_in;
+	char upper = 'U';
+	condition_estimate = 0.0;
+	refinement_steps = 0;
+	relative_residual = 0.0;
+	
+	// Round the symmetrized matrix to single precision and take its 1-norm for the condition estimate.
+	float* factor = new float[n_cols * n_cols];
+	double matrix_norm = 0.0;
+	for (int j = 0; j < n_cols; j++) {
+		double column_sum = 0.0;
+		for (int i = 0; i < n_cols; i++) {
+			double element = h[i] * dense_fm_normal_matrix->values[j * n_cols + i];
+			factor[j * n_cols + i] = (float)element;
+			column_sum += fabs(element);
+		}
+		matrix_norm = std::max(matrix_norm, column_sum);
+	}
+	
+	spotrf_(&upper, &n_cols, factor, &n_cols, &info_in);
+	if (info_in != 0) {
+		printf("Single-precision Cholesky factorization failed at column %d.\n", info_in);
+		delete [] factor;
+		return 0;
+	}
+	
+	float single_norm = (float)matrix_norm;
+	float single_rcond;
+	float* work = new float[3 * n_cols];
+	int* iwork = new int[n_cols];
+	spocon_(&upper, &n_cols, factor, &n_cols, &single_norm, &single_rcond, work, iwork, &info_in);
+	delete [] work;
+	delete [] iwork;
+	condition_estimate = (single_rcond > 0.0) ? 1.0 / single_rcond : 1.0 / DBL_MIN;
+	
+	// Refinement contracts the error by roughly condition * single-precision epsilon per step.
+	// The rcond truncation of the SVD can only matter once the condition number reaches 1 / rcond.
+	if ( (condition_estimate * FLT_EPSILON > 1.0e-2) || ((mat->rcond > 0.0) && (mat->rcond * condition_estimate >= 1.0)) ) {
+		printf("Normal matrix is too poorly conditioned for a mixed-precision solution (condition estimate %le).\n", condition_estimate);
+		delete [] factor;
+		return 0;
+	}
+	
+	double* solution = new double[n_cols]();
+	double* residual = new double[n_cols];
+	float* correction = new float[n_cols];
+	double rhs_norm = cblas_dnrm2(n_cols, dense_fm_normal_rhs_vector, onei);
+	double tolerance = sqrt((double)n_cols) * DBL_EPSILON * matrix_norm;
+	int converged = 0;
+	
+	// The first pass solves from a zero solution; every later pass solves for a correction.
+	for (refinement_steps = 0; refinement_steps <= max_refinement_steps; refinement_steps++) {
+		std::copy(dense_fm_normal_rhs_vector, dense_fm_normal_rhs_vector + n_cols, residual);
+		cblas_dgemv(CblasColMajor, CblasNoTrans, n_cols, n_cols, -1.0, dense_fm_normal_matrix->values, n_cols, solution, onei, 1.0, residual, onei);
+		relative_residual = cblas_dnrm2(n_cols, residual, onei);
+		if (rhs_norm > 0.0) relative_residual /= rhs_norm;
+		for (int i = 0; i < n_cols; i++) residual[i] *= h[i];
+		if ( (refinement_steps > 0) && (cblas_dnrm2(n_cols, residual, onei) <= tolerance * cblas_dnrm2(n_cols, solution, onei)) ) {
+			converged = 1;
+			break;
+		}
+		if (refinement_steps == max_refinement_steps) break;
+		
+		for (int i = 0; i < n_cols; i++) correction[i] = (float)residual[i];
+		spotrs_(&upper, &n_cols, &onei, factor, &n_cols, correction, &n_cols, &info_in);
+		for (int i = 0; i < n_cols; i++) solution[i] += correction[i];
+	}
+	
+	if (converged == 1) {
+		std::copy(solution, solution + n_cols, dense_fm_normal_rhs_vector);
+	} else {
+		printf("Mixed-precision iterative refinement did not converge in %d steps.\n", max_refinement_steps);
+	}
+	
+	delete [] factor;
+	delete [] solution;
+	delete [] residual;
+	delete [] correction;
+	return converged;
+}
+
 //--------------------------------------------------------------------
 // End-of-trajectory routines
 //--------------------------------------------------------------------
@@ -2412,14 +3126,8 @@ void average_sparse_block_fm_solutions(MATRIX_DATA* const mat)
 {
     // Write a binary output of the coefficient vector if desired
     if (mat->output_style >= 2) {
-        FILE* mat_out;
-        double inv_norm = 1.0/mat->normalization;
-        mat_out = open_file("result.out", "wb");
-        fwrite(&mat->fm_solution[0], sizeof(double), mat->fm_matrix_columns, mat_out);
-        fwrite(&mat->fm_solution_normalization_factors[0], sizeof(double), mat->fm_matrix_columns, mat_out);
-        fwrite(&mat->force_sq_total, sizeof(double), 1, mat_out);
-        fwrite(&inv_norm, sizeof(double), 1, mat_out);
-        fclose(mat_out);
+        const double* block_solution_sum = &mat->fm_solution[0];
+        write_block_average_file(mat, "result.out", 1, &block_solution_sum, mat->fm_solution_normalization_factors);
         // If no other output was desired, terminate the program successfully.
         if (mat->output_style == 3) exit(EXIT_SUCCESS);
     }
@@ -2437,16 +3145,9 @@ void average_sparse_bootstrapping_solutions(MATRIX_DATA* const mat)
 {
     // Write a binary output of the coefficient vector if desired
     if (mat->output_style >= 2) {
-        FILE* mat_out;
-        mat_out = open_file("result.out", "wb");
-        for (int i = 0; i < mat->bootstrapping_num_estimates; i++) {
-	        fwrite(&mat->bootstrap_solutions[i][0], sizeof(double), mat->fm_matrix_columns, mat_out);
-    	    fwrite(&mat->fm_solution_normalization_factors[0], sizeof(double), mat->fm_matrix_columns, mat_out);
-        }
-        double inv_norm = 1.0/mat->normalization;
-        fwrite(&mat->force_sq_total, sizeof(double), 1, mat_out);
-        fwrite(&inv_norm, sizeof(double), 1, mat_out);
-        fclose(mat_out);
+        std::vector<const double*> block_solution_sums(mat->bootstrapping_num_estimates);
+        for (int i = 0; i < mat->bootstrapping_num_estimates; i++) block_solution_sums[i] = &mat->bootstrap_solutions[i][0];
+        write_block_average_file(mat, "result.out", mat->bootstrapping_num_estimates, block_solution_sums.data(), mat->fm_solution_normalization_factors);
         // If no other output was desired, terminate the program successfully.
         if (mat->output_style == 3) exit(EXIT_SUCCESS);
     }
@@ -2485,7 +3186,7 @@ void solve_sparse_fm_normal_equations(MATRIX_DATA* const mat)
    }
    
    
-   // Write sparse matrix as CSR and dense for parallel runs
+   // Write sparse matrix as CSR, as text and in binary, for parallel runs
 	if (mat->output_style >= 2) {
 	
 		FILE* csr_out = open_file("result_csr.out", "w");
@@ -2498,28 +3199,7 @@ void solve_sparse_fm_normal_equations(MATRIX_DATA* const mat)
         fprintf(csr_out, "%lf\n", 1.0/mat->normalization);
 		fclose(csr_out);
 	
-		FILE* mat_out = open_file("result.out", "wb");
-		int counter = 0;
-		int low, high;
-		double zero = 0.0;
-		for (int i = 0; i < mat->fm_matrix_columns; i++) {
-			low = mat->sparse_matrix->row_sizes[i] - 1;
-			high = mat->sparse_matrix->row_sizes[i + 1] - 1;
-			counter = low;
-			for (int j = 0; j <= i; j++){
-			  if( (j + 1) == mat->sparse_matrix->column_indices[counter]) {
-			 	  fwrite(&mat->sparse_matrix->values[counter], sizeof(double), 1, mat_out);
-				  counter++;
-			   } else {
-				  fwrite(&zero, sizeof(double), 1, mat_out);
-			   }
-			}
-		}
-		double inv_norm = 1.0/mat->normalization;
-		fwrite(&mat->dense_fm_normal_rhs_vector[0], sizeof(double), mat->fm_matrix_columns, mat_out);
-		fwrite(&mat->force_sq_total, sizeof(double), 1, mat_out);
-        fwrite(&inv_norm, sizeof(double), 1, mat_out);
-        fclose(mat_out);
+		write_sparse_normal_equation_file(mat, "result.out", mat->sparse_matrix, mat->dense_fm_normal_rhs_vector);
 		
 		// If no other output was desired, terminate the program successfully.
 		if (mat->output_style == 3) exit(EXIT_SUCCESS);
@@ -2566,6 +3246,7 @@ void solve_sparse_fm_normal_equations(MATRIX_DATA* const mat)
    if (mat->output_residual == 1) {
       double residual = calculate_sparse_residual(mat, mat->sparse_matrix, mat->dense_fm_normal_rhs_vector, mat->fm_solution, mat->normalization);
       printf("residual %lf\n", residual);
+      mat->fm_residual = residual;
    }
 
     // Calculate First Bayesian Estimates
@@ -2744,51 +3425,73 @@ void solve_sparse_fm_bootstrapping_equations(MATRIX_DATA* const mat)
 {
    // Solve for master
    solve_sparse_fm_normal_equations(mat);
-   mat->h = new double[mat->fm_matrix_columns]();
    
+   // Solve the estimates concurrently, each with its own preconditioner and PARDISO handle.
+   // The sparse solver threads are shared out between the estimates solved at once.
+   int n_concurrent_estimates = 1;
+   #ifdef _OPENMP
+   n_concurrent_estimates = std::max(1, std::min(mat->bootstrapping_num_estimates, omp_get_max_threads()));
+   #endif
+   int n_solver_threads = std::max(1, mat->num_sparse_threads / n_concurrent_estimates);
+   
+   #pragma omp parallel for schedule(dynamic)
    for (int i = 0; i < mat->bootstrapping_num_estimates; i++) {
+      double* h = new double[mat->fm_matrix_columns]();
+      csr_matrix* normal_matrix = mat->bootstrapping_sparse_fm_normal_matrices[i];
+      double* normal_rhs_vector = mat->bootstrapping_dense_fm_normal_rhs_vectors[i];
+      
+      // Keep unmodified copies for the residual.
+      csr_matrix* backup_normal_matrix = NULL;
+      double* backup_rhs = NULL;
+      if (mat->output_residual == 1) {
+         int matrix_size = normal_matrix->row_sizes[mat->fm_matrix_columns] - 1;
+         backup_normal_matrix = new csr_matrix(mat->fm_matrix_columns, mat->fm_matrix_columns, std::max(matrix_size, 1));
+         std::copy(normal_matrix->row_sizes, normal_matrix->row_sizes + mat->fm_matrix_columns + 1, backup_normal_matrix->row_sizes);
+         std::copy(normal_matrix->column_indices, normal_matrix->column_indices + matrix_size, backup_normal_matrix->column_indices);
+         std::copy(normal_matrix->values, normal_matrix->values + matrix_size, backup_normal_matrix->values);
+         backup_rhs = new double[mat->fm_matrix_columns];
+         std::copy(normal_rhs_vector, normal_rhs_vector + mat->fm_matrix_columns, backup_rhs);
+      }
 
       // Apply vector regularization if requested by user.
       if (mat->regularization_style == 2) {
 	     printf("Regularizing FM normal equations (estimate %d).\n", i);
-    	 fflush(stdout);
-    	 regularize_vector_sparse_matrix(mat, mat->bootstrapping_sparse_fm_normal_matrices[i], mat->regularization_vector);
+    	 regularize_vector_sparse_matrix(mat, normal_matrix, mat->regularization_vector);
        }
       
       // Precondition the normal equations by rescaling each of the columns by its 
       // root-of-sum-of-squares-of-elements value.
-      precondition_sparse_matrix(mat->fm_matrix_columns, mat->h, mat->bootstrapping_sparse_fm_normal_matrices[i]);
+      precondition_sparse_matrix(mat->fm_matrix_columns, h, normal_matrix);
 
       // Apply Tikhonov regularization if requested by user.
       if (mat->regularization_style == 1) {
 	     printf("Regularizing FM normal equations (estimate %d).\n", i);
-    	 fflush(stdout);
-    	 regularize_sparse_matrix(mat, mat->bootstrapping_sparse_fm_normal_matrices[i]);
+    	 regularize_sparse_matrix(mat, normal_matrix);
        }
   
       // Solve the normal equations using PARDISO
-	   printf("Computing solution of FM normal equations using sparse matrix operations.\n");
-
-	   mat->block_fm_solution = &(mat->bootstrap_solutions[i][0]);
+	   printf("Computing solution of FM normal equations using sparse matrix operations (estimate %d).\n", i);
 
-	   pardiso_solve(mat, mat->bootstrapping_sparse_fm_normal_matrices[i], mat->bootstrapping_dense_fm_normal_rhs_vectors[i]);
-       printf("Finished PARDISO solve.\n");
+	   pardiso_solve(mat, normal_matrix, normal_rhs_vector, &(mat->bootstrap_solutions[i][0]), n_solver_threads);
+       printf("Finished PARDISO solve (estimate %d).\n", i);
 	
-       // Free the CSR formatted normal matrix
-       delete mat->bootstrapping_sparse_fm_normal_matrices[i];
-       delete [] mat->bootstrapping_dense_fm_normal_rhs_vectors[i];
-       
       // Remove preconditioning effect from solution
       for (int k = 0; k < mat->fm_matrix_columns; k++) {
-         mat->bootstrap_solutions[i][k] *= mat->h[k];
+         mat->bootstrap_solutions[i][k] *= h[k];
       }
       
       if (mat->output_residual == 1) {
-         double residual = calculate_sparse_residual(mat, mat->bootstrapping_sparse_fm_normal_matrices[i], mat->bootstrapping_dense_fm_normal_rhs_vectors[i], mat->bootstrap_solutions[i], mat->normalization);
+         double residual = calculate_sparse_residual(mat, backup_normal_matrix, backup_rhs, mat->bootstrap_solutions[i], mat->bootstrapping_normalization[i]);
          printf("estimate %d: residual %lf\n", i, residual);
+         delete backup_normal_matrix;
+         delete [] backup_rhs;
       }
+      
+       // Free the CSR formatted normal matrix
+       delete normal_matrix;
+       delete [] normal_rhs_vector;
+       delete [] h;
    }
-   delete [] mat->h;
    delete [] mat->bootstrapping_sparse_fm_normal_matrices;
    delete [] mat->bootstrapping_dense_fm_normal_rhs_vectors;
 }
@@ -2818,21 +3521,8 @@ void solve_dense_fm_normal_equations(MATRIX_DATA* const mat)
     if (mat->iterative_calculation_flag == 1) {
         // Read in a stored normal form matrix and normal form target vector for
         // iterative calculations
-		double ttx;
-        FILE* mat_in = open_file("result.in", "rb");
         double* in_rhs = new double[mat->fm_matrix_columns];
-        
-        for (j = 0; j < mat->fm_matrix_columns; j++) {
-            for (k = 0; k <= j; k++) {
-                fread(&ttx, sizeof(double), 1, mat_in);
-                mat->dense_fm_normal_matrix->assign_scalar(k, j, ttx);
-            }
-        }
-        for (j = 0; j < mat->fm_matrix_columns; j++) {
-            fread(&ttx, sizeof(double), 1, mat_in);
-            in_rhs[j] = ttx;
-        }
-        fclose(mat_in);
+        read_iterative_reference_equations(mat, in_rhs);
         
         // The target for an iterative calculation is the difference between the targets
         // for this trajectory and the previous trajectory.
@@ -2843,15 +3533,7 @@ void solve_dense_fm_normal_equations(MATRIX_DATA* const mat)
     } else {
         // Save the results in binary form for parallel runs.
         if (mat->output_style >= 2) {
-            FILE* mat_out = open_file("result.out", "wb");
-            for (i = 0; i < mat->fm_matrix_columns; i++) {
-                fwrite(&mat->dense_fm_normal_matrix->values[i * mat->fm_matrix_columns], sizeof(double), i + 1, mat_out);
-            }
-       		double inv_norm = 1.0/mat->normalization;
-            fwrite(&mat->dense_fm_normal_rhs_vector[0], sizeof(double), mat->fm_matrix_columns, mat_out);
-        	fwrite(&mat->force_sq_total, sizeof(double), 1, mat_out);
-        	fwrite(&inv_norm, sizeof(double), 1, mat_out);
-            fclose(mat_out);
+            write_normal_equation_file(mat, "result.out", 1, &mat->dense_fm_normal_matrix, &mat->dense_fm_normal_rhs_vector);
             // If no other output was desired, terminate the program successfully.
             if (mat->output_style == 3) exit(EXIT_SUCCESS);
         }
@@ -2896,18 +3578,36 @@ void solve_dense_fm_normal_equations(MATRIX_DATA* const mat)
         }
     }
     
-    // Solve the normal equation by singular value decomposition using LAPACK routines.
-    printf("Computing singular value decomposition of preconditioned, regularized FM normal equations.\n"); fflush(stdout);
-    double* singular_values = new double[mat->fm_matrix_columns];
-    calculate_dense_svd(mat, mat->fm_matrix_columns, mat->dense_fm_normal_matrix, mat->dense_fm_normal_rhs_vector, singular_values);
+    // Try a single-precision factorization with double-precision refinement if requested.
+    int mixed_precision_solved = 0;
+    int refinement_steps;
+    double condition_estimate, mixed_precision_residual;
+    if (mat->mixed_precision_flag == 1) {
+    	printf("Solving preconditioned, regularized FM normal equations in mixed precision.\n"); fflush(stdout);
+    	mixed_precision_solved = solve_dense_normal_equations_in_mixed_precision(mat, mat->dense_fm_normal_matrix, mat->dense_fm_normal_rhs_vector, h, condition_estimate, refinement_steps, mixed_precision_residual);
+    	if (mixed_precision_solved == 0) printf("Falling back to singular value decomposition.\n");
+    }
     
-    // Print singular values.
-    printf("Printing FM singular values.\n"); fflush(stdout);
+    double* singular_values = new double[mat->fm_matrix_columns];
     FILE* solution_file = open_file("sol_info.out", "a");
-    fprintf(solution_file, "Singular vector:\n");
-    for (i = 0; i < mat->fm_matrix_columns; i++) {
-        fprintf(solution_file, "%le\n", singular_values[i]);
-    }
+    if (mixed_precision_solved == 1) {
+    	fprintf(solution_file, "Mixed-precision Cholesky solution:\n");
+    	fprintf(solution_file, "Condition estimate: %le\n", condition_estimate);
+    	fprintf(solution_file, "Refinement steps: %d\n", refinement_steps);
+    	fprintf(solution_file, "Relative residual: %le\n", mixed_precision_residual);
+    } else {
+	    // Solve the normal equation by singular value decomposition using LAPACK routines.
+	    printf("Computing singular value decomposition of preconditioned, regularized FM normal equations.\n"); fflush(stdout);
+	    calculate_block_decoupled_dense_svd(mat, mat->dense_fm_normal_matrix, mat->dense_fm_normal_rhs_vector, singular_values);
+	    
+	    // Print singular values.
+	    printf("Printing FM singular values.\n"); fflush(stdout);
+	    fprintf(solution_file, "Singular vector:\n");
+	    for (i = 0; i < mat->fm_matrix_columns; i++) {
+	        fprintf(solution_file, "%le\n", singular_values[i]);
+	    }
+	    mat->fm_singular_values = std::vector<double>(singular_values, singular_values + mat->fm_matrix_columns);
+	}
     fclose(solution_file);
     
     // Calculate the final results from the singular values.
@@ -2921,6 +3621,8 @@ void solve_dense_fm_normal_equations(MATRIX_DATA* const mat)
     if (mat->output_residual == 1) {
     	double residual = calculate_dense_residual(mat, backup_normal_matrix, backup_rhs, mat->fm_solution, mat->normalization);
 	    printf ("residual %lf\n", residual);
+	    mat->fm_residual = residual;
+	    if (mixed_precision_solved == 1) printf ("mixed-precision refinement relative residual %le after %d steps\n", mixed_precision_residual, refinement_steps);
     }
     
     // Calculate First Bayesian Estimates
@@ -3079,10 +3781,8 @@ void solve_dense_fm_normal_equations(MATRIX_DATA* const mat)
     if (mat->iterative_calculation_flag == 1) {
         printf("Adding iterative increment to previous solution.\n");
         fflush(stdout);
-        FILE* x_in = open_file("x.in", "r");
         double* x0 = new double[mat->fm_matrix_columns];
-        for (i = 0; i < mat->fm_matrix_columns; i++) fscanf(x_in, "%le", x0 + i);
-        fclose(x_in);
+        read_previous_iteration_solution(mat, x0);
         
         for (i = 0; i < mat->fm_matrix_columns; i++) mat->fm_solution[i] = mat->fm_solution[i] * mat->iteration_step_size + x0[i];
         delete [] x0;
@@ -3105,6 +3805,26 @@ void solve_dense_fm_normal_equations(MATRIX_DATA* const mat)
  	if(mat->matrix_type == 3) delete [] mat->dense_fm_normal_rhs_vector;
 }
   
+// Read the previous solution of an iterative calculation from x.in, which is
+// either a results bundle or a text list of the solution coefficients.
+
+void read_previous_iteration_solution(MATRIX_DATA* const mat, double* const x0)
+{
+	if (is_solution_bundle("x.in") == 1) {
+		SolutionBundle bundle;
+		read_solution_bundle("x.in", &bundle);
+		if (bundle.solution.size() != (size_t)mat->fm_matrix_columns) {
+			printf("The solution in x.in has %lu coefficients, but this calculation has %d!\n", (unsigned long)bundle.solution.size(), mat->fm_matrix_columns);
+			exit(EXIT_FAILURE);
+		}
+		for (int i = 0; i < mat->fm_matrix_columns; i++) x0[i] = bundle.solution[i];
+	} else {
+		FILE* x_in = open_file("x.in", "r");
+		for (int i = 0; i < mat->fm_matrix_columns; i++) fscanf(x_in, "%le", x0 + i);
+		fclose(x_in);
+	}
+}
+
 void solve_this_BI_equation(MATRIX_DATA* const mat, int &solution_counter)
 {
   // Output BI matrix and vector before solving.
@@ -3130,18 +3850,225 @@ void solve_this_BI_equation(MATRIX_DATA* const mat, int &solution_counter)
   delete mat->dense_fm_matrix;
 }
 
+// Add the diagonal that the regularization and preconditioning steps of 
+// solve_dense_fm_normal_equations effectively add to a symmetric normal matrix.
+// Scalar Tikhonov regularization after column preconditioning is equivalent to
+// adding the squared parameter times each column's norm to the diagonal.
+
+void add_effective_dense_regularization(MATRIX_DATA* const mat, dense_matrix* const normal_matrix)
+{
+	int i, j;
+	if (mat->regularization_style == 2) {
+		for (i = 0; i < mat->fm_matrix_columns; i++) {
+			normal_matrix->add_scalar(i, i, mat->regularization_vector[i]);
+		}
+	}
+	if (mat->regularization_style == 1) {
+		double squared_regularization_parameter = mat->tikhonov_regularization_param * mat->tikhonov_regularization_param;
+		for (j = 0; j < mat->fm_matrix_columns; j++) {
+			double column_norm = 0.0;
+			for (i = 0; i < mat->fm_matrix_columns; i++) {
+				column_norm += normal_matrix->get_scalar(i, j) * normal_matrix->get_scalar(i, j);
+			}
+			if (column_norm < VERYSMALL) column_norm = 1.0;
+			else column_norm = sqrt(column_norm);
+			normal_matrix->add_scalar(j, j, squared_regularization_parameter * column_norm);
+		}
+	}
+}
+
+// Cholesky-factor the regularized master normal matrix for use as a preconditioner
+// for the bootstrapping estimates. Columns that were never sampled are given a unit
+// diagonal. Returns NULL if the matrix is not numerically positive definite.
+
+double* factor_master_dense_normal_matrix(MATRIX_DATA* const mat)
+{
+	int i, j, info_in;
+	int n_cols = mat->fm_matrix_columns;
+	dense_matrix master_matrix(n_cols, n_cols);
+	for (j = 0; j < n_cols; j++) {
+		for (i = 0; i <= j; i++) {
+			master_matrix.assign_scalar(i, j, mat->dense_fm_normal_matrix->get_scalar(i, j));
+			master_matrix.assign_scalar(j, i, mat->dense_fm_normal_matrix->get_scalar(i, j));
+		}
+	}
+	add_effective_dense_regularization(mat, &master_matrix);
+	for (i = 0; i < n_cols; i++) {
+		if (master_matrix.get_scalar(i, i) == 0.0) master_matrix.assign_scalar(i, i, 1.0);
+	}
+	
+	char upper = 'U';
+	dpotrf_(&upper, &n_cols, master_matrix.values, &n_cols, &info_in);
+	if (info_in != 0) {
+		printf("Master normal matrix is not positive definite (info = %d); solving bootstrapping estimates directly.\n", info_in);
+		return NULL;
+	}
+	
+	// Take ownership of the factor so that it outlives master_matrix.
+	double* master_factor = master_matrix.values;
+	master_matrix.values = NULL;
+	return master_factor;
+}
+
+// Solve one bootstrapping estimate's normal equations by preconditioned conjugate
+// gradients starting from the master solution and preconditioned by the master
+// Cholesky factor. Since each estimate is a reweighting of the same frames, only a
+// few iterations are needed. Returns the number of iterations performed.
+
+int solve_dense_bootstrap_estimate_by_pcg(MATRIX_DATA* const mat, const double* master_factor, dense_matrix* const normal_matrix, double* const normal_rhs_vector, std::vector<double> &solution, double &relative_residual)
+{
+	int i, iteration;
+	int onei = 1;
+	int n_cols = mat->fm_matrix_columns;
+	char upper = 'U';
+	int info_in;
+	
+	add_effective_dense_regularization(mat, normal_matrix);
+	
+	double* r = new double[n_cols];
+	double* z = new double[n_cols];
+	double* p = new double[n_cols];
+	double* q = new double[n_cols];
+	
+	// Start from the master solution, but leave columns unsampled in this estimate at zero
+	// as the minimum-norm SVD solution would.
+	for (i = 0; i < n_cols; i++) {
+		if (normal_matrix->get_scalar(i, i) == 0.0) solution[i] = 0.0;
+		else solution[i] = mat->fm_solution[i];
+		r[i] = normal_rhs_vector[i];
+	}
+	cblas_dsymv(CblasColMajor, CblasUpper, n_cols, -1.0, normal_matrix->values, n_cols, &solution[0], onei, 1.0, r, onei);
+	
+	double rhs_norm = cblas_dnrm2(n_cols, normal_rhs_vector, onei);
+	if (rhs_norm < VERYSMALL) rhs_norm = 1.0;
+	relative_residual = cblas_dnrm2(n_cols, r, onei) / rhs_norm;
+	
+	for (i = 0; i < n_cols; i++) z[i] = r[i];
+	dpotrs_(&upper, &n_cols, &onei, const_cast<double*>(master_factor), &n_cols, z, &n_cols, &info_in);
+	for (i = 0; i < n_cols; i++) p[i] = z[i];
+	double rz = cblas_ddot(n_cols, r, onei, z, onei);
+	
+	for (iteration = 0; iteration < mat->bootstrapping_pcg_iterations; iteration++) {
+		if (relative_residual <= mat->bootstrapping_pcg_tolerance) break;
+		
+		cblas_dsymv(CblasColMajor, CblasUpper, n_cols, 1.0, normal_matrix->values, n_cols, p, onei, 0.0, q, onei);
+		double pq = cblas_ddot(n_cols, p, onei, q, onei);
+		if (pq <= 0.0) break;
+		double alpha = rz / pq;
+		cblas_daxpy(n_cols, alpha, p, onei, &solution[0], onei);
+		cblas_daxpy(n_cols, -alpha, q, onei, r, onei);
+		relative_residual = cblas_dnrm2(n_cols, r, onei) / rhs_norm;
+		
+		for (i = 0; i < n_cols; i++) z[i] = r[i];
+		dpotrs_(&upper, &n_cols, &onei, const_cast<double*>(master_factor), &n_cols, z, &n_cols, &info_in);
+		double rz_new = cblas_ddot(n_cols, r, onei, z, onei);
+		double beta = rz_new / rz;
+		rz = rz_new;
+		for (i = 0; i < n_cols; i++) p[i] = z[i] + beta * p[i];
+	}
+	
+	delete [] r;
+	delete [] z;
+	delete [] p;
+	delete [] q;
+	return iteration;
+}
+
+// Solve one bootstrapping estimate's normal equations by preconditioning and SVD
+// as for the master solution. All temporaries are local so that estimates can
+// be solved concurrently.
+
+void solve_dense_bootstrap_estimate_by_svd(MATRIX_DATA* const mat, const int k, double* const singular_values)
+{
+	int i, j;
+	int n_cols = mat->fm_matrix_columns;
+	dense_matrix* normal_matrix = mat->bootstrapping_dense_fm_normal_matrices[k];
+	double* normal_rhs_vector = mat->bootstrapping_dense_fm_normal_rhs_vectors[k];
+	double* h = new double[n_cols];
+	
+	// Keep unmodified copies for the residual.
+	dense_matrix* backup_normal_matrix = NULL;
+	double* backup_rhs = NULL;
+	if (mat->output_residual == 1) {
+		backup_normal_matrix = new dense_matrix(n_cols, n_cols);
+		backup_rhs = new double[n_cols];
+		for (j = 0; j < n_cols; j++) {
+			for (i = 0; i < n_cols; i++) backup_normal_matrix->assign_scalar(i, j, normal_matrix->get_scalar(i, j));
+			backup_rhs[j] = normal_rhs_vector[j];
+		}
+	}
+	
+	// Apply vector regularization.
+	if (mat->regularization_style == 2) {
+		printf("Regularizing FM normal equations (estimate %d).\n", k);
+		for (i = 0; i < n_cols; i++) {
+			normal_matrix->add_scalar(i, i, mat->regularization_vector[i]);
+		}
+	}
+
+	// Precondition the normal matrix using the root-of-sum-of-squares 
+	// of the columns as column scaling factors.
+	printf("Preconditioning FM normal equations (estimate %d).\n", k);
+	calculate_and_apply_dense_preconditioning(mat, normal_matrix, h);
+	
+	// Apply Tikhonov regularization.
+	if (mat->regularization_style == 1) {
+		printf("Regularizing FM normal equations (estimate %d).\n", k);
+		double squared_regularization_parameter = mat->tikhonov_regularization_param * mat->tikhonov_regularization_param;
+		for (i = 0; i < n_cols; i++) {
+			normal_matrix->add_scalar(i, i, squared_regularization_parameter);
+		}
+	}
+
+	// Solve the normal equation by singular value decomposition using LAPACK routines.
+	printf("Computing singular value decomposition of preconditioned, regularized FM normal equations (estimate %d).\n", k);
+	calculate_block_decoupled_dense_svd(mat, normal_matrix, normal_rhs_vector, singular_values);
+	
+	// Calculate the final results from the singular values.
+	for (i = 0; i < n_cols; i++) {
+		mat->bootstrap_solutions[k][i] = normal_rhs_vector[i] * h[i];
+	}
+	
+	// Calculate and output the residual if requested.
+	if (mat->output_residual == 1) {
+		double residual = calculate_dense_residual(mat, backup_normal_matrix, backup_rhs, mat->bootstrap_solutions[k], mat->bootstrapping_normalization[k]);
+		printf("Estimate %d: residual %lf\n", k, residual);
+		delete backup_normal_matrix;
+		delete [] backup_rhs;
+	}
+	delete [] h;
+}
+
 void solve_dense_fm_normal_bootstrapping_equations(MATRIX_DATA* const mat)
 {
     double* dd_bak;
-    double ttx;
     double* dd1;
     
+    // Add any frames still waiting in the bootstrapping frame buffer.
+    flush_dense_bootstrapping_frame_buffer(mat);
+    delete [] mat->bootstrapping_frame_normal_matrices;
+    delete [] mat->bootstrapping_frame_normal_rhs_vectors;
+    delete [] mat->bootstrapping_frame_weights;
+    mat->bootstrapping_frame_normal_matrices = NULL;
+    mat->bootstrapping_frame_normal_rhs_vectors = NULL;
+    mat->bootstrapping_frame_weights = NULL;
+    
+    // Factor the master normal matrix before it is consumed by the master solve
+    // if the estimates are to be found by refining the master solution.
+    double* master_factor = NULL;
+    if (mat->bootstrapping_pcg_iterations > 0) {
+    	if (mat->iterative_calculation_flag == 1) {
+    		printf("Cannot refine bootstrapping estimates from the master solution for iterative calculations; solving them directly.\n");
+    	} else {
+	    	printf("Factoring master FM normal equations.\n"); fflush(stdout);
+    		master_factor = factor_master_dense_normal_matrix(mat);
+    	}
+    }
+    
     // Solve for master
     solve_dense_fm_normal_equations(mat);
     
     //Solve for bootstrapping_estimates.
-    double* backup_rhs = new double[mat->fm_matrix_columns];
-    double* h = new double[mat->fm_matrix_columns];
     
     // Store a temporary backup of the normal form target vector if it
     // should be output later, since it could be changed in this routine 
@@ -3162,20 +4089,8 @@ void solve_dense_fm_normal_bootstrapping_equations(MATRIX_DATA* const mat)
         // Read in a stored normal form matrix and normal form target vector for
         // iterative calculations
         
-        FILE* mat_in = open_file("result.in", "rb");
         dd1 = new double[mat->fm_matrix_columns];
-        
-        for (int j = 0; j < mat->fm_matrix_columns; j++) {
-            for (int k = 0; k <= j; k++) {
-                fread(&ttx, sizeof(double), 1, mat_in);
-                mat->dense_fm_normal_matrix->assign_scalar(k, j, ttx);
-            }
-        }
-        for (int j = 0; j < mat->fm_matrix_columns; j++) {
-            fread(&ttx, sizeof(double), 1, mat_in);
-            dd1[j] = ttx;
-        }
-        fclose(mat_in);
+        read_iterative_reference_equations(mat, dd1);
         
         // The target for an iterative calculation is the difference between the targets
         // for this trajectory and the previous trajectory.
@@ -3187,22 +4102,19 @@ void solve_dense_fm_normal_bootstrapping_equations(MATRIX_DATA* const mat)
     
         // Save the results in binary form for parallel runs.
         if (mat->output_style >= 2) {
-            FILE* mat_out = open_file("result.out", "wb");
-            for (int j = 0; j < mat->bootstrapping_num_estimates; j++) {
-            	for (int i = 0; i < mat->fm_matrix_columns; i++) {
-                	fwrite(&mat->bootstrapping_dense_fm_normal_matrices[j]->values[i * mat->fm_matrix_columns], sizeof(double), i + 1, mat_out);
-            	}
-            	fwrite(&mat->bootstrapping_dense_fm_normal_rhs_vectors[j][0], sizeof(double), mat->fm_matrix_columns, mat_out);
-            }
-            double inv_norm = 1.0/mat->normalization;
-            fwrite(&mat->force_sq_total, sizeof(double), 1, mat_out);
-	        fwrite(&inv_norm, sizeof(double), 1, mat_out);
-            fclose(mat_out);
+            write_normal_equation_file(mat, "result.out", mat->bootstrapping_num_estimates, mat->bootstrapping_dense_fm_normal_matrices, mat->bootstrapping_dense_fm_normal_rhs_vectors);
             // If no other output was desired, terminate the program successfully.
             if (mat->output_style == 3) exit(EXIT_SUCCESS);
         }
     }
 	
+    // Solve the estimates concurrently. Each estimate works in place on its own
+    // normal matrix and target vector with its own temporaries.
+    std::vector<std::vector<double> > estimate_singular_values(mat->bootstrapping_num_estimates);
+    std::vector<int> estimate_pcg_iterations(mat->bootstrapping_num_estimates, 0);
+    std::vector<double> estimate_pcg_residuals(mat->bootstrapping_num_estimates, 0.0);
+    
+    #pragma omp parallel for schedule(dynamic)
     for (int k = 0; k < mat->bootstrapping_num_estimates; k++) {
     
 		// Copy over symmetric off-diagonal values in normal matrix;
@@ -3211,69 +4123,30 @@ void solve_dense_fm_normal_bootstrapping_equations(MATRIX_DATA* const mat)
     	        mat->bootstrapping_dense_fm_normal_matrices[k]->assign_scalar(i, j, mat->bootstrapping_dense_fm_normal_matrices[k]->get_scalar(j , i));
         	}
     	}
-
-    	// Apply vector regularization.
-    	if (mat->regularization_style == 2) {
-	    	printf("Regularizing FM normal equations (estimate %d).\n", k);
-    		fflush(stdout);
-        	for (int i = 0; i < mat->fm_matrix_columns; i++) {
-    	       	mat->bootstrapping_dense_fm_normal_matrices[k]->add_scalar(i, i, mat->regularization_vector[i]);
-        	}
-        }
-
-	    // Precondition the normal matrix using the root-of-sum-of-squares 
-    	// of the columns as column scaling factors.
-    	printf("Preconditioning FM normal equations (estimate %d).\n", k);
-    	fflush(stdout);
-		calculate_and_apply_dense_preconditioning(mat, mat->bootstrapping_dense_fm_normal_matrices[k], h);
-	    
-    	// Apply Tikhonov regularization.
-    	if (mat->regularization_style == 1) {
-	    	printf("Regularizing FM normal equations (estimate %d).\n", k);
-    		fflush(stdout);
-        	double squared_regularization_parameter;
-        	squared_regularization_parameter = mat->tikhonov_regularization_param * mat->tikhonov_regularization_param;
-        	for (int i = 0; i < mat->fm_matrix_columns; i++) {
-    	       	mat->bootstrapping_dense_fm_normal_matrices[k]->add_scalar(i, i, squared_regularization_parameter);
-        	}
-        }
-    
-    	// Solve the normal equation by singular value decomposition using LAPACK routines.
-    	printf("Computing singular value decomposition of preconditioned, regularized FM normal equations (estimate %d).\n", k);
-    	fflush(stdout);
-    	double* singular_values = new double[mat->fm_matrix_columns];
-    	calculate_dense_svd(mat, mat->fm_matrix_columns, mat->bootstrapping_dense_fm_normal_matrices[k], mat->bootstrapping_dense_fm_normal_rhs_vectors[k], singular_values);
-    	
-    	// Print singular values.
-    	printf("Printing FM singular values (estimate %d).\n", k);
-    	fflush(stdout);
-    	FILE* solution_file = open_file("sol_info.out", "a");
-    	fprintf(solution_file, "Singular vector %d:\n", k);
-    	for (int i = 0; i < mat->fm_matrix_columns; i++) {
-    	    fprintf(solution_file, "%le\n", singular_values[i]);
-    	}
-    	fclose(solution_file);
-   	
-   	   	// Clean up the heap-allocated temps.
-    	 delete [] singular_values;
-
-	    // Calculate the final results from the singular values.
-	    printf("Calculating final FM results (estimate %d).\n", k);
-    	fflush(stdout);    
-    	for (int i = 0; i < mat->fm_matrix_columns; i++) {
-    	    mat->bootstrap_solutions[k][i] = mat->bootstrapping_dense_fm_normal_rhs_vectors[k][i] * h[i];
-    	}
     	
-    	// Calculate and output the residual if requested.
-    	if (mat->output_residual == 1) {
-	    	double residual = calculate_dense_residual(mat, mat->bootstrapping_dense_fm_normal_matrices[k], backup_rhs, mat->bootstrap_solutions[k], mat->normalization);
-	    	printf ("Estimate %d: residual %lf\n", k, residual);
+    	if (master_factor != NULL) {
+    		printf("Refining master solution for FM normal equations (estimate %d).\n", k);
+    		estimate_pcg_iterations[k] = solve_dense_bootstrap_estimate_by_pcg(mat, master_factor, mat->bootstrapping_dense_fm_normal_matrices[k], mat->bootstrapping_dense_fm_normal_rhs_vectors[k], mat->bootstrap_solutions[k], estimate_pcg_residuals[k]);
+    	} else {
+    		estimate_singular_values[k] = std::vector<double>(mat->fm_matrix_columns);
+    		solve_dense_bootstrap_estimate_by_svd(mat, k, &estimate_singular_values[k][0]);
     	}
 	}
 	
-    // Free the preconditioner
-    delete [] h;
-    delete [] backup_rhs;
+	// Report singular values or refinement statistics in order of the estimates.
+   	FILE* solution_file = open_file("sol_info.out", "a");
+	for (int k = 0; k < mat->bootstrapping_num_estimates; k++) {
+		if (master_factor != NULL) {
+			fprintf(solution_file, "Estimate %d: %d PCG iterations, relative residual %le\n", k, estimate_pcg_iterations[k], estimate_pcg_residuals[k]);
+		} else {
+	    	fprintf(solution_file, "Singular vector %d:\n", k);
+	    	for (int i = 0; i < mat->fm_matrix_columns; i++) {
+	    	    fprintf(solution_file, "%le\n", estimate_singular_values[k][i]);
+	    	}
+	    }
+	}
+   	fclose(solution_file);
+	if (master_factor != NULL) delete [] master_factor;
     
     // For iterative calculations, the solution is a difference, so the computed quantity
     // should be added on to the previous solution value to obtain the final solution.
@@ -3281,10 +4154,7 @@ void solve_dense_fm_normal_bootstrapping_equations(MATRIX_DATA* const mat)
         printf("Adding iterative increment to previous solution.\n");
         fflush(stdout);
         double* x0 = new double[mat->fm_matrix_columns];
-        std::ifstream x_in;
-        check_and_open_in_stream(x_in, "x.in");
-        for (int i = 0; i < mat->fm_matrix_columns; i++) x_in >> x0[i];
-        x_in.close();
+        read_previous_iteration_solution(mat, x0);
         
         for (int i = 0; i < mat->fm_matrix_columns; i++) mat->fm_solution[i] = mat->fm_solution[i] * mat->iteration_step_size + x0[i];
         delete [] x0;
@@ -3313,6 +4183,8 @@ void solve_dense_fm_normal_bootstrapping_equations(MATRIX_DATA* const mat)
 void solve_accumulation_form_fm_equations(MATRIX_DATA* const mat)
 {
     int i, j;
+    if (mat->accumulation_tsqr_group_size > 1) finalize_grouped_accumulation(mat);
+    
     for (i = 0; i < mat->accumulation_matrix_columns; i++) {
         mat->dense_fm_normal_rhs_vector[i] = mat->dense_fm_matrix->values[mat->fm_matrix_columns * mat->accumulation_matrix_rows + i];
     }
@@ -3320,21 +4192,12 @@ void solve_accumulation_form_fm_equations(MATRIX_DATA* const mat)
     
     // Save the results in binary form and exit if no other output is desired.
     if (mat->output_style >= 2) {
-        FILE* mat_out;
-        mat_out = open_file("final_equations.out", "wb");
-        for (i = 0; i < mat->fm_matrix_columns; i++) {
-            fwrite(&mat->dense_fm_matrix->values[i * mat->accumulation_matrix_rows], sizeof(double), i + 1, mat_out);
-        }
-        fwrite(&mat->dense_fm_normal_rhs_vector[0], sizeof(double), mat->accumulation_matrix_columns, mat_out);
-        double inv_norm = 1.0/mat->normalization;
-        fwrite(&mat->force_sq_total, sizeof(double), 1, mat_out);
-        fwrite(&inv_norm, sizeof(double), 1, mat_out);
-        fclose(mat_out);
+        write_accumulation_equation_file(mat, "final_equations.out", 1, &mat->dense_fm_matrix);
         
         if (mat->output_style == 3) exit(EXIT_SUCCESS);
     }
     
-    double resid = mat->dense_fm_matrix->values[(mat->accumulation_matrix_columns - 1) * mat->accumulation_matrix_rows + mat->accumulation_matrix_columns - 1];
+    double resid = fabs(mat->dense_fm_matrix->values[(mat->accumulation_matrix_columns - 1) * mat->accumulation_matrix_rows + mat->accumulation_matrix_columns - 1]);
     
     // Precondition the accumulation matrix using the root-of-sum-of-squares of the columns
     // as column scaling factors.
@@ -3383,6 +4246,7 @@ void solve_accumulation_form_fm_equations(MATRIX_DATA* const mat)
     for (i = 0; i < mat->fm_matrix_columns; i++) {
         fprintf(solution_file, "%le\n", singular_values[i]);
     }
+    mat->fm_singular_values = std::vector<double>(singular_values, singular_values + mat->fm_matrix_columns);
     
     // Calculate final results from the singular value decomposition.
     mat->fm_solution = std::vector<double>(mat->fm_matrix_columns);
@@ -3418,19 +4282,8 @@ void solve_accumulation_form_bootstrapping_equations(MATRIX_DATA* const mat)
 	}
 	    
    	if (mat->output_style >= 2) {
-       	FILE* mat_out = open_file("final_equations.out", "wb");
-	
-		for (k = 0; k < mat->bootstrapping_num_estimates; k++) {
-			// Save the results in binary form and exit if no other output is desired.
-    	   	for (i = 0; i < mat->fm_matrix_columns; i++) {
-        	   	fwrite(&mat->bootstrapping_dense_fm_normal_matrices[k]->values[i * mat->accumulation_matrix_rows], sizeof(double), i + 1, mat_out);
-       	 	}
-        	fwrite(&mat->bootstrapping_dense_fm_normal_rhs_vectors[k][0], sizeof(double), mat->accumulation_matrix_columns, mat_out);        
-    	}    
-     	double inv_norm = 1.0/mat->normalization;
-        fwrite(&mat->force_sq_total, sizeof(double), 1, mat_out);
-        fwrite(&inv_norm, sizeof(double), 1, mat_out);
-    	fclose(mat_out);
+		// Save the results in binary form and exit if no other output is desired.
+       	write_accumulation_equation_file(mat, "final_equations.out", mat->bootstrapping_num_estimates, mat->bootstrapping_dense_fm_normal_matrices);
 	    if (mat->output_style == 3) exit(EXIT_SUCCESS);
 	}
     	
@@ -3518,9 +4371,12 @@ void read_binary_matrix(MATRIX_DATA* const mat)
     case kDense: case kSparseNormal:
         read_binary_dense_fm_matrix(mat);
         break;
-    case kSparse: case kSparseSparse:
+    case kSparse:
         read_binary_sparse_fm_matrix(mat);
         break;
+    case kSparseSparse:
+        read_binary_sparse_normal_fm_matrix(mat);
+        break;
     case kAccumulation:
         read_binary_accumulation_fm_matrix(mat);
         break;
@@ -3550,75 +4406,387 @@ int read_res_av_file(std::string* &filenames)
 	return n_batch;
 }
 
+// Start a normal-equation file with a header describing the calculation.
+// The header is written again by finish_normal_equation_file once the
+// checksum of the data is known.
+
+FILE* begin_normal_equation_file(MATRIX_DATA* const mat, const char* filename, const int n_systems, NormalEquationFileHeader* const header)
+{
+	memset(header, 0, sizeof(NormalEquationFileHeader));
+	memcpy(header->tag, "MSCGNEQS", 8);
+	header->version = 1;
+	header->matrix_type = mat->matrix_type;
+	header->n_columns = mat->fm_matrix_columns;
+	header->n_systems = n_systems;
+	header->n_frames = mat->n_frames;
+	header->frame_weight_total = 1.0 / mat->normalization;
+	header->force_sq_total = mat->force_sq_total;
+	header->interaction_layout_hash = mat->interaction_layout_hash;
+	header->byte_order_mark = 0x0102030405060708ULL;
+	header->checksum = kChecksumSeed;
+
+	FILE* mat_out = open_file(filename, "wb");
+	fwrite(header, sizeof(NormalEquationFileHeader), 1, mat_out);
+	return mat_out;
+}
+
+void write_normal_equation_data(FILE* const mat_out, const void* const data, const size_t size, NormalEquationFileHeader* const header)
+{
+	header->checksum = update_checksum(data, size, header->checksum);
+	fwrite(data, 1, size, mat_out);
+}
+
+void finish_normal_equation_file(FILE* const mat_out, const char* filename, const NormalEquationFileHeader* const header)
+{
+	fseek(mat_out, 0, SEEK_SET);
+	fwrite(header, sizeof(NormalEquationFileHeader), 1, mat_out);
+	if (ferror(mat_out) != 0) {
+		printf("Problem writing normal-equation file %s\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	fclose(mat_out);
+}
+
+// Write the normal equations of one system, or of every bootstrapping
+// estimate, with a header describing the calculation.
+
+void write_normal_equation_file(MATRIX_DATA* const mat, const char* filename, const int n_systems, dense_matrix* const* const normal_matrices, double* const* const normal_rhs_vectors)
+{
+	int n_columns = mat->fm_matrix_columns;
+	size_t packed_size = (size_t)n_columns * (n_columns + 1) / 2;
+	std::vector<double> packed_system(packed_size + n_columns);
+
+	NormalEquationFileHeader header;
+	FILE* mat_out = begin_normal_equation_file(mat, filename, n_systems, &header);
+	for (int s = 0; s < n_systems; s++) {
+		for (int j = 0; j < n_columns; j++) {
+			memcpy(&packed_system[(size_t)j * (j + 1) / 2], &normal_matrices[s]->values[(size_t)j * n_columns], (j + 1) * sizeof(double));
+		}
+		memcpy(&packed_system[packed_size], normal_rhs_vectors[s], n_columns * sizeof(double));
+		write_normal_equation_data(mat_out, packed_system.data(), packed_system.size() * sizeof(double), &header);
+	}
+	finish_normal_equation_file(mat_out, filename, &header);
+}
+
+// Write the triangular factor of each accumulation matrix, including its
+// target column.
+
+void write_accumulation_equation_file(MATRIX_DATA* const mat, const char* filename, const int n_systems, dense_matrix* const* const accumulation_matrices)
+{
+	NormalEquationFileHeader header;
+	FILE* mat_out = begin_normal_equation_file(mat, filename, n_systems, &header);
+	for (int s = 0; s < n_systems; s++) {
+		for (int j = 0; j < mat->accumulation_matrix_columns; j++) {
+			write_normal_equation_data(mat_out, &accumulation_matrices[s]->values[(size_t)j * mat->accumulation_matrix_rows], (j + 1) * sizeof(double), &header);
+		}
+	}
+	finish_normal_equation_file(mat_out, filename, &header);
+}
+
+// Write the summed block solutions of a sparse calculation, each with the
+// normalization factors of the unknowns.
+
+void write_block_average_file(MATRIX_DATA* const mat, const char* filename, const int n_systems, const double* const* const block_solution_sums, const double* const normalization_factors)
+{
+	NormalEquationFileHeader header;
+	FILE* mat_out = begin_normal_equation_file(mat, filename, n_systems, &header);
+	for (int s = 0; s < n_systems; s++) {
+		write_normal_equation_data(mat_out, block_solution_sums[s], mat->fm_matrix_columns * sizeof(double), &header);
+		write_normal_equation_data(mat_out, normalization_factors, mat->fm_matrix_columns * sizeof(double), &header);
+	}
+	finish_normal_equation_file(mat_out, filename, &header);
+}
+
+// Write a sparse normal matrix in its CSR form with its normal target vector.
+
+void write_sparse_normal_equation_file(MATRIX_DATA* const mat, const char* filename, const csr_matrix* const normal_matrix, const double* const normal_rhs_vector)
+{
+	int n_columns = mat->fm_matrix_columns;
+	uint64_t n_entries = normal_matrix->row_sizes[n_columns] - 1;
+	std::vector<int32_t> indices(normal_matrix->column_indices, normal_matrix->column_indices + n_entries);
+	indices.insert(indices.end(), normal_matrix->row_sizes, normal_matrix->row_sizes + n_columns + 1);
+	if (indices.size() % 2 != 0) indices.push_back(0);
+
+	NormalEquationFileHeader header;
+	FILE* mat_out = begin_normal_equation_file(mat, filename, 1, &header);
+	write_normal_equation_data(mat_out, &n_entries, sizeof(uint64_t), &header);
+	write_normal_equation_data(mat_out, normal_rhs_vector, n_columns * sizeof(double), &header);
+	write_normal_equation_data(mat_out, normal_matrix->values, n_entries * sizeof(double), &header);
+	write_normal_equation_data(mat_out, indices.data(), indices.size() * sizeof(int32_t), &header);
+	finish_normal_equation_file(mat_out, filename, &header);
+}
+
+// Number of values in each stored system of a matrix type with
+// fixed-size systems, or 0 for sparse-sparse systems.
+
+size_t get_fixed_system_values(const int matrix_type, const size_t n_columns)
+{
+	switch (matrix_type) {
+	case kDense: case kSparseNormal:
+		return n_columns * (n_columns + 1) / 2 + n_columns;
+	case kAccumulation:
+		return (n_columns + 1) * (n_columns + 2) / 2;
+	case kSparse:
+		return 2 * n_columns;
+	default:
+		return 0;
+	}
+}
+
+// Find the arrays of the sparse-sparse system starting at system_begin.
+// Returns the size of the system in bytes, or 0 if it would run past data_end.
+
+size_t get_sparse_normal_system(const char* const system_begin, const char* const data_end, const size_t n_columns, SparseNormalSystem* const system)
+{
+	if ((size_t)(data_end - system_begin) < sizeof(uint64_t)) return 0;
+	memcpy(&system->n_entries, system_begin, sizeof(uint64_t));
+	size_t n_indices = system->n_entries + n_columns + 1;
+	size_t system_size = sizeof(uint64_t) + (n_columns + system->n_entries) * sizeof(double) + (n_indices + n_indices % 2) * sizeof(int32_t);
+	if ( (system->n_entries > n_columns * n_columns) || ((size_t)(data_end - system_begin) < system_size) ) return 0;
+
+	system->rhs = (const double*)(system_begin + sizeof(uint64_t));
+	system->values = system->rhs + n_columns;
+	system->column_indices = (const int32_t*)(system->values + system->n_entries);
+	system->row_sizes = system->column_indices + system->n_entries;
+	return system_size;
+}
+
+// Map a normal-equation file and check that it matches this calculation.
+
+void open_normal_equation_file(MATRIX_DATA* const mat, const char* filename, NormalEquationFile* const equation_file)
+{
+	struct stat file_status;
+	int file_descriptor = open(filename, O_RDONLY);
+	if ( (file_descriptor < 0) || (fstat(file_descriptor, &file_status) != 0) ) {
+		printf("Problem opening normal-equation file %s\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	equation_file->map_size = (size_t)file_status.st_size;
+	if (equation_file->map_size < sizeof(NormalEquationFileHeader)) {
+		printf("Normal-equation file %s is too short to hold a header.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+
+	// The mapping stays valid after the file is closed, so many files can be
+	// mapped at once.
+	void* map = mmap(NULL, equation_file->map_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+	close(file_descriptor);
+	if (map == MAP_FAILED) {
+		printf("Problem memory-mapping normal-equation file %s\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	madvise(map, equation_file->map_size, MADV_SEQUENTIAL);
+	equation_file->map_begin = (const char*)map;
+
+	NormalEquationFileHeader &header = equation_file->header;
+	memcpy(&header, equation_file->map_begin, sizeof(NormalEquationFileHeader));
+	if (memcmp(header.tag, "MSCGNEQS", 8) != 0) {
+		open_legacy_normal_equation_file(mat, filename, equation_file);
+		return;
+	}
+	if (header.version != 1) {
+		printf("File %s is not a normal-equation file of a supported version.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	if (header.byte_order_mark != 0x0102030405060708ULL) {
+		printf("Normal-equation file %s was written with a different byte order.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+
+	// Dense and sparse-dense normal calculations store the same equations.
+	int file_matrix_type = (header.matrix_type == kSparseNormal) ? kDense : header.matrix_type;
+	int this_matrix_type = (mat->matrix_type == kSparseNormal) ? kDense : mat->matrix_type;
+	if (file_matrix_type != this_matrix_type) {
+		printf("Normal-equation file %s was written with matrix_type %d, which does not match matrix_type %d.\n", filename, header.matrix_type, mat->matrix_type);
+		exit(EXIT_FAILURE);
+	}
+	if ( (header.n_columns != (uint64_t)mat->fm_matrix_columns) || (header.interaction_layout_hash != mat->interaction_layout_hash) ) {
+		printf("Normal-equation file %s was written for different interactions or basis sets (%lu columns instead of %d).\n", filename, (unsigned long)header.n_columns, mat->fm_matrix_columns);
+		exit(EXIT_FAILURE);
+	}
+
+	// Sparse-sparse systems record their own sizes.
+	equation_file->systems = (const double*)(equation_file->map_begin + sizeof(NormalEquationFileHeader));
+	const char* data_end = equation_file->map_begin + equation_file->map_size;
+	size_t data_size = header.n_systems * get_fixed_system_values(header.matrix_type, header.n_columns) * sizeof(double);
+	if (header.matrix_type == kSparseSparse) {
+		SparseNormalSystem system;
+		data_size = 0;
+		for (uint64_t s = 0; s < header.n_systems; s++) {
+			size_t system_size = get_sparse_normal_system((const char*)equation_file->systems + data_size, data_end, header.n_columns, &system);
+			if (system_size == 0) break;
+			data_size += system_size;
+		}
+	}
+	if (equation_file->map_size != sizeof(NormalEquationFileHeader) + data_size) {
+		printf("Normal-equation file %s is truncated or does not match its header.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	if (update_checksum(equation_file->systems, data_size, kChecksumSeed) != header.checksum) {
+		printf("Normal-equation file %s is corrupt; its checksum does not match.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+}
+
+// Files from older versions hold one system with no header, followed by
+// force_sq_total and the inverse normalization or, in the oldest versions,
+// by nothing at all; such batches are weighted equally. They are recognized
+// by their size alone and cannot be checked.
+
+void open_legacy_normal_equation_file(MATRIX_DATA* const mat, const char* filename, NormalEquationFile* const equation_file)
+{
+	size_t n_equation_values = get_fixed_system_values(mat->matrix_type, mat->fm_matrix_columns);
+	size_t n_values = equation_file->map_size / sizeof(double);
+	if ( (n_equation_values == 0) || (equation_file->map_size % sizeof(double) != 0) || ((n_values != n_equation_values) && (n_values != n_equation_values + 2)) ) {
+		printf("File %s is neither a normal-equation file nor a headerless one from an older version for matrix_type %d with %d columns.\n", filename, mat->matrix_type, mat->fm_matrix_columns);
+		exit(EXIT_FAILURE);
+	}
+	printf("Reading %s as a headerless normal-equation file from an older version; it cannot be checked against this calculation.\n", filename);
+
+	NormalEquationFileHeader &header = equation_file->header;
+	memset(&header, 0, sizeof(NormalEquationFileHeader));
+	equation_file->systems = (const double*)equation_file->map_begin;
+	header.matrix_type = mat->matrix_type;
+	header.n_columns = mat->fm_matrix_columns;
+	header.n_systems = 1;
+	header.interaction_layout_hash = mat->interaction_layout_hash;
+	if (n_values == n_equation_values) {
+		header.frame_weight_total = 1.0;
+	} else {
+		header.force_sq_total = equation_file->systems[n_equation_values];
+		header.frame_weight_total = equation_file->systems[n_equation_values + 1];
+	}
+}
+
+void close_normal_equation_file(NormalEquationFile* const equation_file)
+{
+	munmap((void*)equation_file->map_begin, equation_file->map_size);
+}
+
+// Only the equations of calculations without bootstrapping can be combined.
+
+void check_single_system(const char* filename, const NormalEquationFile* const equation_file)
+{
+	if (equation_file->header.n_systems != 1) {
+		printf("Normal-equation file %s holds %lu bootstrapping estimates; only calculations without bootstrapping can be combined.\n", filename, (unsigned long)equation_file->header.n_systems);
+		exit(EXIT_FAILURE);
+	}
+}
+
+// Total the frame weights, squared forces and frame counts of the batches in
+// file order, so that they do not depend on the order the files were read in,
+// and set the normalization of the combined equations.
+
+void total_batch_normalizations(MATRIX_DATA* const mat, const std::vector<NormalEquationFileHeader> &batch_headers)
+{
+	double inv_norm_sum = 0.0;
+	uint64_t n_frames = 0;
+	for (unsigned i = 0; i < batch_headers.size(); i++) {
+		inv_norm_sum += batch_headers[i].frame_weight_total;
+		mat->force_sq_total += batch_headers[i].force_sq_total;
+		n_frames += batch_headers[i].n_frames;
+	}
+	mat->n_frames = n_frames;
+	set_normalization(mat, 1.0 / inv_norm_sum);
+	printf("Combined the equations of %d batches covering %lu frames.\n", (int)batch_headers.size(), (unsigned long)n_frames);
+}
+
+// Read the stored normal equations of the previous trajectory in an
+// iterative calculation. The upper triangle of the normal matrix goes
+// into the dense normal matrix; the target vector is returned.
+
+void read_iterative_reference_equations(MATRIX_DATA* const mat, double* const reference_rhs)
+{
+	NormalEquationFile equation_file;
+	open_normal_equation_file(mat, "result.in", &equation_file);
+	int n_columns = mat->fm_matrix_columns;
+	const double* packed_system = equation_file.systems;
+	for (int j = 0; j < n_columns; j++) {
+		memcpy(&mat->dense_fm_normal_matrix->values[(size_t)j * n_columns], packed_system + (size_t)j * (j + 1) / 2, (j + 1) * sizeof(double));
+	}
+	memcpy(reference_rhs, packed_system + (size_t)n_columns * (n_columns + 1) / 2, n_columns * sizeof(double));
+	close_normal_equation_file(&equation_file);
+}
+
 // Read the results of a batch of dense-matrix-based FM
 // calculations and add them together as if they were the
 // results of blocks of an earlier trajectory.
 
 void read_binary_dense_fm_matrix(MATRIX_DATA* const mat)
 {
-    double matrix_element;
-    double inv_norm_sum = 0.0;
-    double inv_norm;
+    int onei = 1;
+    int n_columns = mat->fm_matrix_columns;
+    size_t packed_size = (size_t)n_columns * (n_columns + 1) / 2;
+    size_t system_size = packed_size + n_columns;
 
 	// Read the number of files to combine in this batch
     // and the file names for each.
     std::string* filenames;
     int n_batch = read_res_av_file(filenames);
 
-    // Read each file's dense matrix, adding them together element-by-
-    // element to get a final set of normal form equations.
-    // Each matrix is "un-normalized" by its number of frames before accumulating.
-    FILE* single_binary_matrix_input;
-	dense_matrix* read_matrix = new dense_matrix(mat->fm_matrix_columns, mat->fm_matrix_columns);
-	double* read_rhs = new double[mat->fm_matrix_columns];
-    for (int i = 0; i < n_batch; i++) {
-        // Read the new normal form matrix.
-        // Stored as an upper traingular matrix because it is symmetric.
-        single_binary_matrix_input = open_file(filenames[i].c_str(), "rb");
-        for (int j = 0; j < mat->fm_matrix_columns; j++) {
-            for (int k = 0; k <= j; k++) {
-                fread(&matrix_element, sizeof(double), 1, single_binary_matrix_input);
-                read_matrix->assign_scalar(k, j, matrix_element);
-            }
-        }
-
-        // Read the new normal form vector.
-        for (int j = 0; j < mat->fm_matrix_columns; j++) {
-            fread(&matrix_element, sizeof(double), 1, single_binary_matrix_input);
-            read_rhs[j] = matrix_element;
-        }
-        
-        // Read the force_sq_total value
-        fread(&matrix_element, sizeof(double), 1, single_binary_matrix_input);
-        mat->force_sq_total += matrix_element;
-        
-        // Read the inverse normalization
-        fread(&matrix_element, sizeof(double), 1, single_binary_matrix_input);
-        inv_norm = matrix_element;
-        inv_norm_sum += inv_norm;
-        
-        // Add the new normal form matrix to the existing one.
-        // This process "unnormalizes" each element as it is added.
-        // Stored as an upper traingular matrix because it is symmetric.
-         for (int j = 0; j < mat->fm_matrix_columns; j++) {
-            for (int k = 0; k <= j; k++) {
-            	mat->dense_fm_normal_matrix->add_scalar(k, j, inv_norm * read_matrix->get_scalar(k, j));
-            }
-        }
-        
-        // Add the new normal form vector to the existing one.
-        // This process "unnormalizes" each element as it is added.
-        for (int j = 0; j < mat->fm_matrix_columns; j++) {
-            mat->dense_fm_normal_rhs_vector[j] += inv_norm * read_rhs[j];
-        }
-        fclose(single_binary_matrix_input);
+    // Each thread keeps a partial sum of the packed normal equations of a
+    // contiguous range of the files, "un-normalizing" each by its number of
+    // frames as it is added. The next file of the range is mapped and read
+    // ahead while the current one is checked and added. With one thread,
+    // the files are added in the same order as a serial read.
+    int n_partial_sums = 1;
+    #ifdef _OPENMP
+    n_partial_sums = std::max(1, std::min(n_batch, omp_get_max_threads()));
+    #endif
+    std::vector<double*> partial_sums(n_partial_sums);
+    std::vector<NormalEquationFileHeader> batch_headers(n_batch);
+    
+    #pragma omp parallel for schedule(static, 1)
+    for (int p = 0; p < n_partial_sums; p++) {
+    	int first_batch = (int)((long)n_batch * p / n_partial_sums);
+    	int end_batch = (int)((long)n_batch * (p + 1) / n_partial_sums);
+    	partial_sums[p] = new double[system_size]();
+    	
+    	NormalEquationFile equation_file, next_equation_file;
+    	if (first_batch < end_batch) open_normal_equation_file(mat, filenames[first_batch].c_str(), &next_equation_file);
+    	for (int i = first_batch; i < end_batch; i++) {
+    		equation_file = next_equation_file;
+    		if (i + 1 < end_batch) {
+    			open_normal_equation_file(mat, filenames[i + 1].c_str(), &next_equation_file);
+    			madvise((void*)next_equation_file.map_begin, next_equation_file.map_size, MADV_WILLNEED);
+    		}
+	        check_single_system(filenames[i].c_str(), &equation_file);
+	        batch_headers[i] = equation_file.header;
+	        // BLAS lengths are ints, so very large systems are added in pieces.
+	        for (size_t offset = 0; offset < system_size; offset += (size_t)INT_MAX) {
+	        	int length = (int)std::min(system_size - offset, (size_t)INT_MAX);
+	        	cblas_daxpy(length, batch_headers[i].frame_weight_total, equation_file.systems + offset, onei, partial_sums[p] + offset, onei);
+	        }
+	        close_normal_equation_file(&equation_file);
+    	}
     }
     delete [] filenames;
-    delete [] read_rhs;
-    delete read_matrix;
-     
+    
+    // Combine the partial sums pairwise, one cache-sized chunk of the packed
+    // equations at a time so that every thread takes part in every level.
+    const size_t chunk_size = 4096;
+    long n_chunks = (long)((system_size + chunk_size - 1) / chunk_size);
+    #pragma omp parallel for schedule(static)
+    for (long chunk = 0; chunk < n_chunks; chunk++) {
+    	size_t offset = chunk * chunk_size;
+    	int length = (int)std::min(chunk_size, system_size - offset);
+    	for (int stride = 1; stride < n_partial_sums; stride *= 2) {
+    		for (int p = 0; p + stride < n_partial_sums; p += 2 * stride) {
+    			cblas_daxpy(length, 1.0, partial_sums[p + stride] + offset, onei, partial_sums[p] + offset, onei);
+    		}
+    	}
+    }
+    
+    // Unpack the upper triangle into the dense normal matrix; the
+    // symmetric lower triangle is not stored.
+    for (int j = 0; j < n_columns; j++) {
+    	cblas_daxpy(j + 1, 1.0, partial_sums[0] + (size_t)j * (j + 1) / 2, onei, &mat->dense_fm_normal_matrix->values[(size_t)j * n_columns], onei);
+    }
+    cblas_daxpy(n_columns, 1.0, partial_sums[0] + packed_size, onei, mat->dense_fm_normal_rhs_vector, onei);
+    for (int p = 0; p < n_partial_sums; p++) delete [] partial_sums[p];
+    
     // Normalize the normal matrix and RHS vector by the total number of frames.
- 	set_normalization(mat, 1.0/inv_norm_sum);
+    total_batch_normalizations(mat, batch_headers);
 	for (int j = 0; j < mat->fm_matrix_columns; j++) {
 		for (int k = 0; k <= j; k++) {
 			mat->dense_fm_normal_matrix->assign_scalar(k, j, mat->normalization * mat->dense_fm_normal_matrix->get_scalar(k, j));
@@ -3633,45 +4801,79 @@ void read_binary_dense_fm_matrix(MATRIX_DATA* const mat)
 }
 
 // Read the results of a batch of accumulation-matrix-based FM
-// calculations and add them together as if they were the
-// results of blocks of an earlier trajectory.
-
-// Works only for trivial batches of one block each; the primary use
-// is to allow for more sophisticated regularization elsewhere in this
-// program.
+// calculations and merge them as if they were the results of
+// blocks of an earlier trajectory: the triangular factors of all
+// batches are stacked and factored again, as in the grouped
+// accumulation. Each group of accumulation_tsqr_group_size files is
+// merged pairwise in parallel and then with the running factor; with a
+// group size of 1, the files are merged one at a time in order.
 
 void read_binary_accumulation_fm_matrix(MATRIX_DATA* const mat)
 {
-    printf("The use of combinefm with the accumulation matrix type is not supported!\n"); 
-	delete mat->dense_fm_matrix;
-    mat->dense_fm_matrix = new dense_matrix(mat->accumulation_matrix_columns, mat->accumulation_matrix_columns);
+    int columns = mat->accumulation_matrix_columns;
+    size_t r_size = (size_t)columns * columns;
+    int group_size = std::max(1, mat->accumulation_tsqr_group_size);
 
   	// Read the number of files to combine in this batch
     // and the file names for each.
-	double read_value;
     std::string* filenames;
     int n_batch = read_res_av_file(filenames);
-  	if (n_batch > 1) {
-        printf("Can not read more than one block for the sequential accumulation algorithm!\n");
-        exit(EXIT_FAILURE);
+    std::vector<NormalEquationFileHeader> batch_headers(n_batch);
+
+    double* r_factor = NULL;
+    for (int first_batch = 0; first_batch < n_batch; first_batch += group_size) {
+    	int n_blocks = std::min(group_size, n_batch - first_batch);
+    	int first_block = (r_factor != NULL) ? 1 : 0;
+    	int n_factors = n_blocks + first_block;
+    	double* r_factors = new double[n_factors * r_size]();
+    	if (first_block == 1) std::copy(r_factor, r_factor + r_size, r_factors);
+
+    	// Unpack each file's packed factor.
+    	#pragma omp parallel for schedule(dynamic)
+    	for (int b = 0; b < n_blocks; b++) {
+    		int i = first_batch + b;
+    		NormalEquationFile equation_file;
+    		open_normal_equation_file(mat, filenames[i].c_str(), &equation_file);
+    		check_single_system(filenames[i].c_str(), &equation_file);
+    		batch_headers[i] = equation_file.header;
+    		double* factor = r_factors + (b + first_block) * r_size;
+    		for (int j = 0; j < columns; j++) {
+    			std::copy(equation_file.systems + (size_t)j * (j + 1) / 2, equation_file.systems + (size_t)j * (j + 1) / 2 + j + 1, factor + (size_t)j * columns);
+    		}
+    		close_normal_equation_file(&equation_file);
+    	}
+
+    	// Merge the factors pairwise.
+	    for (int stride = 1; stride < n_factors; stride *= 2) {
+	        #pragma omp parallel for schedule(dynamic)
+	        for (int i = 0; i < n_factors - stride; i += 2 * stride) {
+	            merge_accumulation_r_factors(columns, r_factors + i * r_size, r_factors + (i + stride) * r_size);
+	        }
+	    }
+	    if (r_factor == NULL) r_factor = new double[r_size];
+	    std::copy(r_factors, r_factors + r_size, r_factor);
+	    delete [] r_factors;
     }
-    
-    FILE* single_binary_matrix_input = open_file(filenames[0].c_str(), "rb");
-    for (int j = 0; j < mat->fm_matrix_columns; j++) {
-        for (int k = 0; k <= j; k++) {
-            fread(&read_value, sizeof(double), 1, single_binary_matrix_input);
-            mat->dense_fm_matrix->assign_scalar(k, j, read_value);
+    delete [] filenames;
+
+    // Place the merged factor where the solver expects it, as for the
+    // ungrouped and grouped accumulation.
+    std::fill(mat->dense_fm_matrix->values, mat->dense_fm_matrix->values + (size_t)mat->accumulation_matrix_rows * columns, 0.0);
+    for (int j = 0; (j < columns) && (r_factor != NULL); j++) {
+        for (int i = 0; i <= j; i++) {
+            mat->dense_fm_matrix->values[(size_t)j * mat->accumulation_matrix_rows + i] = r_factor[(size_t)j * columns + i];
         }
     }
-
-    for (int j = 0; j < mat->fm_matrix_columns; j++) mat->dense_fm_matrix->assign_scalar(mat->fm_matrix_columns, j, 0.0);
-
-    for (int j = 0; j < mat->accumulation_matrix_columns; j++) {
-        fread(&read_value, sizeof(double), 1, single_binary_matrix_input);
-        mat->dense_fm_normal_rhs_vector[j] = read_value;
+    if (mat->accumulation_tsqr_group_size > 1) {
+    	delete [] mat->accumulation_r_factor;
+    	mat->accumulation_r_factor = r_factor;
+    } else {
+    	delete [] r_factor;
     }
-    fclose(single_binary_matrix_input);
-    delete [] filenames;
+
+    // The accumulation rows are not weighted, so the normalization is only
+    // used for the residual.
+    total_batch_normalizations(mat, batch_headers);
 }
 
 // Read the results of a batch of sparse-matrix-based FM
@@ -3680,35 +4882,144 @@ void read_binary_accumulation_fm_matrix(MATRIX_DATA* const mat)
 
 void read_binary_sparse_fm_matrix(MATRIX_DATA* const mat)
 {
-    printf("The use of combinefm with the sparse matrix type is not supported!\n"); 
-	FILE *single_block_solution_file;
-    
-    // Allocate memory for a single block's worth of temp data.
-    double* single_block_normalization_factors = new double[mat->fm_matrix_columns];
-    
+    int onei = 1;
+
     // Read the number of files to combine in this batch
     // and the file names for each.
     std::string* filenames;
     int n_batch = read_res_av_file(filenames);
+    std::vector<NormalEquationFileHeader> batch_headers(n_batch);
 
-    // For each file in the batch, read the appropriate file
-    // for the solution of that batch (not normalized) and the
-    // normalization factors for that solution.
+    // For each file in the batch, add the summed block solutions of that
+    // batch, "un-normalized" by its number of frames, and the normalization
+    // factors for that solution.
+    NormalEquationFile equation_file;
     for (int i = 0; i < n_batch; i++) {
-        single_block_solution_file = open_file(filenames[i].c_str(), "rb");
-        fread(mat->block_fm_solution, sizeof(double), mat->fm_matrix_columns, single_block_solution_file);
-        fread(single_block_normalization_factors, sizeof(double), mat->fm_matrix_columns, single_block_solution_file);
-        fclose(single_block_solution_file);
-        
-        // Add that to the accumulating solution in this program
-        for (int j = 0; j < mat->fm_matrix_columns; j++) {
-            mat->fm_solution[j] += mat->block_fm_solution[j];
-            mat->fm_solution_normalization_factors[j] += single_block_normalization_factors[j];
-        }
+        open_normal_equation_file(mat, filenames[i].c_str(), &equation_file);
+        check_single_system(filenames[i].c_str(), &equation_file);
+        batch_headers[i] = equation_file.header;
+        cblas_daxpy(mat->fm_matrix_columns, equation_file.header.frame_weight_total, equation_file.systems, onei, &mat->fm_solution[0], onei);
+        cblas_daxpy(mat->fm_matrix_columns, 1.0, equation_file.systems + mat->fm_matrix_columns, onei, mat->fm_solution_normalization_factors, onei);
+        close_normal_equation_file(&equation_file);
     }
-    
-    delete [] single_block_normalization_factors;
     delete [] filenames;
+
+    // Normalize the summed solutions by the total number of frames.
+    total_batch_normalizations(mat, batch_headers);
+    for (int j = 0; j < mat->fm_matrix_columns; j++) mat->fm_solution[j] *= mat->normalization;
+}
+
+// Check that the CSR arrays of a stored sparse-sparse system are consistent
+// before they are used to index the merged matrix.
+
+void check_sparse_normal_system(const char* filename, const SparseNormalSystem &system, const int n_columns)
+{
+	bool consistent = (system.row_sizes[0] == 1) && ((uint64_t)(system.row_sizes[n_columns] - 1) == system.n_entries);
+	for (int r = 0; (r < n_columns) && consistent; r++) {
+		consistent = (system.row_sizes[r] <= system.row_sizes[r + 1]);
+	}
+	for (uint64_t k = 0; (k < system.n_entries) && consistent; k++) {
+		consistent = (system.column_indices[k] >= 1) && (system.column_indices[k] <= n_columns);
+	}
+	if (!consistent) {
+		printf("Normal-equation file %s holds an inconsistent sparse normal matrix.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+}
+
+// Read the results of a batch of sparse-normal-matrix-based FM
+// calculations and add them together as if they were the
+// results of blocks of an earlier trajectory. The CSR normal matrices
+// are merged row by row into the union of their sparsity patterns,
+// "un-normalizing" each by its number of frames; each row sums the
+// files in order, so the result does not depend on the number of threads.
+
+void read_binary_sparse_normal_fm_matrix(MATRIX_DATA* const mat)
+{
+    int onei = 1;
+    int n_columns = mat->fm_matrix_columns;
+
+    // Read the number of files to combine in this batch
+    // and the file names for each.
+    std::string* filenames;
+    int n_batch = read_res_av_file(filenames);
+    std::vector<NormalEquationFileHeader> batch_headers(n_batch);
+    std::vector<NormalEquationFile> equation_files(n_batch);
+    std::vector<SparseNormalSystem> systems(n_batch);
+
+    for (int i = 0; i < n_batch; i++) {
+    	open_normal_equation_file(mat, filenames[i].c_str(), &equation_files[i]);
+    	check_single_system(filenames[i].c_str(), &equation_files[i]);
+    	batch_headers[i] = equation_files[i].header;
+    	get_sparse_normal_system((const char*)equation_files[i].systems, equation_files[i].map_begin + equation_files[i].map_size, n_columns, &systems[i]);
+    	check_sparse_normal_system(filenames[i].c_str(), systems[i], n_columns);
+    	cblas_daxpy(n_columns, batch_headers[i].frame_weight_total, systems[i].rhs, onei, mat->dense_fm_normal_rhs_vector, onei);
+    }
+    delete [] filenames;
+
+    // Count the union of the column indices of each row.
+    std::vector<int> row_sizes(n_columns + 1, 0);
+    #pragma omp parallel
+    {
+    	std::vector<int> last_row_seen(n_columns, -1);
+    	#pragma omp for schedule(dynamic, 64)
+    	for (int r = 0; r < n_columns; r++) {
+    		int row_size = 0;
+    		for (int i = 0; i < n_batch; i++) {
+    			for (int k = systems[i].row_sizes[r] - 1; k < systems[i].row_sizes[r + 1] - 1; k++) {
+    				int column = systems[i].column_indices[k] - 1;
+    				if (last_row_seen[column] != r) {
+    					last_row_seen[column] = r;
+    					row_size++;
+    				}
+    			}
+    		}
+    		row_sizes[r + 1] = row_size;
+    	}
+    }
+    row_sizes[0] = 1;
+    for (int r = 0; r < n_columns; r++) row_sizes[r + 1] += row_sizes[r];
+    int n_entries = row_sizes[n_columns] - 1;
+    printf("Merged sparse normal matrix has %d non-zero entries.\n", n_entries);
+
+    // Sum the entries of each row, with the columns in increasing order.
+    csr_matrix* merged_matrix = new csr_matrix(n_columns, n_columns, std::max(n_entries, 1));
+    std::copy(row_sizes.begin(), row_sizes.end(), merged_matrix->row_sizes);
+    #pragma omp parallel
+    {
+    	std::vector<double> row_values(n_columns, 0.0);
+    	std::vector<int> last_row_seen(n_columns, -1);
+    	#pragma omp for schedule(dynamic, 64)
+    	for (int r = 0; r < n_columns; r++) {
+    		int* columns = merged_matrix->column_indices + row_sizes[r] - 1;
+    		int n_row_entries = 0;
+    		for (int i = 0; i < n_batch; i++) {
+    			for (int k = systems[i].row_sizes[r] - 1; k < systems[i].row_sizes[r + 1] - 1; k++) {
+    				int column = systems[i].column_indices[k] - 1;
+    				if (last_row_seen[column] != r) {
+    					last_row_seen[column] = r;
+    					columns[n_row_entries++] = column;
+    				}
+    				row_values[column] += batch_headers[i].frame_weight_total * systems[i].values[k];
+    			}
+    		}
+    		std::sort(columns, columns + n_row_entries);
+    		double* values = merged_matrix->values + row_sizes[r] - 1;
+    		for (int k = 0; k < n_row_entries; k++) {
+    			values[k] = row_values[columns[k]];
+    			row_values[columns[k]] = 0.0;
+    			columns[k]++;
+    		}
+    	}
+    }
+    for (int i = 0; i < n_batch; i++) close_normal_equation_file(&equation_files[i]);
+    delete mat->sparse_matrix;
+    mat->sparse_matrix = merged_matrix;
+
+    // Normalize the normal matrix and RHS vector by the total number of frames.
+    total_batch_normalizations(mat, batch_headers);
+    for (int k = 0; k < n_entries; k++) mat->sparse_matrix->values[k] *= mat->normalization;
+    for (int j = 0; j < n_columns; j++) mat->dense_fm_normal_rhs_vector[j] *= mat->normalization;
 }
 
 // Read the vector of regularization coefficients.
@@ -11,6 +11,7 @@
 #include <vector>
 
 #include "external_matrix_routines.h"
+#include "misc.h"
 
 #ifndef DIMENSION
 #define DIMENSION 3
@@ -229,7 +230,7 @@ struct dense_matrix {
     	}
     }
 
-    void assign_vector(const int row, const int col, const std::array<double, DIMENSION> &x) {
+    void assign_vector(const int row, const int col, const std::array<frame_real, DIMENSION> &x) {
     	for(int i = 0; i < DIMENSION; i++) {
     		values[ col * n_rows + row + i] = x[i];
     	}
@@ -273,6 +274,8 @@ struct MATRIX_DATA {
     int rows_less_constraint_rows;           		// Rows less the rows reserved for virial constraints
     int virial_constraint_rows;                     // Rows specifically for virial constraints
     int frames_per_traj_block;              		// Number of frames to read in a single block of FM matrix construction
+    int n_frames;                                   // Number of trajectory frames in the calculation
+    uint64_t interaction_layout_hash;               // Checksum of the force-matched interactions and their columns, stored in normal-equation files
     int position_dimension;							// The number of elements needed to specify each particle's position.
 
     // For dense-matrix-based calculations
@@ -283,6 +286,7 @@ struct MATRIX_DATA {
     double normalization;
     double* fm_solution_normalization_factors;      // Weighted number of times each unknown has been found nonzero in the solution vectors of all blocks
     std::vector<double> fm_solution;                // Final answers averaged over all blocks
+    std::vector<double> fm_singular_values;         // Singular values of the final solve; empty unless it used singular value decomposition
 	
 	// BI variables
     double temperature;
@@ -308,6 +312,13 @@ struct MATRIX_DATA {
 	dense_matrix** bootstrapping_dense_fm_normal_matrices;
 	csr_matrix** bootstrapping_sparse_fm_normal_matrices;
 	std::vector<double>* bootstrap_solutions;
+	int bootstrapping_pcg_iterations;				// Maximum PCG iterations refining the master solution for each estimate; 0 to solve each estimate directly (dense only)
+	double bootstrapping_pcg_tolerance;				// Relative residual at which PCG refinement of an estimate stops
+	int bootstrapping_frame_group_size;				// Number of frames whose normal equations are buffered before being added to the estimates (dense only)
+	int bootstrapping_buffered_frames;				// Number of frames currently held in the buffers below
+	double* bootstrapping_frame_normal_matrices;	// Normal matrices of the buffered frames, one after another
+	double* bootstrapping_frame_normal_rhs_vectors;	// Normal target vectors of the buffered frames, one after another
+	double* bootstrapping_frame_weights;			// Weight of each buffered frame in the master (first group) and then each estimate
 
     // For sparse-matrix-based calculations
     int max_nonzero_normal_elements;                // Total number of nonzero values in the sparse normal matrix
@@ -321,7 +332,7 @@ struct MATRIX_DATA {
     double* h;                                      // Temp for preconditioning
 	
     // For accumulation-matrix-based calculations
-    double fm_residual;                             // Final MS-CG residual value
+    double fm_residual;                             // Final MS-CG residual value; negative if it was not calculated
     int trajectory_block_index;                     // Index of the current frame block, needed to calculate compositions of accumulation matrices
     int accumulation_matrix_rows;
     int accumulation_matrix_columns;
@@ -330,6 +341,10 @@ struct MATRIX_DATA {
     int lapack_setup_flag;                          // Temp for LAPACK SVD and QR routines
     double* lapack_temp_workspace;                  // Temp for LAPACK SVD and QR routines
     double* lapack_tau;                             // Temp for LAPACK SVD and QR routines
+    int accumulation_tsqr_group_size;               // Number of frame blocks QR-factored in parallel and merged by a reduction tree; 1 to fold each block into the running factor as it is read
+    int accumulation_buffered_blocks;               // Number of frame blocks currently held in accumulation_block_buffers
+    double** accumulation_block_buffers;            // Frame block matrices awaiting factorization
+    double* accumulation_r_factor;                  // Running triangular factor of all merged groups (NULL before the first group)
 
 	// Optional extras for residual, regularization, and bayesian calculations
 	int output_residual;							// 1 to calculate the residual; 0 otherwise
@@ -342,11 +357,15 @@ struct MATRIX_DATA {
 
     // SVD routine parameter
     double rcond;                           // SVD condition number threshold
+    int block_decoupling_flag;              // 1 to solve independent blocks of the dense normal equations separately; 0 otherwise
+    std::vector<int> interaction_column_starts;     // First column of each force-matched interaction; these columns are never split between blocks
+    int mixed_precision_flag;               // 1 to try a single-precision Cholesky solution with double-precision refinement before SVD; 0 otherwise
     
     // Output specifications for matrix-based routines
     int output_style;                       // 0 to output only tables; 2 to output tables and binary block equations; 3 to output only binary block equations
     int output_normal_equations_rhs_flag;   // 1 to output the final right hand side vector of the MS-CG normal equations as well as force tables; 0 otherwise
-    int output_solution_flag;               // 0 to not output the solution vector; 1 to output the solution vector in x.out
+    int output_solution_flag;               // 0 to not output the solution vector; 1 to output the solution vector in x.out; 2 to output a results bundle in solution.mscgsol
+    int output_table_style;                 // 0 to write a LAMMPS table file for each interaction; 1 to write one for each interaction class
 
 	// Constructors and destructors
 	MATRIX_DATA(ControlInputs* const control_input, CG_MODEL_DATA *const cg);
@@ -447,10 +466,16 @@ void allocate_bootstrapping(MATRIX_DATA* mat, ControlInputs* const control_input
 // Target (RHS) vector calculation routines
 
 void add_target_virials_from_trajectory(MATRIX_DATA* const mat, double *pressure_constraint_rhs_vector);
-void add_target_force_from_trajectory(int shift_i, int site_i, MATRIX_DATA* const mat, std::array<double, DIMENSION>* const &f);
+void add_target_force_from_trajectory(int shift_i, int site_i, MATRIX_DATA* const mat, std::array<frame_real, DIMENSION>* const &f);
 
 // Read serialized, partially-completed post-frameblock matrix calculation intermediates
 
 void read_binary_matrix(MATRIX_DATA* const mat);
 
+// Pass the partial FM equations built from one part of a trajectory between processes,
+// adding them to those already built
+
+void write_partial_fm_equations(MATRIX_DATA* const mat, FILE* const partial_file);
+void add_partial_fm_equations(MATRIX_DATA* const mat, FILE* const partial_file, const int first_part);
+
 #endif
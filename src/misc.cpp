@@ -21,6 +21,7 @@ const float VERYSMALL_F = 1.0e-6; // Small number for single precision
 const double MAX_INPUT_FORCE_VALUE = 1000.0; // Filter some noisy data
 const int MAX_CG_TYPE_NAME_LENGTH = 24; // Max length for CG type names
 const double DEGREES_PER_RADIAN = 180.0 / M_PI;
+const uint64_t kChecksumSeed = 0xcbf29ce484222325ULL;
 
 // An error-catching wrapper for fopen.
 
@@ -500,7 +501,7 @@ void check_and_open_in_stream(std::ifstream &in_stream, const char* filename)
 	}
 }
 
-void check_and_read_next_line(std::ifstream &in_stream, std::string &line)
+void check_and_read_next_line(std::istream &in_stream, std::string &line)
 {
 	if(!std::getline(in_stream, line)) {
 			fprintf(stderr, "\nIt appears that the file is no longer open.\n");
@@ -510,7 +511,7 @@ void check_and_read_next_line(std::ifstream &in_stream, std::string &line)
 	}	
 }
 
-void check_and_read_next_line(std::ifstream &in_stream, std::string &line, int &line_num)
+void check_and_read_next_line(std::istream &in_stream, std::string &line, int &line_num)
 {
 	check_and_read_next_line(in_stream, line);
 	line_num++;	
@@ -522,3 +523,21 @@ void swap_pair(int& a, int& b)
 	b = a;
 	a = tn;
 }
+
+uint64_t update_checksum(const void* const data, const size_t size, uint64_t checksum)
+{
+	// Fold in whole 64-bit words, then any remaining bytes.
+	const unsigned char* bytes = (const unsigned char*)data;
+	size_t n_words = size / sizeof(uint64_t);
+	uint64_t word;
+	for (size_t i = 0; i < n_words; i++) {
+		memcpy(&word, bytes + i * sizeof(uint64_t), sizeof(uint64_t));
+		checksum ^= word;
+		checksum *= 0x100000001b3ULL;
+	}
+	for (size_t i = n_words * sizeof(uint64_t); i < size; i++) {
+		checksum ^= bytes[i];
+		checksum *= 0x100000001b3ULL;
+	}
+	return checksum;
+}
@@ -11,6 +11,16 @@
 typedef float real;
 typedef real rvec[3];
 
+// Precision of the site positions and forces stored for each frame.
+// Building with -D"_single_precision_frames=1" keeps frames in float to
+// halve their memory and bandwidth; geometry is still evaluated in double.
+#if _single_precision_frames == 1
+typedef float frame_real;
+#else
+typedef double frame_real;
+#endif
+
+#include <cstdint>
 #include <fstream>
 #include <string>
 #include "stdio.h"
@@ -38,8 +48,8 @@ FILE* open_file(const char* file_name, const char* mode);
 void check_and_open_in_stream(std::ifstream &in_stream, const char* filename);
 
 // An (overloaded) error-catching wrapper for std::getline
-void check_and_read_next_line(std::ifstream &in_stream, std::string &line);
-void check_and_read_next_line(std::ifstream &in_stream, std::string &line, int &line_num);
+void check_and_read_next_line(std::istream &in_stream, std::string &line);
+void check_and_read_next_line(std::istream &in_stream, std::string &line, int &line_num);
 
 // Integrate function to calculate a potential from a force and distance vectors.
 void integrate_force(const std::vector<double> &axis_vals, const std::vector<double> &force_vals, std::vector<double> &potential_vals);
@@ -78,4 +88,9 @@ int match_type(std::string &source, char** name, const int n_types);
 // A simple function for swapping two numbers.
 void swap_pair(int& a, int& b);
 
+// An FNV-1a style checksum of a block of bytes taken a 64-bit word at a time,
+// continued from a previous checksum. Start from kChecksumSeed.
+extern const uint64_t kChecksumSeed;
+uint64_t update_checksum(const void* const data, const size_t size, uint64_t checksum);
+
 #endif
@@ -145,7 +145,7 @@ void* mscg_startup_part2(void* void_in)
     if (p_frame_source->use_statistical_reweighting == 1) {
         printf("Reading per-frame statistical reweighting factors.\n");
         fflush(stdout);
-        read_frame_weights(p_frame_source, p_control_input->starting_frame, p_control_input->n_frames, "in"); 
+        read_frame_weights(p_frame_source, p_control_input->starting_frame, p_control_input->n_frames, 1, "in"); 
     }
     
     // Generate bootstrapping weights if the
@@ -159,7 +159,7 @@ void* mscg_startup_part2(void* void_in)
     // Read the input virials if the correct flag was set in control.in.
     if (p_frame_source->pressure_constraint_flag == 1) {
         printf("Reading virial constraint target.\n");
-        read_frame_values("p_con.in", p_control_input->starting_frame, p_control_input->n_frames, p_frame_source->pressure_constraint_rhs_vector);
+        read_frame_values("p_con.in", p_control_input->starting_frame, p_control_input->n_frames, 1, p_frame_source->pressure_constraint_rhs_vector);
     }
     
     // Use the trajectory type inferred from trajectory file 
@@ -257,7 +257,7 @@ void* rangefinder_startup_part2(void* void_in)
     if (mscg_struct->frame_source->use_statistical_reweighting == 1) {
         printf("Reading per-frame statistical reweighting factors.\n");
         fflush(stdout);
-        read_frame_weights(mscg_struct->frame_source, mscg_struct->control_input->starting_frame, mscg_struct->control_input->n_frames, "in"); 
+        read_frame_weights(mscg_struct->frame_source, mscg_struct->control_input->starting_frame, mscg_struct->control_input->n_frames, 1, "in"); 
     }
     
     // Initialize the force-matching matrix.
@@ -462,6 +462,7 @@ void* rangefinder_process_frame(void* void_in, double* const x, double* const f)
     	do {    
 			if (p_frame_source->dynamic_state_sampling != 0) p_frame_source->sampleTypesFromProbs();
 	    	calculate_frame_fm_matrix(p_cg, mscg_struct->mat, p_frame_config, pair_cell_list, three_body_cell_list, trajectory_block_frame_index);
+	    	record_frame_pair_densities(p_cg, p_frame_config->simulation_box_half_lengths);
     		times_sampled++;
     		traj_frame_num++;
     		trajectory_block_frame_index++;
@@ -585,7 +586,7 @@ void* rangefinder_solve_and_output(void* void_in)
 		screen_interactions_by_distribution(mscg_struct->cg);
 		set_up_force_computers(mscg_struct->cg);
 
-		calculate_BI(mscg_struct->cg, mscg_struct->mat, mscg_struct->frame_source);
+		calculate_BI(mscg_struct->cg, mscg_struct->mat);
 
 		write_fm_interaction_output_files(mscg_struct->cg,mscg_struct->mat);
 	} else {
@@ -10,6 +10,8 @@
 #include <cstdio>
 #include <cstdlib>
 #include <ctime>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "control_input.h"
 #include "force_computation.h"
 #include "fm_output.h"
@@ -19,7 +21,7 @@
 #include "misc.h"
 #include "trajectory_input.h"
 
-void construct_full_fm_matrix(CG_MODEL_DATA* const cg, MATRIX_DATA* const mat, FrameSource* const frame_source);
+void construct_sharded_fm_matrix(CG_MODEL_DATA* const cg, MATRIX_DATA* const mat, FrameSource* const frame_source, const int n_shards);
 
 int main(int argc, char* argv[])
 {
@@ -80,7 +82,7 @@ int main(int argc, char* argv[])
     if (frame_source.use_statistical_reweighting == 1) {
         printf("Reading per-frame statistical reweighting factors.\n");
         fflush(stdout);
-        read_frame_weights(&frame_source, control_input.starting_frame, control_input.n_frames, "in"); 
+        read_frame_weights(&frame_source, control_input.starting_frame, control_input.n_frames, control_input.frame_stride, "in"); 
     }
         
     // Generate bootstrapping weights if the
@@ -94,7 +96,7 @@ int main(int argc, char* argv[])
     // Read the input virials if the correct flag was set in control.in.
     if (frame_source.pressure_constraint_flag == 1) {
         printf("Reading virial constraint target.\n");
-        read_frame_values("p_con.in", control_input.starting_frame, control_input.n_frames, frame_source.pressure_constraint_rhs_vector);
+        read_frame_values("p_con.in", control_input.starting_frame, control_input.n_frames, control_input.frame_stride, frame_source.pressure_constraint_rhs_vector);
     }
     
     // Use the trajectory type inferred from trajectory file 
@@ -138,7 +140,11 @@ int main(int argc, char* argv[])
     // Process the whole trajectory to build the force-matching matrix
     // of the appropriate type.
     printf("Constructing FM equations.\n");
-    construct_full_fm_matrix(&cg, &mat, &frame_source);
+    if (control_input.trajectory_shard_count > 1) {
+        construct_sharded_fm_matrix(&cg, &mat, &frame_source, control_input.trajectory_shard_count);
+    } else {
+        construct_full_fm_matrix(&cg, &mat, &frame_source);
+    }
 
     // Free the space used to build the force-matching matrix that is
     // not necessary for finding a solution to the final matrix
@@ -167,173 +173,84 @@ int main(int argc, char* argv[])
     return 0;
 }
 
-void construct_full_fm_matrix(CG_MODEL_DATA* const cg, MATRIX_DATA* const mat, FrameSource* const frame_source)
+// Build the FM equations from n_shards contiguous ranges of the trajectory
+// at once. Each range is handled by a forked worker process with its own
+// trajectory reader and matrix, which passes its partial equations back
+// through a pipe to be added to the equations of this process.
+
+void construct_sharded_fm_matrix(CG_MODEL_DATA* const cg, MATRIX_DATA* const mat, FrameSource* const frame_source, const int n_shards)
 {
-    int n_blocks;
-    int read_stat = 1;
-    int total_frame_samples = frame_source->n_frames;
-	int traj_frame_num = 0;
-	int times_sampled = 1;
-	double* ref_box_half_lengths = new double[frame_source->position_dimension];
-    
-    // Skip the desired number of frames before starting the matrix building loops.
-    frame_source->move_to_start_frame(frame_source);
-    
-    // Perform initial generation of cell lists user for generating neighbor lists.
-    // This list will only be rebuilt if the box dimensions change.
-    
-    // Initialize the cell linked lists for finding neighbors in the provided frames;
-    PairCellList pair_cell_list = PairCellList();
-    ThreeBCellList three_body_cell_list = ThreeBCellList();
+    if ( (mat->matrix_type != kDense) && (mat->matrix_type != kAccumulation) && (mat->matrix_type != kSparseNormal) ) {
+        printf("Trajectory sharding only works with matrix_type 0, 2 and 3.\n");
+        exit(EXIT_FAILURE);
+    }
+    if ( (frame_source->bootstrapping_flag == 1) || (mat->iterative_calculation_flag == 1) ) {
+        printf("Trajectory sharding does not work with bootstrapping or iterative calculations.\n");
+        exit(EXIT_FAILURE);
+    }
     
-    // Populate the cell linked lists.
-    pair_cell_list.init(cg->pair_nonbonded_interactions.cutoff, frame_source);
-    if (cg->three_body_nonbonded_interactions.class_subtype > 0) {
-    	double max_cutoff = 0.0;
-        for (int i = 0; i < cg->three_body_nonbonded_interactions.get_n_defined(); i++) {
-        	max_cutoff = fmax(max_cutoff, cg->three_body_nonbonded_interactions.three_body_nonbonded_cutoffs[i]);
+    // Split at whole blocks of frame samples so that every worker
+    // sees only complete blocks.
+    int block_frames = 1;
+    if (mat->matrix_type != kDense) {
+        int samples_per_frame = (frame_source->dynamic_state_sampling == 1) ? frame_source->dynamic_state_samples_per_frame : 1;
+        int common_factor = mat->frames_per_traj_block;
+        for (int remainder = samples_per_frame; remainder != 0; ) {
+            int previous_remainder = remainder;
+            remainder = common_factor % remainder;
+            common_factor = previous_remainder;
         }
-    three_body_cell_list.init(max_cutoff, frame_source);
+        block_frames = mat->frames_per_traj_block / common_factor;
+    }
+    if (frame_source->n_frames < n_shards * block_frames) {
+        printf("Cannot split %d frames into %d trajectory shards.\n", frame_source->n_frames, n_shards);
+        exit(EXIT_FAILURE);
     }
     
-	// Record this box's dimensions.
-	for (int i = 0; i < frame_source->position_dimension; i++) {
-		ref_box_half_lengths[i] = frame_source->frame_config->simulation_box_half_lengths[i];
-	}
-	
-	// Begin the main building loops. This routine operates as a for loop
-    // over frame blocks wrapped around a loop over frames within each block.
-    // In the inner loop, frames are read every iteration and new matrix elements are computed.
-    // In the outer loop, the blockwise matrix is incorporated into the total equations, 
-    // then wiped for the process to start again with the next iteration.
-
-    // Set up the loop index limits for the inner and outer loops.
-    if (frame_source->dynamic_state_sampling == 1) {
-		total_frame_samples = frame_source->n_frames * frame_source->dynamic_state_samples_per_frame;
-	}	
-    if (mat->matrix_type == kDense) {
-        n_blocks = total_frame_samples;
-	    mat->frames_per_traj_block = 1;
-    } else {
-		// Check if number of frames is divisible by frames per trajectory block.
-		if (total_frame_samples % mat->frames_per_traj_block != 0) {
-			printf("Total number of frame samples %d is not divisible by block size %d.\n", total_frame_samples, mat->frames_per_traj_block);
-			exit(EXIT_FAILURE);
-		}
-		n_blocks = total_frame_samples / mat->frames_per_traj_block;
-	}
-
-    mat->accumulation_row_shift = 0;
-
-    // For each block of frame samples.
-    printf("Entering primary matrix-building loop.\n"); fflush(stdout);
-    for (mat->trajectory_block_index = 0; mat->trajectory_block_index < n_blocks; mat->trajectory_block_index++) {
-        
-        // Wipe the matrix, then calculate the target virial for all frames in this block.
-        (*mat->set_fm_matrix_to_zero)(mat);
-        add_target_virials_from_trajectory(mat, frame_source->pressure_constraint_rhs_vector);
-
-        // For each frame sample in this block
-        for (int trajectory_block_frame_index = 0; trajectory_block_frame_index < mat->frames_per_traj_block; trajectory_block_frame_index++) {
-	
-		    // Check that the last frame was read successfully (read at end of each iteration)
-    		if (read_stat == 0) {
-        		printf("Failure reading frame %d (%d). Check trajectory for errors.\n", frame_source->current_frame_n, mat->trajectory_block_index * mat->frames_per_traj_block + trajectory_block_frame_index);
-        		exit(EXIT_FAILURE);
-    		}
-
-            // If reweighting is being used, scale the block of the FM matrix for this frame
-            // by the appropriate weighting factor
-            if (frame_source->use_statistical_reweighting) {
-                int frame_index = mat->trajectory_block_index * mat->frames_per_traj_block + trajectory_block_frame_index;
-                printf("Reweighting entries for frame %d. ", frame_index);
-                mat->current_frame_weight = frame_source->frame_weights[frame_index];
-            }
-            
-            //Skip processing frame if frame weight is 0.
-            if (frame_source->use_statistical_reweighting && mat->current_frame_weight == 0.0) {
-            } else {
-            
-            	// Check if the simulation box has changed.
-            	int box_change = 0;
-            	for (int i = 0; i < frame_source->position_dimension; i++) {
-					if ( fabs(ref_box_half_lengths[i] - frame_source->frame_config->simulation_box_half_lengths[i]) > VERYSMALL_F ) {
-						box_change = 1;
-						break;
-					}
-				}
-				
-				// Redo cell list set-up and update reference box size if box has changed.
-				if (box_change == 1) {
-	            	// Re-initialize the cell linked lists for finding neighbors in the provided frames;
-  					pair_cell_list = PairCellList();
-    				three_body_cell_list = ThreeBCellList();
-    				pair_cell_list.init(cg->pair_nonbonded_interactions.cutoff, frame_source);
-    				if (cg->three_body_nonbonded_interactions.class_subtype > 0) {
-        				double max_cutoff = 0.0;
-        				for (int i = 0; i < cg->three_body_nonbonded_interactions.get_n_defined(); i++) {
-            				max_cutoff = fmax(max_cutoff, cg->three_body_nonbonded_interactions.three_body_nonbonded_cutoffs[i]);
-        				}
-        				three_body_cell_list.init(max_cutoff, frame_source);
-    				}
-    			
-    				// Update the reference_box_half_lengths for this new box size.
-    				for (int i = 0; i < frame_source->position_dimension; i++) {
-    					ref_box_half_lengths[i] = frame_source->frame_config->simulation_box_half_lengths[i];
-    				}
-    			}
-    			
-    			// Modify frame weight if using volume weighting.
-    			if (mat->volume_weighting_flag == 1) {
-    				real* half_lengths = frame_source->frame_config->simulation_box_half_lengths;
-    				double volume = 1.0;
-    				for (int i = 0; i < mat->position_dimension; i++) volume *= 2.0 * half_lengths[i];
-    				mat->current_frame_weight *= volume * volume;
-    			}
-				
-				// Process frame information.
-                FrameConfig* frame_config = frame_source->getFrameConfig();
-    			calculate_frame_fm_matrix(cg, mat, frame_config, pair_cell_list, three_body_cell_list, trajectory_block_frame_index);
-            }
-			
-            // Read the next frame; the success of this read will be
-            // checked at the start of the next iteration of the loop.
-            if (frame_source->dynamic_state_sampling == 0) {
-				// Read next frame.
-				// Only do this if we are not currently process the last frame.
-				if ( ((trajectory_block_frame_index + 1) < mat->frames_per_traj_block) ||
-			         ((mat->trajectory_block_index + 1) < n_blocks) ) {
-					read_stat = (*frame_source->get_next_frame)(frame_source);  
-				}
-				traj_frame_num++;
-				
-			} else if (times_sampled < frame_source->dynamic_state_samples_per_frame) {
-				// Resample this frame.
-				frame_source->sampleTypesFromProbs();
-				times_sampled++;
-				
-			} else {
-				// Read next frame, sample frame, and reset sampling counter.
-				// Only do this if we are not currently process the last frame.
-				if ( ((trajectory_block_frame_index + 1) < mat->frames_per_traj_block) ||
-			         ((mat->trajectory_block_index + 1) < n_blocks) ) {
-					read_stat = (*frame_source->get_next_frame)(frame_source);  
-				}
-				frame_source->sampleTypesFromProbs();
-				times_sampled = 1;
-				traj_frame_num++;
-			}
-		}
-		
-        // Print status and do end-of-block computations before wiping the blockwise matrix and beginning anew
-        printf("\r%d (%d) frames have been sampled. ", frame_source->current_frame_n, (mat->trajectory_block_index + 1) * mat->frames_per_traj_block);
-        fflush(stdout);
-        (*mat->do_end_of_frameblock_matrix_manipulations)(mat);
-	}
-
-    printf("\nFinishing frame parsing.\n");
+    std::vector<pid_t> workers(n_shards);
+    std::vector<FILE*> worker_output(n_shards);
+    fflush(stdout);
+    for (int shard = 0; shard < n_shards; shard++) {
+        int pipe_ends[2];
+        if (pipe(pipe_ends) != 0) {
+            printf("Could not open a pipe for trajectory shard %d.\n", shard);
+            exit(EXIT_FAILURE);
+        }
+        workers[shard] = fork();
+        if (workers[shard] < 0) {
+            printf("Could not start a worker for trajectory shard %d.\n", shard);
+            exit(EXIT_FAILURE);
+        } else if (workers[shard] == 0) {
+            // Reopen the trajectory so that no file position is shared with
+            // the other workers, then build this shard's equations.
+            close(pipe_ends[0]);
+            for (int i = 0; i < shard; i++) fclose(worker_output[i]);
+            select_trajectory_shard(frame_source, shard, n_shards, block_frames);
+            frame_source->get_first_frame(frame_source, cg->topo_data.n_cg_sites, cg->topo_data.cg_site_types);
+            if (frame_source->dynamic_state_sampling == 1) frame_source->sampleTypesFromProbs();
+            construct_full_fm_matrix(cg, mat, frame_source);
+            FILE* partial_file = fdopen(pipe_ends[1], "wb");
+            write_partial_fm_equations(mat, partial_file);
+            fclose(partial_file);
+            fflush(stdout);
+            _exit(EXIT_SUCCESS);
+        }
+        close(pipe_ends[1]);
+        worker_output[shard] = fdopen(pipe_ends[0], "rb");
+    }
     
-    // Close the trajectory and free the relevant temp variables.
+    // Combine the partial equations in shard order.
+    for (int shard = 0; shard < n_shards; shard++) {
+        add_partial_fm_equations(mat, worker_output[shard], (shard == 0) ? 1 : 0);
+        fclose(worker_output[shard]);
+    }
+    for (int shard = 0; shard < n_shards; shard++) {
+        int status;
+        if ( (waitpid(workers[shard], &status, 0) != workers[shard]) || !WIFEXITED(status) || (WEXITSTATUS(status) != EXIT_SUCCESS) ) {
+            printf("The worker for trajectory shard %d failed.\n", shard);
+            exit(EXIT_FAILURE);
+        }
+    }
+    printf("\nCombined the FM equations of %d trajectory shards.\n", n_shards);
     frame_source->cleanup(frame_source);
-    delete [] ref_box_half_lengths;
 }
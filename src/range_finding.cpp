@@ -5,10 +5,12 @@
 //  Copyright (c) 2016 The Voth Group at The University of Chicago. All rights reserved.
 //
 
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
 #include <cstring>
 #include <fstream>
+#include <vector>
 
 #include "force_computation.h"
 #include "geometry.h"
@@ -16,6 +18,23 @@
 #include "matrix.h"
 #include "range_finding.h"
 #include "misc.h"
+#include "trajectory_input.h"
+
+// Sampled values of one interaction's parameter are counted in fine bins,
+// since the range of the final histogram is only known once all frames
+// have been sampled. Each half-fm_binwidth histogram bin spans
+// kHistogramSubbins fine bins. The fine bins of nonbonded interactions start
+// from the cutoff, which their sampled range almost always reaches, so that
+// the final histogram bins are made of whole fine bins.
+
+const int kHistogramSubbins = 16;
+
+struct ParameterHistogram {
+	double origin;
+	double bin_width;
+	long first_bin;                         // Fine bin index ((value - origin) / bin_width) of counts[0]
+	std::vector<unsigned long> counts;
+};
 
 //----------------------------------------------------------------------------
 // Prototypes for private implementation routines.
@@ -25,7 +44,7 @@
 
 void initialize_ranges(int tol, double* const lower_cutoffs, double* const upper_cutoffs, std::vector<unsigned> &num);
 
-void initialize_single_class_range_finding_temps(InteractionClassSpec *iclass, InteractionClassComputer *icomp, TopologyData *topo_data);
+void initialize_single_class_range_finding_temps(InteractionClassSpec *iclass, InteractionClassComputer *icomp, TopologyData *topo_data, const bool count_samples);
 
 // Helper functions that issues failure warnings and do special setup
 void report_unrecognized_class_subtype(InteractionClassSpec *iclass);
@@ -33,29 +52,37 @@ void allocate_and_initialize_density_computer_for_range_finding(DensityClassComp
 void setup_site_to_density_group_index_for_range(DensityClassSpec* iclass);
 
 // Functions for computing the full range of sampling of a given class of interaction in a given trajectory.
-void calc_isotropic_two_body_sampling_range(InteractionClassComputer* const icomp, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
-void calc_angular_three_body_sampling_range(InteractionClassComputer* const icomp, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
-void calc_dihedral_four_body_interaction_sampling_range(InteractionClassComputer* const icomp, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
-void evaluate_density_sampling_range(InteractionClassComputer* const info, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
-void calc_nothing(InteractionClassComputer* const icomp, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
+void calc_isotropic_two_body_sampling_range(InteractionClassComputer* const icomp, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
+void calc_angular_three_body_sampling_range(InteractionClassComputer* const icomp, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
+void calc_dihedral_four_body_interaction_sampling_range(InteractionClassComputer* const icomp, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
+void evaluate_density_sampling_range(InteractionClassComputer* const info, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
+void calc_nothing(InteractionClassComputer* const icomp, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat);
+inline void record_sampled_parameter(InteractionClassComputer* const icomp, const double param, const bool in_distribution);
 
 void write_interaction_range_data_to_file(CG_MODEL_DATA* const cg, MATRIX_DATA* const mat,  FILE* const nonbonded_spline_output_filep, FILE* const bonded_spline_output_filep, FILE* const density_interaction_output_filep);
 
+void trim_sampled_ranges(InteractionClassSpec* const ispec, const int range_trim_style, const double range_trim_threshold);
 void write_iclass_range_specifications(InteractionClassComputer* const icomp, char **name, MATRIX_DATA* const mat, FILE* const solution_spline_output_file);
 void write_one_body_iclass_range_specifications(InteractionClassComputer* const icomp, char **name, MATRIX_DATA* const mat, FILE* const solution_spline_output_file);
 void write_single_range_specification(InteractionClassComputer* const icomp, char **name, MATRIX_DATA* const mat, FILE* const solution_spline_output_file, const int index_among_defined);
 
 void read_density_parameter_file(DensityClassSpec* const ispec);
-void read_interaction_file_and_build_matrix(MATRIX_DATA* mat, InteractionClassComputer* const icomp, double volume, TopologyData* const topo_data, char ** const name);
-void read_one_param_dist_file_pair(InteractionClassComputer* const icomp, char ** const name, MATRIX_DATA* mat, const int index_among_defined_intrxns, int &counter, double num_of_pairs, double volume);
+void read_interaction_file_and_build_matrix(MATRIX_DATA* mat, InteractionClassComputer* const icomp, char ** const name);
+void read_one_param_dist_file_pair(InteractionClassComputer* const icomp, char ** const name, MATRIX_DATA* mat, const int index_among_defined_intrxns, int &counter, double pair_density);
 void read_one_param_dist_file_other(InteractionClassComputer* const icomp, char ** const name, MATRIX_DATA* mat, const int index_among_defined_intrxns, int &counter, double num_of_pairs);
 
 // Output parameter distribution functions
+void allocate_parameter_histograms_for_class(InteractionClassSpec* const ispec);
+inline void add_to_parameter_histogram(ParameterHistogram* const histogram, const double value);
+void free_parameter_histograms_for_class(InteractionClassSpec* const ispec);
 void open_parameter_distribution_files_for_class(InteractionClassComputer* const icomp, char **name); 
 void close_parameter_distribution_files_for_class(InteractionClassComputer* const icomp);
-void remove_dist_files(InteractionClassComputer* const icomp, char **name);
 void generate_parameter_distribution_histogram(InteractionClassComputer* const icomp, char **name);
 
+// Combination of the ranges sampled by separate trajectory shard workers
+void write_partial_class_ranges(InteractionClassSpec* const ispec, FILE* const partial_file);
+void add_partial_class_ranges(InteractionClassSpec* const ispec, FILE* const partial_file);
+
 // Dummy implementations
 void do_not_initialize_fm_matrix(MATRIX_DATA* const mat);
 
@@ -79,9 +106,9 @@ void initialize_range_finding_temps(CG_MODEL_DATA* const cg)
 	std::list<InteractionClassSpec*>::iterator iclass_iterator;
 	std::list<InteractionClassComputer*>::iterator icomp_iterator;
 	for(iclass_iterator=cg->iclass_list.begin(), icomp_iterator=cg->icomp_list.begin(); (iclass_iterator != cg->iclass_list.end()) && (icomp_iterator != cg->icomp_list.end()); iclass_iterator++, icomp_iterator++) {	
-		initialize_single_class_range_finding_temps((*iclass_iterator), (*icomp_iterator), &cg->topo_data);
+		initialize_single_class_range_finding_temps((*iclass_iterator), (*icomp_iterator), &cg->topo_data, (cg->range_trim_style != 0));
 	}
-    initialize_single_class_range_finding_temps(&cg->three_body_nonbonded_interactions, &cg->three_body_nonbonded_computer, &cg->topo_data);
+    initialize_single_class_range_finding_temps(&cg->three_body_nonbonded_interactions, &cg->three_body_nonbonded_computer, &cg->topo_data, false);
 	if(cg->density_interactions.class_subtype != 0) {
 		density_additional_setup_for_defined_interactions(&cg->density_interactions, &cg->topo_data);
 		DensityClassSpec* d_spec = static_cast<DensityClassSpec*>(&cg->density_interactions);
@@ -98,7 +125,7 @@ void initialize_range_finding_temps(CG_MODEL_DATA* const cg)
 	cg->pair_nonbonded_cutoff2 = VERYLARGE * VERYLARGE;
 }
 
-void initialize_single_class_range_finding_temps(InteractionClassSpec *iclass, InteractionClassComputer *icomp, TopologyData *topo_data) 
+void initialize_single_class_range_finding_temps(InteractionClassSpec *iclass, InteractionClassComputer *icomp, TopologyData *topo_data, const bool count_samples) 
 {
 	if( iclass->class_type == kDensity && iclass->class_subtype == 0 ) {
 		iclass->dummy_setup_for_defined_interactions(topo_data);
@@ -158,11 +185,17 @@ void initialize_single_class_range_finding_temps(InteractionClassSpec *iclass, I
     iclass->n_to_force_match = iclass->get_n_defined();
     iclass->interaction_column_indices = std::vector<unsigned>(iclass->n_to_force_match + 1);
 	
+	// The sampled values are counted for trimming the ranges as well as for the distributions.
 	char** name = select_name(iclass, topo_data->name);
-	if(iclass->output_parameter_distribution == 1 || iclass->output_parameter_distribution == 2 ){
+	if(iclass->output_parameter_distribution == 1 || iclass->output_parameter_distribution == 2 || count_samples){
 		if (iclass->class_type == kPairNonbonded || iclass->class_type == kPairBonded || 
-		           iclass->class_type == kAngularBonded || iclass->class_type == kDihedralBonded) {
-		    open_parameter_distribution_files_for_class(icomp, name);
+		           iclass->class_type == kAngularBonded || iclass->class_type == kDihedralBonded ||
+		           (iclass->class_type == kDensity && iclass->class_subtype > 0) ) {
+		    allocate_parameter_histograms_for_class(iclass);
+		    // The individual values are only written out when they are to be kept.
+		    if (iclass->output_parameter_distribution == 2) open_parameter_distribution_files_for_class(icomp, name);
+		    // Nonbonded distributions are normalized by the pairs present in the sampled frames.
+		    if (iclass->class_type == kPairNonbonded && iclass->output_parameter_distribution != 0) iclass->sampled_pair_densities = new double[iclass->get_n_defined()]();
 		} else {
 			// do nothing here
 		}
@@ -288,37 +321,25 @@ void setup_site_to_density_group_index_for_range(DensityClassSpec* iclass)
 
 //--------------------------------------------------------------------------
 
-void calc_isotropic_two_body_sampling_range(InteractionClassComputer* const icomp, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
+void calc_isotropic_two_body_sampling_range(InteractionClassComputer* const icomp, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
 {
     int particle_ids[2] = {icomp->k, icomp->l};
     double param;
     calc_distance(particle_ids, x, simulation_box_half_lengths, param);
 
-    if (icomp->ispec->lower_cutoffs[icomp->index_among_defined_intrxns] > param) icomp->ispec->lower_cutoffs[icomp->index_among_defined_intrxns] = param;
-    if (icomp->ispec->upper_cutoffs[icomp->index_among_defined_intrxns] < param) icomp->ispec->upper_cutoffs[icomp->index_among_defined_intrxns] = param;
-	
-	if (icomp->ispec->output_parameter_distribution == 1 || icomp->ispec->output_parameter_distribution == 2) {
-		if (icomp->ispec->class_type == kPairBonded || icomp->ispec->class_type == kAngularBonded || icomp->ispec->class_type == kDihedralBonded) {
-			fprintf(icomp->ispec->output_range_file_handles[icomp->index_among_defined_intrxns], "%lf\n", param);
-		} else if( (icomp->ispec->class_type == kPairNonbonded) && (param < icomp->ispec->cutoff)) {
-		 	fprintf(icomp->ispec->output_range_file_handles[icomp->index_among_defined_intrxns], "%lf\n", param);
-		}
-	}
+	// Nonbonded distances beyond the cutoff extend the range but are left out of the distribution.
+	record_sampled_parameter(icomp, param, (icomp->ispec->class_type != kPairNonbonded) || (param < icomp->ispec->cutoff));
 }
 
-void calc_angular_three_body_sampling_range(InteractionClassComputer* const icomp, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
+void calc_angular_three_body_sampling_range(InteractionClassComputer* const icomp, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
 {
     int particle_ids[3] = {icomp->k, icomp->l, icomp->j}; // end indices (k, l) followed by center index (j)
     double param;
     calc_angle(particle_ids, x, simulation_box_half_lengths, param);
-
-    if (icomp->ispec->lower_cutoffs[icomp->index_among_defined_intrxns] > param) icomp->ispec->lower_cutoffs[icomp->index_among_defined_intrxns] = param;
-    if (icomp->ispec->upper_cutoffs[icomp->index_among_defined_intrxns] < param) icomp->ispec->upper_cutoffs[icomp->index_among_defined_intrxns] = param;
-	
-	if (icomp->ispec->output_parameter_distribution == 1 || icomp->ispec->output_parameter_distribution == 2) fprintf(icomp->ispec->output_range_file_handles[icomp->index_among_defined_intrxns], "%lf\n", param);
+	record_sampled_parameter(icomp, param, true);
 }
 
-void calc_dihedral_four_body_interaction_sampling_range(InteractionClassComputer* const icomp, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
+void calc_dihedral_four_body_interaction_sampling_range(InteractionClassComputer* const icomp, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
 {
 	if (mat->position_dimension != 3) {
     	printf("Dihedral calculations are currently only implemented for 3-dimensional systems.\n");
@@ -328,26 +349,227 @@ void calc_dihedral_four_body_interaction_sampling_range(InteractionClassComputer
     int particle_ids[4] = {icomp->k, icomp->l, icomp->i, icomp->j}; // end indices (k, l) followed by central bond indices (i, j)
     double param;
     calc_dihedral(particle_ids, x, simulation_box_half_lengths, param);
-    
-    if (icomp->ispec->lower_cutoffs[icomp->index_among_defined_intrxns] > param) icomp->ispec->lower_cutoffs[icomp->index_among_defined_intrxns] = param;
-    if (icomp->ispec->upper_cutoffs[icomp->index_among_defined_intrxns] < param) icomp->ispec->upper_cutoffs[icomp->index_among_defined_intrxns] = param;
-	
-	if (icomp->ispec->output_parameter_distribution == 1 || icomp->ispec->output_parameter_distribution == 2) fprintf(icomp->ispec->output_range_file_handles[icomp->index_among_defined_intrxns], "%lf\n", param);
+	record_sampled_parameter(icomp, param, true);
 }
 
-void evaluate_density_sampling_range(InteractionClassComputer* const info, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
+void evaluate_density_sampling_range(InteractionClassComputer* const info, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat)
 {
 	DensityClassComputer* icomp = static_cast<DensityClassComputer*>(info);
 	DensityClassSpec* ispec = static_cast<DensityClassSpec*>(icomp->ispec);	
 	double param = icomp->density_values[icomp->index_among_defined_intrxns * ispec->n_cg_sites + icomp->k];
+	record_sampled_parameter(icomp, param, true);
+}
+
+void calc_nothing(InteractionClassComputer* const icomp, std::array<frame_real, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat) {
+}
+
+// Extend the sampled range of the current interaction to include this parameter value
+// and count it in the interaction's distribution if one is being collected.
+
+inline void record_sampled_parameter(InteractionClassComputer* const icomp, const double param, const bool in_distribution)
+{
+	InteractionClassSpec* ispec = icomp->ispec;
+	const int index = icomp->index_among_defined_intrxns;
+	if (ispec->lower_cutoffs[index] > param) ispec->lower_cutoffs[index] = param;
+	if (ispec->upper_cutoffs[index] < param) ispec->upper_cutoffs[index] = param;
 	
-	if (icomp->ispec->lower_cutoffs[icomp->index_among_defined_intrxns] > param) icomp->ispec->lower_cutoffs[icomp->index_among_defined_intrxns] = param;
-    if (icomp->ispec->upper_cutoffs[icomp->index_among_defined_intrxns] < param) icomp->ispec->upper_cutoffs[icomp->index_among_defined_intrxns] = param;
+	if (ispec->parameter_histograms == NULL || !in_distribution) return;
+	add_to_parameter_histogram(&ispec->parameter_histograms[index], param);
+	if (ispec->output_parameter_distribution == 2) fprintf(ispec->output_range_file_handles[index], "%lf\n", param);
+}
+
+// Sample the interaction ranges over every frame sample of a frame source.
+// Frames of weight 0.0 are excluded. If frame_cache is not NULL, each frame
+// read is also written to it, once, before its states are resampled.
+
+void construct_range_finding_matrix(CG_MODEL_DATA* const cg, MATRIX_DATA* const mat, FrameSource* const frame_source, BinaryTrajectoryWriter* const frame_cache)
+{
+    int n_blocks;
+	int total_frame_samples = frame_source->n_frames;
+	int traj_frame_num = 0;
+	int times_sampled = 1;
+    int read_stat = 1;
+	double* ref_box_half_lengths = new double[frame_source->position_dimension];
+	    
+    // Skip the desired number of frames before starting the matrix building loops.
+    frame_source->move_to_start_frame(frame_source);
+    
+    // Perform initial generation of cell lists user for generating neighbor lists.
+    // This list will only be rebuilt if the box dimensions change.
+    
+    // Initialize the cell linked lists for finding neighbors in the provided frames;
+  	PairCellList pair_cell_list = PairCellList();
+    ThreeBCellList three_body_cell_list = ThreeBCellList();
+    pair_cell_list.init(cg->pair_nonbonded_interactions.cutoff, frame_source);
+    if (cg->three_body_nonbonded_interactions.class_subtype > 0) {
+    	double max_cutoff = 0.0;
+        for (int i = 0; i < cg->three_body_nonbonded_interactions.get_n_defined(); i++) {
+        	max_cutoff = fmax(max_cutoff, cg->three_body_nonbonded_interactions.three_body_nonbonded_cutoffs[i]);
+        }
+    three_body_cell_list.init(max_cutoff, frame_source);
+    }
+	
+	// Record this box's dimensions.
+	for (int i = 0; i < frame_source->position_dimension; i++) {
+		ref_box_half_lengths[i] = frame_source->frame_config->simulation_box_half_lengths[i];
+	}
+
+    // Begin the main building loops. This routine operates as a for loop
+    // over frame blocks wrapped around a loop over frames within each block.
+    // In the inner loop, frames are read every iteration and new matrix elements are computed.
+    // In the outer loop, the blockwise matrix is incorporated into the total equations, 
+    // then wiped for the process to start again with the next iteration.
+
+    // Set up the loop index limits for the inner and outer loops.
+	if (frame_source->dynamic_state_sampling == 1) {
+		total_frame_samples = frame_source->n_frames * frame_source->dynamic_state_samples_per_frame;
+	}
+	
+    if (mat->matrix_type == kDense) {
+        n_blocks = total_frame_samples;
+        mat->frames_per_traj_block = 1;
+    } else {
+		// Check if number of frames is divisible by frames per trajectory block.
+		if (total_frame_samples % mat->frames_per_traj_block != 0) {
+			printf("Total number of frame samples %d is not divisible by block size %d.\n", total_frame_samples, mat->frames_per_traj_block);
+			exit(EXIT_FAILURE);
+		}
+		n_blocks = total_frame_samples / mat->frames_per_traj_block;
+	}
+
+    mat->accumulation_row_shift = 0;
+
+    // For each block of frame samples.
+    printf("Entering primary matrix-building loop.\n"); fflush(stdout);
+    for (mat->trajectory_block_index = 0; mat->trajectory_block_index < n_blocks; mat->trajectory_block_index++) {
+        
+        // Wipe the matrix, then calculate the target virial for all frames in this block.
+        (*mat->set_fm_matrix_to_zero)(mat);
+        add_target_virials_from_trajectory(mat, frame_source->pressure_constraint_rhs_vector);
+
+        // For each frame sample in this block
+        for (int trajectory_block_frame_index = 0; trajectory_block_frame_index < mat->frames_per_traj_block; trajectory_block_frame_index++) {
 	
-	if (icomp->ispec->output_parameter_distribution == 1 || icomp->ispec->output_parameter_distribution == 2) fprintf(icomp->ispec->output_range_file_handles[icomp->index_among_defined_intrxns], "%lf\n", param);
+		    // Check that the last frame was read successfully (read at end of each iteration)
+    		if (read_stat == 0) {
+        		printf("Failure reading frame %d (%d). Check trajectory for errors.\n", frame_source->current_frame_n, mat->trajectory_block_index * mat->frames_per_traj_block + trajectory_block_frame_index);
+        		exit(EXIT_FAILURE);
+    		}
+
+            // Cache each frame once, before any resampling of its states.
+            if ( (frame_cache != NULL) && (times_sampled == 1) ) write_binary_trajectory_frame(frame_cache, frame_source);
+
+            // If reweighting is being used, scale the block of the FM matrix for this frame
+            // by the appropriate weighting factor
+            if (frame_source->use_statistical_reweighting) {
+                printf("Reweighting entries for trajectory frame %d. ", traj_frame_num);
+                mat->current_frame_weight = frame_source->frame_weights[traj_frame_num];
+            }
+            
+            //Skip processing frame if frame weight is 0.
+            if (frame_source->use_statistical_reweighting && mat->current_frame_weight == 0.0) {
+            } else {
+            
+            	// Check if the simulation box has changed.
+            	int box_change = 0;
+            	for (int i = 0; i < frame_source->position_dimension; i++) {
+					if ( fabs(ref_box_half_lengths[i] - frame_source->frame_config->simulation_box_half_lengths[i]) > VERYSMALL_F ) {
+						box_change = 1;
+						break;
+					}
+				}
+				
+				// Redo cell list set-up and update reference box size if box has changed.
+				if (box_change == 1) {
+	            	// Re-initialize the cell linked lists for finding neighbors in the provided frames;
+  					pair_cell_list = PairCellList();
+    				three_body_cell_list = ThreeBCellList();
+    				pair_cell_list.init(cg->pair_nonbonded_interactions.cutoff, frame_source);
+    				if (cg->three_body_nonbonded_interactions.class_subtype > 0) {
+        				double max_cutoff = 0.0;
+        				for (int i = 0; i < cg->three_body_nonbonded_interactions.get_n_defined(); i++) {
+            				max_cutoff = fmax(max_cutoff, cg->three_body_nonbonded_interactions.three_body_nonbonded_cutoffs[i]);
+        				}
+        				three_body_cell_list.init(max_cutoff, frame_source);
+    				}
+    				
+    				// Update the reference_box_half_lengths for this new box size.
+    				for (int i = 0; i < frame_source->position_dimension; i++) {
+    					ref_box_half_lengths[i] = frame_source->frame_config->simulation_box_half_lengths[i];
+    				}
+    			}
+                FrameConfig* frame_config = frame_source->getFrameConfig();
+    			calculate_frame_fm_matrix(cg, mat, frame_config, pair_cell_list, three_body_cell_list, trajectory_block_frame_index);
+    			record_frame_pair_densities(cg, frame_config->simulation_box_half_lengths);
+            }
+
+            // Read the next frame; the success of this read will be
+            // checked at the start of the next iteration of the loop.
+            if (frame_source->dynamic_state_sampling == 0) {
+				// Read next frame.
+				// Only do this if we are not currently process the last frame.
+				if ( ((trajectory_block_frame_index + 1) < mat->frames_per_traj_block) ||
+			         ((mat->trajectory_block_index + 1) < n_blocks) ) {
+					read_stat = (*frame_source->get_next_frame)(frame_source);  
+				}
+				traj_frame_num++;
+			
+			} else if (times_sampled < frame_source->dynamic_state_samples_per_frame) {
+				// Resample this frame.
+				frame_source->sampleTypesFromProbs();
+				times_sampled++;
+			
+			} else {
+				// Read next frame, sample frame, and reset sampling counter.
+				// Only do this if we are not currently process the last frame.
+				if ( ((trajectory_block_frame_index + 1) < mat->frames_per_traj_block) ||
+			         ((mat->trajectory_block_index + 1) < n_blocks) ) {
+					read_stat = (*frame_source->get_next_frame)(frame_source);  
+				}
+				frame_source->sampleTypesFromProbs();
+				times_sampled = 1;
+				traj_frame_num++;
+			
+			}
+		}
+
+        // Print status and do end-of-block computations before wiping the blockwise matrix and beginning anew
+        printf("\r%d (%d) frames have been sampled. ", frame_source->current_frame_n, (mat->trajectory_block_index + 1) * mat->frames_per_traj_block);
+        fflush(stdout);
+        (*mat->do_end_of_frameblock_matrix_manipulations)(mat);
+	}
+
+    printf("\nFinishing frame parsing.\n");
+    
+    // Close the trajectory and free the relevant temp variables.
+    frame_source->cleanup(frame_source);
+    delete [] ref_box_half_lengths;
 }
 
-void calc_nothing(InteractionClassComputer* const icomp, std::array<double, DIMENSION>* const &x, const real *simulation_box_half_lengths, MATRIX_DATA* const mat) {
+// Add the number of pairs per unit volume in this frame to the sums for each
+// defined nonbonded interaction. The box and the site types of every sampled
+// frame are counted, so that pair distributions of trajectories with changing
+// volumes or dynamic types are normalized correctly.
+
+void record_frame_pair_densities(CG_MODEL_DATA* const cg, const real* const simulation_box_half_lengths)
+{
+	InteractionClassSpec* ispec = &cg->pair_nonbonded_interactions;
+	if (ispec->sampled_pair_densities == NULL) return;
+	
+	double volume = 1.0;
+	for (int i = 0; i < DIMENSION; i++) volume *= 2.0 * simulation_box_half_lengths[i];
+	std::vector<int> type_counts(cg->topo_data.n_cg_types, 0);
+	for (unsigned j = 0; j < cg->topo_data.n_cg_sites; j++) type_counts[cg->topo_data.cg_site_types[j] - 1]++;
+	
+	for (int i = 0; i < ispec->get_n_defined(); i++) {
+		std::vector<int> type_vector = ispec->get_interaction_types(i);
+		double num_pairs = (double)type_counts[type_vector[0] - 1] * (double)type_counts[type_vector[1] - 1];
+		if (type_vector[0] == type_vector[1]) {
+			num_pairs -= type_counts[type_vector[0] - 1];
+			num_pairs /= 2.0;
+		}
+		ispec->sampled_pair_densities[i] += num_pairs / volume;
+	}
 }
 
 //--------------------------------------------------------------------------
@@ -372,6 +594,9 @@ void write_interaction_range_data_to_file(CG_MODEL_DATA* const cg, MATRIX_DATA*
 	std::list<InteractionClassComputer*>::iterator icomp_iterator;
     for(iclass_iterator = cg->iclass_list.begin(), icomp_iterator = cg->icomp_list.begin(); (iclass_iterator != cg->iclass_list.end()) && (icomp_iterator != cg->icomp_list.end()); iclass_iterator++, icomp_iterator++) {
         char** name = select_name((*iclass_iterator), cg->name);
+        if ( (cg->range_trim_style != 0) && ((*iclass_iterator)->parameter_histograms != NULL) ) {
+        	trim_sampled_ranges(*iclass_iterator, cg->range_trim_style, cg->range_trim_threshold);
+        }
 		if ((*iclass_iterator)->class_type == kPairNonbonded) {
             write_iclass_range_specifications(*icomp_iterator, name, mat, nonbonded_spline_output_filep);
         } else if ((*iclass_iterator)->class_type == kDensity) {
@@ -382,6 +607,38 @@ void write_interaction_range_data_to_file(CG_MODEL_DATA* const cg, MATRIX_DATA*
     }
 }
 
+// Move each end of the sampled ranges inwards past the sparsely sampled tail,
+// leaving at most the threshold number (style 1) or fraction (style 2) of the
+// counted values beyond it. The ends are placed at fine bin edges, so that
+// the trimmed range still covers every value of the bins it keeps. The
+// upper ends of nonbonded ranges stay at the largest sampled distance, since
+// the cutoff and not the sampling decides where these interactions end.
+
+void trim_sampled_ranges(InteractionClassSpec* const ispec, const int range_trim_style, const double range_trim_threshold)
+{
+	for (int i = 0; i < ispec->get_n_defined(); i++) {
+		const ParameterHistogram &histogram = ispec->parameter_histograms[i];
+		unsigned long n_values = 0;
+		for (unsigned j = 0; j < histogram.counts.size(); j++) n_values += histogram.counts[j];
+		if (n_values == 0) continue;
+		double n_trimmed = (range_trim_style == 1) ? range_trim_threshold : range_trim_threshold * (double)n_values;
+		if (n_trimmed >= (double)n_values) continue;
+		
+		long lower_bin = 0;
+		for (double n_below = 0.0; n_below + histogram.counts[lower_bin] <= n_trimmed; lower_bin++) n_below += histogram.counts[lower_bin];
+		long upper_bin = (long)histogram.counts.size() - 1;
+		if (ispec->class_type != kPairNonbonded) {
+			for (double n_above = 0.0; n_above + histogram.counts[upper_bin] <= n_trimmed; upper_bin--) n_above += histogram.counts[upper_bin];
+		}
+		if (lower_bin > upper_bin) continue;
+		
+		ispec->lower_cutoffs[i] = std::max(ispec->lower_cutoffs[i], histogram.origin + (histogram.first_bin + lower_bin) * histogram.bin_width);
+		if (ispec->class_type != kPairNonbonded) {
+			ispec->upper_cutoffs[i] = std::min(ispec->upper_cutoffs[i], histogram.origin + (histogram.first_bin + upper_bin + 1) * histogram.bin_width);
+		}
+	}
+}
+
 void write_iclass_range_specifications(InteractionClassComputer* const icomp, char **name, MATRIX_DATA* const mat, FILE* const solution_spline_output_file) 
 {
 	// Name is selected in calling function write_interaction_range_data_to_file.
@@ -393,19 +650,10 @@ void write_iclass_range_specifications(InteractionClassComputer* const icomp, ch
         }
     }
 	
-	if (iclass->output_parameter_distribution == 1 || iclass->output_parameter_distribution == 2) {
-		if(iclass->class_type == kDensity && iclass->class_subtype > 0) {
-			close_parameter_distribution_files_for_class(icomp);
-			generate_parameter_distribution_histogram(icomp, name); // name is set correctly in write_interaction_range_data_to_file
-			remove_dist_files(icomp, name);
-		} else if (iclass->class_type == kPairNonbonded || iclass->class_type == kPairBonded || 
-		           iclass->class_type == kAngularBonded || iclass->class_type == kDihedralBonded) {
-			close_parameter_distribution_files_for_class(icomp);
-			generate_parameter_distribution_histogram(icomp, name);
-			remove_dist_files(icomp, name);
-		} else {
-			// do nothing for these
-		}
+	if (iclass->parameter_histograms != NULL) {
+		if (iclass->output_parameter_distribution == 2) close_parameter_distribution_files_for_class(icomp);
+		if (iclass->output_parameter_distribution != 0) generate_parameter_distribution_histogram(icomp, name); // name is set correctly in write_interaction_range_data_to_file
+		free_parameter_histograms_for_class(iclass);
 	}
 }
 
@@ -485,6 +733,150 @@ void read_density_parameter_file(DensityClassSpec* const ispec)
 	delete [] elements;
 }
 
+void allocate_parameter_histograms_for_class(InteractionClassSpec* const ispec)
+{
+	ispec->parameter_histograms = new ParameterHistogram[ispec->get_n_defined()];
+	for (int i = 0; i < ispec->get_n_defined(); i++) {
+		ispec->parameter_histograms[i].origin = (ispec->class_type == kPairNonbonded) ? ispec->cutoff : 0.0;
+		ispec->parameter_histograms[i].bin_width = 0.5 * ispec->get_fm_binwidth() / (double)(kHistogramSubbins);
+		ispec->parameter_histograms[i].first_bin = 0;
+	}
+}
+
+// Count a value in its fine bin. The bins are grown on demand by at least
+// their current number, so that a drifting range is extended only a few times.
+
+inline void add_to_parameter_histogram(ParameterHistogram* const histogram, const double value)
+{
+	long bin = (long)floor((value - histogram->origin) / histogram->bin_width);
+	if (histogram->counts.empty()) {
+		histogram->first_bin = bin;
+		histogram->counts.assign(1, 0);
+	} else if (bin < histogram->first_bin) {
+		long n_new_bins = std::max(histogram->first_bin - bin, (long)histogram->counts.size());
+		histogram->counts.insert(histogram->counts.begin(), n_new_bins, 0);
+		histogram->first_bin -= n_new_bins;
+	} else if (bin - histogram->first_bin >= (long)histogram->counts.size()) {
+		long n_new_bins = std::max(bin - histogram->first_bin + 1 - (long)histogram->counts.size(), (long)histogram->counts.size());
+		histogram->counts.resize(histogram->counts.size() + n_new_bins, 0);
+	}
+	histogram->counts[bin - histogram->first_bin]++;
+}
+
+void free_parameter_histograms_for_class(InteractionClassSpec* const ispec)
+{
+	delete [] ispec->parameter_histograms;
+	ispec->parameter_histograms = NULL;
+}
+
+// The sampled ranges and fine-binned histograms of a trajectory shard are
+// passed on class by class. Ranges are combined by taking the extremes and
+// histograms by summing the counts of matching fine bins, so the combined
+// result is the same as for a single pass over the whole trajectory. The
+// nonbonded pair densities are summed as well.
+
+void write_partial_ranges(CG_MODEL_DATA* const cg, FILE* const partial_file)
+{
+	std::list<InteractionClassSpec*>::iterator iclass_iterator;
+	for(iclass_iterator = cg->iclass_list.begin(); iclass_iterator != cg->iclass_list.end(); iclass_iterator++) {
+		write_partial_class_ranges(*iclass_iterator, partial_file);
+	}
+	write_partial_class_ranges(&cg->three_body_nonbonded_interactions, partial_file);
+	if (fflush(partial_file) != 0) {
+		printf("Could not pass on partial interaction ranges.\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+void write_partial_class_ranges(InteractionClassSpec* const ispec, FILE* const partial_file)
+{
+	size_t n_defined = ispec->get_n_defined();
+	size_t n_written = fwrite(ispec->lower_cutoffs, sizeof(double), n_defined, partial_file);
+	n_written += fwrite(ispec->upper_cutoffs, sizeof(double), n_defined, partial_file);
+	size_t n_expected = 2 * n_defined;
+	if (ispec->parameter_histograms != NULL) {
+		for (size_t i = 0; i < n_defined; i++) {
+			const ParameterHistogram &histogram = ispec->parameter_histograms[i];
+			long n_bins = (long)histogram.counts.size();
+			n_written += fwrite(&histogram.first_bin, sizeof(long), 1, partial_file);
+			n_written += fwrite(&n_bins, sizeof(long), 1, partial_file);
+			if (n_bins > 0) n_written += fwrite(&histogram.counts[0], sizeof(unsigned long), n_bins, partial_file);
+			n_expected += 2 + n_bins;
+		}
+	}
+	if (ispec->sampled_pair_densities != NULL) {
+		n_written += fwrite(ispec->sampled_pair_densities, sizeof(double), n_defined, partial_file);
+		n_expected += n_defined;
+	}
+	if (n_written != n_expected) {
+		printf("Could not pass on partial interaction ranges.\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+void add_partial_ranges(CG_MODEL_DATA* const cg, FILE* const partial_file)
+{
+	std::list<InteractionClassSpec*>::iterator iclass_iterator;
+	for(iclass_iterator = cg->iclass_list.begin(); iclass_iterator != cg->iclass_list.end(); iclass_iterator++) {
+		add_partial_class_ranges(*iclass_iterator, partial_file);
+	}
+	add_partial_class_ranges(&cg->three_body_nonbonded_interactions, partial_file);
+}
+
+void add_partial_class_ranges(InteractionClassSpec* const ispec, FILE* const partial_file)
+{
+	size_t n_defined = ispec->get_n_defined();
+	std::vector<double> lower_part(n_defined), upper_part(n_defined);
+	if ( (fread(lower_part.data(), sizeof(double), n_defined, partial_file) != n_defined) ||
+	     (fread(upper_part.data(), sizeof(double), n_defined, partial_file) != n_defined) ) {
+		printf("Could not read partial interaction ranges.\n");
+		exit(EXIT_FAILURE);
+	}
+	for (size_t i = 0; i < n_defined; i++) {
+		ispec->lower_cutoffs[i] = std::min(ispec->lower_cutoffs[i], lower_part[i]);
+		ispec->upper_cutoffs[i] = std::max(ispec->upper_cutoffs[i], upper_part[i]);
+	}
+	if (ispec->parameter_histograms == NULL) return;
+	
+	for (size_t i = 0; i < n_defined; i++) {
+		ParameterHistogram* histogram = &ispec->parameter_histograms[i];
+		long first_bin, n_bins;
+		if ( (fread(&first_bin, sizeof(long), 1, partial_file) != 1) ||
+		     (fread(&n_bins, sizeof(long), 1, partial_file) != 1) ) {
+			printf("Could not read partial interaction ranges.\n");
+			exit(EXIT_FAILURE);
+		}
+		if (n_bins == 0) continue;
+		std::vector<unsigned long> counts_part(n_bins);
+		if (fread(counts_part.data(), sizeof(unsigned long), n_bins, partial_file) != (size_t)n_bins) {
+			printf("Could not read partial interaction ranges.\n");
+			exit(EXIT_FAILURE);
+		}
+		
+		// Widen the fine bins to cover both parts before summing the counts.
+		if (histogram->counts.empty()) {
+			histogram->first_bin = first_bin;
+			histogram->counts.swap(counts_part);
+			continue;
+		}
+		if (first_bin < histogram->first_bin) {
+			histogram->counts.insert(histogram->counts.begin(), histogram->first_bin - first_bin, 0);
+			histogram->first_bin = first_bin;
+		}
+		long last_bin = first_bin + n_bins;
+		if (last_bin - histogram->first_bin > (long)histogram->counts.size()) histogram->counts.resize(last_bin - histogram->first_bin, 0);
+		for (long j = 0; j < n_bins; j++) histogram->counts[first_bin - histogram->first_bin + j] += counts_part[j];
+	}
+	if (ispec->sampled_pair_densities == NULL) return;
+	
+	std::vector<double> densities_part(n_defined);
+	if (fread(densities_part.data(), sizeof(double), n_defined, partial_file) != n_defined) {
+		printf("Could not read partial interaction ranges.\n");
+		exit(EXIT_FAILURE);
+	}
+	for (size_t i = 0; i < n_defined; i++) ispec->sampled_pair_densities[i] += densities_part[i];
+}
+
 void open_parameter_distribution_files_for_class(InteractionClassComputer* const icomp, char **name) 
 {
 	// The correct name is selected in calling function initialize_single_class_range_finding_temps
@@ -507,30 +899,14 @@ void close_parameter_distribution_files_for_class(InteractionClassComputer* cons
 	delete [] ispec->output_range_file_handles;
 }
 
-void remove_dist_files(InteractionClassComputer* const icomp, char **name) 
-{
-	// Name is selected in calling function 2x up named write_interaction_range_data_to_file.
-    InteractionClassSpec* ispec = icomp->ispec;	
-    if(ispec->output_parameter_distribution != 1) return;
-    for (int i = 0; i < ispec->get_n_defined(); i++) {
-		// get name of dist file
-		std::string filename = ispec->get_basename(name, i, "_") + ".dist";
-		// remove file
-		remove(filename.c_str());
-	}
-}
-
 void generate_parameter_distribution_histogram(InteractionClassComputer* const icomp, char **name)
 {
 	// Name is selected in calling function 2x up named write_interaction_range_data_to_file.
     InteractionClassSpec* ispec = icomp->ispec;	
 	
 	std::string filename;
-	std::ifstream dist_stream;
 	std::ofstream hist_stream;
 	int num_bins = 0;
-	int	curr_bin;
-	double value; 
 	double* bin_centers;
 	unsigned long* bin_counts;
 	for (int i = 0; i < ispec->get_n_defined(); i++) {
@@ -550,22 +926,22 @@ void generate_parameter_distribution_histogram(InteractionClassComputer* const i
 	      bin_centers[j] = bin_centers[j - 1] + (0.5 * ispec->get_fm_binwidth());
         }
 		
-		// Open distribution file
-	 	filename = ispec->get_basename(name, i, "_") + ".dist";
-		check_and_open_in_stream(dist_stream, filename.c_str()); 
-		
-		// Populate histogram by reading distribution file
-		dist_stream >> value;
-		while (!dist_stream.fail()) {
-		  curr_bin = (int)(floor((value - ispec->lower_cutoffs[i] + VERYSMALL_F) / (0.5 * ispec->get_fm_binwidth())));	
-			if( (curr_bin < num_bins) && (curr_bin >= 0) ) {
-				bin_counts[curr_bin]++;
-			} else if (curr_bin > num_bins) {
-				printf("Warning: Bin %d is out-of-bounds. Array size: %d\n", curr_bin, num_bins);
-				fflush(stdout);
-			}
-			dist_stream >> value;
+		// Populate the histogram from the fine bins counted during sampling.
+		// A fine bin that straddles an edge of the histogram bins is split
+		// between the two in proportion to its overlap with each.
+		const ParameterHistogram &histogram = ispec->parameter_histograms[i];
+		const double half_binwidth = 0.5 * ispec->get_fm_binwidth();
+		std::vector<double> bin_weights(num_bins, 0.0);
+		for (unsigned j = 0; j < histogram.counts.size(); j++) {
+			if (histogram.counts[j] == 0) continue;
+			double bin_start = (histogram.origin + (histogram.first_bin + (long)j) * histogram.bin_width - ispec->lower_cutoffs[i] + VERYSMALL_F) / half_binwidth;
+			double bin_end = bin_start + histogram.bin_width / half_binwidth;
+			int curr_bin = (int)floor(bin_start);
+			double fraction = std::min(1.0, ((double)(curr_bin + 1) - bin_start) / (bin_end - bin_start));
+			if ( (curr_bin < num_bins) && (curr_bin >= 0) ) bin_weights[curr_bin] += fraction * histogram.counts[j];
+			if ( (fraction < 1.0) && (curr_bin + 1 < num_bins) && (curr_bin + 1 >= 0) ) bin_weights[curr_bin + 1] += (1.0 - fraction) * histogram.counts[j];
 		}
+		for (int j = 0; j < num_bins; j++) bin_counts[j] = (unsigned long)(bin_weights[j] + 0.5);
 
 		// Write histogram to file
 		filename = ispec->get_basename(name, i, "_") + ".hist";
@@ -577,16 +953,14 @@ void generate_parameter_distribution_histogram(InteractionClassComputer* const i
 		
 		// Close files
 		hist_stream.close();
-		dist_stream.close();
 		delete [] bin_centers;
 		delete [] bin_counts;
 	}
 }
 
-void calculate_BI(CG_MODEL_DATA* const cg, MATRIX_DATA* mat, FrameSource* const fs)
+void calculate_BI(CG_MODEL_DATA* const cg, MATRIX_DATA* mat)
 {
   initialize_first_BI_matrix(mat, cg);
-  double volume = calculate_volume(fs->simulation_box_limits);
   int solution_counter = 0;
   std::list<InteractionClassComputer*>::iterator icomp_iterator;
   for(icomp_iterator = cg->icomp_list.begin(); icomp_iterator != cg->icomp_list.end(); icomp_iterator++) {
@@ -604,7 +978,7 @@ void calculate_BI(CG_MODEL_DATA* const cg, MATRIX_DATA* mat, FrameSource* const
   	// Do BI for this interaction
   	char** name = select_name((*icomp_iterator)->ispec, cg->name);
     initialize_next_BI_matrix(mat, (*icomp_iterator));
-    read_interaction_file_and_build_matrix(mat, (*icomp_iterator), volume, &cg->topo_data, name);
+    read_interaction_file_and_build_matrix(mat, (*icomp_iterator), name);
     solve_this_BI_equation(mat, solution_counter);
     
     // restore icci
@@ -612,46 +986,31 @@ void calculate_BI(CG_MODEL_DATA* const cg, MATRIX_DATA* mat, FrameSource* const
   }
 }
 
-void read_interaction_file_and_build_matrix(MATRIX_DATA* mat, InteractionClassComputer* const icomp, double volume, TopologyData* topo_data, char ** const name)
+void read_interaction_file_and_build_matrix(MATRIX_DATA* mat, InteractionClassComputer* const icomp, char ** const name)
 { 
   // Name is correctly selected by calling function calculate_BI.
   int counter = 0;
-  int* sitecounter;
-  if (icomp->ispec->class_type == kPairNonbonded) {
-    sitecounter = new int[topo_data->n_cg_types]();
-    for(unsigned j = 0; j < topo_data->n_cg_sites; j++){
-      int type = topo_data->cg_site_types[j];
-      sitecounter[type-1]++;
-    }
-  }
     
   // Otherwise, process the data
   for (unsigned i = 0; i < icomp->ispec->defined_to_matched_intrxn_index_map.size(); i++) {
   	icomp->index_among_defined_intrxns = i; // This is OK since every defined interaction is "matched" here.
   	icomp->set_indices();
 	if( icomp->ispec->class_type == kPairNonbonded ) {
-	  std::vector <int> type_vector = icomp->ispec->get_interaction_types(i);
-	  double num_pairs = sitecounter[type_vector[0]-1] * sitecounter[type_vector[1]-1];
-	  if( type_vector[0] == type_vector[1]){
-	    num_pairs -= sitecounter[type_vector[0]-1];
-	  	num_pairs /= 2.0;
-	  }
-	  read_one_param_dist_file_pair(icomp, name, mat, i, counter,num_pairs, volume);
+	  // Average number of pairs per unit volume over the frames sampled by the rangefinder.
+	  double pair_density = icomp->ispec->sampled_pair_densities[i] * mat->normalization;
+	  read_one_param_dist_file_pair(icomp, name, mat, i, counter, pair_density);
 	} else if ( icomp->ispec->class_type == kPairBonded ) {
-	  read_one_param_dist_file_pair(icomp, name, mat, i, counter, 1.0, 1.0);
+	  read_one_param_dist_file_pair(icomp, name, mat, i, counter, 1.0);
 	} else {
 	  read_one_param_dist_file_other(icomp, name, mat, i, counter, 1.0);
 	}
   }  
-  if (icomp->ispec->class_type == kPairNonbonded) {
-    delete [] sitecounter;
-  }
 }
 
 // Read this hist file to process into Boltzmann inverted potential.
 // At the same time, output an RDF file (r, g(r)).
 
-void read_one_param_dist_file_pair(InteractionClassComputer* const icomp, char** const name, MATRIX_DATA* mat, const int index_among_defined_intrxns, int &counter, double num_of_pairs, double volume)
+void read_one_param_dist_file_pair(InteractionClassComputer* const icomp, char** const name, MATRIX_DATA* mat, const int index_among_defined_intrxns, int &counter, double pair_density)
 {
   // name is corrected selected by calling function 2x up named calculate_BI.
   std::string filename = icomp->ispec->get_basename(name, index_among_defined_intrxns, "_") + ".hist";
@@ -681,7 +1040,7 @@ void read_one_param_dist_file_pair(InteractionClassComputer* const icomp, char**
       if (counts > 0) {
         double dr = r - 0.5 * icomp->ispec->get_fm_binwidth();
       	normalized_counts = (double)(counts) * 3.0 / ( 4.0*PI*( r*r*r - dr*dr*dr) );
-      	normalized_counts *= mat->normalization * volume / num_of_pairs;
+      	normalized_counts *= mat->normalization / pair_density;
       	potential = -mat->temperature*mat->boltzmann*log(normalized_counts);
       } else {
       	normalized_counts = 0.0;
@@ -10,15 +10,25 @@
 
 struct CG_MODEL_DATA;
 struct MATRIX_DATA;
+struct FrameSource;
+struct BinaryTrajectoryWriter;
 
 // Initialization of storage for the range value arrays and their computation
 void initialize_range_finding_temps(CG_MODEL_DATA* const cg);
+void record_frame_pair_densities(CG_MODEL_DATA* const cg, const real* const simulation_box_half_lengths);
+
+// Loop over the frames of a trajectory, sampling the interaction ranges
+void construct_range_finding_matrix(CG_MODEL_DATA* const cg, MATRIX_DATA* const mat, FrameSource* const frame_source, BinaryTrajectoryWriter* const frame_cache);
+
+// Combination of the ranges sampled by separate trajectory shard workers
+void write_partial_ranges(CG_MODEL_DATA* const cg, FILE* const partial_file);
+void add_partial_ranges(CG_MODEL_DATA* const cg, FILE* const partial_file);
 
 // Main output function
 void write_range_files(CG_MODEL_DATA* const cg, MATRIX_DATA* const mat);
 
 // BI implementations
-void calculate_BI(CG_MODEL_DATA* const cg, MATRIX_DATA* mat, FrameSource* const fs);
+void calculate_BI(CG_MODEL_DATA* const cg, MATRIX_DATA* mat);
 bool any_active_parameter_distributions(CG_MODEL_DATA* const cg);
 void screen_interactions_by_distribution(CG_MODEL_DATA* const cg);
 
@@ -11,6 +11,9 @@
 #include <cstdio>
 #include <cstdlib>
 #include <ctime>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "control_input.h"
 #include "force_computation.h"
 #include "interaction_hashing.h"
@@ -21,7 +24,7 @@
 #include "trajectory_input.h"
 #include "fm_output.h"
 
-void construct_full_fm_matrix(CG_MODEL_DATA* const cg, MATRIX_DATA* const mat, FrameSource* const frame_source);
+void construct_sharded_range_finding(CG_MODEL_DATA* const cg, MATRIX_DATA* const mat, FrameSource* const frame_source, const int n_shards);
 
 int main(int argc, char* argv[])
 {
@@ -48,7 +51,7 @@ int main(int argc, char* argv[])
     if (fs.use_statistical_reweighting == 1) {
         printf("Reading per-frame statistical reweighting factors.\n");
         fflush(stdout);
-        read_frame_weights(&fs, control_input.starting_frame, control_input.n_frames, "in"); 
+        read_frame_weights(&fs, control_input.starting_frame, control_input.n_frames, control_input.frame_stride, "in"); 
     }
 
     printf("Reading first frame.\n");
@@ -63,7 +66,11 @@ int main(int argc, char* argv[])
     MATRIX_DATA mat(&control_input, &cg);
 
     printf("Beginning range finding.\n");
-    construct_full_fm_matrix(&cg, &mat, &fs);
+    if (control_input.trajectory_shard_count > 1) {
+        construct_sharded_range_finding(&cg, &mat, &fs, control_input.trajectory_shard_count);
+    } else {
+        construct_range_finding_matrix(&cg, &mat, &fs, NULL);
+    }
     printf("Ending range finding.\n");
     
     printf("Writing final output.\n"); fflush(stdout);
@@ -82,7 +89,7 @@ int main(int argc, char* argv[])
 		screen_interactions_by_distribution(&cg);
 		set_up_force_computers(&cg);
 
-		calculate_BI(&cg,&mat,&fs);
+		calculate_BI(&cg,&mat);
 
 		write_fm_interaction_output_files(&cg,&mat);
 	} else {
@@ -98,163 +105,74 @@ int main(int argc, char* argv[])
     return 0;
 }
 
-void construct_full_fm_matrix(CG_MODEL_DATA* const cg, MATRIX_DATA* const mat, FrameSource* const frame_source)
+void construct_sharded_range_finding(CG_MODEL_DATA* const cg, MATRIX_DATA* const mat, FrameSource* const frame_source, const int n_shards)
 {
-    int n_blocks;
-	int total_frame_samples = frame_source->n_frames;
-	int traj_frame_num = 0;
-	int times_sampled = 1;
-    int read_stat = 1;
-	double* ref_box_half_lengths = new double[frame_source->position_dimension];
-	    
-    // Skip the desired number of frames before starting the matrix building loops.
-    frame_source->move_to_start_frame(frame_source);
+    std::list<InteractionClassSpec*>::iterator iclass_iterator;
+    for (iclass_iterator = cg->iclass_list.begin(); iclass_iterator != cg->iclass_list.end(); iclass_iterator++) {
+        if ((*iclass_iterator)->output_parameter_distribution == 2) {
+            printf("Trajectory sharding does not work with writing individual parameter values to *.dist files.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
     
-    // Perform initial generation of cell lists user for generating neighbor lists.
-    // This list will only be rebuilt if the box dimensions change.
+    // Split at whole blocks of frame samples so that every worker
+    // sees only complete blocks.
+    int samples_per_frame = (frame_source->dynamic_state_sampling == 1) ? frame_source->dynamic_state_samples_per_frame : 1;
+    int common_factor = mat->frames_per_traj_block;
+    for (int remainder = samples_per_frame; remainder != 0; ) {
+        int previous_remainder = remainder;
+        remainder = common_factor % remainder;
+        common_factor = previous_remainder;
+    }
+    int block_frames = mat->frames_per_traj_block / common_factor;
+    if (frame_source->n_frames < n_shards * block_frames) {
+        printf("Cannot split %d frames into %d trajectory shards.\n", frame_source->n_frames, n_shards);
+        exit(EXIT_FAILURE);
+    }
     
-    // Initialize the cell linked lists for finding neighbors in the provided frames;
-  	PairCellList pair_cell_list = PairCellList();
-    ThreeBCellList three_body_cell_list = ThreeBCellList();
-    pair_cell_list.init(cg->pair_nonbonded_interactions.cutoff, frame_source);
-    if (cg->three_body_nonbonded_interactions.class_subtype > 0) {
-    	double max_cutoff = 0.0;
-        for (int i = 0; i < cg->three_body_nonbonded_interactions.get_n_defined(); i++) {
-        	max_cutoff = fmax(max_cutoff, cg->three_body_nonbonded_interactions.three_body_nonbonded_cutoffs[i]);
+    std::vector<pid_t> workers(n_shards);
+    std::vector<FILE*> worker_output(n_shards);
+    fflush(stdout);
+    for (int shard = 0; shard < n_shards; shard++) {
+        int pipe_ends[2];
+        if (pipe(pipe_ends) != 0) {
+            printf("Could not open a pipe for trajectory shard %d.\n", shard);
+            exit(EXIT_FAILURE);
+        }
+        workers[shard] = fork();
+        if (workers[shard] < 0) {
+            printf("Could not start a worker for trajectory shard %d.\n", shard);
+            exit(EXIT_FAILURE);
+        } else if (workers[shard] == 0) {
+            // Reopen the trajectory so that no file position is shared with
+            // the other workers, then sample this shard's ranges.
+            close(pipe_ends[0]);
+            for (int i = 0; i < shard; i++) fclose(worker_output[i]);
+            select_trajectory_shard(frame_source, shard, n_shards, block_frames);
+            frame_source->get_first_frame(frame_source, cg->topo_data.n_cg_sites, cg->topo_data.cg_site_types);
+            construct_range_finding_matrix(cg, mat, frame_source, NULL);
+            FILE* partial_file = fdopen(pipe_ends[1], "wb");
+            write_partial_ranges(cg, partial_file);
+            fclose(partial_file);
+            fflush(stdout);
+            _exit(EXIT_SUCCESS);
         }
-    three_body_cell_list.init(max_cutoff, frame_source);
+        close(pipe_ends[1]);
+        worker_output[shard] = fdopen(pipe_ends[0], "rb");
     }
-	
-	// Record this box's dimensions.
-	for (int i = 0; i < frame_source->position_dimension; i++) {
-		ref_box_half_lengths[i] = frame_source->frame_config->simulation_box_half_lengths[i];
-	}
-
-    // Begin the main building loops. This routine operates as a for loop
-    // over frame blocks wrapped around a loop over frames within each block.
-    // In the inner loop, frames are read every iteration and new matrix elements are computed.
-    // In the outer loop, the blockwise matrix is incorporated into the total equations, 
-    // then wiped for the process to start again with the next iteration.
-
-    // Set up the loop index limits for the inner and outer loops.
-	if (frame_source->dynamic_state_sampling == 1) {
-		total_frame_samples = frame_source->n_frames * frame_source->dynamic_state_samples_per_frame;
-	}
-	
-    if (mat->matrix_type == kDense) {
-        n_blocks = total_frame_samples;
-        mat->frames_per_traj_block = 1;
-    } else {
-		// Check if number of frames is divisible by frames per trajectory block.
-		if (total_frame_samples % mat->frames_per_traj_block != 0) {
-			printf("Total number of frame samples %d is not divisible by block size %d.\n", total_frame_samples, mat->frames_per_traj_block);
-			exit(EXIT_FAILURE);
-		}
-		n_blocks = total_frame_samples / mat->frames_per_traj_block;
-	}
-
-    mat->accumulation_row_shift = 0;
-
-    // For each block of frame samples.
-    printf("Entering primary matrix-building loop.\n"); fflush(stdout);
-    for (mat->trajectory_block_index = 0; mat->trajectory_block_index < n_blocks; mat->trajectory_block_index++) {
-        
-        // Wipe the matrix, then calculate the target virial for all frames in this block.
-        (*mat->set_fm_matrix_to_zero)(mat);
-        add_target_virials_from_trajectory(mat, frame_source->pressure_constraint_rhs_vector);
-
-        // For each frame sample in this block
-        for (int trajectory_block_frame_index = 0; trajectory_block_frame_index < mat->frames_per_traj_block; trajectory_block_frame_index++) {
-	
-		    // Check that the last frame was read successfully (read at end of each iteration)
-    		if (read_stat == 0) {
-        		printf("Failure reading frame %d (%d). Check trajectory for errors.\n", frame_source->current_frame_n, mat->trajectory_block_index * mat->frames_per_traj_block + trajectory_block_frame_index);
-        		exit(EXIT_FAILURE);
-    		}
-
-            // If reweighting is being used, scale the block of the FM matrix for this frame
-            // by the appropriate weighting factor
-            if (frame_source->use_statistical_reweighting) {
-                printf("Reweighting entries for trajectory frame %d. ", traj_frame_num);
-                mat->current_frame_weight = frame_source->frame_weights[traj_frame_num];
-            }
-            
-            //Skip processing frame if frame weight is 0.
-            if (frame_source->use_statistical_reweighting && mat->current_frame_weight == 0.0) {
-            } else {
-            
-            	// Check if the simulation box has changed.
-            	int box_change = 0;
-            	for (int i = 0; i < frame_source->position_dimension; i++) {
-					if ( fabs(ref_box_half_lengths[i] - frame_source->frame_config->simulation_box_half_lengths[i]) > VERYSMALL_F ) {
-						box_change = 1;
-						break;
-					}
-				}
-				
-				// Redo cell list set-up and update reference box size if box has changed.
-				if (box_change == 1) {
-	            	// Re-initialize the cell linked lists for finding neighbors in the provided frames;
-  					pair_cell_list = PairCellList();
-    				three_body_cell_list = ThreeBCellList();
-    				pair_cell_list.init(cg->pair_nonbonded_interactions.cutoff, frame_source);
-    				if (cg->three_body_nonbonded_interactions.class_subtype > 0) {
-        				double max_cutoff = 0.0;
-        				for (int i = 0; i < cg->three_body_nonbonded_interactions.get_n_defined(); i++) {
-            				max_cutoff = fmax(max_cutoff, cg->three_body_nonbonded_interactions.three_body_nonbonded_cutoffs[i]);
-        				}
-        				three_body_cell_list.init(max_cutoff, frame_source);
-    				}
-    				
-    				// Update the reference_box_half_lengths for this new box size.
-    				for (int i = 0; i < frame_source->position_dimension; i++) {
-    					ref_box_half_lengths[i] = frame_source->frame_config->simulation_box_half_lengths[i];
-    				}
-    			}
-                FrameConfig* frame_config = frame_source->getFrameConfig();
-    			calculate_frame_fm_matrix(cg, mat, frame_config, pair_cell_list, three_body_cell_list, trajectory_block_frame_index);
-            }
-
-            // Read the next frame; the success of this read will be
-            // checked at the start of the next iteration of the loop.
-            if (frame_source->dynamic_state_sampling == 0) {
-				// Read next frame.
-				// Only do this if we are not currently process the last frame.
-				if ( ((trajectory_block_frame_index + 1) < mat->frames_per_traj_block) ||
-			         ((mat->trajectory_block_index + 1) < n_blocks) ) {
-					read_stat = (*frame_source->get_next_frame)(frame_source);  
-				}
-				traj_frame_num++;
-			
-			} else if (times_sampled < frame_source->dynamic_state_samples_per_frame) {
-				// Resample this frame.
-				frame_source->sampleTypesFromProbs();
-				times_sampled++;
-			
-			} else {
-				// Read next frame, sample frame, and reset sampling counter.
-				// Only do this if we are not currently process the last frame.
-				if ( ((trajectory_block_frame_index + 1) < mat->frames_per_traj_block) ||
-			         ((mat->trajectory_block_index + 1) < n_blocks) ) {
-					read_stat = (*frame_source->get_next_frame)(frame_source);  
-				}
-				frame_source->sampleTypesFromProbs();
-				times_sampled = 1;
-				traj_frame_num++;
-			
-			}
-		}
-
-        // Print status and do end-of-block computations before wiping the blockwise matrix and beginning anew
-        printf("\r%d (%d) frames have been sampled. ", frame_source->current_frame_n, (mat->trajectory_block_index + 1) * mat->frames_per_traj_block);
-        fflush(stdout);
-        (*mat->do_end_of_frameblock_matrix_manipulations)(mat);
-	}
-
-    printf("\nFinishing frame parsing.\n");
     
-    // Close the trajectory and free the relevant temp variables.
+    // Combine the partial ranges in shard order.
+    for (int shard = 0; shard < n_shards; shard++) {
+        add_partial_ranges(cg, worker_output[shard]);
+        fclose(worker_output[shard]);
+    }
+    for (int shard = 0; shard < n_shards; shard++) {
+        int status;
+        if ( (waitpid(workers[shard], &status, 0) != workers[shard]) || !WIFEXITED(status) || (WEXITSTATUS(status) != EXIT_SUCCESS) ) {
+            printf("The worker for trajectory shard %d failed.\n", shard);
+            exit(EXIT_FAILURE);
+        }
+    }
+    printf("\nCombined the interaction ranges of %d trajectory shards.\n", n_shards);
     frame_source->cleanup(frame_source);
-    delete [] ref_box_half_lengths;
-    
 }
@@ -0,0 +1,225 @@
+//
+//  rangefm.cpp
+//  
+//  This driver determines the interaction ranges and then force matches over
+//  them in a single run. The frames are read from the trajectory only once:
+//  while the ranges are found, each selected frame is also written to a
+//  binary CG trajectory cache, and the force matching equations are then built
+//  from the memory-mapped cache without parsing the trajectory again.
+//
+//  Copyright (c) 2016 The Voth Group at The University of Chicago. All rights reserved.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <unistd.h>
+#include "control_input.h"
+#include "force_computation.h"
+#include "fm_output.h"
+#include "interaction_hashing.h"
+#include "interaction_model.h"
+#include "matrix.h"
+#include "range_finding.h"
+#include "misc.h"
+#include "trajectory_input.h"
+
+// The cache is named uniquely in the working directory so that runs sharing
+// a directory do not overwrite each other's copies. It is removed at exit,
+// including when a run fails, as well as once the force matching has read it.
+std::string frame_cache_filename;
+
+void create_frame_cache_file(void);
+void remove_frame_cache_file(void);
+void find_ranges_and_cache_frames(ControlInputs* const control_input, FrameSource* const frame_source);
+
+int main(int argc, char* argv[])
+{
+    // Begin to compute the total run time
+    double start_cputime = clock();
+    FrameSource trajectory_source;      // Frames read from the trajectory files for range finding
+    FrameSource frame_source;           // Frames read back from the cache for force matching
+    
+    printf("Parsing command line arguments.\n");
+    parse_command_line_arguments(argc, argv, &trajectory_source); 
+    printf("Reading high level control parameters.\n");
+    ControlInputs control_input; 		// Control parameters read from control.in
+    if (control_input.three_body_flag != 0) {
+        printf("Rangefinder does not support three body nonbonded interaction ranges.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (control_input.trajectory_shard_count > 1) {
+        printf("Trajectory sharding is not used by rangefm.x; run rangefinder.x and newfm.x instead.\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    //----------------------------------------------------------------
+    // Find the interaction ranges
+    //----------------------------------------------------------------
+    
+    // Write rmin.in and rmin_b.in (and rmin_den.in) exactly as rangefinder.x
+    // does, keeping a copy of every selected frame.
+    create_frame_cache_file();
+    copy_control_inputs_to_frd(&control_input, &trajectory_source);
+    find_ranges_and_cache_frames(&control_input, &trajectory_source);
+    
+    //----------------------------------------------------------------
+    // Set up the force matching procedure
+    //----------------------------------------------------------------
+    
+    // The model is set up afresh from the range files just written, so the
+    // ranges are adjusted for the basis sets as they are for newfm.x.
+	CG_MODEL_DATA cg(&control_input);   // CG model parameters and data (InteractionClasses and Computers)
+    copy_control_inputs_to_frd(&control_input, &frame_source);
+    select_frame_cache(&frame_source, frame_cache_filename.c_str());
+    printf("Reading topology file.\n");
+    read_topology_file(&cg.topo_data, &cg);
+    printf("Reading interaction ranges.\n");
+    read_all_interaction_ranges(&cg);
+    if (cg.pair_nonbonded_interactions.n_tabulated > 0 ||
+        cg.pair_bonded_interactions.n_tabulated > 0 ||
+        cg.angular_interactions.n_tabulated > 0 ||
+        cg.dihedral_interactions.n_tabulated > 0 ||
+		cg.density_interactions.n_tabulated > 0) {
+        printf("Reading tabulated reference potentials.\n");
+        read_tabulated_interaction_file(&cg, cg.topo_data.n_cg_types);
+    } 
+    
+    // Read statistical weights for each frame if the 
+    // 'use_statistical_reweighting' flag is set in control.in.
+    if (frame_source.use_statistical_reweighting == 1) {
+        printf("Reading per-frame statistical reweighting factors.\n");
+        fflush(stdout);
+        read_frame_weights(&frame_source, control_input.starting_frame, control_input.n_frames, control_input.frame_stride, "in"); 
+    }
+        
+    // Generate bootstrapping weights if the
+    // 'bootstrapping_flag' is set in control.in.
+    if (frame_source.bootstrapping_flag == 1) {
+    	printf("Generating bootstrapping frame weights.\n");
+    	fflush(stdout);
+    	generate_bootstrapping_weights(&frame_source, control_input.n_frames);
+    }
+
+    // Read the input virials if the correct flag was set in control.in.
+    if (frame_source.pressure_constraint_flag == 1) {
+        printf("Reading virial constraint target.\n");
+        read_frame_values("p_con.in", control_input.starting_frame, control_input.n_frames, control_input.frame_stride, frame_source.pressure_constraint_rhs_vector);
+    }
+    
+    printf("Finding first cached frame...\n");
+    frame_source.get_first_frame(&frame_source, cg.topo_data.n_cg_sites, cg.topo_data.cg_site_types);
+	if (frame_source.dynamic_state_sampling == 1) frame_source.sampleTypesFromProbs();
+	
+    // Assign a host of function pointers in 'cg' new definitions
+    // based on matrix implementation, basis set type, etc.
+    set_up_force_computers(&cg);
+
+    // Initialize the force-matching matrix.
+    printf("Initializing FM matrix.\n");
+    MATRIX_DATA mat(&control_input, &cg);
+    if (frame_source.use_statistical_reweighting == 1) {
+        set_normalization(&mat, 1.0 / frame_source.total_frame_weights);
+    }
+    if (frame_source.bootstrapping_flag == 1) {
+    	// Multiply the reweighting frame weights by the bootstrapping weights to determine the appropriate
+    	// net frame weights and normalizations.
+    	if(frame_source.use_statistical_reweighting == 1) {
+    		combine_reweighting_and_boostrapping_weights(&frame_source);
+    	}
+    	set_bootstrapping_normalization(&mat, frame_source.bootstrapping_weights, frame_source.n_frames);
+    }
+        
+    // Record the dimensions of the matrix after initialization in a
+    // solution file.
+    FILE* solution_file = open_file("sol_info.out", "w");
+    fprintf(solution_file, "fm_matrix_rows:%d; fm_matrix_columns:%d;\n",
+            mat.fm_matrix_rows, mat.fm_matrix_columns);
+    fclose(solution_file);
+
+    //----------------------------------------------------------------
+    // Do the force matching
+    //----------------------------------------------------------------
+
+    printf("Constructing FM equations from the frame cache.\n");
+    construct_full_fm_matrix(&cg, &mat, &frame_source);
+    remove_frame_cache_file();
+    printf("Finished constructing FM equations.\n");
+    if (frame_source.bootstrapping_flag == 1) {
+		free_bootstrapping_weights(&frame_source);
+	}
+	
+    printf("Finishing FM.\n");
+    mat.finish_fm(&mat);
+
+    printf("Writing final output.\n"); fflush(stdout);
+    write_fm_interaction_output_files(&cg, &mat);
+	
+    // Record the time and print total elapsed time for profiling purposes.
+    double end_cputime = clock();
+    double elapsed_cputime = ((double)(end_cputime - start_cputime)) / CLOCKS_PER_SEC;
+    printf("%f seconds used.\n", elapsed_cputime);
+    return 0;
+}
+
+// Range finding uses its own model and dummy matrix, which are set up from
+// control.in and top.in as in rangefinder.x and freed once the ranges are written.
+// The cache is written in the precision in which frames are stored, so the
+// force matching sees exactly the frames that were read.
+
+void find_ranges_and_cache_frames(ControlInputs* const control_input, FrameSource* const frame_source)
+{
+    int fm_matrix_type = control_input->matrix_type;
+    CG_MODEL_DATA cg(control_input);
+    printf("Reading topology file.\n");
+    read_topology_file(&cg.topo_data, &cg);
+
+    // Frames with 0.0 weight are excluded from the ranges.
+    if (frame_source->use_statistical_reweighting == 1) {
+        printf("Reading per-frame statistical reweighting factors.\n");
+        fflush(stdout);
+        read_frame_weights(frame_source, control_input->starting_frame, control_input->n_frames, control_input->frame_stride, "in"); 
+    }
+
+    printf("Finding first frame ...\n");
+    frame_source->get_first_frame(frame_source, cg.n_cg_sites, cg.topo_data.cg_site_types);
+
+    printf("Reading interaction ranges.\n");
+    initialize_range_finding_temps(&cg);
+
+    printf("Allocating dummy force matching matrix temps.\n");
+    control_input->matrix_type = kDummy;
+    MATRIX_DATA mat(control_input, &cg);
+    control_input->matrix_type = fm_matrix_type;
+
+    printf("Beginning range finding.\n");
+    BinaryTrajectoryWriter* frame_cache = open_binary_trajectory_writer(frame_cache_filename.c_str(), frame_source, (sizeof(frame_real) == sizeof(double)) ? 1 : 0);
+    construct_range_finding_matrix(&cg, &mat, frame_source, frame_cache);
+    close_binary_trajectory_writer(frame_cache);
+    printf("Ending range finding.\n");
+    
+    printf("Writing interaction ranges.\n"); fflush(stdout);
+    write_range_files(&cg, &mat);
+    free_name(&cg);
+}
+
+void create_frame_cache_file(void)
+{
+    char cache_filename[] = "rangefm_cache.XXXXXX.mscgtrj";
+    int cache_descriptor = mkstemps(cache_filename, 8);
+    if (cache_descriptor < 0) {
+        printf("Could not create a frame cache file in the working directory.\n");
+        exit(EXIT_FAILURE);
+    }
+    close(cache_descriptor);
+    frame_cache_filename = cache_filename;
+    atexit(remove_frame_cache_file);
+}
+
+void remove_frame_cache_file(void)
+{
+    if (frame_cache_filename.empty()) return;
+    remove(frame_cache_filename.c_str());
+    frame_cache_filename.clear();
+}
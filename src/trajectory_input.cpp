@@ -5,79 +5,300 @@
 //  Copyright (c) 2016 The Voth Group at The University of Chicago. All rights reserved.
 //
 
+#include <algorithm>
 #include <cassert>
+#include <cctype>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <vector>
 #include <random>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <stdint.h>
+#include <zlib.h>
+
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "control_input.h"
 #include "misc.h"
 #include "trajectory_input.h"
 
-extern "C" {
-#if _exclude_gromacs == 1
-#else
-#include "xdrfile/xdrfile_xtc.h"
-#include "xdrfile/xdrfile_trr.h"
-#endif
-}
-
 // Local structs only used in trajectory_input.cpp
 // These are PIMPLs of FrameSource
 
+class GzipTrajectoryBuffer;
+
 //-------------------------------------------------------------
 // struct for keeping track of LAMMPS frame data
 //-------------------------------------------------------------
 
 struct LammpsData {
-	std::ifstream trajectory_stream;
+	std::filebuf trajectory_file;			// Uncompressed trajectory read through trajectory_stream
+	GzipTrajectoryBuffer* gzip_buffer;		// Decompressed trajectory read through trajectory_stream; NULL if not gzip-compressed
+	std::istream trajectory_stream {NULL};
 	int type_pos;			// Index for type element in frame body
 	int x_pos;				// Starting index for position elements in frame body
 	int f_pos;				// Starting index for force elements in frame body
 	int state_pos;			// Starting index for state probabilities in frame_body
 	int header_size;		// Number of columns for header/body of frame
 	std::string* elements; 	// Array to store tokenized header elements 
-	double* cg_site_state_probabilities;   // A list of the probabilities for all states of all CG particles (used if dynamic_state_sampling = 1) (currently only for 2 states)
+	void (*read_lammps_frame_header)(LammpsData* const lammps_data, int* const current_n_sites, int* const timestep, real* const time, matrix box, const int dynamic_types, const int dynamic_state_sampling, const int no_forces);
 	int (*read_lammps_body)(LammpsData *const lammps_data, FrameConfig *const frame_config, const int dynamic_types, const int dynamic_state_sampling, const int no_forces);
+	int (*skip_lammps_body)(LammpsData *const lammps_data, const int n_sites);
+	
+	// Memory-mapped reading (lammps_mmap_flag = 1)
+	int mapped;								// 1 if the trajectory is memory-mapped; 0 if it is read through trajectory_stream
+	int file_descriptor;
+	size_t map_size;						// Size of the mapped trajectory, or of the compressed trajectory if gzip_buffer is not NULL
+	const char* map_begin;					// First byte of the mapped trajectory
+	const char* map_end;					// One past the last byte of the mapped trajectory
+	const char* cursor;						// Start of the next unread line
+	uint64_t modification_time;				// Modification time of the trajectory in nanoseconds, used to validate the sidecar index
+	std::string index_filename;				// Sidecar file holding frame_offsets
+	std::vector<uint64_t> frame_offsets;	// Byte offset of the header of each frame indexed so far (after decompression if gzip-compressed)
+	size_t n_loaded_offsets;				// Number of offsets read from the sidecar index
+	size_t next_frame_index;				// Index of the next frame header to be read
 };
 
 //-------------------------------------------------------------
 // struct for keeping track of GROMACS frame data
 //-------------------------------------------------------------
 
+// GROMACS trajectories are memory-mapped and decoded in place, so the
+// values of each frame go straight from the file into the frame data.
+
+struct XdrTrajectory {
+	int file_descriptor;
+	size_t map_size;
+	const char* map_begin;					// First byte of the mapped trajectory
+	uint64_t modification_time;				// Modification time of the trajectory in nanoseconds, used to validate the sidecar index
+	size_t cursor;							// Byte offset of the next frame
+	size_t next_frame_index;				// Index of the next frame
+	std::string index_filename;				// Sidecar file holding frame_offsets; empty if the frames are not indexed
+	std::vector<uint64_t> frame_offsets;	// Byte offset of each frame read so far
+	size_t n_loaded_offsets;				// Number of offsets read from the sidecar index
+};
+
 struct XRDData {
-#if _exclude_gromacs == 1
-#else
-    char extra_trajectory_filename[1000];           // Second trajectory file name (forces for .xtc, not present for .trr)
-    XDRFILE* trajectory_filepointer;
-    XDRFILE* extra_trajectory_filepointer;
-    rvec* x;
-    rvec* f;
-    int read_fr;                                    // Return value holder for the gromacs xtc library functions; see gromacs documentation.
-	
-	inline XRDData(int n_sites) {
-		x = new rvec[n_sites + 1];
-		f = new rvec[n_sites + 1];
-	};
-	
-	inline ~XRDData() {
-		delete [] x;
-		delete [] f;
-	};
-	
-	inline void convert_rvec_to_vector(std::array<double, DIMENSION>* &position, std::array<double, DIMENSION>* &force, const int n_cg_sites) {
-		for (int i = 0; i < n_cg_sites; i++) {
-			for(int j = 0; j < DIMENSION; j++) {
-				position[i][j] = x[i][j];
-				force[i][j] = f[i][j];
-			}
-		}
-	}
+	char extra_trajectory_filename[1000];	// Second trajectory file name (forces for .xtc, not present for .trr)
+	XdrTrajectory trajectory;				// The .trr trajectory, or the .xtc trajectory of positions
+	XdrTrajectory extra_trajectory;			// The .xtc trajectory of forces
+	std::vector<int> xtc_coordinates;		// Integer coordinates of the last .xtc frame decompressed
+};
+
+// The header of a .trr frame gives the size in bytes of each block of data
+// that follows it, so the size of every frame is known without reading it.
+
+struct TrrFrameHeader {
+	size_t header_size;
+	int real_size;							// 4 for single-precision frames, 8 for double-precision frames
+	int box_size;
+	int vir_size;
+	int pres_size;
+	int x_size;
+	int v_size;
+	int f_size;
+	int n_atoms;
+	int step;
+	double time;
+};
+
+// An .xtc frame holds the step, time and box followed by either the raw
+// positions of up to 9 atoms or the compressed positions of more atoms,
+// whose size in bytes is also stored.
+
+struct XtcFrameHeader {
+	int n_atoms;
+	int step;
+	float time;
+	float box[9];
+	size_t data_offset;						// Byte offset of the positions from the start of the file
+};
+
+//-------------------------------------------------------------
+// struct for keeping track of frames read ahead by a background thread
+//-------------------------------------------------------------
+
+struct PrefetchedFrame {
+	FrameConfig* frame_config;				// Configuration read ahead; owns its site types if dynamic_types is 1
+	int read_status;						// Return value of the type-dependent read
+	int current_timestep;
+	int current_frame_n;
+	real time;
+	matrix simulation_box_limits;
+};
+
+struct FramePrefetchData {
+	FrameSource reader_source;				// Copy of the frame source used only by the reader thread
+	std::vector<PrefetchedFrame> ring;		// Bounded ring of frames, filled by the reader and emptied in order by the consumer
+	int n_frames_to_read;					// Number of frames the reader thread has left to read
+	int n_filled;							// Number of frames read but not yet consumed
+	int consumer_position;					// Ring position of the next frame to consume
+	int stop_reading;						// 1 once cleanup asks the reader thread to stop
+	int reader_finished;					// 1 once the reader thread will not fill any more frames
+	std::mutex lock;
+	std::condition_variable frame_filled;
+	std::condition_variable frame_consumed;
+	std::thread reader_thread;
+	void (*cleanup)(FrameSource * const frame_source);	// Type-dependent cleanup run after the reader thread has stopped
+};
+
+//-------------------------------------------------------------
+// struct for keeping track of trajectories split into several files
+//-------------------------------------------------------------
+
+struct TrajectorySegmentData {
+	std::vector<std::string> filenames;		// Files holding consecutive parts of the trajectory, in reading order
+	std::vector<std::string> extra_filenames;	// Files holding the matching parts of the .xtc forces; empty for other trajectories
+	size_t current_segment;					// Index of the file being read
+	int readahead_file_descriptor;			// The next file, held open while the kernel reads it ahead; -1 if none
+	
+	// Type-dependent functions for reading within one file
+	void (*get_first_segment_frame)(FrameSource * const frame_source, const int n_cg_sites, int* cg_site_types);
+	int (*get_segment_frame)(FrameSource * const frame_source);
+	int (*get_segment_junk_frame)(FrameSource * const frame_source);
+	// Type-dependent function returning 1 if no frames are left in the current file
+	int (*at_segment_end)(FrameSource * const frame_source);
+	// Type-dependent function to replace the current file with another, keeping the frame data
+	void (*open_segment)(FrameSource * const frame_source, const char* filename);
+	void (*cleanup)(FrameSource * const frame_source);
+};
+
+//-------------------------------------------------------------
+// structs for keeping track of binary CG trajectory data
+//-------------------------------------------------------------
+
+// A binary CG trajectory (.mscgtrj) holds a fixed header, one fixed-size
+// record per frame, and an index of the byte offset of every record.
+// Each record holds the time (double), the timestep (int64), the box lengths
+// (DIMENSION doubles), and then the positions, forces, types (int32) and
+// state probabilities of all sites, with the values in float or double.
+// Everything is in native byte order, which byte_order_mark checks.
+
+enum BinaryTrajectoryContents {kBinaryForces = 1, kBinaryTypes = 2, kBinaryStateProbabilities = 4, kBinaryDoublePrecision = 8};
+
+struct BinaryTrajectoryHeader {
+	char tag[8];							// "MSCGCGTR"
+	uint32_t version;						// Format version, currently 1
+	uint32_t contents;						// Sum of the BinaryTrajectoryContents flags of the data stored
+	uint32_t n_sites;
+	uint32_t dimension;
+	uint64_t n_frames;
+	uint64_t frame_size;					// Number of bytes in each frame record
+	uint64_t index_offset;					// Byte offset of the frame index; 0 if the file was not closed properly
+	uint64_t byte_order_mark;				// 0x0102030405060708 as written
+	uint64_t reserved;
+};
+
+struct BinaryTrajectoryData {
+	int file_descriptor;
+	size_t map_size;
+	const char* map_begin;					// First byte of the mapped trajectory
+	GzipTrajectoryBuffer* gzip_buffer;		// Decompressed trajectory if it is gzip-compressed; NULL if it is mapped
+	std::vector<char> record;				// Frame record read from gzip_buffer
+	BinaryTrajectoryHeader header;
+	std::vector<uint64_t> frame_offsets;	// Byte offset of each frame record
+	size_t next_frame_index;				// Index of the next frame record to be read
+};
+
+struct BinaryTrajectoryWriter {
+	FILE* file;
+	std::string filename;
+	BinaryTrajectoryHeader header;
+	std::vector<uint64_t> frame_offsets;
+	std::vector<char> record;				// Buffer for assembling one frame record
+};
+
+//-------------------------------------------------------------
+// class for streaming gzip-compressed trajectories
+//-------------------------------------------------------------
+
+// A gzip-compressed trajectory is decompressed by a background thread into
+// a ring of large chunks, which readers consume through the std::streambuf
+// interface. Seeking restarts decompression from the nearest checkpoint at
+// or before the target. A checkpoint is taken at the first deflate block
+// boundary after every kGzipCheckpointSpacing decompressed bytes and holds
+// the compressed position, the bits of the boundary byte already consumed,
+// and the last 32 KiB of decompressed data. Checkpoints are kept in a
+// sidecar file (<trajectory>.zidx) so later runs can seek at once.
+
+const size_t kGzipInputSize = 1 << 20;
+const size_t kGzipChunkSize = 4 << 20;
+const int kGzipChunkCount = 4;
+const uint64_t kGzipCheckpointSpacing = 16 << 20;
+const uint32_t kGzipWindowSize = 32768;
+
+struct GzipCheckpoint {
+	uint64_t uncompressed_offset;			// Decompressed position of the block boundary
+	uint64_t compressed_offset;				// Compressed position of the first byte not fully consumed
+	int32_t bits;							// Number of bits of the byte before compressed_offset still to be read
+	uint32_t window_size;
+	std::vector<unsigned char> window;		// Decompressed data preceding the boundary
+};
+
+class GzipTrajectoryBuffer : public std::streambuf {
+public:
+	GzipTrajectoryBuffer(const char* filename);
+	~GzipTrajectoryBuffer();
+	inline uint64_t get_compressed_size() const { return compressed_size; };
+	inline uint64_t get_modification_time() const { return modification_time; };
+
+protected:
+	virtual int_type underflow();
+	virtual std::streamsize xsgetn(char* destination, std::streamsize n);
+	virtual pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode);
+	virtual pos_type seekpos(pos_type position, std::ios_base::openmode mode);
+
+private:
+	std::string filename;
+	FILE* file;
+	uint64_t compressed_size;
+	uint64_t modification_time;				// In nanoseconds
 	
-#endif
+	// Decompression state, used only by the decompression thread while it runs.
+	z_stream stream;
+	int raw_deflate;						// 1 after restarting from a checkpoint, until the end of the current gzip member
+	int member_started;						// 1 once data of the current gzip member has been decompressed
+	uint64_t trailer_bytes_to_skip;			// Bytes of a gzip member trailer still to pass over in raw_deflate mode
+	std::vector<unsigned char> input;
+	uint64_t decompressed_offset;			// Decompressed position of the next byte the thread will produce
+	std::vector<GzipCheckpoint> checkpoints;
+	size_t n_loaded_checkpoints;
+	
+	// Ring of decompressed chunks shared with the reader.
+	std::vector<std::vector<char> > chunks;
+	std::vector<size_t> chunk_lengths;
+	std::vector<uint64_t> chunk_offsets;
+	int n_filled;							// Chunks decompressed and not yet released by the reader, including the one being read
+	int producer_position;
+	int consumer_position;
+	int holding_chunk;						// 1 if the get area is the chunk at consumer_position
+	uint64_t next_read_offset;				// Decompressed position of the first chunk not yet read
+	int stop_decompressing;
+	int decompression_finished;
+	int decompression_failed;
+	std::mutex lock;
+	std::condition_variable chunk_filled;
+	std::condition_variable chunk_released;
+	std::thread decompression_thread;
+	
+	void decompress_chunks();
+	size_t decompress_into(char* const destination, const size_t size);
+	void record_checkpoint();
+	void start_decompression();
+	void stop_decompression();
+	void restart_decompression(const GzipCheckpoint* const checkpoint);
+	uint64_t get_position() const;
+	int seek_to(const uint64_t target);
+	int discard(uint64_t n_bytes);
+	void load_checkpoints();
+	void save_checkpoints();
 };
 
 // Prototypes for exclusively internal functions.
@@ -86,6 +307,7 @@ struct XRDData {
 void trr_setup(FrameSource* const frame_source, const char* filename);
 void lammps_setup(FrameSource* const frame_source, const char* filename);
 void xtc_setup(FrameSource* const frame_source, const char* filename1, const char* filename2);
+void binary_setup(FrameSource* const frame_source, const char* filename);
 
 // Misc. small helpers.
 inline void report_traj_input_suffix_error(const char *suffix);
@@ -93,37 +315,132 @@ inline void report_usage_error(const char *exe_name);
 inline void report_invalid_setting(const char *flag, const char* suffix);
 inline void check_molecule_sites(const int n_expected, const int n_read);
 inline void check_file_extension(const char* name, const char* suffix);
+inline int has_gzip_suffix(const char* filename);
 
 // Read the initial frame of a trajectory.
 void read_initial_trr_frame(FrameSource* const frame_source, const int n_cg_sites, int* cg_site_types);
 void read_initial_xtc_frame(FrameSource* const frame_source, const int n_cg_sites,  int* cg_site_types);
 void read_initial_lammps_frame(FrameSource* const frame_source, const int n_cg_sites, int* cg_site_types);
+void read_initial_binary_frame(FrameSource* const frame_source, const int n_cg_sites, int* cg_site_types);
 void initial_nothing(FrameSource* const frame_source, const int n_cg_sites, int* cg_site_types);
 
 // Read a frame of a trajectory after the first has been read.
 int read_next_trr_frame(FrameSource* const frame_source);
+int read_junk_trr_frame(FrameSource* const frame_source);
 int read_next_xtc_frame(FrameSource* const frame_source);
+int read_junk_xtc_frame(FrameSource* const frame_source);
 int read_next_lammps_frame(FrameSource* const frame_source);
 int read_junk_lammps_frame(FrameSource* const frame_source);
+int read_next_binary_frame(FrameSource* const frame_source);
+int read_junk_binary_frame(FrameSource* const frame_source);
 int next_nothing(FrameSource* const frame_source);
+int read_next_strided_frame(FrameSource* const frame_source);
+int read_next_weighted_frame(FrameSource* const frame_source);
+
+// Read frames ahead in a background thread.
+void start_frame_prefetching(FrameSource* const frame_source);
+void prefetch_frames(FramePrefetchData* const prefetch_data);
+int read_prefetched_frame(FrameSource* const frame_source);
+void finish_prefetched_reading(FrameSource* const frame_source);
+
+// Read several files in turn as one trajectory.
+void add_trajectory_filenames(const char* argument, std::vector<std::string> &filenames);
+inline bool precedes_in_natural_order(const std::string &name1, const std::string &name2);
+void setup_trajectory_segments(FrameSource* const frame_source, const std::vector<std::string> &filenames, const std::vector<std::string> &extra_filenames);
+void read_initial_segmented_frame(FrameSource* const frame_source, const int n_cg_sites, int* cg_site_types);
+int read_next_segmented_frame(FrameSource* const frame_source);
+int read_junk_segmented_frame(FrameSource* const frame_source);
+int enter_unfinished_segment(FrameSource* const frame_source);
+void read_next_segment_ahead(TrajectorySegmentData* const segment_data);
+void finish_segmented_reading(FrameSource* const frame_source);
+int lammps_at_segment_end(FrameSource* const frame_source);
+void open_lammps_segment(FrameSource* const frame_source, const char* filename);
+int binary_at_segment_end(FrameSource* const frame_source);
+void open_binary_segment(FrameSource* const frame_source, const char* filename);
+int trr_at_segment_end(FrameSource* const frame_source);
+void open_trr_segment(FrameSource* const frame_source, const char* filename);
+int xtc_at_segment_end(FrameSource* const frame_source);
+void open_xtc_segment(FrameSource* const frame_source, const char* filename);
+
+// Pass over frames without processing them.
+int skip_frames_by_reading(FrameSource* const frame_source, const int n_skipped_frames);
+int skip_lammps_frames(FrameSource* const frame_source, const int n_skipped_frames);
+int jump_lammps_frames(FrameSource* const frame_source, const int n_skipped_frames);
+int skip_binary_frames(FrameSource* const frame_source, const int n_skipped_frames);
+int skip_trr_frames(FrameSource* const frame_source, const int n_skipped_frames);
+int skip_xtc_frames(FrameSource* const frame_source, const int n_skipped_frames);
+int jump_xtc_frames(FrameSource* const frame_source, const int n_skipped_frames);
 
 // Read all frames up until a starting frame.
 void default_move_to_starting_frame(FrameSource* const frame_source);
 
 // Read frame-wise entries into an array.
-inline void read_stream_into_array(std::ifstream &in_file, const int start_frame, const int n_frames, double* &values);
+inline void read_stream_into_array(std::ifstream &in_file, const int start_frame, const int n_frames, const int frame_stride, double* &values);
 
 // Finish reading a trajectory by closing relevant files and cleaning up temps.
 inline void finish_general_reading(FrameSource *const frame_source);
 void finish_trr_reading(FrameSource* const frame_source);
 void finish_xtc_reading(FrameSource* const frame_source);
 void finish_lammps_reading(FrameSource* const frame_source);
+void finish_binary_reading(FrameSource* const frame_source);
 
 // Additional helper functions.
 void read_lammps_header(LammpsData* const lammps_data, int* const current_n_sites, int* const timestep, real* const time, matrix box, const int dynamic_types, const int dynamic_state_sampling, const int no_forces);
 int read_dimension_lammps_body(LammpsData* const lammps_data, FrameConfig* const frame_config, const int dynamic_types, const int dynamic_state_sampling, const int no_forces);
+int skip_lammps_body(LammpsData* const lammps_data, const int n_sites);
+void parse_lammps_atoms_labels(LammpsData* const lammps_data, const std::string &line, const int dynamic_types, const int dynamic_state_sampling, const int no_forces);
+
+// Open and close LAMMPS trajectories.
+void open_lammps_trajectory(LammpsData* const lammps_data, const char* filename, const int mmap_flag);
+void close_lammps_trajectory(LammpsData* const lammps_data);
+
+// Memory-mapped LAMMPS reading.
+void open_mapped_lammps_trajectory(LammpsData* const lammps_data, const char* filename);
+void close_mapped_lammps_trajectory(LammpsData* const lammps_data);
+void open_compressed_lammps_trajectory(LammpsData* const lammps_data, const char* filename);
+void close_compressed_lammps_trajectory(LammpsData* const lammps_data);
+size_t load_frame_index(const std::string &index_filename, const uint64_t trajectory_size, const uint64_t modification_time, std::vector<uint64_t> &frame_offsets);
+void save_frame_index(const std::string &index_filename, const uint64_t trajectory_size, const uint64_t modification_time, const std::vector<uint64_t> &frame_offsets);
+void discard_frame_index(const std::string &index_filename, std::vector<uint64_t> &frame_offsets, size_t &n_loaded_offsets);
+uint64_t get_modification_stamp(const struct stat &file_status);
+int check_lammps_frame_offset(LammpsData* const lammps_data, const uint64_t offset);
+int check_xtc_frame_offset(const XdrTrajectory* const trajectory, const uint64_t offset);
+void read_mapped_lammps_header(LammpsData* const lammps_data, int* const current_n_sites, int* const timestep, real* const time, matrix box, const int dynamic_types, const int dynamic_state_sampling, const int no_forces);
+int read_mapped_lammps_body(LammpsData* const lammps_data, FrameConfig* const frame_config, const int dynamic_types, const int dynamic_state_sampling, const int no_forces);
+int skip_mapped_lammps_body(LammpsData* const lammps_data, const int n_sites);
+inline int next_mapped_line(LammpsData* const lammps_data, const char* &line_begin, const char* &line_end);
+inline void report_mapped_end_of_file(void);
+inline double scan_mapped_double(const char* const begin, const char* const end);
+inline int scan_mapped_int(const char* begin, const char* const end);
 inline void set_random_number_seed(const uint_fast32_t random_num_seed);
 
+// Binary CG trajectory reading.
+inline uint64_t calculate_binary_frame_size(const uint32_t contents, const uint32_t n_sites, const uint32_t dimension);
+inline void check_binary_trajectory_header(const BinaryTrajectoryHeader &header, const char* filename);
+void open_binary_trajectory(BinaryTrajectoryData* const binary_data, const char* filename);
+void close_binary_trajectory(BinaryTrajectoryData* const binary_data);
+void open_compressed_binary_trajectory(BinaryTrajectoryData* const binary_data, const char* filename);
+inline const char* locate_binary_record(BinaryTrajectoryData* const binary_data, const size_t frame_index);
+void copy_binary_frame(FrameSource* const frame_source, const size_t frame_index);
+inline const char* read_binary_vectors(const char* record, const int n_sites, const int double_precision, std::array<frame_real, DIMENSION>* const values);
+inline char* write_binary_vectors(char* record, const int n_sites, const int double_precision, const std::array<frame_real, DIMENSION>* const values);
+
+// GROMACS trajectory reading.
+void open_xdr_trajectory(XdrTrajectory* const trajectory, const char* filename, const int indexed);
+void close_xdr_trajectory(XdrTrajectory* const trajectory);
+inline void advance_xdr_trajectory(XdrTrajectory* const trajectory, const size_t frame_size);
+inline uint32_t read_xdr_word(const char* const data);
+inline int read_xdr_int(const char* const data);
+inline float read_xdr_float(const char* const data);
+inline double read_xdr_double(const char* const data);
+inline double read_xdr_real(const char* const data, const int real_size);
+inline void decode_xdr_reals(const char* const data, const int n_values, const int real_size, frame_real* const values);
+size_t parse_trr_header(const XdrTrajectory* const trajectory, const size_t offset, TrrFrameHeader* const header);
+size_t parse_xtc_header(const XdrTrajectory* const trajectory, const size_t offset, XtcFrameHeader* const header);
+int decode_trr_frame(FrameSource* const frame_source);
+int decode_xtc_frame(FrameSource* const frame_source);
+int decompress_xtc_coordinates(const XdrTrajectory* const trajectory, const XtcFrameHeader &header, std::vector<int> &integer_coordinates, frame_real* const values);
+
 //-------------------------------------------------------------
 // Misc. small file-reading helper functions.
 //-------------------------------------------------------------
@@ -132,7 +449,8 @@ inline void set_random_number_seed(const uint_fast32_t random_num_seed);
 
 inline void report_usage_error(const char *exe_name)
 {
-    printf("Usage: %s -f file.trr OR %s -f file.xtc -f1 file1.xtc OR %s -l file.lammpstrj\n", exe_name, exe_name, exe_name);
+    printf("Usage: %s -f file.trr [file2.trr ...] OR %s -f file.xtc [file2.xtc ...] -f1 file1.xtc [file21.xtc ...] OR %s -l file.lammpstrj [file2.lammpstrj ...] OR %s -b file.mscgtrj [file2.mscgtrj ...]\n", exe_name, exe_name, exe_name, exe_name);
+    printf("Several files are read in turn as one trajectory; a quoted wildcard pattern or @list_file may stand for several files.\n");
     exit(EXIT_SUCCESS);
 }
 
@@ -193,23 +511,40 @@ double calculate_volume(const matrix simulation_box_lengths)
 //-------------------------------------------------------------
 
 // Parse the command line arguments to determine the trajectory to
-// read from and the format of that trajectory.
+// read from and the format of that trajectory. Trajectories may be split
+// into several files, which are read in turn; the .xtc positions and forces
+// must then be split into the same number of files.
 
 void parse_command_line_arguments(const int num_arg, char** arg, FrameSource* const frame_source)
 {
-    if (num_arg != 3 && num_arg != 5) report_usage_error(arg[0]);
-    else if (num_arg == 3) {
-        if (strcmp(arg[1], "-f") == 0) { 
-        	trr_setup(frame_source, arg[2]); 
-        } else if (strcmp(arg[1], "-l") == 0) {
-            lammps_setup(frame_source, arg[2]);
-        } else {
-            report_usage_error(arg[0]);
+    std::vector<std::string> filenames;
+    std::vector<std::string> extra_filenames;
+    int next_arg = 2;
+    while ( (next_arg < num_arg) && (arg[next_arg][0] != '-') ) add_trajectory_filenames(arg[next_arg++], filenames);
+    if ( (next_arg < num_arg) && (strcmp(arg[next_arg], "-f1") == 0) ) {
+        next_arg++;
+        while ( (next_arg < num_arg) && (arg[next_arg][0] != '-') ) add_trajectory_filenames(arg[next_arg++], extra_filenames);
+        if ( extra_filenames.empty() || (strcmp(arg[1], "-f") != 0) ) report_usage_error(arg[0]);
+    }
+    if ( (num_arg < 3) || filenames.empty() || (next_arg != num_arg) ) report_usage_error(arg[0]);
+    
+    frame_source->segment_data = NULL;
+    if (!extra_filenames.empty()) {
+        if (extra_filenames.size() != filenames.size()) {
+            printf("The .xtc positions are split into %d files but the forces into %d files.\n", (int)filenames.size(), (int)extra_filenames.size());
+            exit(EXIT_FAILURE);
         }
-    } else if (num_arg == 5) {
-        if (strcmp(arg[1], "-f") != 0 || strcmp(arg[3], "-f1") != 0) report_usage_error(arg[0]);
-        xtc_setup(frame_source, arg[2], arg[4]);
+        xtc_setup(frame_source, filenames[0].c_str(), extra_filenames[0].c_str());
+    } else if (strcmp(arg[1], "-f") == 0) { 
+        trr_setup(frame_source, filenames[0].c_str()); 
+    } else if (strcmp(arg[1], "-l") == 0) {
+        lammps_setup(frame_source, filenames[0].c_str());
+    } else if (strcmp(arg[1], "-b") == 0) {
+        binary_setup(frame_source, filenames[0].c_str());
+    } else {
+        report_usage_error(arg[0]);
     }
+    if (filenames.size() > 1) setup_trajectory_segments(frame_source, filenames, extra_filenames);
     frame_source->move_to_start_frame = default_move_to_starting_frame;
 }
 
@@ -218,15 +553,13 @@ void trr_setup(FrameSource* const frame_source, const char* filename)
 	sscanf(filename, "%s", frame_source->trajectory_filename);
 	check_file_extension(filename, "trr");
 	frame_source->trajectory_type = kGromacsTRR;
+	frame_source->gromacs_data = new XRDData;
 	frame_source->get_first_frame = read_initial_trr_frame;
+	frame_source->get_adjacent_frame = read_next_trr_frame;
 	frame_source->get_next_frame = read_next_trr_frame;
-	frame_source->get_junk_frame = read_next_trr_frame;
+	frame_source->get_junk_frame = read_junk_trr_frame;
+	frame_source->skip_frames = skip_trr_frames;
 	frame_source->cleanup = finish_trr_reading;
-	#if _exclude_gromacs == 1
-	printf("Cannot read TRR files when _exclude_gromacs is 1. Please recompile without this option and try again.\n");
-	fflush(stdout);
-	exit(EXIT_FAILURE);
-	#endif 
 }
 
 void lammps_setup(FrameSource* const frame_source, const char* filename)
@@ -234,31 +567,44 @@ void lammps_setup(FrameSource* const frame_source, const char* filename)
 	sscanf(filename, "%s", frame_source->trajectory_filename);
 	frame_source->trajectory_type = kLAMMPSDump;
 	frame_source->get_first_frame = read_initial_lammps_frame;
+	frame_source->get_adjacent_frame = read_next_lammps_frame;
 	frame_source->get_next_frame = read_next_lammps_frame;
 	frame_source->get_junk_frame = read_junk_lammps_frame;
+	frame_source->skip_frames = skip_lammps_frames;
 	frame_source->cleanup = finish_lammps_reading;
 }
 
 void xtc_setup(FrameSource* const frame_source, const char* filename1, const char* filename2)
 {
 	sscanf(filename1, "%s", frame_source->trajectory_filename);
-	#if _exclude_gromacs == 1
-	printf("Cannot read XTC files when _exclude_gromacs is 1. Please recompile without this option and try again.\n");
-	fflush(stdout);
-	exit(EXIT_FAILURE);
-	#else
-	sscanf(filename2, "%s", frame_source->gromacs_data->extra_trajectory_filename);
-	#endif
 	check_file_extension(filename1, "xtc");
 	check_file_extension(filename2, "xtc");
+	frame_source->gromacs_data = new XRDData;
+	sscanf(filename2, "%s", frame_source->gromacs_data->extra_trajectory_filename);
 
 	frame_source->trajectory_type = kGromacsXTC;
 	frame_source->get_first_frame = read_initial_xtc_frame;
+	frame_source->get_adjacent_frame = read_next_xtc_frame;
 	frame_source->get_next_frame = read_next_xtc_frame;
-	frame_source->get_junk_frame = read_next_xtc_frame;
+	frame_source->get_junk_frame = read_junk_xtc_frame;
+	frame_source->skip_frames = skip_xtc_frames;
 	frame_source->cleanup = finish_xtc_reading;
 }
 
+void binary_setup(FrameSource* const frame_source, const char* filename)
+{
+	sscanf(filename, "%s", frame_source->trajectory_filename);
+	if (has_gzip_suffix(filename) == 1) check_file_extension(std::string(filename, strlen(filename) - 3).c_str(), "mscgtrj");
+	else check_file_extension(filename, "mscgtrj");
+	frame_source->trajectory_type = kMSCGBinary;
+	frame_source->get_first_frame = read_initial_binary_frame;
+	frame_source->get_adjacent_frame = read_next_binary_frame;
+	frame_source->get_next_frame = read_next_binary_frame;
+	frame_source->get_junk_frame = read_junk_binary_frame;
+	frame_source->skip_frames = skip_binary_frames;
+	frame_source->cleanup = finish_binary_reading;
+}
+
 void copy_control_inputs_to_frd(ControlInputs* const control_input, FrameSource* const frame_source)
 {
     frame_source->use_statistical_reweighting = control_input->use_statistical_reweighting;
@@ -273,12 +619,56 @@ void copy_control_inputs_to_frd(ControlInputs* const control_input, FrameSource*
     frame_source->position_dimension = control_input->position_dimension;
     frame_source->starting_frame = control_input->starting_frame;
     frame_source->n_frames = control_input->n_frames;
+    frame_source->frame_stride = control_input->frame_stride;
+    frame_source->lammps_mmap_flag = control_input->lammps_mmap_flag;
+    frame_source->frame_prefetch_depth = control_input->frame_prefetch_depth;
     frame_source->no_forces = 0;
     
     if(frame_source->position_dimension != DIMENSION) {
     	printf("The value of position_dimension(%d) in control_input does not match the compiled dimension(%d)!\n", control_input->position_dimension, DIMENSION);
     	exit(EXIT_FAILURE);
     }
+    if (frame_source->frame_stride < 1) {
+    	printf("The value of frame_stride(%d) in control_input must be at least 1!\n", frame_source->frame_stride);
+    	exit(EXIT_FAILURE);
+    }
+}
+
+// Ranges are split at multiples of block_size frames, with any leftover
+// blocks going one each to the first shards and any leftover frames to the
+// last shard. Per-frame values of the range are moved to the front of their
+// arrays so that they are indexed from the start of the range. The random
+// number seed is offset by the shard index so that shards draw different
+// dynamic state samples.
+
+void select_trajectory_shard(FrameSource* const frame_source, const int shard_index, const int n_shards, const int block_size)
+{
+	int n_blocks = frame_source->n_frames / block_size;
+	int n_leftover_frames = frame_source->n_frames - n_blocks * block_size;
+	int first_block = shard_index * (n_blocks / n_shards) + std::min(shard_index, n_blocks % n_shards);
+	int shard_blocks = n_blocks / n_shards + ((shard_index < n_blocks % n_shards) ? 1 : 0);
+	int first_frame = first_block * block_size;
+	int shard_frames = shard_blocks * block_size;
+	if (shard_index == n_shards - 1) shard_frames += n_leftover_frames;
+	
+	if (frame_source->use_statistical_reweighting == 1) memmove(frame_source->frame_weights, frame_source->frame_weights + first_frame, shard_frames * sizeof(double));
+	if (frame_source->pressure_constraint_flag == 1) memmove(frame_source->pressure_constraint_rhs_vector, frame_source->pressure_constraint_rhs_vector + first_frame, shard_frames * sizeof(double));
+	// A start_frame of 0 selects the first frame, just as 1 does.
+	frame_source->starting_frame = std::max(frame_source->starting_frame, 1) + first_frame * frame_source->frame_stride;
+	frame_source->n_frames = shard_frames;
+	frame_source->random_num_seed += shard_index;
+}
+
+// The cache holds the selected frames in order, so frame weights and virial
+// constraint values are read for the original selection as usual.
+
+void select_frame_cache(FrameSource* const frame_source, const char* filename)
+{
+	binary_setup(frame_source, filename);
+	frame_source->segment_data = NULL;
+	frame_source->move_to_start_frame = default_move_to_starting_frame;
+	frame_source->starting_frame = 1;
+	frame_source->frame_stride = 1;
 }
 
 inline void finish_general_reading(FrameSource *const frame_source)
@@ -290,33 +680,35 @@ inline void finish_general_reading(FrameSource *const frame_source)
 
 void finish_trr_reading(FrameSource *const frame_source)
 {
- 	#if _exclude_gromacs == 1
-	#else
-    xdrfile_close(frame_source->gromacs_data->trajectory_filepointer);
+    close_xdr_trajectory(&frame_source->gromacs_data->trajectory);
     delete frame_source->gromacs_data;
     finish_general_reading(frame_source);
-    #endif
 }
 
 void finish_xtc_reading(FrameSource *const frame_source)
 {
- 	#if _exclude_gromacs == 1
-	#else
-	xdrfile_close(frame_source->gromacs_data->trajectory_filepointer);
-    xdrfile_close(frame_source->gromacs_data->extra_trajectory_filepointer);
+    close_xdr_trajectory(&frame_source->gromacs_data->trajectory);
+    close_xdr_trajectory(&frame_source->gromacs_data->extra_trajectory);
     delete frame_source->gromacs_data;
     finish_general_reading(frame_source);
-    #endif
+}
+
+void finish_binary_reading(FrameSource *const frame_source)
+{
+	close_binary_trajectory(frame_source->binary_data);
+	if ( (frame_source->dynamic_types == 1) || (frame_source->dynamic_state_sampling == 1) ) frame_source->frame_config->cg_site_types = NULL; //undo alias of cg.topo_data.cg_site_types
+	delete frame_source->binary_data;
+	
+	finish_general_reading(frame_source);
 }
 
 void finish_lammps_reading(FrameSource *const frame_source)
 {
     //close trajectory file
-    frame_source->lammps_data->trajectory_stream.close();
+    close_lammps_trajectory(frame_source->lammps_data);
     
     //cleanup allocated memory
     if ( (frame_source->dynamic_types == 1) || (frame_source->dynamic_state_sampling == 1) ) frame_source->frame_config->cg_site_types = NULL; //undo alias of cg.topo_data.cg_site_types
-    if (frame_source->dynamic_state_sampling == 1) delete [] frame_source->lammps_data->cg_site_state_probabilities;
     delete [] frame_source->lammps_data->elements;
 	delete frame_source->lammps_data;
 	
@@ -331,10 +723,7 @@ void finish_lammps_reading(FrameSource *const frame_source)
 
 void read_initial_trr_frame(FrameSource* const frame_source, const int n_cg_sites, int* cg_site_types)
 {
-	#if _exclude_gromacs == 1
-	#else
-    real junk_floating_point;
-    int n_sites;
+	TrrFrameHeader header;
 	
  	if (frame_source->dynamic_types == 1) report_invalid_setting("dynamic_types", "TRR");
     if (frame_source->dynamic_state_sampling == 1) report_invalid_setting("dynamic_state_sampling", "TRR");
@@ -345,16 +734,18 @@ void read_initial_trr_frame(FrameSource* const frame_source, const int n_cg_site
     };
     
     // Get the number of sites in this initial frame and allocate memory to store their forces and positions.
-    read_trr_natoms(frame_source->trajectory_filename, &n_sites);
-    frame_source->frame_config = new FrameConfig(n_sites);
-    frame_source->gromacs_data = new XRDData(n_sites);
+    open_xdr_trajectory(&frame_source->gromacs_data->trajectory, frame_source->trajectory_filename, 0);
+    if (parse_trr_header(&frame_source->gromacs_data->trajectory, 0, &header) == 0) {
+        printf("Can not read the first frame!\n");
+        exit(EXIT_FAILURE);
+    }
+    frame_source->frame_config = new FrameConfig(header.n_atoms);
 
     // Check that the trajectory is consistent with the desired CG model.
     check_molecule_sites(n_cg_sites, frame_source->frame_config->current_n_sites);
     
-    // Use Gromacs xtc library routines to read all the data stored in the .trr file for a single frame.
-    frame_source->gromacs_data->trajectory_filepointer = xdrfile_open(frame_source->trajectory_filename, "r");
-    if (read_trr(frame_source->gromacs_data->trajectory_filepointer, frame_source->frame_config->current_n_sites, &frame_source->current_timestep, &frame_source->time, &junk_floating_point, frame_source->simulation_box_limits, frame_source->gromacs_data->x, NULL, frame_source->gromacs_data->f) != exdrOK) {
+    // Decode the positions and forces of the first frame straight into the frame data.
+    if (decode_trr_frame(frame_source) == 0) {
         printf("Can not read the first frame!\n");
         exit(EXIT_FAILURE);
     }
@@ -363,23 +754,13 @@ void read_initial_trr_frame(FrameSource* const frame_source, const int n_cg_site
 	if (frame_source->bootstrapping_flag == 1) {
 		frame_source->mt_rand_gen = std::mt19937(frame_source->random_num_seed);
 	}
-	
-    // Finish up by changing information simply determined by the data just read.
-    frame_source->gromacs_data->convert_rvec_to_vector(frame_source->frame_config->x, frame_source->frame_config->f, frame_source->frame_config->current_n_sites);
-    for (int i = 0; i < DIMENSION; i++) frame_source->frame_config->simulation_box_half_lengths[i] = frame_source->simulation_box_limits[i][i] * 0.5;
-    return;
-    #endif
 }
 
 // Read the initial frame of a .xtc-format trajectory.
 
 void read_initial_xtc_frame(FrameSource* const frame_source, const int n_cg_sites, int* cg_site_types)
 {
-	#if _exclude_gromacs == 1
-	#else
-    int junk_integer;
-    real junk_floating_point;
-    int n_atoms, n_sites;
+	XtcFrameHeader position_header, force_header;
     
     if (frame_source->dynamic_types == 1) report_invalid_setting("dynamic_types", "XTC");
     if (frame_source->dynamic_state_sampling == 1) report_invalid_setting("dynamic_state_sampling", "XTC"); 
@@ -389,41 +770,33 @@ void read_initial_xtc_frame(FrameSource* const frame_source, const int n_cg_site
     	exit(EXIT_FAILURE);
     };
     
-    
     // Get the number of sites in this initial frame and allocate memory to store their forces and positions.
-    read_xtc_natoms(frame_source->trajectory_filename, &n_sites);
-    read_xtc_natoms(frame_source->gromacs_data->extra_trajectory_filename, &n_atoms);
-    if (n_sites != n_atoms) {
+    open_xdr_trajectory(&frame_source->gromacs_data->trajectory, frame_source->trajectory_filename, 1);
+    open_xdr_trajectory(&frame_source->gromacs_data->extra_trajectory, frame_source->gromacs_data->extra_trajectory_filename, 1);
+    if ( (parse_xtc_header(&frame_source->gromacs_data->trajectory, 0, &position_header) == 0) ||
+         (parse_xtc_header(&frame_source->gromacs_data->extra_trajectory, 0, &force_header) == 0) ) {
+        printf("Can not read the first frame!\n");
+        exit(EXIT_FAILURE);
+    }
+    if (position_header.n_atoms != force_header.n_atoms) {
         printf("Atom numbers are not consistent between two xtc files!\n");
         exit(EXIT_FAILURE);
     }
-    frame_source->frame_config = new FrameConfig(n_sites);
-    frame_source->gromacs_data = new XRDData(n_sites);
+    frame_source->frame_config = new FrameConfig(position_header.n_atoms);
     
     // Check that the trajectory is consistent with the desired CG model.
     check_molecule_sites(n_cg_sites, frame_source->frame_config->current_n_sites);
     
-    // Use Gromacs xtc library routines to read all the data stored in the .xtc files for a single frame.
-    frame_source->gromacs_data->trajectory_filepointer = xdrfile_open(frame_source->trajectory_filename, "r");
-    frame_source->gromacs_data->extra_trajectory_filepointer = xdrfile_open(frame_source->gromacs_data->extra_trajectory_filename, "r");
-    if ((read_xtc(frame_source->gromacs_data->extra_trajectory_filepointer, frame_source->frame_config->current_n_sites, &frame_source->current_timestep, &frame_source->time, frame_source->simulation_box_limits, frame_source->gromacs_data->f, &junk_floating_point)
-         != exdrOK) ||
-        (read_xtc(frame_source->gromacs_data->trajectory_filepointer, frame_source->frame_config->current_n_sites, &junk_integer, &junk_floating_point, frame_source->simulation_box_limits, frame_source->gromacs_data->x, &junk_floating_point)
-         != exdrOK)) {
-            printf("Can not read the first frame!\n");
-            exit(EXIT_FAILURE);
+    // Decompress the positions and forces of the first frame straight into the frame data.
+    if (decode_xtc_frame(frame_source) == 0) {
+        printf("Can not read the first frame!\n");
+        exit(EXIT_FAILURE);
     }
     frame_source->current_frame_n = 1;
 
 	if (frame_source->bootstrapping_flag == 1) {
 		frame_source->mt_rand_gen = std::mt19937(frame_source->random_num_seed);
 	}
-    
-    // Finish up by changing information simply determined by the data just read.
-    frame_source->gromacs_data->convert_rvec_to_vector(frame_source->frame_config->x, frame_source->frame_config->f, frame_source->frame_config->current_n_sites);
-    for (int i = 0; i < DIMENSION; i++) frame_source->frame_config->simulation_box_half_lengths[i] = frame_source->simulation_box_limits[i][i] * 0.5;
-    return;
-    #endif
 }
 
 // Read the initial frame of a lammps-dump-format trajectory.
@@ -435,17 +808,11 @@ void read_initial_lammps_frame(FrameSource* const frame_source, const int n_cg_s
 	frame_source->lammps_data->header_size = 0;
 	int n_sites = 0;
 
-	frame_source->lammps_data->read_lammps_body = read_dimension_lammps_body;
-	
     // Get the number of sites in this initial frame and allocate memory to store their forces and positions.
-	frame_source->lammps_data->trajectory_stream.open(frame_source->trajectory_filename, std::ifstream::in);
-	if (frame_source->lammps_data->trajectory_stream.fail()) {
-		printf("Problem opening lammps trajcetory %s\n", frame_source->trajectory_filename);
-		exit(EXIT_FAILURE);
-	}
+	open_lammps_trajectory(frame_source->lammps_data, frame_source->trajectory_filename, frame_source->lammps_mmap_flag);
 	
 	//read header for first frame 
-	read_lammps_header(frame_source->lammps_data, &n_sites, &frame_source->current_timestep, &frame_source->time, frame_source->simulation_box_limits, frame_source->dynamic_types, frame_source->dynamic_state_sampling, frame_source->no_forces);
+	frame_source->lammps_data->read_lammps_frame_header(frame_source->lammps_data, &n_sites, &frame_source->current_timestep, &frame_source->time, frame_source->simulation_box_limits, frame_source->dynamic_types, frame_source->dynamic_state_sampling, frame_source->no_forces);
 	if(n_sites <= 0) {
 		exit(EXIT_FAILURE);
     }
@@ -453,7 +820,7 @@ void read_initial_lammps_frame(FrameSource* const frame_source, const int n_cg_s
     //allocate position and force vectors
     frame_source->frame_config = new FrameConfig(n_sites);
     frame_source->lammps_data->elements = new std::string[frame_source->lammps_data->header_size];
-    if (frame_source->dynamic_state_sampling == 1) frame_source->lammps_data->cg_site_state_probabilities = new double[n_sites];
+    if (frame_source->dynamic_state_sampling == 1) frame_source->frame_config->cg_site_state_probabilities = new double[n_sites];
 	else frame_source->lammps_data->state_pos = -1;
     if ( (frame_source->dynamic_types == 1) || (frame_source->dynamic_state_sampling == 1) ) {
     	frame_source->frame_config->cg_site_types = cg_site_types;
@@ -472,7 +839,6 @@ void read_initial_lammps_frame(FrameSource* const frame_source, const int n_cg_s
     if ( frame_source->lammps_data->read_lammps_body(frame_source->lammps_data, frame_source->frame_config, frame_source->dynamic_types, frame_source->dynamic_state_sampling, frame_source->no_forces) != 1 ) {
     	printf("Cannot read the first frame!\n");			
     	if ( (frame_source->dynamic_types == 1) || (frame_source->dynamic_state_sampling == 1) ) frame_source->frame_config->cg_site_types = NULL; //undo aliasing to cg.topo_data.cg_site_types
-		if (frame_source->dynamic_state_sampling == 1) delete [] frame_source->lammps_data->cg_site_state_probabilities;			
 		delete [] frame_source->lammps_data->elements;			
 		delete frame_source->frame_config;
     	exit(EXIT_FAILURE);
@@ -489,6 +855,49 @@ void read_initial_lammps_frame(FrameSource* const frame_source, const int n_cg_s
     return;
 }
 
+// Read the initial frame of a binary CG trajectory.
+
+void read_initial_binary_frame(FrameSource* const frame_source, const int n_cg_sites, int* cg_site_types)
+{
+	frame_source->binary_data = new BinaryTrajectoryData;
+	open_binary_trajectory(frame_source->binary_data, frame_source->trajectory_filename);
+	const BinaryTrajectoryHeader &header = frame_source->binary_data->header;
+	
+	if ( (frame_source->no_forces == 0) && ((header.contents & kBinaryForces) == 0) ) {
+		printf("Binary trajectory %s does not contain forces!\n", frame_source->trajectory_filename);
+		exit(EXIT_FAILURE);
+	}
+	if ( (frame_source->dynamic_types == 1) && ((header.contents & kBinaryTypes) == 0) ) {
+		printf("Binary trajectory %s does not contain site types needed for dynamic_types!\n", frame_source->trajectory_filename);
+		exit(EXIT_FAILURE);
+	}
+	if ( (frame_source->dynamic_state_sampling == 1) && ((header.contents & kBinaryStateProbabilities) == 0) ) {
+		printf("Binary trajectory %s does not contain state probabilities needed for dynamic_state_sampling!\n", frame_source->trajectory_filename);
+		exit(EXIT_FAILURE);
+	}
+	if (header.n_frames == 0) {
+		printf("Can not read the first frame!\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	// Allocate memory to store the forces and positions of each frame.
+	frame_source->frame_config = new FrameConfig(header.n_sites);
+	if (frame_source->dynamic_state_sampling == 1) frame_source->frame_config->cg_site_state_probabilities = new double[header.n_sites];
+	if ( (frame_source->dynamic_types == 1) || (frame_source->dynamic_state_sampling == 1) ) frame_source->frame_config->cg_site_types = cg_site_types;
+	
+	// Check that the trajectory is consistent with the desired CG model.
+	check_molecule_sites(n_cg_sites, frame_source->frame_config->current_n_sites);
+	
+	copy_binary_frame(frame_source, 0);
+	frame_source->binary_data->next_frame_index = 1;
+	frame_source->current_frame_n = 1;
+	
+	// Setup random number generator, if appropriate.
+	if ( (frame_source->dynamic_state_sampling == 1) || (frame_source->bootstrapping_flag == 1) ) {
+		frame_source->mt_rand_gen = std::mt19937(frame_source->random_num_seed);
+	}
+}
+
 void initial_nothing(FrameSource* const frame_source, const int n_cg_sites, int* cg_site_types)
 {
 }
@@ -497,52 +906,61 @@ void initial_nothing(FrameSource* const frame_source, const int n_cg_sites, int*
 
 int read_next_trr_frame(FrameSource* const frame_source)
 {
-    int return_val = 0;
-    
-    #if _exclude_gromacs == 1
-	#else
-	real junk_floating_point;
-    // Use Gromacs xtc library routines to read all the data stored in the .trr file for a single frame.
-    if (read_trr(frame_source->gromacs_data->trajectory_filepointer, frame_source->frame_config->current_n_sites, &frame_source->current_timestep, &frame_source->time, &junk_floating_point, frame_source->simulation_box_limits, frame_source->gromacs_data->x, NULL, frame_source->gromacs_data->f) == exdrOK) return_val = 1;
-    else return_val = 0;
-    
-    // Finish up by changing information simply determined by the data just read.
-    frame_source->gromacs_data->convert_rvec_to_vector(frame_source->frame_config->x, frame_source->frame_config->f, frame_source->frame_config->current_n_sites);
-    for (int i = 0; i < DIMENSION; i++) frame_source->frame_config->simulation_box_half_lengths[i] = frame_source->simulation_box_limits[i][i] * 0.5;
+    int return_val = decode_trr_frame(frame_source);
     frame_source->current_frame_n += 1;
-	#endif
-    
-    // Return any relevant error codes.
     return return_val;
 }
 
+// Pass over a .trr frame, reading only its header.
+
+int read_junk_trr_frame(FrameSource* const frame_source)
+{
+	XdrTrajectory* const trajectory = &frame_source->gromacs_data->trajectory;
+	TrrFrameHeader header;
+	size_t frame_size = parse_trr_header(trajectory, trajectory->cursor, &header);
+	frame_source->current_frame_n += 1;
+	if (frame_size == 0) return 0;
+	if (header.n_atoms != frame_source->frame_config->current_n_sites) {
+		printf("Warning: Number of CG sites defined in top.in is not consistent with trajectory!\n");
+		return 0;
+	}
+	frame_source->current_timestep = header.step;
+	frame_source->time = header.time;
+	advance_xdr_trajectory(trajectory, frame_size);
+	return 1;
+}
+
 // Read a frame of a .xtc-format trajectory after the first has been read
 
 int read_next_xtc_frame(FrameSource* const frame_source)
 {
-    int return_val = 0;
-    
-    #if _exclude_gromacs == 1
-    #else
-    int junk_integer;
-    real junk_floating_point;
-    // Use Gromacs xtc library routines to read all the data stored in the .xtc files for a single frame.
-    if ((read_xtc(frame_source->gromacs_data->extra_trajectory_filepointer, frame_source->frame_config->current_n_sites, &frame_source->current_timestep, &frame_source->time, frame_source->simulation_box_limits, frame_source->gromacs_data->f, &junk_floating_point)
-         == exdrOK) &&
-        (read_xtc(frame_source->gromacs_data->trajectory_filepointer, frame_source->frame_config->current_n_sites, &junk_integer, &junk_floating_point, frame_source->simulation_box_limits, frame_source->gromacs_data->x, &junk_floating_point)
-         == exdrOK)) return_val = 1;
-    else return_val = 0;
-    
-    // Finish up by changing information simply determined by the data just read.
-    frame_source->gromacs_data->convert_rvec_to_vector(frame_source->frame_config->x, frame_source->frame_config->f, frame_source->frame_config->current_n_sites);
-    for (int i = 0; i < DIMENSION; i++) frame_source->frame_config->simulation_box_half_lengths[i] = frame_source->simulation_box_limits[i][i] * 0.5;
+    int return_val = decode_xtc_frame(frame_source);
     frame_source->current_frame_n += 1;
-	#endif
-	
-    // Return any relevant error codes.
     return return_val;
 }
 
+// Pass over a frame of both .xtc trajectories without decompressing it.
+
+int read_junk_xtc_frame(FrameSource* const frame_source)
+{
+	XdrTrajectory* const position_trajectory = &frame_source->gromacs_data->trajectory;
+	XdrTrajectory* const force_trajectory = &frame_source->gromacs_data->extra_trajectory;
+	XtcFrameHeader position_header, force_header;
+	size_t position_frame_size = parse_xtc_header(position_trajectory, position_trajectory->cursor, &position_header);
+	size_t force_frame_size = parse_xtc_header(force_trajectory, force_trajectory->cursor, &force_header);
+	frame_source->current_frame_n += 1;
+	if ( (position_frame_size == 0) || (force_frame_size == 0) ) return 0;
+	if ( (position_header.n_atoms != frame_source->frame_config->current_n_sites) || (force_header.n_atoms != frame_source->frame_config->current_n_sites) ) {
+		printf("Warning: Number of CG sites defined in top.in is not consistent with trajectory!\n");
+		return 0;
+	}
+	frame_source->current_timestep = position_header.step;
+	frame_source->time = position_header.time;
+	advance_xdr_trajectory(position_trajectory, position_frame_size);
+	advance_xdr_trajectory(force_trajectory, force_frame_size);
+	return 1;
+}
+
 // Read a frame of a lammps-dump-format trajectory after the first has been read.
 
 int read_next_lammps_frame(FrameSource* const frame_source)
@@ -550,7 +968,7 @@ int read_next_lammps_frame(FrameSource* const frame_source)
 	int return_value = 1;  
 	int reference_atoms  = frame_source->frame_config->current_n_sites;
 
-	read_lammps_header(frame_source->lammps_data, &frame_source->frame_config->current_n_sites, &frame_source->current_timestep, &frame_source->time, frame_source->simulation_box_limits, frame_source->dynamic_types, frame_source->dynamic_state_sampling, frame_source->no_forces);    
+	frame_source->lammps_data->read_lammps_frame_header(frame_source->lammps_data, &frame_source->frame_config->current_n_sites, &frame_source->current_timestep, &frame_source->time, frame_source->simulation_box_limits, frame_source->dynamic_types, frame_source->dynamic_state_sampling, frame_source->no_forces);    
 
  	if (reference_atoms != frame_source->frame_config->current_n_sites) {
  		printf("Warning: Number of CG sites defined in top.in is not consistent with trajectory!\n");
@@ -572,18 +990,15 @@ int read_junk_lammps_frame(FrameSource* const frame_source)
 {
 	int return_value = 1;  
 	int reference_atoms  = frame_source->frame_config->current_n_sites;
-	std::string line;
 
-	read_lammps_header(frame_source->lammps_data, &frame_source->frame_config->current_n_sites, &frame_source->current_timestep, &frame_source->time, frame_source->simulation_box_limits, frame_source->dynamic_types, frame_source->dynamic_state_sampling, frame_source->no_forces);    
+	frame_source->lammps_data->read_lammps_frame_header(frame_source->lammps_data, &frame_source->frame_config->current_n_sites, &frame_source->current_timestep, &frame_source->time, frame_source->simulation_box_limits, frame_source->dynamic_types, frame_source->dynamic_state_sampling, frame_source->no_forces);    
 
  	if (reference_atoms != frame_source->frame_config->current_n_sites) {
  		printf("Warning: Number of CG sites defined in top.in is not consistent with trajectory!\n");
  		return_value = 0;
  	} else {
  		// Skip through expected number of lines in frame body without parsing.
-		for(int i=0; i < frame_source->frame_config->current_n_sites; i++) {
-			check_and_read_next_line(frame_source->lammps_data->trajectory_stream, line);
-    	}
+ 		return_value = frame_source->lammps_data->skip_lammps_body(frame_source->lammps_data, frame_source->frame_config->current_n_sites);
 	}
 	 
     // Finish up by changing information simply determined by the data just read.
@@ -594,127 +1009,669 @@ int read_junk_lammps_frame(FrameSource* const frame_source)
  	return return_value;
 }
 
+// Read a frame of a binary CG trajectory after the first has been read.
+// Returns 0 past the last frame.
+
+int read_next_binary_frame(FrameSource* const frame_source)
+{
+	BinaryTrajectoryData* const binary_data = frame_source->binary_data;
+	if (binary_data->next_frame_index >= binary_data->header.n_frames) return 0;
+	copy_binary_frame(frame_source, binary_data->next_frame_index);
+	binary_data->next_frame_index++;
+	frame_source->current_frame_n += 1;
+	return 1;
+}
+
+int read_junk_binary_frame(FrameSource* const frame_source)
+{
+	BinaryTrajectoryData* const binary_data = frame_source->binary_data;
+	if (binary_data->next_frame_index >= binary_data->header.n_frames) return 0;
+	binary_data->next_frame_index++;
+	frame_source->current_frame_n += 1;
+	return 1;
+}
+
 int next_nothing(FrameSource* const frame_source)
 {
 	return 1;
 }
 
+// Read the frame after skipping frame_stride - 1 frames.
+
+int read_next_strided_frame(FrameSource* const frame_source)
+{
+	if ((*frame_source->skip_frames)(frame_source, frame_source->frame_stride - 1) == 0) return 0;
+	return (*frame_source->get_adjacent_frame)(frame_source);
+}
+
+// Read the next frame to be processed, or pass over it without parsing it
+// if its statistical weight is zero, since such frames are never processed.
+// The frame data is then left as it was.
+
+int read_next_weighted_frame(FrameSource* const frame_source)
+{
+	frame_source->current_selected_frame++;
+	if ( (frame_source->current_selected_frame < frame_source->n_frames) && (frame_source->frame_weights[frame_source->current_selected_frame] == 0.0) ) {
+		return (*frame_source->skip_frames)(frame_source, frame_source->frame_stride);
+	}
+	if (frame_source->frame_stride > 1) return read_next_strided_frame(frame_source);
+	return (*frame_source->get_adjacent_frame)(frame_source);
+}
+
+// Pass over frames by reading each of them as a junk frame.
+
+int skip_frames_by_reading(FrameSource* const frame_source, const int n_skipped_frames)
+{
+    for (int i = 0; i < n_skipped_frames; i++) {
+        if ((*frame_source->get_junk_frame)(frame_source) == 0) return 0;
+    }
+    return 1;
+}
+
+// Pass over LAMMPS frames by jumping to the furthest indexed frame
+// up to the target before reading the remaining frames as junk. The jump
+// is tried again after each junk frame, since reading may have moved on
+// to the next file of a trajectory split into several files.
+
+int skip_lammps_frames(FrameSource* const frame_source, const int n_skipped_frames)
+{
+	int n_remaining_frames = n_skipped_frames;
+	while (n_remaining_frames > 0) {
+		n_remaining_frames -= jump_lammps_frames(frame_source, n_remaining_frames);
+		if (n_remaining_frames > 0) {
+			if ((*frame_source->get_junk_frame)(frame_source) == 0) return 0;
+			n_remaining_frames--;
+		}
+	}
+	return 1;
+}
+
+// Jump over up to n_skipped_frames indexed frames, returning the number jumped.
+// If the indexed offset is not the start of a frame, the index is discarded
+// and nothing is jumped, so the frames are parsed instead.
+
+int jump_lammps_frames(FrameSource* const frame_source, const int n_skipped_frames)
+{
+	LammpsData* const lammps_data = frame_source->lammps_data;
+	int n_jumped_frames = 0;
+	if ( ((lammps_data->mapped == 1) || (lammps_data->gzip_buffer != NULL)) && (n_skipped_frames > 0) && (lammps_data->frame_offsets.size() > lammps_data->next_frame_index) ) {
+		size_t target_frame_index = lammps_data->next_frame_index + n_skipped_frames;
+		if (target_frame_index >= lammps_data->frame_offsets.size()) target_frame_index = lammps_data->frame_offsets.size() - 1;
+		n_jumped_frames = (int)(target_frame_index - lammps_data->next_frame_index);
+		if (check_lammps_frame_offset(lammps_data, lammps_data->frame_offsets[target_frame_index]) == 0) {
+			printf("Frame index %s does not match the trajectory; the frames will be read instead.\n", lammps_data->index_filename.c_str());
+			discard_frame_index(lammps_data->index_filename, lammps_data->frame_offsets, lammps_data->n_loaded_offsets);
+			return 0;
+		}
+		if (lammps_data->mapped == 1) lammps_data->cursor = lammps_data->map_begin + lammps_data->frame_offsets[target_frame_index];
+		lammps_data->next_frame_index = target_frame_index;
+		frame_source->current_timestep += n_jumped_frames;
+		frame_source->current_frame_n += n_jumped_frames;
+	}
+	return n_jumped_frames;
+}
+
+// Pass over binary CG trajectory frames through the frame index, reading
+// a junk frame to move on whenever the end of the file is reached.
+
+int skip_binary_frames(FrameSource* const frame_source, const int n_skipped_frames)
+{
+	BinaryTrajectoryData* const binary_data = frame_source->binary_data;
+	int n_remaining_frames = n_skipped_frames;
+	while (n_remaining_frames > 0) {
+		int n_jumped_frames = (int)std::min((uint64_t)n_remaining_frames, binary_data->header.n_frames - binary_data->next_frame_index);
+		binary_data->next_frame_index += n_jumped_frames;
+		frame_source->current_frame_n += n_jumped_frames;
+		n_remaining_frames -= n_jumped_frames;
+		if (n_remaining_frames > 0) {
+			if ((*frame_source->get_junk_frame)(frame_source) == 0) return 0;
+			n_remaining_frames--;
+		}
+	}
+	return 1;
+}
+
+// Pass over .trr frames by jumping straight past as many frames of the
+// current frame's size as the file can hold. The jump is only taken if it
+// lands on a frame header of the same size or exactly at the end of the
+// file; otherwise one junk frame is read and the jump is tried again.
+
+int skip_trr_frames(FrameSource* const frame_source, const int n_skipped_frames)
+{
+	XdrTrajectory* const trajectory = &frame_source->gromacs_data->trajectory;
+	TrrFrameHeader header, target_header;
+	int n_remaining_frames = n_skipped_frames;
+	while (n_remaining_frames > 0) {
+		size_t frame_size = parse_trr_header(trajectory, trajectory->cursor, &header);
+		if (frame_size > 0) {
+			size_t n_jumped_frames = std::min((size_t)n_remaining_frames, (trajectory->map_size - trajectory->cursor) / frame_size);
+			size_t target_offset = trajectory->cursor + n_jumped_frames * frame_size;
+			if ( (n_jumped_frames > 0) && ((target_offset == trajectory->map_size) || (parse_trr_header(trajectory, target_offset, &target_header) == frame_size)) ) {
+				trajectory->cursor = target_offset;
+				trajectory->next_frame_index += n_jumped_frames;
+				frame_source->current_frame_n += (int)n_jumped_frames;
+				n_remaining_frames -= (int)n_jumped_frames;
+			}
+		}
+		if (n_remaining_frames > 0) {
+			if ((*frame_source->get_junk_frame)(frame_source) == 0) return 0;
+			n_remaining_frames--;
+		}
+	}
+	return 1;
+}
+
+// Pass over .xtc frames as LAMMPS frames are passed over, since compressed
+// frames differ in size and can only be jumped to once indexed.
+
+int skip_xtc_frames(FrameSource* const frame_source, const int n_skipped_frames)
+{
+	int n_remaining_frames = n_skipped_frames;
+	while (n_remaining_frames > 0) {
+		n_remaining_frames -= jump_xtc_frames(frame_source, n_remaining_frames);
+		if (n_remaining_frames > 0) {
+			if ((*frame_source->get_junk_frame)(frame_source) == 0) return 0;
+			n_remaining_frames--;
+		}
+	}
+	return 1;
+}
+
+// Jump over up to n_skipped_frames frames indexed in both .xtc trajectories,
+// returning the number jumped.
+
+int jump_xtc_frames(FrameSource* const frame_source, const int n_skipped_frames)
+{
+	XdrTrajectory* const position_trajectory = &frame_source->gromacs_data->trajectory;
+	XdrTrajectory* const force_trajectory = &frame_source->gromacs_data->extra_trajectory;
+	size_t n_indexed_frames = std::min(position_trajectory->frame_offsets.size(), force_trajectory->frame_offsets.size());
+	if ( (n_skipped_frames <= 0) || (n_indexed_frames <= position_trajectory->next_frame_index) ) return 0;
+	
+	size_t target_frame_index = std::min(position_trajectory->next_frame_index + n_skipped_frames, n_indexed_frames - 1);
+	if ( (check_xtc_frame_offset(position_trajectory, position_trajectory->frame_offsets[target_frame_index]) == 0) ||
+		 (check_xtc_frame_offset(force_trajectory, force_trajectory->frame_offsets[target_frame_index]) == 0) ) {
+		printf("Frame indices %s and %s do not match the trajectories; the frames will be read instead.\n", position_trajectory->index_filename.c_str(), force_trajectory->index_filename.c_str());
+		discard_frame_index(position_trajectory->index_filename, position_trajectory->frame_offsets, position_trajectory->n_loaded_offsets);
+		discard_frame_index(force_trajectory->index_filename, force_trajectory->frame_offsets, force_trajectory->n_loaded_offsets);
+		return 0;
+	}
+	int n_jumped_frames = (int)(target_frame_index - position_trajectory->next_frame_index);
+	position_trajectory->cursor = position_trajectory->frame_offsets[target_frame_index];
+	force_trajectory->cursor = force_trajectory->frame_offsets[target_frame_index];
+	position_trajectory->next_frame_index = target_frame_index;
+	force_trajectory->next_frame_index = target_frame_index;
+	frame_source->current_frame_n += n_jumped_frames;
+	return n_jumped_frames;
+}
+
+// Move from the first frame to starting_frame, leaving it as the current
+// frame, switch to strided reading if frame_stride is above 1, pass over
+// frames with zero statistical weight, and start reading the remaining
+// frames ahead if frame_prefetch_depth is above 0. Frame weights are
+// indexed by frame sample under dynamic_state_sampling, so there every
+// frame is still read.
+
 void default_move_to_starting_frame(FrameSource* const frame_source) {
-    for (int i = 0; i < frame_source->starting_frame - 1; i++) {
-        if ((*frame_source->get_junk_frame)(frame_source) == 0) {
-            printf("Failure attempting to skip frame %d. Check the trajectory file for errors.\n", i);
+    if (frame_source->starting_frame > 1) {
+        if ( ((*frame_source->skip_frames)(frame_source, frame_source->starting_frame - 2) == 0) ||
+             ((*frame_source->get_adjacent_frame)(frame_source) == 0) ) {
+            printf("Failure attempting to move to frame %d. Check the trajectory file for errors.\n", frame_source->starting_frame);
             exit(EXIT_FAILURE);
         }
     }
+    if (frame_source->frame_stride > 1) frame_source->get_next_frame = read_next_strided_frame;
+    if ( (frame_source->use_statistical_reweighting == 1) && (frame_source->dynamic_state_sampling == 0) ) {
+        int n_zero_weights = 0;
+        for (int i = 1; i < frame_source->n_frames; i++) {
+            if (frame_source->frame_weights[i] == 0.0) n_zero_weights++;
+        }
+        frame_source->current_selected_frame = 0;
+        if (n_zero_weights > 0) {
+            frame_source->get_next_frame = read_next_weighted_frame;
+            printf("Passing over %d frames with zero weight without reading them.\n", n_zero_weights);
+        }
+    }
+    if (frame_source->frame_prefetch_depth > 0) start_frame_prefetching(frame_source);
 }
 
 //-------------------------------------------------------------
-// Helper functions for reading LAMMPS header and body
+// Background frame prefetching
 //-------------------------------------------------------------
 
-void read_lammps_header(LammpsData *const lammps_data, int* const current_n_sites, int *const timestep, real *const time, matrix box, const int dynamic_types, const int dynamic_state_sampling, const int no_forces)
+// A reader thread fills a ring of frame_prefetch_depth frames through a
+// private copy of the frame source while the current frame is processed.
+// Each get_next_frame call trades buffers with the oldest filled frame, so
+// the data is never copied site by site except for dynamic site types,
+// which must stay in the topology's array. The reader reads exactly the
+// n_frames - 1 frames that follow the starting frame and stops at the first
+// failed read, whose status is handed on to the consumer.
+
+void start_frame_prefetching(FrameSource* const frame_source)
 {
-	double low = 0.0;
-	double high = 0.0;
-	std::string line;
-	int flag = 1; 
+	int n_frames_to_read = frame_source->n_frames - 1;
+	if (n_frames_to_read < 1) return;
 	
-	while(flag == 1) {
-		//read next line of header (and wrap-up if end-of-file)
-		check_and_read_next_line(lammps_data->trajectory_stream, line);
+	FramePrefetchData* const prefetch_data = new FramePrefetchData;
+	int n_sites = frame_source->frame_config->current_n_sites;
+	int ring_size = (frame_source->frame_prefetch_depth < n_frames_to_read) ? frame_source->frame_prefetch_depth : n_frames_to_read;
+	prefetch_data->reader_source = *frame_source;
+	prefetch_data->ring.resize(ring_size);
+	for (int i = 0; i < ring_size; i++) {
+		prefetch_data->ring[i].frame_config = new FrameConfig(n_sites);
+		if (frame_source->dynamic_types == 1) prefetch_data->ring[i].frame_config->cg_site_types = new int[n_sites];
+		if (frame_source->dynamic_state_sampling == 1) prefetch_data->ring[i].frame_config->cg_site_state_probabilities = new double[n_sites];
+	}
+	prefetch_data->n_frames_to_read = n_frames_to_read;
+	prefetch_data->n_filled = 0;
+	prefetch_data->consumer_position = 0;
+	prefetch_data->stop_reading = 0;
+	prefetch_data->reader_finished = 0;
+	prefetch_data->cleanup = frame_source->cleanup;
+	
+	frame_source->prefetch_data = prefetch_data;
+	frame_source->get_next_frame = read_prefetched_frame;
+	frame_source->cleanup = finish_prefetched_reading;
+	printf("Reading up to %d frames ahead in the background.\n", ring_size);
+	prefetch_data->reader_thread = std::thread(prefetch_frames, prefetch_data);
+}
+
+void prefetch_frames(FramePrefetchData* const prefetch_data)
+{
+	FrameSource* const reader_source = &prefetch_data->reader_source;
+	int ring_size = (int)prefetch_data->ring.size();
+	int producer_position = 0;
+	
+	while (prefetch_data->n_frames_to_read > 0) {
+		{
+			std::unique_lock<std::mutex> guard(prefetch_data->lock);
+			while ( (prefetch_data->stop_reading == 0) && (prefetch_data->n_filled == ring_size) ) prefetch_data->frame_consumed.wait(guard);
+			if (prefetch_data->stop_reading == 1) break;
+		}
 		
-		//test if it is a labeled line (all LAMMPS labels start with "ITEM:")
-		if( line.compare(0, 5, "ITEM:") == 0 ) {
-			//find out which label matched (skip space after ITEM:)
-			if( line.compare(6, 15, "NUMBER OF ATOMS") == 0) {
-				
-				//read number of atoms
-				lammps_data->trajectory_stream >> *current_n_sites;
-				
-			} else if( line.compare(6, 10, "BOX BOUNDS") == 0) {
-					
-				//read in bounds (low high) for each dimensions
-				for(int pos=0; pos <  DIMENSION; pos++) {
-					lammps_data->trajectory_stream >> low >> high;
-					box[pos][pos] = high - low;
-				}	
-				
-			} else if( line.compare(6, 8, "TIMESTEP") == 0) {
-				
-				//read in timestep value
-				lammps_data->trajectory_stream >> *time;
+		// Read into a free frame without holding the lock.
+		PrefetchedFrame &frame = prefetch_data->ring[producer_position];
+		reader_source->frame_config = frame.frame_config;
+		frame.read_status = (*reader_source->get_next_frame)(reader_source);
+		frame.current_timestep = reader_source->current_timestep;
+		frame.current_frame_n = reader_source->current_frame_n;
+		frame.time = reader_source->time;
+		memcpy(frame.simulation_box_limits, reader_source->simulation_box_limits, sizeof(matrix));
+		if (frame.read_status == 0) prefetch_data->n_frames_to_read = 0;
+		else prefetch_data->n_frames_to_read--;
+		producer_position = (producer_position + 1) % ring_size;
+		
+		{
+			std::lock_guard<std::mutex> guard(prefetch_data->lock);
+			prefetch_data->n_filled++;
+		}
+		prefetch_data->frame_filled.notify_one();
+	}
+	
+	{
+		std::lock_guard<std::mutex> guard(prefetch_data->lock);
+		prefetch_data->reader_finished = 1;
+	}
+	prefetch_data->frame_filled.notify_one();
+}
+
+int read_prefetched_frame(FrameSource* const frame_source)
+{
+	FramePrefetchData* const prefetch_data = frame_source->prefetch_data;
+	{
+		std::unique_lock<std::mutex> guard(prefetch_data->lock);
+		while ( (prefetch_data->n_filled == 0) && (prefetch_data->reader_finished == 0) ) prefetch_data->frame_filled.wait(guard);
+		if (prefetch_data->n_filled == 0) return 0;
+	}
+	
+	// Take over the buffers of the oldest filled frame, leaving the current ones for the reader to refill.
+	PrefetchedFrame &frame = prefetch_data->ring[prefetch_data->consumer_position];
+	FrameConfig* const frame_config = frame_source->frame_config;
+	std::swap(frame_config->x, frame.frame_config->x);
+	std::swap(frame_config->f, frame.frame_config->f);
+	std::swap(frame_config->cg_site_state_probabilities, frame.frame_config->cg_site_state_probabilities);
+	frame_config->current_n_sites = frame.frame_config->current_n_sites;
+	for (int i = 0; i < DIMENSION; i++) frame_config->simulation_box_half_lengths[i] = frame.frame_config->simulation_box_half_lengths[i];
+	if (frame_source->dynamic_types == 1) memcpy(frame_config->cg_site_types, frame.frame_config->cg_site_types, frame_config->current_n_sites * sizeof(int));
+	frame_source->current_timestep = frame.current_timestep;
+	frame_source->current_frame_n = frame.current_frame_n;
+	frame_source->time = frame.time;
+	memcpy(frame_source->simulation_box_limits, frame.simulation_box_limits, sizeof(matrix));
+	int read_status = frame.read_status;
+	prefetch_data->consumer_position = (prefetch_data->consumer_position + 1) % (int)prefetch_data->ring.size();
+	
+	{
+		std::lock_guard<std::mutex> guard(prefetch_data->lock);
+		prefetch_data->n_filled--;
+	}
+	prefetch_data->frame_consumed.notify_one();
+	return read_status;
+}
+
+void finish_prefetched_reading(FrameSource* const frame_source)
+{
+	FramePrefetchData* const prefetch_data = frame_source->prefetch_data;
+	{
+		std::lock_guard<std::mutex> guard(prefetch_data->lock);
+		prefetch_data->stop_reading = 1;
+	}
+	prefetch_data->frame_consumed.notify_one();
+	prefetch_data->reader_thread.join();
+	
+	for (unsigned i = 0; i < prefetch_data->ring.size(); i++) {
+		if (frame_source->dynamic_types == 1) delete [] prefetch_data->ring[i].frame_config->cg_site_types;
+		delete prefetch_data->ring[i].frame_config;
+	}
+	frame_source->cleanup = prefetch_data->cleanup;
+	frame_source->prefetch_data = NULL;
+	delete prefetch_data;
+	(*frame_source->cleanup)(frame_source);
+}
+
+//-------------------------------------------------------------
+// Trajectories split into several files
+//-------------------------------------------------------------
+
+// Add the files named by one command line argument: a file name, a wildcard
+// pattern quoted so that the shell passes it on, or @ followed by the name
+// of a file listing one trajectory file per line. Relative names in a list
+// are taken from the list's own directory. The files matching a
+// pattern are taken in natural order, so that numbered files are read in
+// numerical order whether or not their numbers are padded with zeros.
+
+void add_trajectory_filenames(const char* argument, std::vector<std::string> &filenames)
+{
+	if (argument[0] == '@') {
+		std::ifstream list_file(argument + 1);
+		if (!list_file.good()) {
+			printf("Problem opening trajectory file list %s\n", argument + 1);
+			exit(EXIT_FAILURE);
+		}
+		std::string list_filename(argument + 1);
+		size_t directory_end = list_filename.find_last_of('/');
+		std::string list_directory = (directory_end == std::string::npos) ? std::string() : list_filename.substr(0, directory_end + 1);
+		std::string filename;
+		while (list_file >> filename) filenames.push_back( (filename[0] == '/') ? filename : list_directory + filename );
+	} else if (strpbrk(argument, "*?[") != NULL) {
+		glob_t matches;
+		if ( (glob(argument, 0, NULL, &matches) != 0) || (matches.gl_pathc == 0) ) {
+			printf("No trajectory files match %s\n", argument);
+			exit(EXIT_FAILURE);
+		}
+		std::vector<std::string> matched_filenames(matches.gl_pathv, matches.gl_pathv + matches.gl_pathc);
+		globfree(&matches);
+		std::sort(matched_filenames.begin(), matched_filenames.end(), precedes_in_natural_order);
+		filenames.insert(filenames.end(), matched_filenames.begin(), matched_filenames.end());
+	} else {
+		filenames.push_back(argument);
+	}
+}
+
+// Compare names as text, except that runs of digits are compared as numbers.
+
+inline bool precedes_in_natural_order(const std::string &name1, const std::string &name2)
+{
+	size_t i = 0, j = 0;
+	while ( (i < name1.size()) && (j < name2.size()) ) {
+		if ( isdigit((unsigned char)name1[i]) && isdigit((unsigned char)name2[j]) ) {
+			while ( (i + 1 < name1.size()) && (name1[i] == '0') && isdigit((unsigned char)name1[i + 1]) ) i++;
+			while ( (j + 1 < name2.size()) && (name2[j] == '0') && isdigit((unsigned char)name2[j + 1]) ) j++;
+			size_t end1 = i, end2 = j;
+			while ( (end1 < name1.size()) && isdigit((unsigned char)name1[end1]) ) end1++;
+			while ( (end2 < name2.size()) && isdigit((unsigned char)name2[end2]) ) end2++;
+			if (end1 - i != end2 - j) return (end1 - i < end2 - j);
+			int comparison = name1.compare(i, end1 - i, name2, j, end2 - j);
+			if (comparison != 0) return (comparison < 0);
+			i = end1;
+			j = end2;
+		} else {
+			if (name1[i] != name2[j]) return (name1[i] < name2[j]);
+			i++;
+			j++;
+		}
+	}
+	if ( (i < name1.size()) || (j < name2.size()) ) return (j < name2.size());
+	return (name1 < name2);
+}
+
+// Present several files as one trajectory by wrapping the type-dependent
+// reading functions. Frames are numbered across all files, and a file is
+// only replaced by the next once no frames are left in it, so skipping
+// and strided reading cross file boundaries transparently. The next file
+// is opened as soon as the current one is, and the kernel is asked to read
+// it ahead so that its data is cached by the time it is needed.
+
+void setup_trajectory_segments(FrameSource* const frame_source, const std::vector<std::string> &filenames, const std::vector<std::string> &extra_filenames)
+{
+	TrajectorySegmentData* const segment_data = new TrajectorySegmentData;
+	segment_data->filenames = filenames;
+	segment_data->extra_filenames = extra_filenames;
+	segment_data->current_segment = 0;
+	segment_data->readahead_file_descriptor = -1;
+	
+	if (frame_source->trajectory_type == kLAMMPSDump) {
+		segment_data->at_segment_end = lammps_at_segment_end;
+		segment_data->open_segment = open_lammps_segment;
+	} else if (frame_source->trajectory_type == kMSCGBinary) {
+		for (unsigned i = 1; i < filenames.size(); i++) {
+			if (has_gzip_suffix(filenames[i].c_str()) == 1) check_file_extension(std::string(filenames[i], 0, filenames[i].size() - 3).c_str(), "mscgtrj");
+			else check_file_extension(filenames[i].c_str(), "mscgtrj");
+		}
+		segment_data->at_segment_end = binary_at_segment_end;
+		segment_data->open_segment = open_binary_segment;
+	} else if (frame_source->trajectory_type == kGromacsTRR) {
+		for (unsigned i = 1; i < filenames.size(); i++) check_file_extension(filenames[i].c_str(), "trr");
+		segment_data->at_segment_end = trr_at_segment_end;
+		segment_data->open_segment = open_trr_segment;
+	} else {
+		for (unsigned i = 1; i < filenames.size(); i++) {
+			check_file_extension(filenames[i].c_str(), "xtc");
+			check_file_extension(extra_filenames[i].c_str(), "xtc");
+		}
+		segment_data->at_segment_end = xtc_at_segment_end;
+		segment_data->open_segment = open_xtc_segment;
+	}
+	
+	segment_data->get_first_segment_frame = frame_source->get_first_frame;
+	segment_data->get_segment_frame = frame_source->get_adjacent_frame;
+	segment_data->get_segment_junk_frame = frame_source->get_junk_frame;
+	segment_data->cleanup = frame_source->cleanup;
+	frame_source->segment_data = segment_data;
+	frame_source->get_first_frame = read_initial_segmented_frame;
+	frame_source->get_adjacent_frame = read_next_segmented_frame;
+	frame_source->get_next_frame = read_next_segmented_frame;
+	frame_source->get_junk_frame = read_junk_segmented_frame;
+	frame_source->cleanup = finish_segmented_reading;
+	printf("Reading %d trajectory files as one trajectory.\n", (int)filenames.size());
+}
+
+// Start from the first file, as when reading a trajectory that is not split.
+
+void read_initial_segmented_frame(FrameSource* const frame_source, const int n_cg_sites, int* cg_site_types)
+{
+	TrajectorySegmentData* const segment_data = frame_source->segment_data;
+	segment_data->current_segment = 0;
+	sscanf(segment_data->filenames[0].c_str(), "%s", frame_source->trajectory_filename);
+	if (!segment_data->extra_filenames.empty()) sscanf(segment_data->extra_filenames[0].c_str(), "%s", frame_source->gromacs_data->extra_trajectory_filename);
+	segment_data->get_first_segment_frame(frame_source, n_cg_sites, cg_site_types);
+	read_next_segment_ahead(segment_data);
+}
+
+int read_next_segmented_frame(FrameSource* const frame_source)
+{
+	if (enter_unfinished_segment(frame_source) == 0) return 0;
+	return frame_source->segment_data->get_segment_frame(frame_source);
+}
+
+int read_junk_segmented_frame(FrameSource* const frame_source)
+{
+	if (enter_unfinished_segment(frame_source) == 0) return 0;
+	return frame_source->segment_data->get_segment_junk_frame(frame_source);
+}
+
+// Move on past any files with no frames left.
+// Returns 0 if no frames are left in any file.
+
+int enter_unfinished_segment(FrameSource* const frame_source)
+{
+	TrajectorySegmentData* const segment_data = frame_source->segment_data;
+	while (segment_data->at_segment_end(frame_source) == 1) {
+		if (segment_data->current_segment + 1 >= segment_data->filenames.size()) return 0;
+		segment_data->current_segment++;
+		sscanf(segment_data->filenames[segment_data->current_segment].c_str(), "%s", frame_source->trajectory_filename);
+		segment_data->open_segment(frame_source, frame_source->trajectory_filename);
+		read_next_segment_ahead(segment_data);
+	}
+	return 1;
+}
+
+// Open the file after the current one and ask the kernel to read it into
+// the page cache in the background. Holding it open also keeps it readable
+// if it is renamed or removed before it is reached.
+
+void read_next_segment_ahead(TrajectorySegmentData* const segment_data)
+{
+	if (segment_data->readahead_file_descriptor >= 0) close(segment_data->readahead_file_descriptor);
+	segment_data->readahead_file_descriptor = -1;
+	if (segment_data->current_segment + 1 >= segment_data->filenames.size()) return;
+	
+	segment_data->readahead_file_descriptor = open(segment_data->filenames[segment_data->current_segment + 1].c_str(), O_RDONLY);
+	#ifdef POSIX_FADV_WILLNEED
+	if (segment_data->readahead_file_descriptor >= 0) posix_fadvise(segment_data->readahead_file_descriptor, 0, 0, POSIX_FADV_WILLNEED);
+	#endif
+}
+
+void finish_segmented_reading(FrameSource* const frame_source)
+{
+	TrajectorySegmentData* const segment_data = frame_source->segment_data;
+	if (segment_data->readahead_file_descriptor >= 0) close(segment_data->readahead_file_descriptor);
+	frame_source->cleanup = segment_data->cleanup;
+	frame_source->segment_data = NULL;
+	delete segment_data;
+	(*frame_source->cleanup)(frame_source);
+}
+
+// A LAMMPS file has no frames left once only white space remains.
+
+int lammps_at_segment_end(FrameSource* const frame_source)
+{
+	LammpsData* const lammps_data = frame_source->lammps_data;
+	if (lammps_data->mapped == 1) {
+		while ( (lammps_data->cursor < lammps_data->map_end) && isspace((unsigned char)*lammps_data->cursor) ) lammps_data->cursor++;
+		return (lammps_data->cursor >= lammps_data->map_end) ? 1 : 0;
+	}
+	lammps_data->trajectory_stream >> std::ws;
+	return (lammps_data->trajectory_stream.peek() == std::char_traits<char>::eof()) ? 1 : 0;
+}
+
+// The atom labels are parsed again from the header of each frame, so only
+// the file itself needs to be replaced.
+
+void open_lammps_segment(FrameSource* const frame_source, const char* filename)
+{
+	close_lammps_trajectory(frame_source->lammps_data);
+	open_lammps_trajectory(frame_source->lammps_data, filename, frame_source->lammps_mmap_flag);
+}
+
+int binary_at_segment_end(FrameSource* const frame_source)
+{
+	return (frame_source->binary_data->next_frame_index >= frame_source->binary_data->header.n_frames) ? 1 : 0;
+}
+
+// Every file must hold the same sites and data as the first, though not
+// necessarily at the same precision.
+
+void open_binary_segment(FrameSource* const frame_source, const char* filename)
+{
+	BinaryTrajectoryHeader previous_header = frame_source->binary_data->header;
+	close_binary_trajectory(frame_source->binary_data);
+	open_binary_trajectory(frame_source->binary_data, filename);
+	const BinaryTrajectoryHeader &header = frame_source->binary_data->header;
+	if ( (header.n_sites != previous_header.n_sites) || ((header.contents | kBinaryDoublePrecision) != (previous_header.contents | kBinaryDoublePrecision)) ) {
+		printf("Binary trajectory %s does not hold the same sites and data as the files before it.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+}
+
+int trr_at_segment_end(FrameSource* const frame_source)
+{
+	return (frame_source->gromacs_data->trajectory.cursor >= frame_source->gromacs_data->trajectory.map_size) ? 1 : 0;
+}
+
+// The number of sites is checked against the frame data as each frame is read.
+
+void open_trr_segment(FrameSource* const frame_source, const char* filename)
+{
+	close_xdr_trajectory(&frame_source->gromacs_data->trajectory);
+	open_xdr_trajectory(&frame_source->gromacs_data->trajectory, filename, 0);
+}
+
+int xtc_at_segment_end(FrameSource* const frame_source)
+{
+	return (frame_source->gromacs_data->trajectory.cursor >= frame_source->gromacs_data->trajectory.map_size) ? 1 : 0;
+}
+
+// The forces are replaced by the file matching the new file of positions.
+
+void open_xtc_segment(FrameSource* const frame_source, const char* filename)
+{
+	XRDData* const gromacs_data = frame_source->gromacs_data;
+	sscanf(frame_source->segment_data->extra_filenames[frame_source->segment_data->current_segment].c_str(), "%s", gromacs_data->extra_trajectory_filename);
+	close_xdr_trajectory(&gromacs_data->trajectory);
+	close_xdr_trajectory(&gromacs_data->extra_trajectory);
+	open_xdr_trajectory(&gromacs_data->trajectory, filename, 1);
+	open_xdr_trajectory(&gromacs_data->extra_trajectory, gromacs_data->extra_trajectory_filename, 1);
+}
+
+//-------------------------------------------------------------
+// Helper functions for reading LAMMPS header and body
+//-------------------------------------------------------------
+
+void read_lammps_header(LammpsData *const lammps_data, int* const current_n_sites, int *const timestep, real *const time, matrix box, const int dynamic_types, const int dynamic_state_sampling, const int no_forces)
+{
+	double low = 0.0;
+	double high = 0.0;
+	std::string line;
+	int flag = 1; 
+	
+	// Record where this frame starts in a compressed trajectory if it has not been indexed yet.
+	if (lammps_data->gzip_buffer != NULL) {
+		if (lammps_data->next_frame_index == lammps_data->frame_offsets.size()) {
+			lammps_data->frame_offsets.push_back((uint64_t)lammps_data->trajectory_stream.tellg());
+		}
+		lammps_data->next_frame_index++;
+	}
+	
+	while(flag == 1) {
+		//read next line of header (and wrap-up if end-of-file)
+		check_and_read_next_line(lammps_data->trajectory_stream, line);
+		
+		//test if it is a labeled line (all LAMMPS labels start with "ITEM:")
+		if( line.compare(0, 5, "ITEM:") == 0 ) {
+			//find out which label matched (skip space after ITEM:)
+			if( line.compare(6, 15, "NUMBER OF ATOMS") == 0) {
+				
+				//read number of atoms
+				lammps_data->trajectory_stream >> *current_n_sites;
+				
+			} else if( line.compare(6, 10, "BOX BOUNDS") == 0) {
+					
+				//read in bounds (low high) for each dimensions
+				for(int pos=0; pos <  DIMENSION; pos++) {
+					lammps_data->trajectory_stream >> low >> high;
+					box[pos][pos] = high - low;
+				}	
+				
+			} else if( line.compare(6, 8, "TIMESTEP") == 0) {
+				
+				//read in timestep value
+				lammps_data->trajectory_stream >> *time;
 				(*timestep)++;
 			
 			} else if( line.compare(6, 5, "ATOMS") == 0) {
 				
 				//read labels for body of frame
 				flag = 0; 
-				size_t prev = 11;
-				size_t next = 0;
-				int set_x = 0;
-				int set_f = 0;
-				int set_type = 0;
-				int set_state = 0;
-				lammps_data->header_size = 0;
-				
-				//check for xpos and fpos as we tokenize string to determine number of columns in body
-				while ((next = line.find_first_of(" ", prev)) != std::string::npos) {
-					if( (next - prev) == 0 ) { //check if empty
-						prev++;
-						continue;
-					} else if( (line.compare(prev, 1, "x") == 0) ||
-							   (line.compare(prev, 1, "xu") == 0) ) {
-						lammps_data->x_pos = lammps_data->header_size;
-						set_x = 1;
-					} else if( line.compare(prev, 2, "fx") == 0 ) {
-						lammps_data->f_pos = lammps_data->header_size;
-						set_f = 1;
-					} else if( line.compare(prev, 4, "type") == 0 ) {		
-						lammps_data->type_pos = lammps_data->header_size;
-						set_type = 1;
-					} else if( line.compare(prev, 5, "state") == 0 ) {
-						lammps_data->state_pos = lammps_data->header_size;
-						set_state = 1;
-					}
-					lammps_data->header_size++;
-					prev = next;
-				}
-		
-				if (prev < line.size()) {
-                	if( (line.compare(prev, 1, "x") == 0 )  ||
-					    (line.compare(prev, 1, "xu") == 0) ) {
-                        lammps_data->x_pos = lammps_data->header_size;
-                    	set_x = 1;
-                    } else if( line.compare(prev, 2, "fx") == 0 ) {
-                        lammps_data->f_pos = lammps_data->header_size;
-                    	set_f = 1;
-                    } else if( line.compare(prev, 4, "type") == 0 ) {
-                        lammps_data->type_pos = lammps_data->header_size;
-                    	set_type = 1;
-					} else if( line.compare(prev, 5, "state") == 0 ) {
-						lammps_data->state_pos = lammps_data->header_size;
-						set_state = 1;
-					}
-                	lammps_data->header_size++;
-                }
-				
-				//verify that necessary information was extracted to input
-				if(set_x == 0 ) {
-					printf("Warning: Was not able to find either x (positions) when parsing LAMMPS frame header!\n");
-					exit(EXIT_FAILURE);
-				}
-				if( (no_forces == 0) && (set_f == 0) ) {
-					printf("Warning: Was not able to fx (forces) when parsing LAMMPS frame header!\n");
-					exit(EXIT_FAILURE);
-				}
-				if ( (dynamic_types == 1) && (set_type == 0) ) {
-					printf("Warning: Type information not detected in header when parsing LAMMPS frame header!\n");
-					exit(EXIT_FAILURE);
-				}
-				if ( (dynamic_state_sampling == 1) && (set_state == 0) ) {
-					printf("Warning: State probability information not detected in header when parsing LAMMPS frame header!\n");
-					exit(EXIT_FAILURE);
-				}
+				parse_lammps_atoms_labels(lammps_data, line, dynamic_types, dynamic_state_sampling, no_forces);
 			} else {
 				printf("Unrecognized line in frame header: %s", line.c_str() );
 				
@@ -724,6 +1681,78 @@ void read_lammps_header(LammpsData *const lammps_data, int* const current_n_site
 	return;
 }
 
+// Determine the column positions of the values needed from the labels of the "ITEM: ATOMS" line.
+
+void parse_lammps_atoms_labels(LammpsData* const lammps_data, const std::string &line, const int dynamic_types, const int dynamic_state_sampling, const int no_forces)
+{
+	size_t prev = 11;
+	size_t next = 0;
+	int set_x = 0;
+	int set_f = 0;
+	int set_type = 0;
+	int set_state = 0;
+	lammps_data->header_size = 0;
+	
+	//check for xpos and fpos as we tokenize string to determine number of columns in body
+	while ((next = line.find_first_of(" ", prev)) != std::string::npos) {
+		if( (next - prev) == 0 ) { //check if empty
+			prev++;
+			continue;
+		} else if( (line.compare(prev, 1, "x") == 0) ||
+				   (line.compare(prev, 1, "xu") == 0) ) {
+			lammps_data->x_pos = lammps_data->header_size;
+			set_x = 1;
+		} else if( line.compare(prev, 2, "fx") == 0 ) {
+			lammps_data->f_pos = lammps_data->header_size;
+			set_f = 1;
+		} else if( line.compare(prev, 4, "type") == 0 ) {		
+			lammps_data->type_pos = lammps_data->header_size;
+			set_type = 1;
+		} else if( line.compare(prev, 5, "state") == 0 ) {
+			lammps_data->state_pos = lammps_data->header_size;
+			set_state = 1;
+		}
+		lammps_data->header_size++;
+		prev = next;
+	}
+
+	if (prev < line.size()) {
+    	if( (line.compare(prev, 1, "x") == 0 )  ||
+		    (line.compare(prev, 1, "xu") == 0) ) {
+            lammps_data->x_pos = lammps_data->header_size;
+        	set_x = 1;
+        } else if( line.compare(prev, 2, "fx") == 0 ) {
+            lammps_data->f_pos = lammps_data->header_size;
+        	set_f = 1;
+        } else if( line.compare(prev, 4, "type") == 0 ) {
+            lammps_data->type_pos = lammps_data->header_size;
+        	set_type = 1;
+		} else if( line.compare(prev, 5, "state") == 0 ) {
+			lammps_data->state_pos = lammps_data->header_size;
+			set_state = 1;
+		}
+    	lammps_data->header_size++;
+    }
+	
+	//verify that necessary information was extracted to input
+	if(set_x == 0 ) {
+		printf("Warning: Was not able to find either x (positions) when parsing LAMMPS frame header!\n");
+		exit(EXIT_FAILURE);
+	}
+	if( (no_forces == 0) && (set_f == 0) ) {
+		printf("Warning: Was not able to fx (forces) when parsing LAMMPS frame header!\n");
+		exit(EXIT_FAILURE);
+	}
+	if ( (dynamic_types == 1) && (set_type == 0) ) {
+		printf("Warning: Type information not detected in header when parsing LAMMPS frame header!\n");
+		exit(EXIT_FAILURE);
+	}
+	if ( (dynamic_state_sampling == 1) && (set_state == 0) ) {
+		printf("Warning: State probability information not detected in header when parsing LAMMPS frame header!\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
 int read_dimension_lammps_body(LammpsData *const lammps_data, FrameConfig *const frame_config, const int dynamic_types, const int dynamic_state_sampling, const int no_forces)
 {
 	//read in current_n_sites lines to extract position and force information
@@ -760,69 +1789,1752 @@ int read_dimension_lammps_body(LammpsData *const lammps_data, FrameConfig *const
 			frame_config->cg_site_types[i] = atoi( lammps_data->elements[lammps_data->type_pos].c_str() );
 		}
 		if(dynamic_state_sampling == 1) { // check if dynamic_state_sampling is set
-			lammps_data->cg_site_state_probabilities[i] = atof( lammps_data->elements[lammps_data->state_pos].c_str() );
+			frame_config->cg_site_state_probabilities[i] = atof( lammps_data->elements[lammps_data->state_pos].c_str() );
 		}
 	}
 	return return_value;
 }
 
-void FrameSource::sampleTypesFromProbs()
+// Skip through the expected number of lines in a frame body without parsing.
+
+int skip_lammps_body(LammpsData *const lammps_data, const int n_sites)
 {
-	double rand;
-        std::uniform_real_distribution<double> uniform_dist(0.0, 1.0);
-	// Determine each site's type/state by comparing the probability against a random number
-	for(int i = 0; i < frame_config->current_n_sites; i++) {
-		// Generate random number [0,1] using Mersenne Twister.
-		rand = uniform_dist(mt_rand_gen);
-		// Make state assignment based on comparison.
-		if (rand > lammps_data->cg_site_state_probabilities[i]) frame_config->cg_site_types[i] = 2;
-		else frame_config->cg_site_types[i] = 1;
+	std::string line;
+	for(int i=0; i < n_sites; i++) {
+		check_and_read_next_line(lammps_data->trajectory_stream, line);
+	}
+	return 1;
+}
+
+//-------------------------------------------------------------
+// Opening and closing LAMMPS trajectories
+//-------------------------------------------------------------
+
+// Open a LAMMPS trajectory and choose the functions that read it.
+// Gzip-compressed trajectories are always read as a stream of decompressed data.
+
+void open_lammps_trajectory(LammpsData* const lammps_data, const char* filename, const int mmap_flag)
+{
+	lammps_data->mapped = mmap_flag;
+	lammps_data->gzip_buffer = NULL;
+	lammps_data->trajectory_stream.clear();
+	
+	if (has_gzip_suffix(filename) == 1) {
+		lammps_data->mapped = 0;
+		lammps_data->read_lammps_frame_header = read_lammps_header;
+		lammps_data->read_lammps_body = read_dimension_lammps_body;
+		lammps_data->skip_lammps_body = skip_lammps_body;
+		open_compressed_lammps_trajectory(lammps_data, filename);
+	} else if (lammps_data->mapped == 1) {
+		lammps_data->read_lammps_frame_header = read_mapped_lammps_header;
+		lammps_data->read_lammps_body = read_mapped_lammps_body;
+		lammps_data->skip_lammps_body = skip_mapped_lammps_body;
+		open_mapped_lammps_trajectory(lammps_data, filename);
+	} else {
+		lammps_data->read_lammps_frame_header = read_lammps_header;
+		lammps_data->read_lammps_body = read_dimension_lammps_body;
+		lammps_data->skip_lammps_body = skip_lammps_body;
+		if (lammps_data->trajectory_file.open(filename, std::ios::in) == NULL) {
+			printf("Problem opening lammps trajcetory %s\n", filename);
+			exit(EXIT_FAILURE);
+		}
+		lammps_data->trajectory_stream.rdbuf(&lammps_data->trajectory_file);
 	}
 }
 
+void close_lammps_trajectory(LammpsData* const lammps_data)
+{
+	if (lammps_data->mapped == 1) close_mapped_lammps_trajectory(lammps_data);
+	else if (lammps_data->gzip_buffer != NULL) close_compressed_lammps_trajectory(lammps_data);
+	else lammps_data->trajectory_file.close();
+}
 
 //-------------------------------------------------------------
-// Whole-trajectory reading functions
+// Memory-mapped LAMMPS reading
 //-------------------------------------------------------------
 
-// Read information to reweight all frames from an auxiliary file 'frame_weights.in'.
+// The whole trajectory is mapped read-only and parsed in place, so no line
+// is copied or tokenized into strings. The byte offset of every frame read
+// is recorded and kept in a sidecar index next to the trajectory.
 
-void read_frame_weights(FrameSource* const frame_source, const int start_frame, const int n_frames, const std::string &extension)
+void open_mapped_lammps_trajectory(LammpsData* const lammps_data, const char* filename)
 {
-	std::string filename = "frame_weights." + extension;
-    read_frame_values(filename.c_str(), start_frame, n_frames, frame_source->frame_weights);
+	struct stat file_status;
+	lammps_data->file_descriptor = open(filename, O_RDONLY);
+	if ( (lammps_data->file_descriptor < 0) || (fstat(lammps_data->file_descriptor, &file_status) != 0) ) {
+		printf("Problem opening lammps trajcetory %s\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	lammps_data->map_size = (size_t)file_status.st_size;
+	lammps_data->modification_time = get_modification_stamp(file_status);
+	if (lammps_data->map_size == 0) {
+		printf("Lammps trajectory %s is empty.\n", filename);
+		exit(EXIT_FAILURE);
+	}
 	
-    double total = 0.0;
-    for (int i = 0; i < n_frames; i++) {
- 		total += frame_source->frame_weights[i];
- 	}
-    frame_source->total_frame_weights = 1.0 / total;
+	void* map = mmap(NULL, lammps_data->map_size, PROT_READ, MAP_PRIVATE, lammps_data->file_descriptor, 0);
+	if (map == MAP_FAILED) {
+		printf("Problem memory-mapping lammps trajectory %s; set lammps_mmap_flag to 0 to read it as a stream.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	#ifdef MADV_SEQUENTIAL
+	madvise(map, lammps_data->map_size, MADV_SEQUENTIAL);
+	#endif
+	lammps_data->map_begin = (const char*)map;
+	lammps_data->map_end = lammps_data->map_begin + lammps_data->map_size;
+	lammps_data->cursor = lammps_data->map_begin;
+	lammps_data->next_frame_index = 0;
+	
+	lammps_data->index_filename = std::string(filename) + ".idx";
+	lammps_data->n_loaded_offsets = load_frame_index(lammps_data->index_filename, lammps_data->map_size, lammps_data->modification_time, lammps_data->frame_offsets);
 }
 
-// Read framewise information from an auxiliary file.
-// Note: This supports:
-// 1) the virial constraint for all frames in file 'p_con.in'.
-// The pressure_constraint_rhs_vector is the RHS of eq. (12) in JCP,123,134105,2005
-// 2) the framewise relative entropy observable method in file 'observable.in'. 
-// 3) frame weights for statistical reweighting through 'frame_weights.in', 'frame_weights.ref', and 'frame_weights.cg'
-// 4) framewise observable values for newobs.x through 'observables.ref' and 'observables.cg'
+void close_mapped_lammps_trajectory(LammpsData* const lammps_data)
+{
+	if (lammps_data->frame_offsets.size() > lammps_data->n_loaded_offsets) save_frame_index(lammps_data->index_filename, lammps_data->map_size, lammps_data->modification_time, lammps_data->frame_offsets);
+	munmap((void*)lammps_data->map_begin, lammps_data->map_size);
+	close(lammps_data->file_descriptor);
+}
 
-void read_frame_values(const char* filename, const int start_frame, const int n_frames, double* &values)
+// A gzip-compressed trajectory is indexed by decompressed byte offsets, which
+// the decompression checkpoints make quick to seek to.
+
+void open_compressed_lammps_trajectory(LammpsData* const lammps_data, const char* filename)
 {
-    std::ifstream vals_in;
-    values = new double[n_frames];
-    check_and_open_in_stream(vals_in, filename);
-    read_stream_into_array(vals_in, start_frame, n_frames, values);
-    vals_in.close();
+	lammps_data->gzip_buffer = new GzipTrajectoryBuffer(filename);
+	lammps_data->trajectory_stream.rdbuf(lammps_data->gzip_buffer);
+	lammps_data->map_size = (size_t)lammps_data->gzip_buffer->get_compressed_size();
+	lammps_data->modification_time = lammps_data->gzip_buffer->get_modification_time();
+	lammps_data->next_frame_index = 0;
+	
+	lammps_data->index_filename = std::string(filename) + ".idx";
+	lammps_data->n_loaded_offsets = load_frame_index(lammps_data->index_filename, lammps_data->map_size, lammps_data->modification_time, lammps_data->frame_offsets);
 }
 
-inline void read_stream_into_array(std::ifstream &in_file, const int start_frame, const int n_frames, double* &values)
+void close_compressed_lammps_trajectory(LammpsData* const lammps_data)
 {
-	double junk;
-    for (int i = 0; i < start_frame - 1; i++) {
-        in_file >> junk;
-    }
-    for (int i = 0; i < n_frames; i++) {
+	if (lammps_data->frame_offsets.size() > lammps_data->n_loaded_offsets) save_frame_index(lammps_data->index_filename, lammps_data->map_size, lammps_data->modification_time, lammps_data->frame_offsets);
+	lammps_data->trajectory_stream.rdbuf(NULL);
+	delete lammps_data->gzip_buffer;
+	lammps_data->gzip_buffer = NULL;
+}
+
+// The sidecar index holds a tag, the trajectory size and modification time it
+// describes, the number of frames indexed, and then one byte offset per frame.
+// An index that does not match the trajectory is ignored and later overwritten.
+// Returns the number of offsets loaded.
+
+size_t load_frame_index(const std::string &index_filename, const uint64_t trajectory_size, const uint64_t modification_time, std::vector<uint64_t> &frame_offsets)
+{
+	char tag[8];
+	uint64_t description[3];
+	size_t n_loaded_offsets = 0;
+	frame_offsets.clear();
+	
+	FILE* index_file = fopen(index_filename.c_str(), "rb");
+	if (index_file == NULL) return 0;
+	if ( (fread(tag, sizeof(char), 8, index_file) == 8) && (memcmp(tag, "MSCGLIDX", 8) == 0) &&
+		 (fread(description, sizeof(uint64_t), 3, index_file) == 3) &&
+		 (description[0] == trajectory_size) && (description[1] == modification_time) ) {
+		frame_offsets.resize(description[2]);
+		if (fread(frame_offsets.data(), sizeof(uint64_t), description[2], index_file) == description[2]) {
+			n_loaded_offsets = description[2];
+			printf("Loaded offsets of %lu frames from %s.\n", (unsigned long)description[2], index_filename.c_str());
+		} else {
+			frame_offsets.clear();
+		}
+	}
+	fclose(index_file);
+	return n_loaded_offsets;
+}
+
+void save_frame_index(const std::string &index_filename, const uint64_t trajectory_size, const uint64_t modification_time, const std::vector<uint64_t> &frame_offsets)
+{
+	uint64_t description[3] = {trajectory_size, modification_time, (uint64_t)frame_offsets.size()};
+	
+	// Write to a temporary file first so that processes reading the same
+	// trajectory never see a partly written index. The index only saves
+	// time, so it is silently skipped when the directory cannot be written.
+	std::string temporary_filename = index_filename + "." + std::to_string((long)getpid());
+	FILE* index_file = fopen(temporary_filename.c_str(), "wb");
+	if (index_file == NULL) return;
+	fwrite("MSCGLIDX", sizeof(char), 8, index_file);
+	fwrite(description, sizeof(uint64_t), 3, index_file);
+	fwrite(frame_offsets.data(), sizeof(uint64_t), frame_offsets.size(), index_file);
+	if ( (fclose(index_file) != 0) || (rename(temporary_filename.c_str(), index_filename.c_str()) != 0) ) remove(temporary_filename.c_str());
+}
+
+// Drop an index found not to match its trajectory. Offsets are then only
+// recorded again if no frame has been read yet; otherwise the index is
+// rebuilt by the next run that reads the trajectory.
+
+void discard_frame_index(const std::string &index_filename, std::vector<uint64_t> &frame_offsets, size_t &n_loaded_offsets)
+{
+	remove(index_filename.c_str());
+	frame_offsets.clear();
+	n_loaded_offsets = 0;
+}
+
+// The index is keyed on the modification time in nanoseconds so that a
+// trajectory rewritten to the same size within one second is not matched.
+
+uint64_t get_modification_stamp(const struct stat &file_status)
+{
+	#ifdef __APPLE__
+	return (uint64_t)file_status.st_mtimespec.tv_sec * 1000000000 + (uint64_t)file_status.st_mtimespec.tv_nsec;
+	#else
+	return (uint64_t)file_status.st_mtim.tv_sec * 1000000000 + (uint64_t)file_status.st_mtim.tv_nsec;
+	#endif
+}
+
+// Check that a frame header starts at an indexed offset. A compressed
+// trajectory is left positioned at the offset if it does and where it was
+// if it does not.
+
+int check_lammps_frame_offset(LammpsData* const lammps_data, const uint64_t offset)
+{
+	const char kFrameTag[] = "ITEM: TIMESTEP";
+	const size_t tag_length = sizeof(kFrameTag) - 1;
+	if (lammps_data->mapped == 1) {
+		return ( (offset < lammps_data->map_size) && (lammps_data->map_size - offset >= tag_length) && (memcmp(lammps_data->map_begin + offset, kFrameTag, tag_length) == 0) ) ? 1 : 0;
+	}
+	
+	char tag[sizeof(kFrameTag) - 1];
+	std::streamoff position = lammps_data->trajectory_stream.tellg();
+	if ( lammps_data->trajectory_stream.seekg((std::streamoff)offset) && lammps_data->trajectory_stream.read(tag, tag_length) &&
+		 (memcmp(tag, kFrameTag, tag_length) == 0) && lammps_data->trajectory_stream.seekg((std::streamoff)offset) ) return 1;
+	lammps_data->trajectory_stream.clear();
+	if (!lammps_data->trajectory_stream.seekg(position)) {
+		printf("Cannot return to frame %d of the compressed trajectory.\n", (int)lammps_data->next_frame_index + 1);
+		exit(EXIT_FAILURE);
+	}
+	return 0;
+}
+
+inline void report_mapped_end_of_file(void)
+{
+	fprintf(stderr, "\nIt appears that the file is no longer open.\n");
+	fprintf(stderr, "Please check that you are not attempting to read past the end of the file and try again.\n");
+	fflush(stderr);
+	exit(EXIT_FAILURE);
+}
+
+// Find the next line of the mapped trajectory, without its line ending.
+// Returns 0 at the end of the file.
+
+inline int next_mapped_line(LammpsData* const lammps_data, const char* &line_begin, const char* &line_end)
+{
+	if (lammps_data->cursor >= lammps_data->map_end) return 0;
+	line_begin = lammps_data->cursor;
+	line_end = (const char*)memchr(line_begin, '\n', lammps_data->map_end - line_begin);
+	if (line_end == NULL) {
+		line_end = lammps_data->map_end;
+		lammps_data->cursor = lammps_data->map_end;
+	} else {
+		lammps_data->cursor = line_end + 1;
+	}
+	if ( (line_end > line_begin) && (*(line_end - 1) == '\r') ) line_end--;
+	return 1;
+}
+
+// Convert a token to a double with the same result as atof. Tokens with at most
+// 15 significant digits and a small decimal exponent are converted exactly by a
+// single multiplication or division of exactly representable values; all others
+// are passed to strtod.
+
+inline double scan_mapped_double(const char* const begin, const char* const end)
+{
+	static const double powers_of_ten[] = {1.0e0, 1.0e1, 1.0e2, 1.0e3, 1.0e4, 1.0e5, 1.0e6, 1.0e7, 1.0e8, 1.0e9, 1.0e10, 1.0e11,
+										   1.0e12, 1.0e13, 1.0e14, 1.0e15, 1.0e16, 1.0e17, 1.0e18, 1.0e19, 1.0e20, 1.0e21, 1.0e22};
+	const char* p = begin;
+	int negative = 0;
+	int fast = 1;
+	int n_digits = 0;
+	int n_significant_digits = 0;
+	int exponent = 0;
+	uint64_t mantissa = 0;
+	
+	if ( (p < end) && ((*p == '-') || (*p == '+')) ) {
+		negative = (*p == '-');
+		p++;
+	}
+	for (; (p < end) && (*p >= '0') && (*p <= '9'); p++) {
+		n_digits++;
+		if ( (mantissa == 0) && (*p == '0') ) continue;
+		if (++n_significant_digits > 15) fast = 0;
+		else mantissa = mantissa * 10 + (*p - '0');
+		if (fast == 0) exponent++;
+	}
+	if ( (p < end) && (*p == '.') ) {
+		for (p++; (p < end) && (*p >= '0') && (*p <= '9'); p++) {
+			n_digits++;
+			if ( (mantissa == 0) && (*p == '0') ) {
+				exponent--;
+				continue;
+			}
+			if (++n_significant_digits > 15) fast = 0;
+			else {
+				mantissa = mantissa * 10 + (*p - '0');
+				exponent--;
+			}
+		}
+	}
+	if ( (p < end) && ((*p == 'e') || (*p == 'E')) ) {
+		int exponent_sign = 1;
+		int explicit_exponent = 0;
+		int n_exponent_digits = 0;
+		p++;
+		if ( (p < end) && ((*p == '-') || (*p == '+')) ) {
+			if (*p == '-') exponent_sign = -1;
+			p++;
+		}
+		for (; (p < end) && (*p >= '0') && (*p <= '9'); p++) {
+			if (explicit_exponent < 100000) explicit_exponent = explicit_exponent * 10 + (*p - '0');
+			n_exponent_digits++;
+		}
+		if (n_exponent_digits == 0) fast = 0;
+		exponent += exponent_sign * explicit_exponent;
+	}
+	if ( (n_digits == 0) || (p != end) ) fast = 0;
+	
+	if ( (fast == 1) && (exponent >= -22) && (exponent <= 22) ) {
+		double value = (double)mantissa;
+		if (exponent < 0) value /= powers_of_ten[-exponent];
+		else value *= powers_of_ten[exponent];
+		return (negative == 1) ? -value : value;
+	}
+	
+	std::string token(begin, end);
+	return strtod(token.c_str(), NULL);
+}
+
+inline int scan_mapped_int(const char* begin, const char* const end)
+{
+	int negative = 0;
+	int value = 0;
+	if ( (begin < end) && ((*begin == '-') || (*begin == '+')) ) {
+		negative = (*begin == '-');
+		begin++;
+	}
+	for (; (begin < end) && (*begin >= '0') && (*begin <= '9'); begin++) value = value * 10 + (*begin - '0');
+	return (negative == 1) ? -value : value;
+}
+
+// Read a frame header from the mapped trajectory; see read_lammps_header.
+
+void read_mapped_lammps_header(LammpsData *const lammps_data, int* const current_n_sites, int *const timestep, real *const time, matrix box, const int dynamic_types, const int dynamic_state_sampling, const int no_forces)
+{
+	const char* line_begin;
+	const char* line_end;
+	const char* value_begin;
+	const char* value_end;
+	int flag = 1; 
+	
+	// Record where this frame starts if it has not been indexed yet.
+	if (lammps_data->next_frame_index == lammps_data->frame_offsets.size()) {
+		lammps_data->frame_offsets.push_back((uint64_t)(lammps_data->cursor - lammps_data->map_begin));
+	}
+	lammps_data->next_frame_index++;
+	
+	while(flag == 1) {
+		//read next line of header (and wrap-up if end-of-file)
+		if (next_mapped_line(lammps_data, line_begin, line_end) == 0) report_mapped_end_of_file();
+		
+		//test if it is a labeled line (all LAMMPS labels start with "ITEM:")
+		if ( ((line_end - line_begin) < 5) || (memcmp(line_begin, "ITEM:", 5) != 0) ) continue;
+		std::string line(line_begin, line_end);
+		
+		//find out which label matched (skip space after ITEM:)
+		if( line.compare(6, 15, "NUMBER OF ATOMS") == 0) {
+			if (next_mapped_line(lammps_data, value_begin, value_end) == 0) report_mapped_end_of_file();
+			*current_n_sites = (int)strtol(std::string(value_begin, value_end).c_str(), NULL, 10);
+			
+		} else if( line.compare(6, 10, "BOX BOUNDS") == 0) {
+			//read in bounds (low high) for each dimensions
+			for(int pos=0; pos <  DIMENSION; pos++) {
+				if (next_mapped_line(lammps_data, value_begin, value_end) == 0) report_mapped_end_of_file();
+				std::string bounds(value_begin, value_end);
+				char* high_begin;
+				double low = strtod(bounds.c_str(), &high_begin);
+				double high = strtod(high_begin, NULL);
+				box[pos][pos] = high - low;
+			}
+			
+		} else if( line.compare(6, 8, "TIMESTEP") == 0) {
+			if (next_mapped_line(lammps_data, value_begin, value_end) == 0) report_mapped_end_of_file();
+			*time = (real)strtod(std::string(value_begin, value_end).c_str(), NULL);
+			(*timestep)++;
+		
+		} else if( line.compare(6, 5, "ATOMS") == 0) {
+			//read labels for body of frame
+			flag = 0; 
+			parse_lammps_atoms_labels(lammps_data, line, dynamic_types, dynamic_state_sampling, no_forces);
+		} else {
+			printf("Unrecognized line in frame header: %s", line.c_str() );
+		}
+	}
+}
+
+// Read a frame body from the mapped trajectory, scanning each needed column
+// directly into the frame; see read_dimension_lammps_body.
+
+int read_mapped_lammps_body(LammpsData *const lammps_data, FrameConfig *const frame_config, const int dynamic_types, const int dynamic_state_sampling, const int no_forces)
+{
+	// Destination of each column: 0 to DIMENSION - 1 for positions, DIMENSION to 2 * DIMENSION - 1
+	// for forces, 2 * DIMENSION for the type, 2 * DIMENSION + 1 for the state probability, -1 to skip.
+	std::vector<int> column_destinations(lammps_data->header_size, -1);
+	for (int j = 0; j < DIMENSION; j++) {
+		if (j + lammps_data->x_pos < lammps_data->header_size) column_destinations[j + lammps_data->x_pos] = j;
+		if ( (no_forces == 0) && (j + lammps_data->f_pos < lammps_data->header_size) ) column_destinations[j + lammps_data->f_pos] = DIMENSION + j;
+	}
+	if (dynamic_types == 1) column_destinations[lammps_data->type_pos] = 2 * DIMENSION;
+	if (dynamic_state_sampling == 1) column_destinations[lammps_data->state_pos] = 2 * DIMENSION + 1;
+	
+	const char* line_begin;
+	const char* line_end;
+	for (int i = 0; i < frame_config->current_n_sites; i++) {
+		if (next_mapped_line(lammps_data, line_begin, line_end) == 0) report_mapped_end_of_file();
+		
+		int n_fields = 0;
+		const char* p = line_begin;
+		while (1) {
+			while ( (p < line_end) && ((*p == ' ') || (*p == '\t')) ) p++;
+			if (p >= line_end) break;
+			const char* token_end = p;
+			while ( (token_end < line_end) && (*token_end != ' ') && (*token_end != '\t') ) token_end++;
+			
+			int destination = (n_fields < lammps_data->header_size) ? column_destinations[n_fields] : -1;
+			if (destination >= 0) {
+				if (destination < DIMENSION) frame_config->x[i][destination] = scan_mapped_double(p, token_end);
+				else if (destination < 2 * DIMENSION) frame_config->f[i][destination - DIMENSION] = scan_mapped_double(p, token_end);
+				else if (destination == 2 * DIMENSION) frame_config->cg_site_types[i] = scan_mapped_int(p, token_end);
+				else frame_config->cg_site_state_probabilities[i] = scan_mapped_double(p, token_end);
+			}
+			n_fields++;
+			p = token_end;
+		}
+		
+		if (n_fields != lammps_data->header_size) {
+			printf("Warning: Number of fields detected in frame body");
+			printf(" (%d) does not agree with number expected from frame header (%d)!\n", n_fields, lammps_data->header_size);
+			return -1;
+		}
+	}
+	return 1;
+}
+
+int skip_mapped_lammps_body(LammpsData *const lammps_data, const int n_sites)
+{
+	const char* line_begin;
+	const char* line_end;
+	for (int i = 0; i < n_sites; i++) {
+		if (next_mapped_line(lammps_data, line_begin, line_end) == 0) report_mapped_end_of_file();
+	}
+	return 1;
+}
+
+//-------------------------------------------------------------
+// Gzip-compressed trajectory streaming
+//-------------------------------------------------------------
+
+// Check whether a file name ends in .gz.
+
+inline int has_gzip_suffix(const char* filename)
+{
+	size_t len = strlen(filename);
+	return ( (len > 3) && (strcmp(filename + len - 3, ".gz") == 0) ) ? 1 : 0;
+}
+
+GzipTrajectoryBuffer::GzipTrajectoryBuffer(const char* name) : filename(name), input(kGzipInputSize), chunks(kGzipChunkCount), chunk_lengths(kGzipChunkCount), chunk_offsets(kGzipChunkCount)
+{
+	struct stat file_status;
+	file = fopen(name, "rb");
+	if ( (file == NULL) || (fstat(fileno(file), &file_status) != 0) ) {
+		printf("Problem opening compressed trajectory %s\n", name);
+		exit(EXIT_FAILURE);
+	}
+	compressed_size = (uint64_t)file_status.st_size;
+	modification_time = get_modification_stamp(file_status);
+	for (int i = 0; i < kGzipChunkCount; i++) chunks[i].resize(kGzipChunkSize);
+	
+	memset(&stream, 0, sizeof(z_stream));
+	if (inflateInit2(&stream, 15 + 16) != Z_OK) {
+		printf("Problem starting decompression of %s\n", name);
+		exit(EXIT_FAILURE);
+	}
+	raw_deflate = 0;
+	member_started = 0;
+	trailer_bytes_to_skip = 0;
+	decompressed_offset = 0;
+	load_checkpoints();
+	
+	n_filled = 0;
+	producer_position = 0;
+	consumer_position = 0;
+	holding_chunk = 0;
+	next_read_offset = 0;
+	setg(NULL, NULL, NULL);
+	decompression_finished = 0;
+	decompression_failed = 0;
+	start_decompression();
+}
+
+GzipTrajectoryBuffer::~GzipTrajectoryBuffer()
+{
+	stop_decompression();
+	if (checkpoints.size() > n_loaded_checkpoints) save_checkpoints();
+	inflateEnd(&stream);
+	fclose(file);
+}
+
+void GzipTrajectoryBuffer::start_decompression()
+{
+	if (decompression_finished == 1) return;
+	stop_decompressing = 0;
+	decompression_thread = std::thread(&GzipTrajectoryBuffer::decompress_chunks, this);
+}
+
+void GzipTrajectoryBuffer::stop_decompression()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stop_decompressing = 1;
+	}
+	chunk_released.notify_all();
+	if (decompression_thread.joinable()) decompression_thread.join();
+}
+
+// Body of the decompression thread: fill free chunks of the ring in order
+// until the end of the data or until asked to stop. A chunk shorter than
+// kGzipChunkSize marks the end of the data.
+
+void GzipTrajectoryBuffer::decompress_chunks()
+{
+	while (true) {
+		int position;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			chunk_released.wait(guard, [this]{ return (stop_decompressing == 1) || (n_filled < kGzipChunkCount); });
+			if (stop_decompressing == 1) return;
+			position = producer_position;
+		}
+		
+		uint64_t chunk_offset = decompressed_offset;
+		size_t length = decompress_into(chunks[position].data(), kGzipChunkSize);
+		
+		std::lock_guard<std::mutex> guard(lock);
+		chunk_lengths[position] = length;
+		chunk_offsets[position] = chunk_offset;
+		producer_position = (producer_position + 1) % kGzipChunkCount;
+		n_filled++;
+		if (length < kGzipChunkSize) decompression_finished = 1;
+		chunk_filled.notify_all();
+		if (decompression_finished == 1) return;
+	}
+}
+
+// Decompress up to size bytes, returning fewer only at the end of the data.
+// Concatenated gzip members are decompressed as one stream, and anything
+// after the last complete member that is not gzip data is ignored.
+
+size_t GzipTrajectoryBuffer::decompress_into(char* const destination, const size_t size)
+{
+	stream.next_out = (Bytef*)destination;
+	stream.avail_out = (uInt)size;
+	while (stream.avail_out > 0) {
+		if (stream.avail_in == 0) {
+			size_t n_read = fread(input.data(), 1, input.size(), file);
+			if (n_read == 0) {
+				if ( (member_started == 1) || (trailer_bytes_to_skip > 0) ) {
+					printf("Compressed trajectory %s ends in the middle of its data.\n", filename.c_str());
+					decompression_failed = 1;
+				}
+				break;
+			}
+			stream.next_in = input.data();
+			stream.avail_in = (uInt)n_read;
+		}
+		if (trailer_bytes_to_skip > 0) {
+			uint64_t n_skipped = std::min((uint64_t)stream.avail_in, trailer_bytes_to_skip);
+			stream.next_in += n_skipped;
+			stream.avail_in -= n_skipped;
+			trailer_bytes_to_skip -= n_skipped;
+			continue;
+		}
+		
+		uInt previous_avail_out = stream.avail_out;
+		int status = inflate(&stream, Z_BLOCK);
+		decompressed_offset += previous_avail_out - stream.avail_out;
+		if (status == Z_STREAM_END) {
+			// Continue with the next gzip member, if any. Restarts from a
+			// checkpoint decompress raw deflate data, so the gzip trailer
+			// is passed over by hand and the next header parsed normally.
+			if (raw_deflate == 1) {
+				trailer_bytes_to_skip = 8;
+				raw_deflate = 0;
+				inflateReset2(&stream, 15 + 16);
+			} else {
+				inflateReset(&stream);
+			}
+			member_started = 0;
+			continue;
+		} else if ( (status == Z_DATA_ERROR) && (member_started == 0) && (decompressed_offset > 0) ) {
+			break;
+		} else if ( (status != Z_OK) && (status != Z_BUF_ERROR) ) {
+			printf("Problem decompressing trajectory %s: %s\n", filename.c_str(), (stream.msg != NULL) ? stream.msg : "unknown error");
+			decompression_failed = 1;
+			break;
+		}
+		member_started = 1;
+		
+		// Take a checkpoint at the end of a block that is not the last of its member.
+		if ( ((stream.data_type & 128) != 0) && ((stream.data_type & 64) == 0) &&
+			 (decompressed_offset >= (checkpoints.empty() ? kGzipCheckpointSpacing : checkpoints.back().uncompressed_offset + kGzipCheckpointSpacing)) ) {
+			record_checkpoint();
+		}
+	}
+	return size - stream.avail_out;
+}
+
+void GzipTrajectoryBuffer::record_checkpoint()
+{
+	GzipCheckpoint checkpoint;
+	checkpoint.uncompressed_offset = decompressed_offset;
+	checkpoint.compressed_offset = (uint64_t)ftello(file) - stream.avail_in;
+	checkpoint.bits = stream.data_type & 7;
+	checkpoint.window.resize(kGzipWindowSize);
+	uInt window_size = kGzipWindowSize;
+	if (inflateGetDictionary(&stream, checkpoint.window.data(), &window_size) != Z_OK) return;
+	checkpoint.window_size = window_size;
+	checkpoint.window.resize(window_size);
+	checkpoints.push_back(checkpoint);
+}
+
+// Throw away all decompressed data and restart decompression at a
+// checkpoint, or at the beginning of the file if checkpoint is NULL.
+
+void GzipTrajectoryBuffer::restart_decompression(const GzipCheckpoint* const checkpoint)
+{
+	stop_decompression();
+	n_filled = 0;
+	producer_position = 0;
+	consumer_position = 0;
+	holding_chunk = 0;
+	setg(NULL, NULL, NULL);
+	decompression_finished = 0;
+	decompression_failed = 0;
+	stream.avail_in = 0;
+	trailer_bytes_to_skip = 0;
+	
+	int status;
+	if (checkpoint == NULL) {
+		status = inflateReset2(&stream, 15 + 16);
+		if (fseeko(file, 0, SEEK_SET) != 0) status = Z_ERRNO;
+		raw_deflate = 0;
+		member_started = 0;
+		decompressed_offset = 0;
+	} else {
+		status = inflateReset2(&stream, -15);
+		if (fseeko(file, (off_t)(checkpoint->compressed_offset - ((checkpoint->bits > 0) ? 1 : 0)), SEEK_SET) != 0) status = Z_ERRNO;
+		if ( (status == Z_OK) && (checkpoint->bits > 0) ) {
+			int partial_byte = getc(file);
+			if (partial_byte == EOF) status = Z_ERRNO;
+			else status = inflatePrime(&stream, checkpoint->bits, partial_byte >> (8 - checkpoint->bits));
+		}
+		if (status == Z_OK) status = inflateSetDictionary(&stream, checkpoint->window.data(), checkpoint->window_size);
+		raw_deflate = 1;
+		member_started = 1;
+		decompressed_offset = checkpoint->uncompressed_offset;
+	}
+	if (status != Z_OK) {
+		printf("Problem restarting decompression of %s.\n", filename.c_str());
+		exit(EXIT_FAILURE);
+	}
+	next_read_offset = decompressed_offset;
+	start_decompression();
+}
+
+// Release the chunk being read and make the next one the get area.
+
+GzipTrajectoryBuffer::int_type GzipTrajectoryBuffer::underflow()
+{
+	if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+	std::unique_lock<std::mutex> guard(lock);
+	if (holding_chunk == 1) {
+		next_read_offset = chunk_offsets[consumer_position] + chunk_lengths[consumer_position];
+		consumer_position = (consumer_position + 1) % kGzipChunkCount;
+		n_filled--;
+		holding_chunk = 0;
+		setg(NULL, NULL, NULL);
+		chunk_released.notify_all();
+	}
+	chunk_filled.wait(guard, [this]{ return (n_filled > 0) || (decompression_finished == 1); });
+	if (n_filled == 0) {
+		if (decompression_failed == 1) exit(EXIT_FAILURE);
+		return traits_type::eof();
+	}
+	holding_chunk = 1;
+	char* chunk = chunks[consumer_position].data();
+	setg(chunk, chunk, chunk + chunk_lengths[consumer_position]);
+	if (chunk_lengths[consumer_position] == 0) return traits_type::eof();
+	return traits_type::to_int_type(*gptr());
+}
+
+// Copy whole runs of the current chunk at a time.
+
+std::streamsize GzipTrajectoryBuffer::xsgetn(char* destination, std::streamsize n)
+{
+	std::streamsize n_copied = 0;
+	while (n_copied < n) {
+		if ( (gptr() == egptr()) && (traits_type::eq_int_type(underflow(), traits_type::eof())) ) break;
+		std::streamsize n_available = std::min((std::streamsize)(egptr() - gptr()), n - n_copied);
+		memcpy(destination + n_copied, gptr(), n_available);
+		gbump((int)n_available);
+		n_copied += n_available;
+	}
+	return n_copied;
+}
+
+uint64_t GzipTrajectoryBuffer::get_position() const
+{
+	if (holding_chunk == 0) return next_read_offset;
+	return chunk_offsets[consumer_position] + (uint64_t)(gptr() - eback());
+}
+
+GzipTrajectoryBuffer::pos_type GzipTrajectoryBuffer::seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode)
+{
+	if ( (mode & std::ios_base::in) == 0 ) return pos_type(off_type(-1));
+	if (direction == std::ios_base::cur) {
+		if (offset == 0) return pos_type((off_type)get_position());
+		return seekpos(pos_type((off_type)get_position() + offset), mode);
+	} else if (direction == std::ios_base::beg) {
+		return seekpos(pos_type(offset), mode);
+	}
+	return pos_type(off_type(-1));
+}
+
+GzipTrajectoryBuffer::pos_type GzipTrajectoryBuffer::seekpos(pos_type position, std::ios_base::openmode mode)
+{
+	if ( ((mode & std::ios_base::in) == 0) || ((off_type)position < 0) ) return pos_type(off_type(-1));
+	if (seek_to((uint64_t)(off_type)position) == 0) return pos_type(off_type(-1));
+	return position;
+}
+
+// Move to a decompressed position. Targets in the chunk being read are
+// reached at once and targets a short way ahead by decompressing forward;
+// anything else restarts from the best checkpoint.
+
+int GzipTrajectoryBuffer::seek_to(const uint64_t target)
+{
+	uint64_t position = get_position();
+	if ( (holding_chunk == 1) && (target < position) && (position - target <= (uint64_t)(gptr() - eback())) ) {
+		gbump(-(int)(position - target));
+		return 1;
+	}
+	if ( (target >= position) && (target - position < kGzipCheckpointSpacing) ) return discard(target - position);
+	
+	// The checkpoints may only be read once the thread that adds them has stopped.
+	stop_decompression();
+	const GzipCheckpoint* best_checkpoint = NULL;
+	for (size_t i = 0; (i < checkpoints.size()) && (checkpoints[i].uncompressed_offset <= target); i++) best_checkpoint = &checkpoints[i];
+	if ( (target >= position) && ((best_checkpoint == NULL) || (best_checkpoint->uncompressed_offset <= position)) ) {
+		start_decompression();
+		return discard(target - position);
+	}
+	restart_decompression(best_checkpoint);
+	return discard(target - get_position());
+}
+
+int GzipTrajectoryBuffer::discard(uint64_t n_bytes)
+{
+	while (n_bytes > 0) {
+		if ( (gptr() == egptr()) && (traits_type::eq_int_type(underflow(), traits_type::eof())) ) return 0;
+		uint64_t n_available = std::min((uint64_t)(egptr() - gptr()), n_bytes);
+		gbump((int)n_available);
+		n_bytes -= n_available;
+	}
+	return 1;
+}
+
+// The checkpoint sidecar holds a tag, the compressed size and modification
+// time it describes, the checkpoint spacing and count, and then each
+// checkpoint with its window. A sidecar that does not match is ignored.
+
+void GzipTrajectoryBuffer::load_checkpoints()
+{
+	char tag[8];
+	uint64_t description[4];
+	n_loaded_checkpoints = 0;
+	std::string checkpoint_filename = filename + ".zidx";
+	FILE* checkpoint_file = fopen(checkpoint_filename.c_str(), "rb");
+	if (checkpoint_file == NULL) return;
+	if ( (fread(tag, sizeof(char), 8, checkpoint_file) == 8) && (memcmp(tag, "MSCGZIDX", 8) == 0) &&
+		 (fread(description, sizeof(uint64_t), 4, checkpoint_file) == 4) &&
+		 (description[0] == compressed_size) && (description[1] == modification_time) && (description[2] == kGzipCheckpointSpacing) ) {
+		checkpoints.resize(description[3]);
+		for (size_t i = 0; i < checkpoints.size(); i++) {
+			GzipCheckpoint &checkpoint = checkpoints[i];
+			if ( (fread(&checkpoint.uncompressed_offset, sizeof(uint64_t), 1, checkpoint_file) != 1) ||
+				 (fread(&checkpoint.compressed_offset, sizeof(uint64_t), 1, checkpoint_file) != 1) ||
+				 (fread(&checkpoint.bits, sizeof(int32_t), 1, checkpoint_file) != 1) ||
+				 (fread(&checkpoint.window_size, sizeof(uint32_t), 1, checkpoint_file) != 1) ||
+				 (checkpoint.window_size > kGzipWindowSize) ) {
+				checkpoints.clear();
+				break;
+			}
+			checkpoint.window.resize(checkpoint.window_size);
+			if (fread(checkpoint.window.data(), 1, checkpoint.window_size, checkpoint_file) != checkpoint.window_size) {
+				checkpoints.clear();
+				break;
+			}
+		}
+		n_loaded_checkpoints = checkpoints.size();
+		if (n_loaded_checkpoints > 0) printf("Loaded %lu decompression checkpoints from %s.\n", (unsigned long)n_loaded_checkpoints, checkpoint_filename.c_str());
+	}
+	fclose(checkpoint_file);
+}
+
+void GzipTrajectoryBuffer::save_checkpoints()
+{
+	uint64_t description[4] = {compressed_size, modification_time, kGzipCheckpointSpacing, (uint64_t)checkpoints.size()};
+	std::string checkpoint_filename = filename + ".zidx";
+	std::string temporary_filename = checkpoint_filename + "." + std::to_string((long)getpid());
+	FILE* checkpoint_file = fopen(temporary_filename.c_str(), "wb");
+	if (checkpoint_file == NULL) return;
+	fwrite("MSCGZIDX", sizeof(char), 8, checkpoint_file);
+	fwrite(description, sizeof(uint64_t), 4, checkpoint_file);
+	for (size_t i = 0; i < checkpoints.size(); i++) {
+		fwrite(&checkpoints[i].uncompressed_offset, sizeof(uint64_t), 1, checkpoint_file);
+		fwrite(&checkpoints[i].compressed_offset, sizeof(uint64_t), 1, checkpoint_file);
+		fwrite(&checkpoints[i].bits, sizeof(int32_t), 1, checkpoint_file);
+		fwrite(&checkpoints[i].window_size, sizeof(uint32_t), 1, checkpoint_file);
+		fwrite(checkpoints[i].window.data(), 1, checkpoints[i].window_size, checkpoint_file);
+	}
+	if ( (fclose(checkpoint_file) != 0) || (rename(temporary_filename.c_str(), checkpoint_filename.c_str()) != 0) ) remove(temporary_filename.c_str());
+}
+
+//-------------------------------------------------------------
+// GROMACS trajectory reading
+//-------------------------------------------------------------
+
+// .trr and .xtc trajectories are XDR files: every value is stored big-endian
+// in a multiple of four bytes. Each file is mapped read-only and every frame
+// is decoded straight into the double-precision frame data, so no values
+// pass through intermediate single-precision buffers.
+
+const int kTrrMagicNumber = 1993;
+const int kXtcMagicNumber = 1995;
+
+void open_xdr_trajectory(XdrTrajectory* const trajectory, const char* filename, const int indexed)
+{
+	struct stat file_status;
+	trajectory->file_descriptor = open(filename, O_RDONLY);
+	if ( (trajectory->file_descriptor < 0) || (fstat(trajectory->file_descriptor, &file_status) != 0) ) {
+		printf("Problem opening GROMACS trajectory %s\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	trajectory->map_size = (size_t)file_status.st_size;
+	trajectory->modification_time = get_modification_stamp(file_status);
+	if (trajectory->map_size == 0) {
+		printf("GROMACS trajectory %s is empty.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	
+	void* map = mmap(NULL, trajectory->map_size, PROT_READ, MAP_PRIVATE, trajectory->file_descriptor, 0);
+	if (map == MAP_FAILED) {
+		printf("Problem memory-mapping GROMACS trajectory %s\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	#ifdef MADV_SEQUENTIAL
+	madvise(map, trajectory->map_size, MADV_SEQUENTIAL);
+	#endif
+	trajectory->map_begin = (const char*)map;
+	trajectory->cursor = 0;
+	trajectory->next_frame_index = 0;
+	
+	// Compressed frames differ in size, so their offsets are indexed as for LAMMPS trajectories.
+	trajectory->frame_offsets.clear();
+	trajectory->n_loaded_offsets = 0;
+	trajectory->index_filename.clear();
+	if (indexed == 1) {
+		trajectory->index_filename = std::string(filename) + ".idx";
+		trajectory->n_loaded_offsets = load_frame_index(trajectory->index_filename, trajectory->map_size, trajectory->modification_time, trajectory->frame_offsets);
+	}
+}
+
+void close_xdr_trajectory(XdrTrajectory* const trajectory)
+{
+	if ( !trajectory->index_filename.empty() && (trajectory->frame_offsets.size() > trajectory->n_loaded_offsets) ) save_frame_index(trajectory->index_filename, trajectory->map_size, trajectory->modification_time, trajectory->frame_offsets);
+	munmap((void*)trajectory->map_begin, trajectory->map_size);
+	close(trajectory->file_descriptor);
+}
+
+// Move past the frame at the cursor, recording its offset if it has not been indexed yet.
+
+inline void advance_xdr_trajectory(XdrTrajectory* const trajectory, const size_t frame_size)
+{
+	if ( !trajectory->index_filename.empty() && (trajectory->next_frame_index == trajectory->frame_offsets.size()) ) trajectory->frame_offsets.push_back(trajectory->cursor);
+	trajectory->cursor += frame_size;
+	trajectory->next_frame_index++;
+}
+
+inline uint32_t read_xdr_word(const char* const data)
+{
+	const unsigned char* const bytes = (const unsigned char*)data;
+	return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
+}
+
+int check_xtc_frame_offset(const XdrTrajectory* const trajectory, const uint64_t offset)
+{
+	return ( (offset < trajectory->map_size) && (trajectory->map_size - offset >= 4) && (read_xdr_word(trajectory->map_begin + offset) == (uint32_t)kXtcMagicNumber) ) ? 1 : 0;
+}
+
+inline int read_xdr_int(const char* const data)
+{
+	return (int)(int32_t)read_xdr_word(data);
+}
+
+inline float read_xdr_float(const char* const data)
+{
+	uint32_t word = read_xdr_word(data);
+	float value;
+	memcpy(&value, &word, sizeof(float));
+	return value;
+}
+
+inline double read_xdr_double(const char* const data)
+{
+	uint64_t word = ((uint64_t)read_xdr_word(data) << 32) | (uint64_t)read_xdr_word(data + 4);
+	double value;
+	memcpy(&value, &word, sizeof(double));
+	return value;
+}
+
+inline double read_xdr_real(const char* const data, const int real_size)
+{
+	if (real_size == sizeof(float)) return read_xdr_float(data);
+	return read_xdr_double(data);
+}
+
+// Convert a block of XDR reals into frame values. Each value is swapped and
+// converted independently of the others, so the loops are vectorized.
+
+inline void decode_xdr_reals(const char* const data, const int n_values, const int real_size, frame_real* const values)
+{
+	if (real_size == sizeof(float)) {
+		#pragma omp simd
+		for (int i = 0; i < n_values; i++) values[i] = read_xdr_float(data + i * sizeof(float));
+	} else {
+		#pragma omp simd
+		for (int i = 0; i < n_values; i++) values[i] = read_xdr_double(data + i * sizeof(double));
+	}
+}
+
+// Read the header of the .trr frame starting at offset. Returns the size of
+// the whole frame, or 0 if no complete frame that can be read starts there.
+// The blocks of input records, energies, topologies and symmetries that
+// GROMACS has long since stopped writing are not supported.
+
+size_t parse_trr_header(const XdrTrajectory* const trajectory, const size_t offset, TrrFrameHeader* const header)
+{
+	int block_sizes[13];
+	if ( (offset >= trajectory->map_size) || (trajectory->map_size - offset < 12) ) return 0;
+	const char* const data = trajectory->map_begin + offset;
+	if (read_xdr_int(data) != kTrrMagicNumber) return 0;
+	
+	// The magic number is followed by the length of the version string, stored twice, and the string itself.
+	size_t position = 12 + (((size_t)read_xdr_word(data + 8) + 3) & ~(size_t)3);
+	if (trajectory->map_size - offset < position + 13 * 4) return 0;
+	for (int i = 0; i < 13; i++) {
+		block_sizes[i] = read_xdr_int(data + position + 4 * i);
+		if (block_sizes[i] < 0) return 0;
+	}
+	position += 13 * 4;
+	if ( (block_sizes[0] != 0) || (block_sizes[1] != 0) || (block_sizes[5] != 0) || (block_sizes[6] != 0) ) return 0;
+	header->box_size = block_sizes[2];
+	header->vir_size = block_sizes[3];
+	header->pres_size = block_sizes[4];
+	header->x_size = block_sizes[7];
+	header->v_size = block_sizes[8];
+	header->f_size = block_sizes[9];
+	header->n_atoms = block_sizes[10];
+	header->step = block_sizes[11];
+	
+	// The precision of the frame is only recorded through the sizes of its blocks.
+	header->real_size = 0;
+	if (header->box_size != 0) header->real_size = header->box_size / 9;
+	else if ( (header->n_atoms > 0) && (header->x_size != 0) ) header->real_size = header->x_size / (3 * header->n_atoms);
+	else if ( (header->n_atoms > 0) && (header->v_size != 0) ) header->real_size = header->v_size / (3 * header->n_atoms);
+	else if ( (header->n_atoms > 0) && (header->f_size != 0) ) header->real_size = header->f_size / (3 * header->n_atoms);
+	if ( (header->real_size != sizeof(float)) && (header->real_size != sizeof(double)) ) return 0;
+	
+	// The time and lambda values close the header.
+	if (trajectory->map_size - offset < position + 2 * header->real_size) return 0;
+	header->time = read_xdr_real(data + position, header->real_size);
+	position += 2 * header->real_size;
+	header->header_size = position;
+	
+	size_t frame_size = position + (size_t)header->box_size + (size_t)header->vir_size + (size_t)header->pres_size + (size_t)header->x_size + (size_t)header->v_size + (size_t)header->f_size;
+	if (trajectory->map_size - offset < frame_size) return 0;
+	return frame_size;
+}
+
+// Read the header of the .xtc frame starting at offset. Returns the size of
+// the whole frame, which the header gives without decompressing anything,
+// or 0 if no complete frame starts there.
+
+size_t parse_xtc_header(const XdrTrajectory* const trajectory, const size_t offset, XtcFrameHeader* const header)
+{
+	const size_t kHeaderSize = 14 * 4;
+	if ( (offset >= trajectory->map_size) || (trajectory->map_size - offset < kHeaderSize) ) return 0;
+	const char* const data = trajectory->map_begin + offset;
+	if (read_xdr_int(data) != kXtcMagicNumber) return 0;
+	header->n_atoms = read_xdr_int(data + 4);
+	header->step = read_xdr_int(data + 8);
+	header->time = read_xdr_float(data + 12);
+	for (int i = 0; i < 9; i++) header->box[i] = read_xdr_float(data + 16 + 4 * i);
+	if ( (header->n_atoms <= 0) || (read_xdr_int(data + 52) != header->n_atoms) ) return 0;
+	header->data_offset = offset + kHeaderSize;
+	
+	// Up to 9 atoms are stored uncompressed; otherwise the precision, the
+	// bounds and first run size of the integer coordinates, and the number
+	// of bytes of compressed data precede the data, padded to four bytes.
+	size_t frame_size = kHeaderSize;
+	if (header->n_atoms <= 9) {
+		frame_size += (size_t)header->n_atoms * 3 * sizeof(float);
+	} else {
+		if (trajectory->map_size - offset < kHeaderSize + 9 * 4) return 0;
+		frame_size += 9 * 4 + (((size_t)read_xdr_word(data + kHeaderSize + 8 * 4) + 3) & ~(size_t)3);
+	}
+	if (trajectory->map_size - offset < frame_size) return 0;
+	return frame_size;
+}
+
+// Decode the .trr frame at the cursor and move past it. Returns 0 if no
+// complete frame is left or the frame lacks positions or needed forces.
+
+int decode_trr_frame(FrameSource* const frame_source)
+{
+	XdrTrajectory* const trajectory = &frame_source->gromacs_data->trajectory;
+	FrameConfig* const frame_config = frame_source->frame_config;
+	TrrFrameHeader header;
+	size_t frame_size = parse_trr_header(trajectory, trajectory->cursor, &header);
+	if (frame_size == 0) return 0;
+	if (header.n_atoms != frame_config->current_n_sites) {
+		printf("Warning: Number of CG sites defined in top.in is not consistent with trajectory!\n");
+		return 0;
+	}
+	if ( (header.x_size == 0) || ((header.f_size == 0) && (frame_source->no_forces == 0)) ) {
+		printf("Frame at time %lf of %s lacks positions or forces!\n", header.time, frame_source->trajectory_filename);
+		return 0;
+	}
+	
+	const char* data = trajectory->map_begin + trajectory->cursor + header.header_size;
+	if (header.box_size != 0) {
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++) frame_source->simulation_box_limits[i][j] = read_xdr_real(data + (3 * i + j) * header.real_size, header.real_size);
+		}
+	}
+	data += header.box_size + header.vir_size + header.pres_size;
+	decode_xdr_reals(data, 3 * header.n_atoms, header.real_size, frame_config->x[0].data());
+	data += header.x_size + header.v_size;
+	if (header.f_size != 0) decode_xdr_reals(data, 3 * header.n_atoms, header.real_size, frame_config->f[0].data());
+	
+	frame_source->current_timestep = header.step;
+	frame_source->time = header.time;
+	for (int i = 0; i < DIMENSION; i++) frame_config->simulation_box_half_lengths[i] = frame_source->simulation_box_limits[i][i] * 0.5;
+	advance_xdr_trajectory(trajectory, frame_size);
+	return 1;
+}
+
+// Decode the frame at the cursor of both .xtc trajectories and move past it.
+// The forces are only decompressed if they are needed.
+
+int decode_xtc_frame(FrameSource* const frame_source)
+{
+	XRDData* const gromacs_data = frame_source->gromacs_data;
+	FrameConfig* const frame_config = frame_source->frame_config;
+	XtcFrameHeader position_header, force_header;
+	size_t position_frame_size = parse_xtc_header(&gromacs_data->trajectory, gromacs_data->trajectory.cursor, &position_header);
+	size_t force_frame_size = parse_xtc_header(&gromacs_data->extra_trajectory, gromacs_data->extra_trajectory.cursor, &force_header);
+	if ( (position_frame_size == 0) || (force_frame_size == 0) ) return 0;
+	if ( (position_header.n_atoms != frame_config->current_n_sites) || (force_header.n_atoms != frame_config->current_n_sites) ) {
+		printf("Warning: Number of CG sites defined in top.in is not consistent with trajectory!\n");
+		return 0;
+	}
+	
+	if (decompress_xtc_coordinates(&gromacs_data->trajectory, position_header, gromacs_data->xtc_coordinates, frame_config->x[0].data()) == 0) {
+		printf("Frame at time %lf of %s is corrupt!\n", position_header.time, frame_source->trajectory_filename);
+		return 0;
+	}
+	if ( (frame_source->no_forces == 0) && (decompress_xtc_coordinates(&gromacs_data->extra_trajectory, force_header, gromacs_data->xtc_coordinates, frame_config->f[0].data()) == 0) ) {
+		printf("Frame at time %lf of %s is corrupt!\n", force_header.time, gromacs_data->extra_trajectory_filename);
+		return 0;
+	}
+	
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++) frame_source->simulation_box_limits[i][j] = position_header.box[3 * i + j];
+	}
+	frame_source->current_timestep = position_header.step;
+	frame_source->time = position_header.time;
+	for (int i = 0; i < DIMENSION; i++) frame_config->simulation_box_half_lengths[i] = frame_source->simulation_box_limits[i][i] * 0.5;
+	advance_xdr_trajectory(&gromacs_data->trajectory, position_frame_size);
+	advance_xdr_trajectory(&gromacs_data->extra_trajectory, force_frame_size);
+	return 1;
+}
+
+//-------------------------------------------------------------
+// .xtc coordinate decompression
+//-------------------------------------------------------------
+
+// Coordinates are stored as integers, the values times the frame's precision,
+// packed into a bit stream. The first atom of each run is stored relative to
+// the minimum coordinates with a fixed number of bits, and the following
+// atoms of the run as small differences from the atom before them, with a
+// number of bits that adapts from run to run along kXtcMagicInts. The first
+// two atoms of a run are stored swapped, which packs water molecules better.
+
+const int kXtcMagicInts[] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 8, 10, 12, 16, 20, 25, 32, 40, 50, 64,
+	80, 101, 128, 161, 203, 256, 322, 406, 512, 645, 812, 1024, 1290,
+	1625, 2048, 2580, 3250, 4096, 5060, 6501, 8192, 10321, 13003,
+	16384, 20642, 26007, 32768, 41285, 52015, 65536, 82570, 104031,
+	131072, 165140, 208063, 262144, 330280, 416127, 524287, 660561,
+	832255, 1048576, 1321122, 1664510, 2097152, 2642245, 3329021,
+	4194304, 5284491, 6658042, 8388607, 10568983, 13316085, 16777216
+};
+const int kXtcFirstMagicInt = 9;
+const int kXtcMagicIntCount = sizeof(kXtcMagicInts) / sizeof(int);
+
+struct XtcBitReader {
+	const unsigned char* data;
+	size_t n_bytes;						// Number of bytes of compressed data
+	size_t position;					// Index of the next byte to read
+	unsigned int n_buffered_bits;		// Number of bits of last_bytes not yet read
+	unsigned int last_bytes;			// The bytes read most recently
+	int overrun;						// 1 once a read has passed the end of the data
+};
+
+inline unsigned int next_xtc_byte(XtcBitReader* const reader)
+{
+	if (reader->position >= reader->n_bytes) {
+		reader->overrun = 1;
+		return 0;
+	}
+	return reader->data[reader->position++];
+}
+
+// Read an unsigned integer of n_bits bits.
+
+inline unsigned int decode_xtc_bits(XtcBitReader* const reader, int n_bits)
+{
+	unsigned int mask = (n_bits < 32) ? ((1u << n_bits) - 1) : ~0u;
+	unsigned int value = 0;
+	while (n_bits >= 8) {
+		reader->last_bytes = (reader->last_bytes << 8) | next_xtc_byte(reader);
+		value |= (reader->last_bytes >> reader->n_buffered_bits) << (n_bits - 8);
+		n_bits -= 8;
+	}
+	if (n_bits > 0) {
+		if ((int)reader->n_buffered_bits < n_bits) {
+			reader->n_buffered_bits += 8;
+			reader->last_bytes = (reader->last_bytes << 8) | next_xtc_byte(reader);
+		}
+		reader->n_buffered_bits -= n_bits;
+		value |= (reader->last_bytes >> reader->n_buffered_bits) & ((1u << n_bits) - 1);
+	}
+	return value & mask;
+}
+
+// Read three integers in [0, sizes[i]) packed together as one n_bits-bit
+// number in mixed radix. Numbers of up to 64 bits, by far the most common,
+// are unpacked with two divisions instead of byte-by-byte long division.
+
+inline void decode_xtc_ints(XtcBitReader* const reader, const int n_bits, const unsigned int sizes[3], int numbers[3])
+{
+	unsigned int bytes[32];
+	int n_bytes = 0;
+	int n_remaining_bits = n_bits;
+	bytes[1] = bytes[2] = bytes[3] = 0;
+	while (n_remaining_bits > 8) {
+		bytes[n_bytes++] = decode_xtc_bits(reader, 8);
+		n_remaining_bits -= 8;
+	}
+	if (n_remaining_bits > 0) bytes[n_bytes++] = decode_xtc_bits(reader, n_remaining_bits);
+	
+	if (n_bytes <= 8) {
+		uint64_t packed_number = 0;
+		for (int j = n_bytes - 1; j >= 0; j--) packed_number = (packed_number << 8) | bytes[j];
+		numbers[2] = (int)(packed_number % sizes[2]);
+		packed_number /= sizes[2];
+		numbers[1] = (int)(packed_number % sizes[1]);
+		numbers[0] = (int)(packed_number / sizes[1]);
+		return;
+	}
+	for (int i = 2; i > 0; i--) {
+		uint64_t remainder = 0;
+		for (int j = n_bytes - 1; j >= 0; j--) {
+			remainder = (remainder << 8) | bytes[j];
+			bytes[j] = (unsigned int)(remainder / sizes[i]);
+			remainder -= bytes[j] * (uint64_t)sizes[i];
+		}
+		numbers[i] = (int)remainder;
+	}
+	numbers[0] = (int)(bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (bytes[3] << 24));
+}
+
+// Number of bits needed to hold integers in [0, size).
+
+inline int count_xtc_bits(const unsigned int size)
+{
+	uint64_t limit = 1;
+	int n_bits = 0;
+	while ( (size >= limit) && (n_bits < 32) ) {
+		n_bits++;
+		limit <<= 1;
+	}
+	return n_bits;
+}
+
+// Number of bits needed to pack three integers in [0, sizes[i]) together.
+
+inline int count_xtc_packed_bits(const unsigned int sizes[3])
+{
+	unsigned int bytes[32];
+	int n_bytes = 1;
+	int n_bits = 0;
+	bytes[0] = 1;
+	for (int i = 0; i < 3; i++) {
+		unsigned int carry = 0;
+		int j;
+		for (j = 0; j < n_bytes; j++) {
+			uint64_t product = (uint64_t)bytes[j] * sizes[i] + carry;
+			bytes[j] = (unsigned int)(product & 0xff);
+			carry = (unsigned int)(product >> 8);
+		}
+		while (carry != 0) {
+			bytes[j++] = carry & 0xff;
+			carry >>= 8;
+		}
+		n_bytes = j;
+	}
+	unsigned int top_byte = bytes[n_bytes - 1];
+	while (top_byte >= (1u << n_bits)) n_bits++;
+	return n_bits + (n_bytes - 1) * 8;
+}
+
+// Decompress the positions of the .xtc frame described by header into
+// values, scaled back from integers. Returns 0 if the data is corrupt.
+
+int decompress_xtc_coordinates(const XdrTrajectory* const trajectory, const XtcFrameHeader &header, std::vector<int> &integer_coordinates, frame_real* const values)
+{
+	const char* const data = trajectory->map_begin + header.data_offset;
+	const int n_atoms = header.n_atoms;
+	if (n_atoms <= 9) {
+		decode_xdr_reals(data, 3 * n_atoms, sizeof(float), values);
+		return 1;
+	}
+	
+	float precision = read_xdr_float(data);
+	int min_ints[3], max_ints[3];
+	unsigned int sizes[3];
+	int bit_sizes[3] = {0, 0, 0};
+	int packed_bit_size = 0;
+	for (int i = 0; i < 3; i++) {
+		min_ints[i] = read_xdr_int(data + 4 + 4 * i);
+		max_ints[i] = read_xdr_int(data + 16 + 4 * i);
+		sizes[i] = (unsigned int)max_ints[i] - (unsigned int)min_ints[i] + 1u;
+	}
+	if ( (sizes[0] | sizes[1] | sizes[2]) > 0xffffff ) {
+		for (int i = 0; i < 3; i++) bit_sizes[i] = count_xtc_bits(sizes[i]);
+	} else {
+		packed_bit_size = count_xtc_packed_bits(sizes);
+	}
+	
+	int small_index = read_xdr_int(data + 28);
+	if ( (small_index < kXtcFirstMagicInt) || (small_index >= kXtcMagicIntCount) ) return 0;
+	int smaller = kXtcMagicInts[std::max(kXtcFirstMagicInt, small_index - 1)] / 2;
+	int small_number = kXtcMagicInts[small_index] / 2;
+	unsigned int small_sizes[3];
+	small_sizes[0] = small_sizes[1] = small_sizes[2] = kXtcMagicInts[small_index];
+	
+	XtcBitReader reader;
+	reader.data = (const unsigned char*)(data + 36);
+	reader.n_bytes = read_xdr_word(data + 32);
+	reader.position = 0;
+	reader.n_buffered_bits = 0;
+	reader.last_bytes = 0;
+	reader.overrun = 0;
+	
+	integer_coordinates.resize(3 * n_atoms);
+	int* output = integer_coordinates.data();
+	int* const output_end = output + 3 * n_atoms;
+	int this_coordinate[3], previous_coordinate[3], small_coordinate[3];
+	int run = 0;
+	int i = 0;
+	while (i < n_atoms) {
+		if (packed_bit_size == 0) {
+			for (int k = 0; k < 3; k++) this_coordinate[k] = (int)decode_xtc_bits(&reader, bit_sizes[k]);
+		} else {
+			decode_xtc_ints(&reader, packed_bit_size, sizes, this_coordinate);
+		}
+		i++;
+		for (int k = 0; k < 3; k++) {
+			this_coordinate[k] += min_ints[k];
+			previous_coordinate[k] = this_coordinate[k];
+		}
+		
+		// A set flag introduces a new run length and a change in the bits per difference.
+		int is_smaller = 0;
+		if (decode_xtc_bits(&reader, 1) == 1) {
+			run = (int)decode_xtc_bits(&reader, 5);
+			is_smaller = run % 3;
+			run -= is_smaller;
+			is_smaller--;
+		}
+		if (run > 0) {
+			if (output + 3 + run > output_end) return 0;
+			for (int k = 0; k < run; k += 3) {
+				decode_xtc_ints(&reader, small_index, small_sizes, small_coordinate);
+				i++;
+				for (int m = 0; m < 3; m++) small_coordinate[m] += previous_coordinate[m] - small_number;
+				if (k == 0) {
+					// Undo the swap of the first two atoms.
+					for (int m = 0; m < 3; m++) std::swap(small_coordinate[m], previous_coordinate[m]);
+					for (int m = 0; m < 3; m++) *output++ = previous_coordinate[m];
+				} else {
+					for (int m = 0; m < 3; m++) previous_coordinate[m] = small_coordinate[m];
+				}
+				for (int m = 0; m < 3; m++) *output++ = small_coordinate[m];
+			}
+		} else {
+			if (output + 3 > output_end) return 0;
+			for (int m = 0; m < 3; m++) *output++ = this_coordinate[m];
+		}
+		
+		small_index += is_smaller;
+		if ( (small_index < kXtcFirstMagicInt) || (small_index >= kXtcMagicIntCount) ) return 0;
+		if (is_smaller < 0) {
+			small_number = smaller;
+			smaller = (small_index > kXtcFirstMagicInt) ? kXtcMagicInts[small_index - 1] / 2 : 0;
+		} else if (is_smaller > 0) {
+			smaller = small_number;
+			small_number = kXtcMagicInts[small_index] / 2;
+		}
+		small_sizes[0] = small_sizes[1] = small_sizes[2] = kXtcMagicInts[small_index];
+	}
+	if ( (reader.overrun == 1) || (output != output_end) ) return 0;
+	
+	// Scale in single precision, exactly as GROMACS does, and widen; this loop
+	// over all coordinates is independent from value to value and vectorized.
+	const float inverse_precision = 1.0 / precision;
+	const int* const coordinates = integer_coordinates.data();
+	#pragma omp simd
+	for (int k = 0; k < 3 * n_atoms; k++) values[k] = (float)coordinates[k] * inverse_precision;
+	return 1;
+}
+
+//-------------------------------------------------------------
+// Binary CG trajectory reading and writing
+//-------------------------------------------------------------
+
+inline uint64_t calculate_binary_frame_size(const uint32_t contents, const uint32_t n_sites, const uint32_t dimension)
+{
+	uint64_t value_size = ((contents & kBinaryDoublePrecision) != 0) ? sizeof(double) : sizeof(float);
+	uint64_t frame_size = sizeof(double) + sizeof(int64_t) + dimension * sizeof(double);
+	frame_size += value_size * n_sites * dimension;
+	if ((contents & kBinaryForces) != 0) frame_size += value_size * n_sites * dimension;
+	if ((contents & kBinaryTypes) != 0) frame_size += sizeof(int32_t) * n_sites;
+	if ((contents & kBinaryStateProbabilities) != 0) frame_size += value_size * n_sites;
+	return frame_size;
+}
+
+// Check the header of a binary CG trajectory.
+
+inline void check_binary_trajectory_header(const BinaryTrajectoryHeader &header, const char* filename)
+{
+	if ( (memcmp(header.tag, "MSCGCGTR", 8) != 0) || (header.version != 1) ) {
+		printf("File %s is not a binary CG trajectory of a supported version.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	if (header.byte_order_mark != 0x0102030405060708ULL) {
+		printf("Binary trajectory %s was written with a different byte order.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	if (header.dimension != DIMENSION) {
+		printf("Binary trajectory %s has %u dimensional positions, but the compiled dimension is %d!\n", filename, header.dimension, DIMENSION);
+		exit(EXIT_FAILURE);
+	}
+}
+
+// A gzip-compressed binary CG trajectory is read as a stream. Its frame
+// index is at the end of the data, so the records are instead located from
+// the header, which requires them to follow it without gaps, as written by
+// convert_trajectory.
+
+void open_compressed_binary_trajectory(BinaryTrajectoryData* const binary_data, const char* filename)
+{
+	binary_data->gzip_buffer = new GzipTrajectoryBuffer(filename);
+	binary_data->map_begin = NULL;
+	binary_data->map_size = 0;
+	BinaryTrajectoryHeader &header = binary_data->header;
+	if (binary_data->gzip_buffer->sgetn((char*)&header, sizeof(BinaryTrajectoryHeader)) != (std::streamsize)sizeof(BinaryTrajectoryHeader)) {
+		printf("Binary trajectory %s is too short to hold a header.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	check_binary_trajectory_header(header, filename);
+	if ( (header.index_offset != sizeof(BinaryTrajectoryHeader) + header.n_frames * header.frame_size) ||
+		 (header.frame_size != calculate_binary_frame_size(header.contents, header.n_sites, header.dimension)) ) {
+		printf("Compressed binary trajectory %s is incomplete, corrupt, or does not hold its frames contiguously.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	
+	binary_data->frame_offsets.resize(header.n_frames);
+	for (size_t i = 0; i < header.n_frames; i++) binary_data->frame_offsets[i] = sizeof(BinaryTrajectoryHeader) + i * header.frame_size;
+	binary_data->record.resize(header.frame_size);
+	binary_data->next_frame_index = 0;
+}
+
+// Find a frame record in the map, or read it from a compressed trajectory.
+
+inline const char* locate_binary_record(BinaryTrajectoryData* const binary_data, const size_t frame_index)
+{
+	if (binary_data->gzip_buffer == NULL) return binary_data->map_begin + binary_data->frame_offsets[frame_index];
+	
+	std::streamoff offset = (std::streamoff)binary_data->frame_offsets[frame_index];
+	std::streamsize frame_size = (std::streamsize)binary_data->header.frame_size;
+	if ( (binary_data->gzip_buffer->pubseekoff(0, std::ios_base::cur, std::ios_base::in) != offset) &&
+		 (binary_data->gzip_buffer->pubseekpos(offset, std::ios_base::in) != offset) ) {
+		printf("Cannot seek to frame record %lu of the compressed binary trajectory.\n", (unsigned long)frame_index);
+		exit(EXIT_FAILURE);
+	}
+	if (binary_data->gzip_buffer->sgetn(binary_data->record.data(), frame_size) != frame_size) {
+		printf("Cannot read frame record %lu of the compressed binary trajectory.\n", (unsigned long)frame_index);
+		exit(EXIT_FAILURE);
+	}
+	return binary_data->record.data();
+}
+
+// Map a binary CG trajectory and check its header and frame index.
+
+void open_binary_trajectory(BinaryTrajectoryData* const binary_data, const char* filename)
+{
+	if (has_gzip_suffix(filename) == 1) {
+		open_compressed_binary_trajectory(binary_data, filename);
+		return;
+	}
+	binary_data->gzip_buffer = NULL;
+	
+	struct stat file_status;
+	binary_data->file_descriptor = open(filename, O_RDONLY);
+	if ( (binary_data->file_descriptor < 0) || (fstat(binary_data->file_descriptor, &file_status) != 0) ) {
+		printf("Problem opening binary trajectory %s\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	binary_data->map_size = (size_t)file_status.st_size;
+	if (binary_data->map_size < sizeof(BinaryTrajectoryHeader)) {
+		printf("Binary trajectory %s is too short to hold a header.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	void* map = mmap(NULL, binary_data->map_size, PROT_READ, MAP_PRIVATE, binary_data->file_descriptor, 0);
+	if (map == MAP_FAILED) {
+		printf("Problem memory-mapping binary trajectory %s\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	binary_data->map_begin = (const char*)map;
+	
+	BinaryTrajectoryHeader &header = binary_data->header;
+	memcpy(&header, binary_data->map_begin, sizeof(BinaryTrajectoryHeader));
+	check_binary_trajectory_header(header, filename);
+	if ( (header.index_offset == 0) || (header.frame_size != calculate_binary_frame_size(header.contents, header.n_sites, header.dimension)) ||
+		 (header.index_offset + header.n_frames * sizeof(uint64_t) > binary_data->map_size) ) {
+		printf("Binary trajectory %s is incomplete or corrupt.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	
+	binary_data->frame_offsets.resize(header.n_frames);
+	memcpy(binary_data->frame_offsets.data(), binary_data->map_begin + header.index_offset, header.n_frames * sizeof(uint64_t));
+	for (size_t i = 0; i < header.n_frames; i++) {
+		if (binary_data->frame_offsets[i] + header.frame_size > header.index_offset) {
+			printf("Binary trajectory %s has an invalid frame index.\n", filename);
+			exit(EXIT_FAILURE);
+		}
+	}
+	binary_data->next_frame_index = 0;
+}
+
+void close_binary_trajectory(BinaryTrajectoryData* const binary_data)
+{
+	if (binary_data->gzip_buffer != NULL) {
+		delete binary_data->gzip_buffer;
+		binary_data->gzip_buffer = NULL;
+	} else {
+		munmap((void*)binary_data->map_begin, binary_data->map_size);
+		close(binary_data->file_descriptor);
+	}
+}
+
+// Copy one frame record straight from the map into the frame source.
+
+void copy_binary_frame(FrameSource* const frame_source, const size_t frame_index)
+{
+	const BinaryTrajectoryHeader &header = frame_source->binary_data->header;
+	FrameConfig* const frame_config = frame_source->frame_config;
+	const char* record = locate_binary_record(frame_source->binary_data, frame_index);
+	int n_values = header.n_sites * DIMENSION;
+	double time;
+	int64_t timestep;
+	double box_lengths[DIMENSION];
+	
+	memcpy(&time, record, sizeof(double));
+	record += sizeof(double);
+	memcpy(&timestep, record, sizeof(int64_t));
+	record += sizeof(int64_t);
+	memcpy(box_lengths, record, DIMENSION * sizeof(double));
+	record += DIMENSION * sizeof(double);
+	frame_source->time = (real)time;
+	frame_source->current_timestep = (int)timestep;
+	for (int i = 0; i < DIMENSION; i++) {
+		frame_source->simulation_box_limits[i][i] = box_lengths[i];
+		frame_config->simulation_box_half_lengths[i] = box_lengths[i] * 0.5;
+	}
+	frame_config->current_n_sites = header.n_sites;
+	
+	const int double_precision = ((header.contents & kBinaryDoublePrecision) != 0);
+	record = read_binary_vectors(record, header.n_sites, double_precision, frame_config->x);
+	if ((header.contents & kBinaryForces) != 0) {
+		if (frame_source->no_forces == 0) read_binary_vectors(record, header.n_sites, double_precision, frame_config->f);
+		record += n_values * (double_precision ? sizeof(double) : sizeof(float));
+	}
+	
+	if ((header.contents & kBinaryTypes) != 0) {
+		if (frame_source->dynamic_types == 1) {
+			int32_t type;
+			for (unsigned i = 0; i < header.n_sites; i++) {
+				memcpy(&type, record + i * sizeof(int32_t), sizeof(int32_t));
+				frame_config->cg_site_types[i] = type;
+			}
+		}
+		record += header.n_sites * sizeof(int32_t);
+	}
+	if ( ((header.contents & kBinaryStateProbabilities) != 0) && (frame_source->dynamic_state_sampling == 1) ) {
+		for (unsigned i = 0; i < header.n_sites; i++) {
+			if ((header.contents & kBinaryDoublePrecision) != 0) {
+				memcpy(&frame_config->cg_site_state_probabilities[i], record + i * sizeof(double), sizeof(double));
+			} else {
+				float probability;
+				memcpy(&probability, record + i * sizeof(float), sizeof(float));
+				frame_config->cg_site_state_probabilities[i] = probability;
+			}
+		}
+	}
+}
+
+// Copy the positions or forces of one record into a frame, returning the
+// end of the copied block. Records stored in the precision of the frame
+// are copied as a block; the others are converted value by value.
+
+inline const char* read_binary_vectors(const char* record, const int n_sites, const int double_precision, std::array<frame_real, DIMENSION>* const values)
+{
+	const int n_values = n_sites * DIMENSION;
+	if ( (double_precision == 1) == (sizeof(frame_real) == sizeof(double)) ) {
+		memcpy(values, record, n_values * sizeof(frame_real));
+		return record + n_values * sizeof(frame_real);
+	}
+	if (double_precision == 1) {
+		double value;
+		for (int i = 0; i < n_values; i++, record += sizeof(double)) {
+			memcpy(&value, record, sizeof(double));
+			values[i / DIMENSION][i % DIMENSION] = value;
+		}
+	} else {
+		float value;
+		for (int i = 0; i < n_values; i++, record += sizeof(float)) {
+			memcpy(&value, record, sizeof(float));
+			values[i / DIMENSION][i % DIMENSION] = value;
+		}
+	}
+	return record;
+}
+
+inline char* write_binary_vectors(char* record, const int n_sites, const int double_precision, const std::array<frame_real, DIMENSION>* const values)
+{
+	const int n_values = n_sites * DIMENSION;
+	if ( (double_precision == 1) == (sizeof(frame_real) == sizeof(double)) ) {
+		memcpy(record, values, n_values * sizeof(frame_real));
+		return record + n_values * sizeof(frame_real);
+	}
+	if (double_precision == 1) {
+		double value;
+		for (int i = 0; i < n_values; i++, record += sizeof(double)) {
+			value = values[i / DIMENSION][i % DIMENSION];
+			memcpy(record, &value, sizeof(double));
+		}
+	} else {
+		float value;
+		for (int i = 0; i < n_values; i++, record += sizeof(float)) {
+			value = (float)values[i / DIMENSION][i % DIMENSION];
+			memcpy(record, &value, sizeof(float));
+		}
+	}
+	return record;
+}
+
+BinaryTrajectoryWriter* open_binary_trajectory_writer(const char* filename, const FrameSource* const frame_source, const int double_precision)
+{
+	BinaryTrajectoryWriter* const writer = new BinaryTrajectoryWriter;
+	BinaryTrajectoryHeader &header = writer->header;
+	memset(&header, 0, sizeof(BinaryTrajectoryHeader));
+	memcpy(header.tag, "MSCGCGTR", 8);
+	header.version = 1;
+	header.contents = 0;
+	if (frame_source->no_forces == 0) header.contents += kBinaryForces;
+	if (frame_source->dynamic_types == 1) header.contents += kBinaryTypes;
+	if (frame_source->dynamic_state_sampling == 1) header.contents += kBinaryStateProbabilities;
+	if (double_precision == 1) header.contents += kBinaryDoublePrecision;
+	header.n_sites = frame_source->frame_config->current_n_sites;
+	header.dimension = DIMENSION;
+	header.frame_size = calculate_binary_frame_size(header.contents, header.n_sites, header.dimension);
+	header.byte_order_mark = 0x0102030405060708ULL;
+	writer->record.resize(header.frame_size);
+	
+	// The header is written again with the frame count and index offset when the writer is closed.
+	writer->filename = filename;
+	writer->file = fopen(filename, "wb");
+	if ( (writer->file == NULL) || (fwrite(&header, sizeof(BinaryTrajectoryHeader), 1, writer->file) != 1) ) {
+		printf("Problem opening binary trajectory %s for writing.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	return writer;
+}
+
+void write_binary_trajectory_frame(BinaryTrajectoryWriter* const writer, const FrameSource* const frame_source)
+{
+	const BinaryTrajectoryHeader &header = writer->header;
+	const FrameConfig* const frame_config = frame_source->frame_config;
+	char* record = writer->record.data();
+	double time = frame_source->time;
+	int64_t timestep = frame_source->current_timestep;
+	
+	if (frame_config->current_n_sites != (int)header.n_sites) {
+		printf("Cannot write a frame of %d sites to binary trajectory %s of %u sites.\n", frame_config->current_n_sites, writer->filename.c_str(), header.n_sites);
+		exit(EXIT_FAILURE);
+	}
+	memcpy(record, &time, sizeof(double));
+	record += sizeof(double);
+	memcpy(record, &timestep, sizeof(int64_t));
+	record += sizeof(int64_t);
+	for (int i = 0; i < DIMENSION; i++, record += sizeof(double)) {
+		double box_length = frame_source->simulation_box_limits[i][i];
+		memcpy(record, &box_length, sizeof(double));
+	}
+	
+	const int double_precision = ((header.contents & kBinaryDoublePrecision) != 0);
+	record = write_binary_vectors(record, header.n_sites, double_precision, frame_config->x);
+	if ((header.contents & kBinaryForces) != 0) record = write_binary_vectors(record, header.n_sites, double_precision, frame_config->f);
+	
+	if ((header.contents & kBinaryTypes) != 0) {
+		for (unsigned i = 0; i < header.n_sites; i++, record += sizeof(int32_t)) {
+			int32_t type = frame_config->cg_site_types[i];
+			memcpy(record, &type, sizeof(int32_t));
+		}
+	}
+	if ((header.contents & kBinaryStateProbabilities) != 0) {
+		for (unsigned i = 0; i < header.n_sites; i++) {
+			if ((header.contents & kBinaryDoublePrecision) != 0) {
+				memcpy(record, &frame_config->cg_site_state_probabilities[i], sizeof(double));
+				record += sizeof(double);
+			} else {
+				float probability = (float)frame_config->cg_site_state_probabilities[i];
+				memcpy(record, &probability, sizeof(float));
+				record += sizeof(float);
+			}
+		}
+	}
+	
+	writer->frame_offsets.push_back(sizeof(BinaryTrajectoryHeader) + writer->frame_offsets.size() * header.frame_size);
+	if (fwrite(writer->record.data(), sizeof(char), header.frame_size, writer->file) != header.frame_size) {
+		printf("Problem writing frame %lu to binary trajectory %s.\n", (unsigned long)writer->frame_offsets.size(), writer->filename.c_str());
+		exit(EXIT_FAILURE);
+	}
+}
+
+void close_binary_trajectory_writer(BinaryTrajectoryWriter* const writer)
+{
+	writer->header.n_frames = writer->frame_offsets.size();
+	writer->header.index_offset = sizeof(BinaryTrajectoryHeader) + writer->header.n_frames * writer->header.frame_size;
+	if ( (fwrite(writer->frame_offsets.data(), sizeof(uint64_t), writer->frame_offsets.size(), writer->file) != writer->frame_offsets.size()) ||
+		 (fseek(writer->file, 0, SEEK_SET) != 0) ||
+		 (fwrite(&writer->header, sizeof(BinaryTrajectoryHeader), 1, writer->file) != 1) ) {
+		printf("Problem writing the frame index of binary trajectory %s.\n", writer->filename.c_str());
+		exit(EXIT_FAILURE);
+	}
+	fclose(writer->file);
+	printf("Wrote %lu frames to binary trajectory %s.\n", (unsigned long)writer->header.n_frames, writer->filename.c_str());
+	delete writer;
+}
+
+void FrameSource::sampleTypesFromProbs()
+{
+	double rand;
+        std::uniform_real_distribution<double> uniform_dist(0.0, 1.0);
+	// Determine each site's type/state by comparing the probability against a random number
+	for(int i = 0; i < frame_config->current_n_sites; i++) {
+		// Generate random number [0,1] using Mersenne Twister.
+		rand = uniform_dist(mt_rand_gen);
+		// Make state assignment based on comparison.
+		if (rand > frame_config->cg_site_state_probabilities[i]) frame_config->cg_site_types[i] = 2;
+		else frame_config->cg_site_types[i] = 1;
+	}
+}
+
+
+//-------------------------------------------------------------
+// Whole-trajectory reading functions
+//-------------------------------------------------------------
+
+// Read information to reweight all frames from an auxiliary file 'frame_weights.in'.
+
+void read_frame_weights(FrameSource* const frame_source, const int start_frame, const int n_frames, const int frame_stride, const std::string &extension)
+{
+	std::string filename = "frame_weights." + extension;
+    read_frame_values(filename.c_str(), start_frame, n_frames, frame_stride, frame_source->frame_weights);
+	
+    double total = 0.0;
+    for (int i = 0; i < n_frames; i++) {
+ 		total += frame_source->frame_weights[i];
+ 	}
+    frame_source->total_frame_weights = 1.0 / total;
+}
+
+// Read framewise information from an auxiliary file.
+// Note: This supports:
+// 1) the virial constraint for all frames in file 'p_con.in'.
+// The pressure_constraint_rhs_vector is the RHS of eq. (12) in JCP,123,134105,2005
+// 2) the framewise relative entropy observable method in file 'observable.in'. 
+// 3) frame weights for statistical reweighting through 'frame_weights.in', 'frame_weights.ref', and 'frame_weights.cg'
+// 4) framewise observable values for newobs.x through 'observables.ref' and 'observables.cg'
+// One value is kept every frame_stride frames, matching the frames read.
+
+void read_frame_values(const char* filename, const int start_frame, const int n_frames, const int frame_stride, double* &values)
+{
+    std::ifstream vals_in;
+    values = new double[n_frames];
+    check_and_open_in_stream(vals_in, filename);
+    read_stream_into_array(vals_in, start_frame, n_frames, frame_stride, values);
+    vals_in.close();
+}
+
+inline void read_stream_into_array(std::ifstream &in_file, const int start_frame, const int n_frames, const int frame_stride, double* &values)
+{
+	double junk;
+    for (int i = 0; i < start_frame - 1; i++) {
+        in_file >> junk;
+    }
+    for (int i = 0; i < n_frames; i++) {
+    	if (i > 0) {
+    		for (int j = 0; j < frame_stride - 1; j++) in_file >> junk;
+    	}
     	in_file >> values[i];
     }
 }
@@ -951,7 +3663,7 @@ void BaseCellList::setUpCellListCells(const double cutoff, const real*  simulati
 
 // Populate the cell lists.
 
-void BaseCellList::populateList(const int n_particles, std::array<double, DIMENSION>* const &particle_positions)
+void BaseCellList::populateList(const int n_particles, std::array<frame_real, DIMENSION>* const &particle_positions)
 {
     assert(n_particles > 0);
     int icell; // The index for the cell that a particle is in;
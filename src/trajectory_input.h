@@ -8,12 +8,6 @@
 #ifndef _trajectory_input_h
 #define _trajectory_input_h
 
-# if _exclude_gromacs == 1
-# else
-#  undef _exclude_gromacs
-#  define _exclude_gromacs 0
-# endif
-
 #ifndef DIMENSION
 #define DIMENSION 3
 #endif
@@ -30,10 +24,14 @@
 struct ControlInputs;
 struct LammpsData;
 struct XRDData;
+struct FramePrefetchData;
+struct TrajectorySegmentData;
+struct BinaryTrajectoryData;
+struct BinaryTrajectoryWriter;
 
 typedef real matrix[3][3];
 
-enum TrajectoryType {kGromacsTRR = 0, kGromacsXTC = 1, kLAMMPSDump = 2};
+enum TrajectoryType {kGromacsTRR = 0, kGromacsXTC = 1, kLAMMPSDump = 2, kMSCGBinary = 3};
 
 typedef void (*dimension_neighbor_action)(const std::vector<int> &cell_number, std::vector<int> &indices, std::vector<int> &stencil, const std::vector<int> &hash_offset);
 typedef int (*add_stencil_element)(const std::vector<int> &cell_number, const std::vector<int> &cell_indices, std::vector<int> &shift_indices, std::vector<int> &stencil, const std::vector<int> &hash_offset, int stencil_counter);
@@ -45,29 +43,33 @@ typedef int (*add_stencil_element)(const std::vector<int> &cell_number, const st
 struct FrameConfig {
     int current_n_sites;                 // Total number of sites in this frame
     real* simulation_box_half_lengths;   // A list of half the box length in each dimension
-    std::array<double, DIMENSION>* x;    // A list of all CG particle positions for a single frame stored in a flat array, x,y,z components contiguous 
-    std::array<double, DIMENSION>* f;    // A list of all CG particle positions for a single frame stored in a flat array, x,y,z components contiguous    
+    std::array<frame_real, DIMENSION>* x;    // A list of all CG particle positions for a single frame stored in a flat array, x,y,z components contiguous 
+    std::array<frame_real, DIMENSION>* f;    // A list of all CG particle positions for a single frame stored in a flat array, x,y,z components contiguous    
 	int* cg_site_types;				   	 // A list of all CG particle types (used if dynamic_types = 1)
+	double* cg_site_state_probabilities; // A list of the probabilities for all states of all CG particles (used if dynamic_state_sampling = 1) (currently only for 2 states)
 	
 	inline FrameConfig(const int n_sites) {
 		current_n_sites = n_sites;
-		x = new std::array<double, DIMENSION>[current_n_sites + 1];
-		f = new std::array<double, DIMENSION>[current_n_sites + 1];
+		x = new std::array<frame_real, DIMENSION>[current_n_sites + 1];
+		f = new std::array<frame_real, DIMENSION>[current_n_sites + 1];
 		simulation_box_half_lengths = new real[DIMENSION];
+		cg_site_state_probabilities = NULL;
 	};
 	
 	inline FrameConfig(const int n_sites, int* site_types) {
 		current_n_sites = n_sites;
-		x = new std::array<double, DIMENSION>[current_n_sites + 1];
-		f = new std::array<double, DIMENSION>[current_n_sites + 1];
+		x = new std::array<frame_real, DIMENSION>[current_n_sites + 1];
+		f = new std::array<frame_real, DIMENSION>[current_n_sites + 1];
 		simulation_box_half_lengths = new real[DIMENSION];
 		cg_site_types = site_types;		
+		cg_site_state_probabilities = NULL;
 	};
 	
 	inline ~FrameConfig() {
 		delete [] x;
 		delete [] f;
 		delete [] simulation_box_half_lengths;
+		delete [] cg_site_state_probabilities;
 	};
 };
 
@@ -89,14 +91,21 @@ struct FrameSource {
 	uint_fast32_t random_num_seed;			// Random number seed only used if dynamic_state_sampling or bootstrapping_flag is 1
     int starting_frame;                     // Trajectory frame number to start from
     int n_frames;                           // Total number of frames to read for this force matching
-    char trajectory_filename[1000];         // Trajectory file name (positions for .xtc, forces and positions for .trr)
+    int frame_stride;                       // Number of trajectory frames to advance between frames that are read
+    int current_selected_frame;             // Index of the current frame among the n_frames frames to be read
+    char trajectory_filename[1000];         // Trajectory file name (positions for .xtc, forces and positions for .trr); the current file if several are read in turn
     std::mt19937 mt_rand_gen;    			// A Mersenne Twister random number generator for dynamic state sampling.
 	int position_dimension;					// The number of elements in each particle's position vector.
+	int lammps_mmap_flag;					// 1 to memory-map LAMMPS trajectories and index their frames; 0 to read them through a stream
+	int frame_prefetch_depth;				// Number of frames read ahead by a background thread; 0 to read frames when they are needed
 	
     // Type-dependent source data and functions
-    TrajectoryType trajectory_type;         // 0 to use .trr format trajectories; 1 to use .xtc format trajectories; 2 to use LAMMPS trajectories
+    TrajectoryType trajectory_type;         // 0 to use .trr format trajectories; 1 to use .xtc format trajectories; 2 to use LAMMPS trajectories; 3 to use binary CG trajectories
 	XRDData* gromacs_data;
 	LammpsData* lammps_data;
+	BinaryTrajectoryData* binary_data;
+	FramePrefetchData* prefetch_data;
+	TrajectorySegmentData* segment_data;	// Files read in turn as one trajectory; NULL for a single file
 
     // Type-dependent function to read the first frame of a given source
     // Performs initial sanity checks to make sure the frame is consistent 
@@ -106,7 +115,11 @@ struct FrameSource {
     void (*move_to_start_frame)(FrameSource * const frame_source);
     // Type-dependent function to read but not process the next frame of a given source
     int (*get_junk_frame)(FrameSource * const frame_source);
-    // Type-dependent function to provide the next frame of a given source
+    // An optionally type-dependent function to pass over a number of frames of a given source
+    int (*skip_frames)(FrameSource * const frame_source, const int n_skipped_frames);
+    // Type-dependent function to read the frame immediately after the current one
+    int (*get_adjacent_frame)(FrameSource * const frame_source);
+    // Function to provide the next frame to process; get_adjacent_frame unless frames are strided
     int (*get_next_frame)(FrameSource * const frame_source);
     // Type-dependent function to clean up after reading all desired frames
     void (*cleanup)(FrameSource * const frame_source);
@@ -137,16 +150,34 @@ struct FrameSource {
 void parse_command_line_arguments(const int num_arg, char** arg, FrameSource* const frame_source);
 // Copy trajectory-reading specifications from ControlInputs to FRAME_DATA.
 void copy_control_inputs_to_frd(struct ControlInputs* const control_input, FrameSource* const frame_source);
+// Restrict a frame source to one of n_shards contiguous ranges of its frames,
+// keeping per-frame weights and virial constraint values aligned with the range.
+void select_trajectory_shard(FrameSource* const frame_source, const int shard_index, const int n_shards, const int block_size);
+// Read the selected frames back from a binary CG trajectory holding just those
+// frames (a frame cache) instead of from the trajectory on the command line.
+void select_frame_cache(FrameSource* const frame_source, const char* filename);
+
+//-------------------------------------------------------------
+// Binary CG trajectory writing functions.
+//-------------------------------------------------------------
+
+// Open a binary CG trajectory for frames shaped like the current frame of a source.
+// Forces, types and state probabilities are stored if the source reads them.
+BinaryTrajectoryWriter* open_binary_trajectory_writer(const char* filename, const FrameSource* const frame_source, const int double_precision);
+// Append the current frame of a source.
+void write_binary_trajectory_frame(BinaryTrajectoryWriter* const writer, const FrameSource* const frame_source);
+// Write the frame index and close the file.
+void close_binary_trajectory_writer(BinaryTrajectoryWriter* const writer);
 
 //-------------------------------------------------------------
 // Auxiliary-trajectory reading functions.
 //-------------------------------------------------------------
 
 // Read statistical weights for all needed frames.
-void read_frame_weights(FrameSource* const frame_source, const int start_frame, const int n_frames, const std::string &extension);
+void read_frame_weights(FrameSource* const frame_source, const int start_frame, const int n_frames, const int frame_stride, const std::string &extension);
 
 // Read information relating to the virial constraint or frame-wise observable for all needed frames.
-void read_frame_values(const char* filename, const int start_frame, const int n_frames, double* &vals);
+void read_frame_values(const char* filename, const int start_frame, const int n_frames, const int frame_stride, double* &vals);
 
 //-------------------------------------------------------------
 // Auxiliary-trajectory generating functions.
@@ -177,7 +208,7 @@ class BaseCellList {
 
 public:
     void init(const double cutoff, const FrameSource* const fr);
-    void populateList(const int n_particles, std::array<double, DIMENSION>* const &particle_positions);
+    void populateList(const int n_particles, std::array<frame_real, DIMENSION>* const &particle_positions);
     inline int get_stencil_size() const { return stencil_size; };
     inline double get_cell_size(int i) const {return cell_size[i]; };
     int size;					// The total number of cells to cover the simulation box.